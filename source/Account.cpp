@@ -0,0 +1,36 @@
+/* Account.cpp - Miles Shamo
+ *
+ * Implementation of the per account state
+ * and the registry that shares it
+ *
+ */
+
+#include "Account.hpp"
+
+Twitch::Account::Account(const std::string &username, const RateLimits &limits)
+	:	Username(username),
+		Chat(limits)
+{
+}
+
+
+Twitch::AccountRegistry::AccountRegistry(const RateLimits &limits) : Limits(limits)
+{
+}
+
+
+// get
+//
+// Bots can be launched from the console or from a worker
+// thread (after a token renewal), so this is locked.
+std::shared_ptr<Twitch::Account> Twitch::AccountRegistry::get(const std::string &username)
+{
+	std::lock_guard<std::mutex> guard(Lock);
+
+	auto &account = Accounts[username];
+
+	if (!account)
+		account = std::make_shared<Account>(username, Limits);
+
+	return account;
+}
@@ -0,0 +1,56 @@
+/* Account.hpp - Miles Shamo
+ *
+ * State shared between every IRCBot logged in
+ * as the same Twitch account.
+ *
+ * Clients share tokens through hard links to the
+ * same token file, and Twitch applies its limits
+ * per account, so anything that has to respect
+ * those limits lives here rather than in a bot.
+ * Accounts are keyed by the username stored in
+ * the token, which is the same for every link.
+ *
+ * The Overseer owns the registry and hands it to
+ * each bot, which looks up its account once it
+ * has loaded its token.
+ */
+
+#ifndef TWITCH_ACCOUNT
+#define TWITCH_ACCOUNT
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "RateLimiter.hpp"
+
+namespace Twitch
+{
+	struct Account
+	{
+		const std::string Username;
+
+		// PRIVMSG limits
+		ChatLimiter Chat;
+
+		Account(const std::string &username, const RateLimits &limits);
+	};
+
+	class AccountRegistry
+	{
+		private:
+			std::mutex Lock;
+
+			std::map<std::string, std::shared_ptr<Account>> Accounts;
+
+			RateLimits Limits;
+
+		public:
+			explicit AccountRegistry(const RateLimits &limits = RateLimits());
+
+			// finds (or creates) the shared state for an account
+			std::shared_ptr<Account> get(const std::string &username);
+	};
+}
+#endif
@@ -0,0 +1,163 @@
+/* Admission.cpp - Miles Shamo
+ *
+ * Implementation of the login admission control
+ *
+ */
+
+#include "Admission.hpp"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+Twitch::Admission::Admission(asio::io_context &context, const AdmissionLimits &limits)
+	:	Limits(limits),
+		Global(limits.Attempts, limits.Period),
+		_Strand(asio::make_strand(context)),
+		Timer(_Strand)
+{
+}
+
+
+// request
+//
+// the request only joins the queue here; granting it (even
+// straight away) always happens on our strand
+std::uint64_t Twitch::Admission::request(const std::string &username, std::function<void()> granted)
+{
+	std::uint64_t ticket;
+
+	{
+		std::lock_guard<std::mutex> guard(Lock);
+
+		ticket = NextTicket++;
+
+		Waiting.push_back({ticket, username, Clock::now(), std::move(granted)});
+		Stats.Waiting = Waiting.size();
+	}
+
+	asio::post(_Strand, [this]()
+	{
+		_dispatch();
+	});
+
+	return ticket;
+}
+
+
+// cancel
+//
+// A request that has already been granted is gone from the queue,
+// so this does nothing for it (its callback may still be running)
+bool Twitch::Admission::cancel(std::uint64_t ticket)
+{
+	std::lock_guard<std::mutex> guard(Lock);
+
+	auto found = std::find_if(Waiting.begin(), Waiting.end(),
+			[ticket](const Request &request) { return request.Ticket == ticket; });
+
+	if (found == Waiting.end())
+		return false;
+
+	Waiting.erase(found);
+	Stats.Waiting = Waiting.size();
+
+	return true;
+}
+
+
+// _dispatch
+//
+// Walks the queue oldest first.  A request is granted if both the
+// global and its account's window have an attempt left; if only its
+// account is out, it's skipped (keeping its place) so later accounts
+// can go.  Once the global window is full there's no point looking
+// further, so we sleep until its oldest attempt leaves it.
+//
+// The granted callbacks are run after the lock is released, as
+// they usually post into a bot's strand.
+void Twitch::Admission::_dispatch()
+{
+	std::vector<std::function<void()>> granted;
+	Clock::duration wait = Clock::duration::zero();
+
+	{
+		std::lock_guard<std::mutex> guard(Lock);
+
+		auto now = Clock::now();
+
+		for (auto iter = Waiting.begin(); iter != Waiting.end();)
+		{
+			Clock::duration globalWait = Global.waitTime(now);
+
+			if (globalWait > Clock::duration::zero())
+			{
+				wait = globalWait;
+				break;
+			}
+
+			auto account = Accounts.find(iter->Username);
+
+			if (account == Accounts.end())
+				account = Accounts.emplace(iter->Username, 
+						SendWindow(Limits.AccountAttempts, Limits.AccountPeriod)).first;
+
+			Clock::duration accountWait = account->second.waitTime(now);
+
+			if (accountWait > Clock::duration::zero())
+			{
+				if (wait == Clock::duration::zero() || accountWait < wait)
+					wait = accountWait;
+
+				++iter;
+				continue;
+			}
+
+			Global.take(now);
+			account->second.take(now);
+
+			Stats.Granted++;
+			Stats.MaxWait = std::max(Stats.MaxWait, now - iter->Queued);
+
+			granted.push_back(std::move(iter->Granted));
+			iter = Waiting.erase(iter);
+		}
+
+		Stats.Waiting = Waiting.size();
+	}
+
+	for (auto &callback : granted)
+		callback();
+
+	// something is still waiting, so come back when it might be allowed
+	if (wait > Clock::duration::zero() && !TimerArmed)
+	{
+		TimerArmed = true;
+
+		Timer.expires_after(wait);
+		Timer.async_wait(asio::bind_executor(_Strand,
+					[this](const asio::error_code &e)
+					{
+						TimerArmed = false;
+
+						if (!e)
+							_dispatch();
+					}));
+	}
+}
+
+
+// stats
+//
+// a snapshot of the backlog, for the console
+Twitch::AdmissionStats Twitch::Admission::stats()
+{
+	std::lock_guard<std::mutex> guard(Lock);
+
+	AdmissionStats current = Stats;
+
+	if (!Waiting.empty())
+		current.OldestWait = Clock::now() - Waiting.front().Queued;
+
+	return current;
+}
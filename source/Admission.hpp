@@ -0,0 +1,109 @@
+/* Admission.hpp - Miles Shamo
+ *
+ * Decides when each bot may try to connect and
+ * log in.
+ *
+ * Twitch only allows so many login attempts in
+ * a window, per account and from one address.  If
+ * the network drops, every bot the Overseer runs
+ * tries to reconnect at once and most of them get
+ * refused, which only makes them all wait longer.
+ *
+ * So instead of connecting straight away a bot
+ * asks here first.  Requests are granted in the
+ * order they came in, at the rate the limits allow.
+ * A request whose account has no attempts left
+ * waits without holding up other accounts behind
+ * it, so one busy account can't starve the rest.
+ *
+ * The Overseer owns the only one and hands it to
+ * every bot.  Requests can come from any strand,
+ * so the queue is locked.
+ */
+
+#ifndef TWITCH_ADMISSION
+#define TWITCH_ADMISSION
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include <asio.hpp>
+
+#include "RateLimiter.hpp"
+
+namespace Twitch
+{
+	// how fast login attempts are handed out
+	struct AdmissionLimits
+	{
+		// from this machine, over every account
+		std::size_t Attempts = 20;
+		Clock::duration Period = std::chrono::seconds(10);
+
+		// for any single account
+		std::size_t AccountAttempts = 5;
+		Clock::duration AccountPeriod = std::chrono::seconds(10);
+	};
+
+	// the current reconnect backlog
+	struct AdmissionStats
+	{
+		std::size_t Waiting = 0;	// requests not yet granted
+		std::size_t Granted = 0;	// requests granted since startup
+		Clock::duration OldestWait = Clock::duration::zero();
+		Clock::duration MaxWait = Clock::duration::zero();
+	};
+
+	class Admission
+	{
+		private:
+			struct Request
+			{
+				std::uint64_t Ticket;
+				std::string Username;
+				Clock::time_point Queued;
+				std::function<void()> Granted;
+			};
+
+			std::mutex Lock;
+
+			AdmissionLimits Limits;
+
+			SendWindow Global;
+			std::map<std::string, SendWindow> Accounts;
+
+			// oldest first
+			std::deque<Request> Waiting;
+			std::uint64_t NextTicket = 1;
+
+			AdmissionStats Stats;
+
+			// wakes us up when the next attempt can be handed out
+			asio::strand<asio::io_context::executor_type> _Strand;
+			asio::steady_timer Timer;
+			bool TimerArmed = false;
+
+			// grants what it can, then sleeps until it can grant more
+			void _dispatch();
+
+		public:
+			Admission(asio::io_context &context, const AdmissionLimits &limits = AdmissionLimits());
+
+			// Queues a login attempt for the account.  granted is called
+			// (from this class's strand) once the attempt may be made.
+			// Returns a ticket for cancelling it
+			std::uint64_t request(const std::string &username, std::function<void()> granted);
+
+			// Drops a request that hasn't been granted yet (a stopped bot's).
+			// False if it was already granted, so its callback will still run
+			bool cancel(std::uint64_t ticket);
+
+			AdmissionStats stats();
+	};
+}
+#endif
@@ -0,0 +1,41 @@
+/* Backoff.cpp - Miles Shamo
+ *
+ * Implementation of the reconnect backoff
+ *
+ */
+
+#include "Backoff.hpp"
+
+Twitch::Backoff::Backoff(std::chrono::milliseconds base, std::chrono::milliseconds cap)
+	:	Base(base), Cap(cap),
+		Random(std::random_device()())
+{
+}
+
+
+// window
+//
+// Base * 2^attempts, without overflowing, and never above the cap
+std::chrono::milliseconds Twitch::Backoff::window() const
+{
+	auto window = Base;
+
+	for (unsigned i = 0; i < Attempts && window < Cap; i++)
+		window *= 2;
+
+	return window < Cap ? window : Cap;
+}
+
+
+// next
+//
+// the delay is uniform over [0, window], so even the first
+// retry after a drop is spread out over Base
+std::chrono::milliseconds Twitch::Backoff::next()
+{
+	std::uniform_int_distribution<long long> pick(0, window().count());
+
+	Attempts++;
+
+	return std::chrono::milliseconds(pick(Random));
+}
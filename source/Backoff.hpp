@@ -0,0 +1,46 @@
+/* Backoff.hpp - Miles Shamo
+ *
+ * Exponential backoff with "full jitter" for
+ * reconnecting to Twitch.
+ *
+ * Each failed attempt doubles the window (up to a
+ * cap), and the actual delay is picked at random
+ * from anywhere in that window.  The randomness is
+ * what matters when a network blip drops hundreds
+ * of bots at once; without it they would all retry
+ * together, forever.
+ */
+
+#ifndef TWITCH_BACKOFF
+#define TWITCH_BACKOFF
+
+#include <chrono>
+#include <random>
+
+namespace Twitch
+{
+	class Backoff
+	{
+		private:
+			std::chrono::milliseconds Base, Cap;
+			unsigned Attempts = 0;
+
+			std::minstd_rand Random;
+
+		public:
+			Backoff(std::chrono::milliseconds base = std::chrono::seconds(1),
+					std::chrono::milliseconds cap = std::chrono::minutes(2));
+
+			// the delay before the next attempt (and counts the attempt)
+			std::chrono::milliseconds next();
+
+			// the window the next delay will be picked from
+			std::chrono::milliseconds window() const;
+
+			// called once we are properly connected again
+			void reset() { Attempts = 0; }
+
+			unsigned attempts() const { return Attempts; }
+	};
+}
+#endif
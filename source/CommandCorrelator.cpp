@@ -17,70 +17,66 @@ Twitch::CommandCorrelator::CommandCorrelator()
 {
 	// for reference in ALL commands:
 	//	
-	// The IRCsm capture groups are as follows
-	// [0] - Entire command (0-1)@TAGS (0-1):PREFIX COMMAND PARAMETERS :FINAL PARAMETER
-	// [1] - All tags supplied (if any)
-	// [2] - Prefix (if any)
-	// [3] - Command (all caps or number if correct form; this is more general)
-	// [4] - Parameters
-	// [5] - Optional final parameter
+	// The IRCMessage is the PRIVMSG that held the command
+	// (see IRCMessage.hpp), already split so that
+	// userCommand() - the command name (without the '!')
+	// userArgs()    - everything after the name
 	//
 	// Note that for PRIVMSG IRC Commands (currently all commands)
-	// the 4'th smatch group (parameters) is just the channel.  
+	// the parameters are just the channel.  
 	// Thus, we can use that to write to the channel that sent the
 	// message
 
 
-	SFM["test"] = [](const std::smatch &IRCsm, 
-					 const std::smatch &Commandsm, 
-					 Twitch::IRCBot *Caller) -> std::string 
+	SFM["test"] = [](const IRCMessage &Msg, 
+					 Twitch::IRCBot *Caller) -> const char * 
 	{
-		Caller->write("PRIVMSG " +  IRCsm[4].str() + " :This is a test");
+		Caller->write({"PRIVMSG ", Msg.channel(), " :This is a test"});
 
 		return R"(Command "test" fired)";
 	};
 
-	SFM["echo"] = [](const std::smatch &IRCsm, 
-					 const std::smatch &Commandsm, 
-					 Twitch::IRCBot *Caller) -> std::string 
+	SFM["echo"] = [](const IRCMessage &Msg, 
+					 Twitch::IRCBot *Caller) -> const char * 
 	{
-		Caller->write("PRIVMSG " +  IRCsm[4].str() + " :" + Commandsm[2].str());
+		Caller->write({"PRIVMSG ", Msg.channel(), " :", Msg.userArgs()});
 
-		return R"(Command "echo" fired, echoed: )" + Commandsm[2].str();
+		return R"(Command "echo" fired)";
 	};
 
-	SFM["endorse"] = [](const std::smatch &IRCsm, 
-						const std::smatch &Commandsm, 
-						Twitch::IRCBot *Caller) -> std::string 
+	SFM["endorse"] = [](const IRCMessage &Msg, 
+						Twitch::IRCBot *Caller) -> const char * 
 	{
-		Caller->write("PRIVMSG " +  IRCsm[4].str() + " :" + Commandsm[2].str() + " is pretty cool");
+		Caller->write({"PRIVMSG ", Msg.channel(), " :", Msg.userArgs(), " is pretty cool"});
 
-		return R"(Command "endorse" fired, endorsed: )" + Commandsm[2].str();
+		return R"(Command "endorse" fired)";
 	};
 
-	SFM["purge"] = [](const std::smatch &IRCsm,
-					  const std::smatch &Commandsm,
-					  Twitch::IRCBot *Caller) -> std::string
+	SFM["purge"] = [](const IRCMessage &Msg,
+					  Twitch::IRCBot *Caller) -> const char *
 	{
-		// grab the prefix to grab the username
-		auto prefix = IRCsm[2].str();
-
-		const static std::regex getUsername(R"((\w+)!\1@\1.tmi.twitch.tv)");
-
-		std::smatch prefixMatch;
-
-		// tests prefix to grab username
-		if (!std::regex_match(prefix, prefixMatch, getUsername))
+		// Twitch prefixes are "user!user@user.tmi.twitch.tv", so we
+		// grab the username and check the rest of the prefix matches it
+		auto user = Msg.nick();
+		auto prefix = Msg.prefix();
+
+		bool found = !user.empty() && 
+			prefix.size() == user.size() * 3 + 2 + std::string_view(".tmi.twitch.tv").size() &&
+			prefix.substr(user.size() + 1, user.size()) == user &&
+			prefix[user.size() * 2 + 1] == '@' &&
+			prefix.substr(user.size() * 2 + 2, user.size()) == user &&
+			prefix.substr(user.size() * 3 + 2) == ".tmi.twitch.tv";
+
+		if (!found)
 		{
-			Caller->write("PRIVMSG " + IRCsm[4].str() + " :" + "Cound not find user");
+			Caller->write({"PRIVMSG ", Msg.channel(), " :Cound not find user"});
 
 			return R"(Command "purge" could not find the user to purge)";
 		}
 		else
 		{
 			// timeout's user for one second
-			Caller->write("@ban-duration=1 :tmi.twitch.tv CLEARCHAT #baricus :"
-					+ prefixMatch[1].str());
+			Caller->write({"@ban-duration=1 :tmi.twitch.tv CLEARCHAT #baricus :", user}, Priority::Moderation);
 
 			return R"(Command "purge" succesfully purged a user from the chat)";
 		}
@@ -21,6 +21,11 @@
  *
  * however, until the above happens, I'm leaving
  * it public to save my head.
+ *
+ * Bots don't hold a copy of this any more.  The
+ * Overseer's one is the first version of the
+ * CommandRegistry's shared table, which every
+ * bot reads (see CommandTable.hpp).
  * 
  */
 
@@ -29,8 +34,10 @@
 
 #include <set>
 #include <map>
-#include <regex>
 #include <string>
+#include <functional>
+
+#include "IRCMessage.hpp"
 
 namespace Twitch
 {
@@ -40,7 +47,7 @@ namespace Twitch
 	{
 		public:
 			// should I use the same approach?	
-			std::map<std::string, std::string (*)(const std::smatch &, const std::smatch &, Twitch::IRCBot *Caller)> SFM;
+			std::map<std::string, const char *(*)(const IRCMessage &, Twitch::IRCBot *Caller), std::less<>> SFM;
 
 		public:
 			CommandCorrelator();
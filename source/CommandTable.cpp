@@ -0,0 +1,170 @@
+/* CommandTable.cpp - Miles Shamo
+ *
+ * Implementation of the shared command tables
+ * and the per bot layers over them
+ *
+ */
+
+#include "CommandTable.hpp"
+
+#include <fstream>
+#include <utility>
+
+#include "CommandCorrelator.hpp"
+#include "TIRCBot.hpp"
+
+
+//--------------------------------------------------------
+// CommandTable
+
+Twitch::CommandTable::CommandTable(CommandHandlers handlers, std::uint64_t version)
+	:	Handlers(std::move(handlers)),
+		Version(version)
+{
+}
+
+
+Twitch::CommandHandler Twitch::CommandTable::find(std::string_view name) const
+{
+	auto found = Handlers.find(name);
+
+	return found == Handlers.end() ? nullptr : found->second;
+}
+
+
+//--------------------------------------------------------
+// CommandRegistry
+
+Twitch::CommandRegistry::CommandRegistry(const CommandCorrelator &builtIns)
+	:	Current(std::make_shared<const CommandTable>(builtIns.SFM, 1)),
+		Version(1)
+{
+}
+
+
+// current
+//
+// Bots only come here when version() has changed, so the
+// lock is taken once per bot per update, not per message
+std::shared_ptr<const Twitch::CommandTable> Twitch::CommandRegistry::current() const
+{
+	std::lock_guard<std::mutex> guard(Lock);
+	return Current;
+}
+
+
+// update
+//
+// Copies the current table, edits the copy and swaps it in.
+// The version is only bumped once the new table is in place,
+// so a reader that sees the new version always finds it
+void Twitch::CommandRegistry::update(const std::function<void(CommandHandlers &)> &edit)
+{
+	std::lock_guard<std::mutex> guard(Lock);
+
+	CommandHandlers copy = Current->handlers();
+	edit(copy);
+
+	auto version = Current->version() + 1;
+
+	Current = std::make_shared<const CommandTable>(std::move(copy), version);
+	Version.store(version, std::memory_order_release);
+}
+
+
+//--------------------------------------------------------
+// CommandOverrides
+
+// load
+//
+// one disabled command per line, with or without its '!'.
+// See CustomCommands.hpp for customCommands.txt, and
+// Cooldowns.hpp for cooldowns.txt
+std::shared_ptr<const Twitch::CommandOverrides> Twitch::CommandOverrides::load(const std::string &disabledPath,
+		const std::string &customPath,
+		const std::string &cooldownsPath,
+		const CommandOverrides *previous)
+{
+	auto overrides = std::make_shared<CommandOverrides>();
+
+	std::ifstream in(disabledPath);
+
+	std::string name;
+	while (in >> name)
+	{
+		if (name.front() == '!')
+			name.erase(0, 1);
+
+		if (!name.empty())
+			overrides->Disabled.insert(name);
+	}
+
+	if (!customPath.empty())
+		overrides->Custom = CustomCommands::load(customPath, previous ? &previous->Custom : nullptr);
+
+	if (!cooldownsPath.empty())
+		overrides->Cooldown = CooldownRules::load(cooldownsPath);
+
+	return overrides;
+}
+
+
+//--------------------------------------------------------
+// CommandSet
+
+Twitch::CommandSet::CommandSet(std::shared_ptr<const CommandTable> shared, std::shared_ptr<const CommandOverrides> own,
+		Cooldowns *running)
+	:	Shared(std::move(shared)),
+		Own(std::move(own)),
+		Running(running)
+{
+}
+
+
+// find
+//
+// a bot's overrides win over the shared table.  Most bots
+// have none, so the common case is one empty check
+Twitch::CommandHandler Twitch::CommandSet::find(std::string_view name) const
+{
+	if (!Own->Disabled.empty() && Own->Disabled.find(name) != Own->Disabled.end())
+		return nullptr;
+
+	return Shared->find(name);
+}
+
+
+// run
+//
+// a custom command's compiled reply is handed to the bot to
+// write (along with what keeps the commands and the line alive);
+// a disabled name hides custom and shared alike.  Cooldowns are
+// only checked for commands that exist, so made up names never
+// take up room in the table
+const char *Twitch::CommandSet::run(const IRCMessage &message, Twitch::IRCBot *caller,
+		std::shared_ptr<const std::string> text) const
+{
+	auto name = message.userCommand();
+
+	if (!Own->Disabled.empty() && Own->Disabled.find(name) != Own->Disabled.end())
+		return R"(Command PRIVMSG recieved, no user command found)";
+
+	bool custom = !Own->Custom.empty() && Own->Custom.contains(name);
+
+	CommandHandler handler = custom ? nullptr : Shared->find(name);
+
+	if (!custom && !handler)
+		return R"(Command PRIVMSG recieved, no user command found)";
+
+	if (Running && !Running->tryUse(Own->Cooldown.find(name), Own->Cooldown.anyCommand(), name, message.channel(), message.nick()))
+		return R"(Command PRIVMSG recieved, command cooling down)";
+
+	if (custom)
+	{
+		caller->reply(std::shared_ptr<const CustomCommands>(Own, &Own->Custom), message, std::move(text));
+
+		return R"(Custom command fired)";
+	}
+
+	return handler(message, caller);
+}
@@ -0,0 +1,151 @@
+/* CommandTable.hpp - Miles Shamo
+ *
+ * The user commands ("!name args") every bot
+ * runs, shared rather than copied into each one.
+ *
+ * A CommandTable is one version of the commands,
+ * and is never changed once it is published.  The
+ * CommandRegistry (owned by the Overseer) holds the
+ * current table; to change the commands, a writer
+ * copies it, edits the copy and swaps it in whole
+ * (read-copy-update).  Anything still using the old
+ * table keeps it alive through its shared_ptr until
+ * it is done, and then it goes away by itself.
+ *
+ * Readers never lock.  A bot checks the registry's
+ * version (a single atomic load) as it hands each
+ * line of chat to its channel, and only goes for
+ * the new table when the version has moved on.  The
+ * snapshot it hands over with the line is what the
+ * handler looks the command up in, so a swap in the
+ * middle of a handler changes nothing under it.
+ *
+ * A bot's own changes (commands turned off in its
+ * disabledCommands.txt, its own text commands from
+ * customCommands.txt and the cooldowns in its
+ * cooldowns.txt) are a CommandOverrides, which is
+ * layered over the shared table in a small
+ * CommandSet rather than copied into it.  The
+ * cooldowns that are running belong to the bot
+ * (see Cooldowns.hpp), so they carry on across
+ * reloads.
+ */
+
+#ifndef TWITCH_COMMAND_TABLE
+#define TWITCH_COMMAND_TABLE
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+
+#include "IRCMessage.hpp"
+#include "CustomCommands.hpp"
+#include "Cooldowns.hpp"
+
+namespace Twitch
+{
+	class IRCBot;
+	class CommandCorrelator;
+
+	// a user command's handler, returning what it did
+	using CommandHandler = const char *(*)(const IRCMessage &, Twitch::IRCBot *Caller);
+
+	using CommandHandlers = std::map<std::string, CommandHandler, std::less<>>;
+
+	// one version of the shared commands (immutable)
+	class CommandTable
+	{
+		private:
+			const CommandHandlers Handlers;
+			const std::uint64_t Version;
+
+		public:
+			CommandTable(CommandHandlers handlers, std::uint64_t version);
+
+			// the handler for a command (nullptr if there isn't one)
+			CommandHandler find(std::string_view name) const;
+
+			const CommandHandlers &handlers() const { return Handlers; }
+			std::uint64_t version() const { return Version; }
+	};
+
+	// holds the current table, and swaps in new ones
+	class CommandRegistry
+	{
+		private:
+			// only writers (and readers fetching a new version) take this
+			mutable std::mutex Lock;
+			std::shared_ptr<const CommandTable> Current;
+
+			// Current's version, so readers can check for a new one without the lock
+			std::atomic<std::uint64_t> Version;
+
+		public:
+			// version 1 holds the built in commands
+			explicit CommandRegistry(const CommandCorrelator &builtIns);
+
+			// the current table
+			std::shared_ptr<const CommandTable> current() const;
+
+			// the current table's version (cheap enough to check on every message)
+			std::uint64_t version() const { return Version.load(std::memory_order_acquire); }
+
+			// publishes a copy of the current table with edit applied to it
+			void update(const std::function<void(CommandHandlers &)> &edit);
+	};
+
+	// a bot's own changes to the shared commands (immutable, like the table)
+	struct CommandOverrides
+	{
+		// commands turned off for this bot (without their '!')
+		std::set<std::string, std::less<>> Disabled;
+
+		// this bot's own text commands (these win over shared ones of the same name)
+		CustomCommands Custom;
+
+		// how often each command can be used
+		CooldownRules Cooldown;
+
+		// reads a client's disabledCommands.txt, customCommands.txt and cooldowns.txt
+		// (missing files are no overrides, and the default cooldowns).  Custom commands
+		// that were in previous keep their counts
+		static std::shared_ptr<const CommandOverrides> load(const std::string &disabledPath,
+				const std::string &customPath = std::string(),
+				const std::string &cooldownsPath = std::string(),
+				const CommandOverrides *previous = nullptr);
+	};
+
+	// what a bot actually runs: the shared table with its overrides on top
+	class CommandSet
+	{
+		private:
+			std::shared_ptr<const CommandTable> Shared;
+			std::shared_ptr<const CommandOverrides> Own;
+
+			// the bot's running cooldowns (none are checked without them)
+			Cooldowns *Running;
+
+		public:
+			CommandSet(std::shared_ptr<const CommandTable> shared, std::shared_ptr<const CommandOverrides> own,
+					Cooldowns *running = nullptr);
+
+			// the handler for a command (nullptr if there isn't one, or it's disabled)
+			CommandHandler find(std::string_view name) const;
+
+			// runs the user command in a message (having caller write a custom
+			// command's reply) if it isn't cooling down, returning what happened.
+			// text is what the message's views point into, if it's owned elsewhere
+			const char *run(const IRCMessage &message, Twitch::IRCBot *caller,
+					std::shared_ptr<const std::string> text = nullptr) const;
+
+			// the version of the shared table this was built on
+			std::uint64_t version() const { return Shared->version(); }
+	};
+}
+#endif
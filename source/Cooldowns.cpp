@@ -0,0 +1,452 @@
+/* Cooldowns.cpp - Miles Shamo
+ *
+ * Implementation of the command cooldowns
+ * and their timing wheel
+ *
+ */
+
+#include "Cooldowns.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+	// the command's own cooldowns are lower case, those covering
+	// every command upper case
+	enum class Scope : char
+	{
+		Global = 'g',
+		Channel = 'c',
+		User = 'u',
+		AnyChannel = 'C',
+		AnyUser = 'U'
+	};
+
+	// FNV-1a over each part, with a separator between them
+	std::uint64_t hashParts(std::initializer_list<std::string_view> parts)
+	{
+		std::uint64_t h = 14695981039346656037ull;
+
+		for (auto part : parts)
+		{
+			for (char c : part)
+			{
+				h ^= static_cast<unsigned char>(c);
+				h *= 1099511628211ull;
+			}
+
+			h ^= 0xff;
+			h *= 1099511628211ull;
+		}
+
+		h ^= h >> 32;
+
+		// 0 marks an empty slot
+		return h == 0 ? 1 : h;
+	}
+
+	std::uint64_t cooldownKey(Scope scope, std::string_view command, std::string_view channel, std::string_view user)
+	{
+		char tag = static_cast<char>(scope);
+		std::string_view scopeText(&tag, 1);
+
+		switch (scope)
+		{
+			case Scope::Global:
+				return hashParts({scopeText, command});
+			case Scope::Channel:
+				return hashParts({scopeText, command, channel});
+			case Scope::AnyChannel:
+				return hashParts({scopeText, channel});
+			case Scope::AnyUser:
+				return hashParts({scopeText, channel, user});
+			case Scope::User:
+				break;
+		}
+
+		return hashParts({scopeText, command, channel, user});
+	}
+
+	Twitch::Clock::duration seconds(double value)
+	{
+		return std::chrono::duration_cast<Twitch::Clock::duration>(std::chrono::duration<double>(std::max(value, 0.0)));
+	}
+}
+
+
+//--------------------------------------------------------
+// CooldownRule
+
+bool Twitch::CooldownRule::any() const
+{
+	return Global > Clock::duration::zero() || Channel > Clock::duration::zero() || User > Clock::duration::zero();
+}
+
+
+//--------------------------------------------------------
+// AnyCommandRule
+
+bool Twitch::AnyCommandRule::any() const
+{
+	return Channel > Clock::duration::zero() || User > Clock::duration::zero();
+}
+
+
+//--------------------------------------------------------
+// CooldownRules
+
+Twitch::CooldownRules::CooldownRules()
+{
+	Default.User = std::chrono::seconds(3);
+}
+
+
+const Twitch::CooldownRule &Twitch::CooldownRules::find(std::string_view command) const
+{
+	if (Commands.empty())
+		return Default;
+
+	auto found = Commands.find(hashParts({command}));
+
+	return found == Commands.end() ? Default : found->second;
+}
+
+
+void Twitch::CooldownRules::set(std::string_view command, const CooldownRule &rule)
+{
+	if (!command.empty() && command.front() == '!')
+		command.remove_prefix(1);
+
+	if (command == "*")
+		Default = rule;
+	else
+		Commands[hashParts({command})] = rule;
+}
+
+
+// load
+//
+// "name global channel user" per line, in seconds, or "@ channel
+// user" for every command.  Blank lines, '#' comments and lines
+// that don't parse are skipped
+Twitch::CooldownRules Twitch::CooldownRules::load(const std::string &path)
+{
+	CooldownRules rules;
+
+	std::ifstream in(path);
+
+	std::string line;
+	while (std::getline(in, line))
+	{
+		std::istringstream fields(line);
+
+		std::string name;
+		double global, channel, user;
+
+		if (!(fields >> name) || name.front() == '#')
+			continue;
+
+		if (name == "@")
+		{
+			if (!(fields >> channel >> user))
+				continue;
+
+			AnyCommandRule rule;
+			rule.Channel = seconds(channel);
+			rule.User = seconds(user);
+
+			rules.setAnyCommand(rule);
+			continue;
+		}
+
+		if (!(fields >> global >> channel >> user))
+			continue;
+
+		CooldownRule rule;
+		rule.Global = seconds(global);
+		rule.Channel = seconds(channel);
+		rule.User = seconds(user);
+
+		rules.set(name, rule);
+	}
+
+	return rules;
+}
+
+
+//--------------------------------------------------------
+// Cooldowns
+
+Twitch::Cooldowns::Cooldowns(Clock::time_point start)
+	:	Table(1024),
+		Start(start)
+{
+}
+
+
+std::uint64_t Twitch::Cooldowns::_tick(Clock::time_point time) const
+{
+	if (time <= Start)
+		return 0;
+
+	return static_cast<std::uint64_t>((time - Start) / Tick);
+}
+
+
+// _find
+//
+// linear probing; the table is never more than 3/4 full
+std::size_t Twitch::Cooldowns::_find(std::uint64_t key) const
+{
+	std::size_t mask = Table.size() - 1;
+	std::size_t slot = key & mask;
+
+	while (Table[slot].Key != 0 && Table[slot].Key != key)
+		slot = (slot + 1) & mask;
+
+	return slot;
+}
+
+
+void Twitch::Cooldowns::_grow()
+{
+	std::vector<Entry> old(Table.size() * 2);
+	old.swap(Table);
+
+	for (const auto &entry : old)
+	{
+		if (entry.Key != 0)
+			Table[_find(entry.Key)] = entry;
+	}
+}
+
+
+void Twitch::Cooldowns::_start(std::uint64_t key, std::uint64_t ends)
+{
+	if ((Count + 1) * 4 > Table.size() * 3)
+		_grow();
+
+	std::size_t slot = _find(key);
+
+	if (Table[slot].Key == 0)
+		Count++;
+
+	Table[slot] = Entry{key, ends};
+
+	_schedule(Table[slot]);
+}
+
+
+// _erase
+//
+// Removing from a linear probing table leaves a gap that could
+// hide entries further along.  Rather than leave a marker, later
+// entries that would have liked to be in the gap are moved back
+// into it (so lookups never have to step over dead slots)
+void Twitch::Cooldowns::_erase(std::size_t slot)
+{
+	std::size_t mask = Table.size() - 1;
+	std::size_t next = slot;
+
+	while (true)
+	{
+		next = (next + 1) & mask;
+
+		if (Table[next].Key == 0)
+			break;
+
+		std::size_t home = Table[next].Key & mask;
+
+		// whether home is cyclically outside (slot, next]
+		bool movable = (slot <= next) ? (home <= slot || home > next) : (home <= slot && home > next);
+
+		if (movable)
+		{
+			Table[slot] = Table[next];
+			slot = next;
+		}
+	}
+
+	Table[slot] = Entry();
+	Count--;
+}
+
+
+// _schedule
+//
+// puts an entry in the lowest level whose span reaches the tick it
+// ends on.  The slot is picked from the end tick itself, so it is
+// found again when the levels below it wrap around to it
+void Twitch::Cooldowns::_schedule(const Entry &entry)
+{
+	std::uint64_t delta = entry.Ends - Now;
+
+	unsigned level = 0;
+	while (level + 1 < Levels && delta >= (std::uint64_t(1) << (WheelBits * (level + 1))))
+		level++;
+
+	Wheel[level][(entry.Ends >> (WheelBits * level)) & (WheelSize - 1)].push_back(entry);
+	Scheduled[level]++;
+}
+
+
+// _cascade
+//
+// a higher level slot has come round: its entries all end within
+// the span of the level below, so they move down into it
+void Twitch::Cooldowns::_cascade(unsigned level, std::size_t slot)
+{
+	std::vector<Entry> entries;
+	entries.swap(Wheel[level][slot]);
+
+	Scheduled[level] -= entries.size();
+
+	for (const auto &entry : entries)
+	{
+		if (entry.Ends <= Now)
+			_expire(entry);
+		else
+			_schedule(entry);
+	}
+
+	// hand the storage back, so the slot doesn't allocate next time round
+	entries.clear();
+	if (Wheel[level][slot].empty())
+		Wheel[level][slot].swap(entries);
+}
+
+
+// _expire
+//
+// the cooldown has ended, unless it was started again since
+void Twitch::Cooldowns::_expire(const Entry &entry)
+{
+	std::size_t slot = _find(entry.Key);
+
+	if (Table[slot].Key == entry.Key && Table[slot].Ends == entry.Ends)
+		_erase(slot);
+}
+
+
+// _advance
+//
+// One tick at a time, cascading each level down as the ones
+// below it wrap.  Stretches where the lower levels are empty
+// are skipped up to the next slot of the lowest level in use,
+// and with nothing running at all it just jumps ahead (a bot
+// that was quiet for hours doesn't step through every tick)
+void Twitch::Cooldowns::_advance(std::uint64_t tick)
+{
+	while (Now < tick)
+	{
+		if (Count == 0)
+		{
+			Now = tick;
+			break;
+		}
+
+		unsigned lowest = 0;
+		while (lowest + 1 < Levels && Scheduled[lowest] == 0)
+			lowest++;
+
+		if (lowest > 0)
+		{
+			std::uint64_t boundary = ((Now >> (WheelBits * lowest)) + 1) << (WheelBits * lowest);
+			Now = std::min(tick, boundary) - 1;
+		}
+
+		Now++;
+
+		for (unsigned level = Levels - 1; level > 0; level--)
+		{
+			std::uint64_t span = std::uint64_t(1) << (WheelBits * level);
+
+			if ((Now & (span - 1)) == 0)
+				_cascade(level, (Now >> (WheelBits * level)) & (WheelSize - 1));
+		}
+
+		auto &due = Wheel[0][Now & (WheelSize - 1)];
+
+		for (std::size_t i = 0; i < due.size(); i++)
+			_expire(due[i]);
+
+		Scheduled[0] -= due.size();
+		due.clear();
+	}
+}
+
+
+bool Twitch::Cooldowns::tryUse(const CooldownRule &rule, std::string_view command, std::string_view channel,
+		std::string_view user, Clock::time_point now)
+{
+	return tryUse(rule, AnyCommandRule(), command, channel, user, now);
+}
+
+
+// tryUse
+//
+// Each cooldown ends at least a tick from now, and at most as far
+// as the wheel reaches (about 16 months)
+bool Twitch::Cooldowns::tryUse(const CooldownRule &rule, const AnyCommandRule &anyCommand, std::string_view command,
+		std::string_view channel, std::string_view user, Clock::time_point now)
+{
+	if (!rule.any() && !anyCommand.any())
+		return true;
+
+	struct Check
+	{
+		Scope Kind;
+		Clock::duration Length;
+	};
+
+	const Check checks[] =
+	{
+		{Scope::Global, rule.Global},
+		{Scope::Channel, rule.Channel},
+		{Scope::User, rule.User},
+		{Scope::AnyChannel, anyCommand.Channel},
+		{Scope::AnyUser, anyCommand.User}
+	};
+
+	constexpr int Scopes = sizeof(checks) / sizeof(checks[0]);
+
+	std::uint64_t keys[Scopes] = {};
+
+	std::lock_guard<std::mutex> guard(Lock);
+
+	_advance(_tick(now));
+
+	for (int i = 0; i < Scopes; i++)
+	{
+		if (checks[i].Length <= Clock::duration::zero())
+			continue;
+
+		keys[i] = cooldownKey(checks[i].Kind, command, channel, user);
+
+		if (Table[_find(keys[i])].Key == keys[i])
+			return false;
+	}
+
+	constexpr std::uint64_t MaxTicks = (std::uint64_t(1) << (WheelBits * Levels)) - 1;
+
+	for (int i = 0; i < Scopes; i++)
+	{
+		if (keys[i] == 0)
+			continue;
+
+		auto ticks = static_cast<std::uint64_t>((checks[i].Length + Tick - Clock::duration(1)) / Tick);
+
+		_start(keys[i], Now + std::clamp<std::uint64_t>(ticks, 1, MaxTicks));
+	}
+
+	return true;
+}
+
+
+std::size_t Twitch::Cooldowns::running() const
+{
+	std::lock_guard<std::mutex> guard(Lock);
+	return Count;
+}
@@ -0,0 +1,181 @@
+/* Cooldowns.hpp - Miles Shamo
+ *
+ * Cooldowns on user commands, so one viewer (or a
+ * whole channel) spamming a command doesn't make the
+ * bot spam its replies and spend the account's chat
+ * budget doing it.
+ *
+ * Each command has a rule (from the client's
+ * cooldowns.txt) with three cooldowns, any of which
+ * may be zero (off):
+ *
+ * 		Global   the command, anywhere the bot is
+ * 		Channel  the command, in one channel
+ * 		User     one user's use of the command in a channel
+ *
+ * On top of those are two that cover every command
+ * at once, so a user can't get around their cooldown
+ * by taking turns with different commands:
+ *
+ * 		Channel  any command, in one channel
+ * 		User     one user's use of any command in a channel
+ *
+ * A command only runs if none of its cooldowns are
+ * still going, and running it starts all of them.
+ *
+ * Every running cooldown is one 16 byte entry in an
+ * open addressing table: a 64 bit hash of what it
+ * covers and the tick it ends on.  Nothing else is
+ * kept (two keys sharing a hash would only share a
+ * cooldown).  Checking a command is at most five
+ * table lookups.
+ *
+ * Entries are removed as they end by a hierarchical
+ * timing wheel (four levels of 256 slots, 10ms per
+ * tick at the bottom), rather than a timer each.
+ * The wheel is moved on whenever a command is
+ * checked, so it costs nothing while the bot is
+ * quiet, and each entry is touched at most once per
+ * level on its way out.  The table only ever holds
+ * cooldowns that are running, so millions of users
+ * and commands that have cooled down take no space.
+ *
+ * Channels are handled in parallel, so the table
+ * is behind a lock (held for a few lookups).
+ */
+
+#ifndef TWITCH_COOLDOWNS
+#define TWITCH_COOLDOWNS
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "RateLimiter.hpp"
+
+namespace Twitch
+{
+	// the cooldowns of one command (zero is no cooldown)
+	struct CooldownRule
+	{
+		Clock::duration Global = Clock::duration::zero();
+		Clock::duration Channel = Clock::duration::zero();
+		Clock::duration User = Clock::duration::zero();
+
+		bool any() const;
+	};
+
+	// the cooldowns covering every command at once (zero is no cooldown)
+	struct AnyCommandRule
+	{
+		Clock::duration Channel = Clock::duration::zero();
+		Clock::duration User = Clock::duration::zero();
+
+		bool any() const;
+	};
+
+	// every command's rule, from a client's cooldowns.txt:
+	//
+	// 		!name global channel user    (in seconds)
+	// 		* global channel user        (every command without a line of its own)
+	// 		@ channel user               (any command at all, per channel and per user)
+	//
+	// Without a "*" line, each user can use each command once every 3 seconds.
+	// Without a "@" line, nothing covers every command
+	class CooldownRules
+	{
+		private:
+			CooldownRule Default;
+			AnyCommandRule AnyCommand;
+
+			// by the hash of the command's name
+			std::unordered_map<std::uint64_t, CooldownRule> Commands;
+
+		public:
+			CooldownRules();
+
+			// the rule for a command
+			const CooldownRule &find(std::string_view command) const;
+
+			// sets the rule for a command ("*" for the default)
+			void set(std::string_view command, const CooldownRule &rule);
+
+			// the cooldowns covering every command
+			const AnyCommandRule &anyCommand() const { return AnyCommand; }
+			void setAnyCommand(const AnyCommandRule &rule) { AnyCommand = rule; }
+
+			// reads a client's cooldowns.txt (a missing file is only the default)
+			static CooldownRules load(const std::string &path);
+	};
+
+	// the cooldowns that are running for one bot
+	class Cooldowns
+	{
+		public:
+			// the wheel's resolution
+			static constexpr Clock::duration Tick = std::chrono::milliseconds(10);
+
+		private:
+			static constexpr unsigned WheelBits = 8;
+			static constexpr std::size_t WheelSize = std::size_t(1) << WheelBits;
+			static constexpr unsigned Levels = 4;
+
+			// a running cooldown (a Key of 0 is an empty slot)
+			struct Entry
+			{
+				std::uint64_t Key = 0;
+				std::uint64_t Ends = 0;
+			};
+
+			mutable std::mutex Lock;
+
+			std::vector<Entry> Table;
+			std::size_t Count = 0;
+
+			// each level's slots cover 256 times as long as the level below
+			std::array<std::array<std::vector<Entry>, WheelSize>, Levels> Wheel;
+
+			// how many entries each level holds
+			std::array<std::size_t, Levels> Scheduled = {};
+
+			// the tick the wheel has reached, counted from Start
+			std::uint64_t Now = 0;
+			Clock::time_point Start;
+
+			// the slot key is in, or the empty slot it would go in
+			std::size_t _find(std::uint64_t key) const;
+
+			// starts (or restarts) a cooldown ending at ends
+			void _start(std::uint64_t key, std::uint64_t ends);
+			void _erase(std::size_t slot);
+			void _grow();
+
+			void _schedule(const Entry &entry);
+			void _cascade(unsigned level, std::size_t slot);
+			void _expire(const Entry &entry);
+
+			// moves the wheel on to tick, ending every cooldown due by then
+			void _advance(std::uint64_t tick);
+
+			std::uint64_t _tick(Clock::time_point time) const;
+
+		public:
+			explicit Cooldowns(Clock::time_point start = Clock::now());
+
+			// Whether command can be used by user in channel now.  If it can,
+			// its cooldowns (and those covering every command) are started
+			bool tryUse(const CooldownRule &rule, std::string_view command, std::string_view channel,
+					std::string_view user, Clock::time_point now = Clock::now());
+			bool tryUse(const CooldownRule &rule, const AnyCommandRule &anyCommand, std::string_view command,
+					std::string_view channel, std::string_view user, Clock::time_point now = Clock::now());
+
+			// the number of cooldowns running (as of the last tryUse)
+			std::size_t running() const;
+	};
+}
+#endif
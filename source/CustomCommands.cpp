@@ -0,0 +1,294 @@
+/* CustomCommands.cpp - Miles Shamo
+ *
+ * Implementation of the compiled custom
+ * text commands
+ *
+ */
+
+#include "CustomCommands.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+
+namespace
+{
+	// FNV-1a
+	std::uint64_t hashName(std::string_view name)
+	{
+		std::uint64_t h = 14695981039346656037ull;
+
+		for (char c : name)
+		{
+			h ^= static_cast<unsigned char>(c);
+			h *= 1099511628211ull;
+		}
+
+		return h ^ (h >> 32);
+	}
+
+	struct Placeholder
+	{
+		std::string_view Text;
+		int Kind;
+	};
+
+	// in the same order as CustomCommands::Segment (after Text)
+	const Placeholder Placeholders[] =
+	{
+		{"{user}", 1},
+		{"{args}", 2},
+		{"{channel}", 3},
+		{"{count}", 4}
+	};
+}
+
+
+std::string_view Twitch::CustomCommands::_name(const Command &command) const
+{
+	return std::string_view(Pool).substr(command.NameOffset, command.NameLength);
+}
+
+
+// _slot
+//
+// linear probing from the name's hash.  The table is never
+// more than half full, so this always finds an empty slot
+std::size_t Twitch::CustomCommands::_slot(std::string_view name) const
+{
+	std::size_t mask = Slots.size() - 1;
+	std::size_t slot = hashName(name) & mask;
+
+	while (Slots[slot] != 0 && _name(Commands[Slots[slot] - 1]) != name)
+		slot = (slot + 1) & mask;
+
+	return slot;
+}
+
+
+// _buildSlots
+//
+// (re)builds the hash table big enough for one more command
+void Twitch::CustomCommands::_buildSlots()
+{
+	std::size_t size = 16;
+	while (size < 2 * (Commands.size() + 1))
+		size *= 2;
+
+	Slots.assign(size, 0);
+
+	for (std::uint32_t i = 0; i < Commands.size(); i++)
+		Slots[_slot(_name(Commands[i]))] = i + 1;
+}
+
+
+// _add
+//
+// compiles one command into the pool.  The reply is split
+// into runs of text and the placeholders between them; the
+// text is left where it is in the pool and only pointed at
+void Twitch::CustomCommands::_add(std::string_view name, std::string_view reply)
+{
+	if (Slots.size() < 2 * (Commands.size() + 1))
+		_buildSlots();
+
+	Command command;
+	command.NameOffset = static_cast<std::uint32_t>(Pool.size());
+	command.NameLength = static_cast<std::uint32_t>(name.size());
+	command.FirstPart = static_cast<std::uint32_t>(Parts.size());
+
+	Pool.append(name);
+
+	std::uint32_t base = static_cast<std::uint32_t>(Pool.size());
+	Pool.append(reply);
+
+	std::size_t placeholders = 0;
+	std::size_t textStart = 0;
+
+	for (std::size_t i = 0; i < reply.size() && placeholders < MaxPlaceholders; i++)
+	{
+		if (reply[i] != '{')
+			continue;
+
+		for (auto &placeholder : Placeholders)
+		{
+			if (reply.compare(i, placeholder.Text.size(), placeholder.Text) != 0)
+				continue;
+
+			if (i > textStart)
+				Parts.push_back(Part{Segment::Text, base + static_cast<std::uint32_t>(textStart), static_cast<std::uint32_t>(i - textStart)});
+
+			Parts.push_back(Part{static_cast<Segment>(placeholder.Kind), 0, 0});
+			placeholders++;
+
+			i += placeholder.Text.size() - 1;
+			textStart = i + 1;
+			break;
+		}
+	}
+
+	if (textStart < reply.size())
+		Parts.push_back(Part{Segment::Text, base + static_cast<std::uint32_t>(textStart), static_cast<std::uint32_t>(reply.size() - textStart)});
+
+	command.PartCount = static_cast<std::uint32_t>(Parts.size() - command.FirstPart);
+
+	// a later line for the same name replaces the earlier one
+	std::size_t slot = _slot(name);
+
+	if (Slots[slot] != 0)
+	{
+		Commands[Slots[slot] - 1] = command;
+	}
+	else
+	{
+		Commands.push_back(command);
+		Slots[slot] = static_cast<std::uint32_t>(Commands.size());
+	}
+}
+
+
+// read
+//
+// "!name reply" per line.  Blank lines and '#' comments are
+// skipped, as are commands with no reply (Twitch won't send
+// an empty message)
+void Twitch::CustomCommands::read(std::istream &in)
+{
+	std::size_t before = Commands.size();
+
+	std::string line;
+	while (std::getline(in, line))
+	{
+		std::string_view view(line);
+
+		if (!view.empty() && view.back() == '\r')
+			view.remove_suffix(1);
+
+		auto start = view.find_first_not_of(' ');
+		if (start == std::string_view::npos || view[start] == '#')
+			continue;
+
+		view.remove_prefix(start);
+
+		if (view.front() == '!')
+			view.remove_prefix(1);
+
+		auto space = view.find(' ');
+		if (space == std::string_view::npos || space == 0)
+			continue;
+
+		auto name = view.substr(0, space);
+		auto reply = view.substr(space);
+
+		reply.remove_prefix(std::min(reply.find_first_not_of(' '), reply.size()));
+
+		if (!reply.empty())
+			_add(name, reply);
+	}
+
+	// carry the counts of the commands we already had
+	auto uses = std::make_unique<std::atomic<std::uint64_t>[]>(Commands.size());
+
+	for (std::size_t i = 0; i < Commands.size(); i++)
+		uses[i].store(i < before ? Uses[i].load(std::memory_order_relaxed) : 0, std::memory_order_relaxed);
+
+	Uses = std::move(uses);
+}
+
+
+// load
+//
+// reloading the file shouldn't reset {count}, so any command
+// that was in previous starts from where it was
+Twitch::CustomCommands Twitch::CustomCommands::load(const std::string &path, const CustomCommands *previous)
+{
+	CustomCommands commands;
+
+	std::ifstream in(path);
+	commands.read(in);
+
+	if (previous && !previous->empty())
+	{
+		for (std::size_t i = 0; i < commands.Commands.size(); i++)
+			commands.Uses[i].store(previous->uses(commands._name(commands.Commands[i])), std::memory_order_relaxed);
+	}
+
+	return commands;
+}
+
+
+bool Twitch::CustomCommands::contains(std::string_view name) const
+{
+	return !Commands.empty() && Slots[_slot(name)] != 0;
+}
+
+
+std::uint64_t Twitch::CustomCommands::uses(std::string_view name) const
+{
+	if (Commands.empty())
+		return 0;
+
+	auto index = Slots[_slot(name)];
+
+	return index == 0 ? 0 : Uses[index - 1].load(std::memory_order_relaxed);
+}
+
+
+// reply
+//
+// Handlers for the same bot can run at once (one per channel),
+// so the count is bumped atomically.  Everything else is read only
+bool Twitch::CustomCommands::reply(const IRCMessage &message, Reply &out) const
+{
+	if (Commands.empty())
+		return false;
+
+	auto index = Slots[_slot(message.userCommand())];
+	if (index == 0)
+		return false;
+
+	const Command &command = Commands[index - 1];
+
+	auto channel = message.channel();
+
+	out.Count = 0;
+	out.Pieces[out.Count++] = "PRIVMSG ";
+	out.Pieces[out.Count++] = channel;
+	out.Pieces[out.Count++] = " :";
+
+	if (!channel.empty() && channel.front() == '#')
+		channel.remove_prefix(1);
+
+	std::uint64_t count = Uses[index - 1].fetch_add(1, std::memory_order_relaxed) + 1;
+
+	std::string_view pool(Pool);
+
+	for (std::uint32_t i = 0; i < command.PartCount; i++)
+	{
+		const Part &part = Parts[command.FirstPart + i];
+
+		switch (part.Kind)
+		{
+			case Segment::Text:
+				out.Pieces[out.Count++] = pool.substr(part.Offset, part.Length);
+				break;
+			case Segment::User:
+				out.Pieces[out.Count++] = message.nick();
+				break;
+			case Segment::Args:
+				out.Pieces[out.Count++] = message.userArgs();
+				break;
+			case Segment::Channel:
+				out.Pieces[out.Count++] = channel;
+				break;
+			case Segment::Count:
+			{
+				auto written = std::to_chars(out.Number, out.Number + sizeof(out.Number), count);
+				out.Pieces[out.Count++] = std::string_view(out.Number, written.ptr - out.Number);
+				break;
+			}
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,145 @@
+/* CustomCommands.hpp - Miles Shamo
+ *
+ * A client's own text commands, read from its
+ * customCommands.txt, one per line:
+ *
+ * 		!name the reply, with {user}, {args}, {channel} and {count}
+ *
+ * Blank lines and lines starting with '#' are
+ * skipped, and a later line with the same name
+ * replaces an earlier one.  {user} is the sender's
+ * nick, {args} is whatever followed the command,
+ * {channel} is the channel (without its '#') and
+ * {count} is how many times the command has been
+ * used.  Any other braces are left as they are.
+ *
+ * Replies are compiled once, when the file is
+ * read, into a list of segments: runs of literal
+ * text (views into one pool holding every reply)
+ * and the placeholders between them.  Answering a
+ * command is then one hash lookup and filling in a
+ * few string_views, which the bot joins straight
+ * into its outbound buffer; no strings are built
+ * along the way.
+ *
+ * Names are kept in an open addressing hash table
+ * (never more than half full), so looking one up
+ * stays O(1) with tens of thousands of commands.
+ *
+ * Apart from the use counts (which are atomic),
+ * a CustomCommands is never changed once loaded.
+ */
+
+#ifndef TWITCH_CUSTOM_COMMANDS
+#define TWITCH_CUSTOM_COMMANDS
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "IRCMessage.hpp"
+
+namespace Twitch
+{
+	class CustomCommands
+	{
+		public:
+			// placeholders past this many in one reply are left as text
+			static constexpr std::size_t MaxPlaceholders = 30;
+
+			// "PRIVMSG ", the channel, " :" and the reply's segments
+			static constexpr std::size_t MaxPieces = 3 + 2 * MaxPlaceholders + 1;
+
+			// a reply ready to be written; the views point into the
+			// commands, the message and Number, so it must not be copied
+			// or outlive either of them
+			struct Reply
+			{
+				std::array<std::string_view, MaxPieces> Pieces;
+				std::size_t Count = 0;
+
+				// {count}'s digits
+				char Number[20];
+
+				Reply() = default;
+				Reply(const Reply &) = delete;
+				Reply &operator=(const Reply &) = delete;
+
+				const std::string_view *begin() const { return Pieces.data(); }
+				const std::string_view *end() const { return Pieces.data() + Count; }
+			};
+
+		private:
+			enum class Segment : std::uint8_t
+			{
+				Text,
+				User,
+				Args,
+				Channel,
+				Count
+			};
+
+			struct Part
+			{
+				Segment Kind;
+				std::uint32_t Offset, Length;
+			};
+
+			struct Command
+			{
+				// the name and the reply's parts are both in the pool
+				std::uint32_t NameOffset, NameLength;
+				std::uint32_t FirstPart, PartCount;
+			};
+
+			// every name and reply, back to back
+			std::string Pool;
+
+			std::vector<Part> Parts;
+			std::vector<Command> Commands;
+
+			// indices into Commands, plus one (0 is an empty slot)
+			std::vector<std::uint32_t> Slots;
+
+			// how many times each command has been used
+			std::unique_ptr<std::atomic<std::uint64_t>[]> Uses;
+
+			std::string_view _name(const Command &command) const;
+
+			// the slot name is in, or the empty slot it would go in
+			std::size_t _slot(std::string_view name) const;
+
+			void _add(std::string_view name, std::string_view reply);
+			void _buildSlots();
+
+		public:
+			CustomCommands() = default;
+
+			// compiles a customCommands.txt
+			void read(std::istream &in);
+
+			// reads a client's customCommands.txt (a missing file is no commands).
+			// Commands that were in previous keep their counts
+			static CustomCommands load(const std::string &path, const CustomCommands *previous = nullptr);
+
+			// how many commands there are
+			std::size_t size() const { return Commands.size(); }
+			bool empty() const { return Commands.empty(); }
+
+			bool contains(std::string_view name) const;
+
+			// how many times a command has been used (0 if there is no such command)
+			std::uint64_t uses(std::string_view name) const;
+
+			// fills in the reply to the user command in message, counting it
+			// as a use.  Returns false if it isn't one of ours
+			bool reply(const IRCMessage &message, Reply &out) const;
+	};
+}
+#endif
@@ -0,0 +1,276 @@
+/* FairScheduler.cpp - Miles Shamo
+ *
+ * Implementation of the fair handler scheduler
+ *
+ */
+
+#include "FairScheduler.hpp"
+
+#include <algorithm>
+#include <thread>
+#include <utility>
+
+Twitch::FairScheduler::FairScheduler(std::size_t maxInFlight, bool perChannel)
+{
+	configure(maxInFlight, perChannel);
+}
+
+
+void Twitch::FairScheduler::configure(std::size_t maxInFlight, bool perChannel)
+{
+	std::lock_guard<std::mutex> guard(Lock);
+
+	if (maxInFlight == 0)
+		maxInFlight = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+
+	MaxInFlight = maxInFlight;
+	PerChannel = perChannel;
+}
+
+
+// setWeight
+//
+// also applies to the bot's tenants that already exist (all of
+// its channels, in per channel mode)
+void Twitch::FairScheduler::setWeight(std::string_view bot, double weight)
+{
+	std::lock_guard<std::mutex> guard(Lock);
+
+	// a weight of zero would never be served
+	weight = std::max(weight, 0.01);
+
+	auto iter = Weights.find(bot);
+	if (iter == Weights.end())
+		Weights.emplace(std::string(bot), weight);
+	else
+		iter->second = weight;
+
+	for (auto &tenant : Tenants)
+	{
+		if (_belongsTo(tenant.first, bot, std::string_view()))
+		{
+			tenant.second.Weight = weight;
+			tenant.second.Stats.Weight = weight;
+		}
+	}
+}
+
+
+// _belongsTo
+//
+// tenants are named "bot" or "bot/#channel"
+bool Twitch::FairScheduler::_belongsTo(std::string_view tenant, std::string_view bot, std::string_view channel)
+{
+	if (tenant.size() < bot.size() || tenant.substr(0, bot.size()) != bot)
+		return false;
+
+	std::string_view rest = tenant.substr(bot.size());
+
+	if (channel.empty())
+		return rest.empty() || rest.front() == '/';
+
+	return rest.size() == channel.size() + 1 && rest.front() == '/' && rest.substr(1) == channel;
+}
+
+
+void Twitch::FairScheduler::submit(std::string_view bot, std::string_view channel, const Strand &strand, std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> guard(Lock);
+
+		std::string name(bot);
+		if (PerChannel)
+		{
+			name += '/';
+			name += channel;
+		}
+
+		auto iter = Tenants.find(name);
+		if (iter == Tenants.end())
+		{
+			iter = Tenants.emplace(name, Tenant()).first;
+
+			auto weight = Weights.find(bot);
+			iter->second.Weight = weight == Weights.end() ? 1 : weight->second;
+
+			iter->second.Stats.Tenant = name;
+			iter->second.Stats.Weight = iter->second.Weight;
+		}
+
+		Tenant &tenant = iter->second;
+
+		// a bot launched again under the same name takes the tenant back
+		tenant.Forgotten = false;
+
+		tenant.Queue.push_back({strand, std::move(task), Clock::now()});
+		tenant.Stats.Queued++;
+
+		if (!tenant.Active)
+		{
+			tenant.Active = true;
+			tenant.Fresh = true;
+			Active.push_back(&tenant);
+		}
+	}
+
+	_dispatch();
+}
+
+
+// _next
+//
+// Deficit round robin, with every handler costing one.  The tenant
+// at the front gets its weight added to its deficit once per turn,
+// and runs handlers while the deficit covers them.  Then it goes to
+// the back (counted as throttled if anyone else was waiting).  A
+// tenant with a weight under one builds its deficit up over several
+// turns.
+bool Twitch::FairScheduler::_next(std::vector<Task> &starting, Tenant *&owner)
+{
+	while (!Active.empty())
+	{
+		Tenant *tenant = Active.front();
+
+		if (tenant->Queue.empty())
+		{
+			tenant->Active = false;
+			tenant->Deficit = 0;
+			Active.pop_front();
+
+			if (tenant->Forgotten)
+				Tenants.erase(Tenants.find(tenant->Stats.Tenant));
+
+			continue;
+		}
+
+		if (tenant->Fresh)
+		{
+			tenant->Deficit += tenant->Weight;
+			tenant->Fresh = false;
+		}
+
+		if (tenant->Deficit >= 1)
+		{
+			tenant->Deficit -= 1;
+
+			starting.push_back(std::move(tenant->Queue.front()));
+			tenant->Queue.pop_front();
+			owner = tenant;
+
+			return true;
+		}
+
+		// its turn is over with work still waiting
+		if (Active.size() > 1)
+			tenant->Stats.Throttled++;
+
+		tenant->Fresh = true;
+		Active.pop_front();
+		Active.push_back(tenant);
+	}
+
+	return false;
+}
+
+
+// _dispatch
+//
+// The tasks are posted to their strands under the lock.  Posting only
+// queues them, and two dispatches (one from a submit, one from a
+// finished handler) can run at once: posting after the lock would let
+// the second post a channel's next task ahead of the first's
+void Twitch::FairScheduler::_dispatch()
+{
+	std::lock_guard<std::mutex> guard(Lock);
+
+	auto now = Clock::now();
+
+	std::vector<Task> starting;
+	Tenant *owner = nullptr;
+
+	while (InFlight < MaxInFlight && _next(starting, owner))
+	{
+		InFlight++;
+
+		Task &task = starting.back();
+		auto waited = now - task.Queued;
+
+		owner->Stats.Queued--;
+		owner->Stats.Run++;
+		owner->Stats.TotalWait += waited;
+		owner->Stats.MaxWait = std::max(owner->Stats.MaxWait, waited);
+
+		asio::post(task.Where, [this, run = std::move(task.Run)]()
+		{
+			// the slot is given back even if the handler throws
+			try
+			{
+				run();
+			}
+			catch (...)
+			{
+				_finished();
+				throw;
+			}
+
+			_finished();
+		});
+	}
+}
+
+
+void Twitch::FairScheduler::_finished()
+{
+	{
+		std::lock_guard<std::mutex> guard(Lock);
+		InFlight--;
+	}
+
+	_dispatch();
+}
+
+
+// forget
+//
+// A tenant still in the round robin is only marked, and erased by
+// _next when it comes up with nothing left.  Handlers already started
+// don't need it (they only give back their slot)
+void Twitch::FairScheduler::forget(std::string_view bot, std::string_view channel)
+{
+	std::lock_guard<std::mutex> guard(Lock);
+
+	// without per channel tenants, a channel shares its bot's
+	if (!channel.empty() && !PerChannel)
+		return;
+
+	for (auto iter = Tenants.begin(); iter != Tenants.end();)
+	{
+		if (!_belongsTo(iter->first, bot, channel))
+		{
+			++iter;
+			continue;
+		}
+
+		if (iter->second.Active)
+		{
+			iter->second.Forgotten = true;
+			++iter;
+		}
+		else
+			iter = Tenants.erase(iter);
+	}
+}
+
+
+std::vector<Twitch::FairnessStats> Twitch::FairScheduler::stats()
+{
+	std::lock_guard<std::mutex> guard(Lock);
+
+	std::vector<FairnessStats> all;
+	all.reserve(Tenants.size());
+
+	for (auto &tenant : Tenants)
+		all.push_back(tenant.second.Stats);
+
+	return all;
+}
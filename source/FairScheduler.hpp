@@ -0,0 +1,138 @@
+/* FairScheduler.hpp - Miles Shamo
+ *
+ * Shares the Overseer's worker threads fairly
+ * between the bots (tenants) running on them.
+ *
+ * Without this, whoever has the most messages gets
+ * the most handler time: a raid on one channel fills
+ * the threads with its handlers and every other bot's
+ * commands wait behind them.  So chat handlers (see
+ * IRCBot::_dispatchToChannel) are submitted here
+ * instead of straight to their strands, and only a
+ * few are let onto the threads at once.  When one
+ * finishes the next is picked by deficit round robin:
+ * each tenant with work waiting gets its weight's
+ * worth of handlers per round, in turn.  A flooded
+ * tenant's backlog waits in its own queue and only
+ * slows itself down.
+ *
+ * A tenant is a bot, or (in per channel mode) one
+ * channel of a bot.  A bot's weight is read from
+ * weight.txt in its client folder.  Tenants are let
+ * go once their bot stops or their channel is left
+ * (see forget), so only the ones running are kept.
+ *
+ * Handlers for one channel stay in order: a tenant's
+ * queue is first in first out, they're posted to the
+ * channel's strand in that order (under the lock), and
+ * they still run on it.
+ */
+
+#ifndef TWITCH_FAIR_SCHEDULER
+#define TWITCH_FAIR_SCHEDULER
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <asio.hpp>
+
+#include "RateLimiter.hpp"
+
+namespace Twitch
+{
+	// how a tenant is being treated
+	struct FairnessStats
+	{
+		std::string Tenant;
+		double Weight = 1;
+		std::size_t Queued = 0;		// handlers waiting now
+		std::size_t Run = 0;		// handlers run so far
+		std::size_t Throttled = 0;	// times it still had work when its turn ended
+		Clock::duration TotalWait = Clock::duration::zero();
+		Clock::duration MaxWait = Clock::duration::zero();
+	};
+
+	class FairScheduler
+	{
+		public:
+			using Strand = asio::strand<asio::io_context::executor_type>;
+
+		private:
+			struct Task
+			{
+				Strand Where;
+				std::function<void()> Run;
+				Clock::time_point Queued;
+			};
+
+			struct Tenant
+			{
+				std::deque<Task> Queue;
+
+				double Weight = 1;
+				double Deficit = 0;
+
+				// in the round robin, and whether it has had its quantum this turn
+				bool Active = false;
+				bool Fresh = true;
+
+				// to be erased once its queue runs dry
+				bool Forgotten = false;
+
+				FairnessStats Stats;
+			};
+
+			std::mutex Lock;
+
+			// by "bot" or "bot/#channel"
+			std::map<std::string, Tenant, std::less<>> Tenants;
+
+			// weights by bot
+			std::map<std::string, double, std::less<>> Weights;
+
+			// tenants with work waiting, in turn order
+			std::deque<Tenant *> Active;
+
+			std::size_t InFlight = 0;
+			std::size_t MaxInFlight;
+			bool PerChannel;
+
+			// moves the next task (by deficit round robin) onto starting (locked)
+			bool _next(std::vector<Task> &starting, Tenant *&owner);
+
+			// starts as many tasks as there are free slots
+			void _dispatch();
+
+			// a task has finished, freeing its slot
+			void _finished();
+
+			// whether a tenant is the bot's, or only the channel's if one is given
+			static bool _belongsTo(std::string_view tenant, std::string_view bot, std::string_view channel);
+
+		public:
+			// maxInFlight of zero means one per core
+			explicit FairScheduler(std::size_t maxInFlight = 0, bool perChannel = false);
+
+			void configure(std::size_t maxInFlight, bool perChannel);
+
+			// sets a bot's weight (relative to the default of 1)
+			void setWeight(std::string_view bot, double weight);
+
+			// queues a handler for a bot's channel, to run on that channel's strand
+			void submit(std::string_view bot, std::string_view channel, const Strand &strand, std::function<void()> task);
+
+			// Lets go of a bot's tenants (or only a channel's, in per channel
+			// mode), as soon as whatever they have queued has been started
+			void forget(std::string_view bot, std::string_view channel = std::string_view());
+
+			// every tenant still around, for the console
+			std::vector<FairnessStats> stats();
+	};
+}
+#endif
@@ -0,0 +1,701 @@
+/* FakeTwitch.cpp - Miles Shamo
+ *
+ * Implementation of the fake Twitch IRC server.
+ *
+ * Each connection is a Session, kept alive by the
+ * handlers waiting on it (and by the server's list
+ * of sessions until it closes).  A session's reads,
+ * writes and timers all run on its own strand, so
+ * nothing in it is locked.
+ *
+ * Lines are read with the bot's own LineBuffer and
+ * parser, and written in batches with its WriteQueue,
+ * so the server costs about as much per line as the
+ * bots it is testing.
+ */
+
+#include "FakeTwitch.hpp"
+
+#include <algorithm>
+#include <array>
+#include <utility>
+
+#include "IRCParser.hpp"
+#include "LineBuffer.hpp"
+#include "WriteQueue.hpp"
+
+namespace
+{
+	// how often the chat generator runs
+	constexpr auto ChatTick = std::chrono::milliseconds(50);
+
+	// how many of the bots' PRIVMSGs are kept for chatReceived
+	constexpr std::size_t ChatKept = 1000;
+
+	// what the viewers say
+	constexpr std::array<std::string_view, 8> Phrases = {
+		"hello chat",
+		"LUL",
+		"that was close",
+		"PogChamp PogChamp",
+		"what game is this?",
+		"gg",
+		"first time here, love the stream",
+		"Kappa"
+	};
+
+	std::string_view trimmed(std::string_view text)
+	{
+		while (!text.empty() && text.back() == ' ')
+			text.remove_suffix(1);
+
+		return text;
+	}
+}
+
+
+//--------------------------------------------------------
+// Session
+
+class Twitch::FakeTwitch::Session : public std::enable_shared_from_this<Session>
+{
+	private:
+		FakeTwitch &Owner;
+
+		asio::strand<asio::io_context::executor_type> Strand;
+		asio::ip::tcp::socket Socket;
+
+		LineBuffer In;
+		WriteQueue Out;
+		std::vector<asio::const_buffer> OutBuffers;
+
+		asio::steady_timer ChatTimer;
+		asio::steady_timer PingTimer;
+
+		std::string Nick;
+		bool LoggedIn = false;
+		bool Closing = false;	// closes once everything queued is written
+		bool Closed = false;
+
+		// joined channels, and how much chat each is owed (fractions carry over)
+		struct Channel
+		{
+			std::string Name;
+			double Owed = 0;
+		};
+		std::vector<Channel> Channels;
+
+		// numbers the generated messages (for their id tag and viewer)
+		std::size_t Generated = 0;
+
+		// the timed PING waiting on its PONG
+		std::size_t PingNumber = 0;
+		Clock::time_point PingSent;
+		bool PingWaiting = false;
+
+		void _read()
+		{
+			char *space = In.prepare();
+
+			Socket.async_read_some(asio::buffer(space, In.space()),
+					asio::bind_executor(Strand,
+						[self = shared_from_this()](const asio::error_code &e, std::size_t size)
+						{
+							self->_onRead(e, size);
+						}));
+		}
+
+		void _onRead(const asio::error_code &e, std::size_t size)
+		{
+			if (e || Closed)
+			{
+				close();
+				return;
+			}
+
+			In.commit(size);
+
+			std::string_view line;
+			while (In.nextLine(line) && !Closing)
+				_onLine(line);
+
+			if (!Closing)
+				_read();
+		}
+
+		// a line from the bot
+		void _onLine(std::string_view text)
+		{
+			IRCLine line;
+			if (!parseIRCLine(text, line))
+				return;
+
+			auto command = line.command;
+			auto params = trimmed(line.params);
+
+			if (command == "CAP")
+			{
+				// "CAP REQ :caps" is acknowledged in full
+				_send({":tmi.twitch.tv CAP * ACK :", line.trailing});
+			}
+			else if (command == "PASS")
+			{
+				// any password will do, unless the NICK is turned away
+			}
+			else if (command == "NICK")
+			{
+				_login(params);
+			}
+			else if (command == "PING")
+			{
+				_send({":tmi.twitch.tv PONG tmi.twitch.tv :", line.hasTrailing ? line.trailing : params});
+			}
+			else if (command == "PONG")
+			{
+				std::string_view token = line.hasTrailing ? line.trailing : params;
+
+				if (PingWaiting && token == "ft-" + std::to_string(PingNumber))
+				{
+					PingWaiting = false;
+					Owner.Count.Pongs++;
+					Owner._timed(Clock::now() - PingSent);
+				}
+			}
+			else if (!LoggedIn)
+			{
+				// Twitch ignores everything else until the login is done
+				Owner.Count.Ignored++;
+			}
+			else if (command == "JOIN")
+			{
+				while (!params.empty())
+				{
+					auto comma = params.find(',');
+					_join(params.substr(0, comma));
+
+					params = comma == std::string_view::npos ? std::string_view() : params.substr(comma + 1);
+				}
+			}
+			else if (command == "PART")
+			{
+				auto found = std::find_if(Channels.begin(), Channels.end(),
+						[&](const Channel &c) { return c.Name == params; });
+
+				if (found != Channels.end())
+				{
+					Channels.erase(found);
+					Owner.Count.Parts++;
+					_send({":", Nick, "!", Nick, "@", Nick, ".tmi.twitch.tv PART ", params});
+				}
+			}
+			else if (command == "PRIVMSG")
+			{
+				Owner.Count.ChatReceived++;
+				Owner._heard(Nick + " " + std::string(params) + " :" + std::string(line.trailing));
+			}
+		}
+
+		void _login(std::string_view nick)
+		{
+			if (LoggedIn)
+				return;
+
+			Nick = nick;
+
+			if (Owner._rejects(Nick))
+			{
+				Owner.Count.AuthFailures++;
+
+				// Twitch closes the connection right after saying so
+				_send({":tmi.twitch.tv NOTICE * :Login authentication failed"});
+				Closing = true;
+				return;
+			}
+
+			LoggedIn = true;
+			Owner.Count.Logins++;
+			Owner.Count.LoggedIn++;
+
+			_send({":tmi.twitch.tv 001 ", Nick, " :Welcome, GLHF!"});
+			_send({":tmi.twitch.tv 002 ", Nick, " :Your host is tmi.twitch.tv"});
+			_send({":tmi.twitch.tv 003 ", Nick, " :This server is rather new"});
+			_send({":tmi.twitch.tv 004 ", Nick, " :-"});
+			_send({":tmi.twitch.tv 375 ", Nick, " :-"});
+			_send({":tmi.twitch.tv 372 ", Nick, " :You are in a maze of twisty passages, all alike."});
+			_send({":tmi.twitch.tv 376 ", Nick, " :>"});
+
+			_chatTick();
+
+			if (Owner.Options.PingInterval > Clock::duration::zero())
+				_pingTick();
+		}
+
+		void _join(std::string_view channel)
+		{
+			if (channel.empty())
+				return;
+
+			if (Owner._suspended(channel))
+			{
+				_send({"@msg-id=msg_channel_suspended :tmi.twitch.tv NOTICE ", channel, " :This channel has been suspended."});
+				return;
+			}
+
+			bool joined = std::any_of(Channels.begin(), Channels.end(),
+					[&](const Channel &c) { return c.Name == channel; });
+
+			if (!joined)
+			{
+				Channels.push_back({std::string(channel)});
+				Owner.Count.Joins++;
+			}
+
+			_send({":", Nick, "!", Nick, "@", Nick, ".tmi.twitch.tv JOIN ", channel});
+			_send({":", Nick, ".tmi.twitch.tv 353 ", Nick, " = ", channel, " :", Nick});
+			_send({":", Nick, ".tmi.twitch.tv 366 ", Nick, " ", channel, " :End of /NAMES list"});
+			_send({"@badge-info=;badges=;color=;display-name=", Nick, ";emote-sets=0;mod=0;subscriber=0;user-type= :tmi.twitch.tv USERSTATE ", channel});
+			_send({"@emote-only=0;followers-only=-1;r9k=0;room-id=1;slow=0;subs-only=0 :tmi.twitch.tv ROOMSTATE ", channel});
+		}
+
+		// generates whatever chat each channel is owed since the last tick
+		void _chatTick()
+		{
+			if (Closed)
+				return;
+
+			double rate = Owner.ChatRate;
+			double perTick = rate * std::chrono::duration<double>(ChatTick).count();
+
+			for (auto &channel : Channels)
+			{
+				channel.Owed += perTick;
+
+				for (; channel.Owed >= 1; channel.Owed -= 1)
+					_chat(channel.Name);
+			}
+
+			ChatTimer.expires_after(ChatTick);
+			ChatTimer.async_wait(asio::bind_executor(Strand,
+						[self = shared_from_this()](const asio::error_code &e)
+						{
+							if (!e)
+								self->_chatTick();
+						}));
+		}
+
+		// one line of chat from one of the viewers
+		void _chat(const std::string &channel)
+		{
+			std::size_t number = Generated++;
+			std::string viewer = "viewer" + std::to_string(number % std::max<std::size_t>(Owner.Options.Chatters, 1));
+
+			std::string_view text = Phrases[number % Phrases.size()];
+
+			std::size_t every = Owner.Options.CommandEvery;
+			if (every && number % every == every - 1)
+				text = "!echo hello from chat";
+
+			say(channel, viewer, text, number);
+		}
+
+		void _pingTick()
+		{
+			if (Closed)
+				return;
+
+			// a PING that was never answered just isn't timed
+			PingNumber++;
+			PingSent = Clock::now();
+			PingWaiting = true;
+
+			_send({"PING :ft-", std::to_string(PingNumber)});
+
+			PingTimer.expires_after(Owner.Options.PingInterval);
+			PingTimer.async_wait(asio::bind_executor(Strand,
+						[self = shared_from_this()](const asio::error_code &e)
+						{
+							if (!e)
+								self->_pingTick();
+						}));
+		}
+
+		// queues a line (the "\r\n" is added here)
+		void _send(std::initializer_list<std::string_view> pieces)
+		{
+			if (Closed)
+				return;
+
+			std::string line = Out.acquire();
+			for (auto piece : pieces)
+				line.append(piece);
+			line.append("\r\n");
+
+			Out.push(std::move(line));
+
+			if (!Out.writing())
+				_flush();
+		}
+
+		void _flush()
+		{
+			if (!Out.startBatch())
+			{
+				if (Closing)
+					close();
+
+				return;
+			}
+
+			OutBuffers.clear();
+			for (const auto &line : Out.batch())
+				OutBuffers.push_back(asio::buffer(line));
+
+			asio::async_write(Socket, OutBuffers,
+					asio::bind_executor(Strand,
+						[self = shared_from_this()](const asio::error_code &e, std::size_t)
+						{
+							self->Out.finishBatch();
+
+							if (e)
+								self->close();
+							else
+								self->_flush();
+						}));
+		}
+
+	public:
+		Session(FakeTwitch &owner, asio::ip::tcp::socket socket)
+			:	Owner(owner),
+				Strand(asio::make_strand(owner.Context)),
+				Socket(std::move(socket)),
+				ChatTimer(Strand),
+				PingTimer(Strand)
+		{
+		}
+
+		void start()
+		{
+			asio::post(Strand, [self = shared_from_this()]()
+			{
+				asio::error_code ignored;
+				self->Socket.set_option(asio::ip::tcp::no_delay(true), ignored);
+
+				self->_read();
+			});
+		}
+
+		const asio::strand<asio::io_context::executor_type> &strand() const { return Strand; }
+
+		// a viewer's PRIVMSG, tagged as Twitch would
+		void say(std::string_view channel, std::string_view user, std::string_view text, std::size_t id)
+		{
+			auto sent = std::chrono::duration_cast<std::chrono::milliseconds>(
+					std::chrono::system_clock::now().time_since_epoch()).count();
+
+			_send({"@badge-info=;badges=;color=#1E90FF;display-name=", user,
+				   ";emotes=;first-msg=0;flags=;id=", std::to_string(id),
+				   ";mod=0;room-id=1;subscriber=0;tmi-sent-ts=", std::to_string(sent),
+				   ";turbo=0;user-id=", std::to_string(1000 + id % 100000),
+				   ";user-type= :", user, "!", user, "@", user, ".tmi.twitch.tv PRIVMSG ", channel, " :", text});
+
+			Owner.Count.ChatSent++;
+		}
+
+		bool inChannel(std::string_view channel) const
+		{
+			return std::any_of(Channels.begin(), Channels.end(),
+					[&](const Channel &c) { return c.Name == channel; });
+		}
+
+		void sendLine(std::string_view line) { _send({line}); }
+
+		// closes the connection (on the strand only)
+		void close()
+		{
+			if (Closed)
+				return;
+
+			Closed = true;
+
+			asio::error_code ignored;
+			ChatTimer.cancel();
+			PingTimer.cancel();
+			Socket.shutdown(asio::ip::tcp::socket::shutdown_both, ignored);
+			Socket.close(ignored);
+
+			if (LoggedIn)
+				Owner.Count.LoggedIn--;
+
+			Owner._closed(shared_from_this());
+		}
+};
+
+
+//--------------------------------------------------------
+// FakeTwitch
+
+// Constructor
+//
+// starts listening straight away, and runs the server on its own threads
+Twitch::FakeTwitch::FakeTwitch(const FakeTwitchOptions &options)
+	:	Options(options),
+		Work(asio::make_work_guard(Context)),
+		Acceptor(Context, asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), options.Port)),
+		AcceptStrand(asio::make_strand(Context)),
+		ChatRate(options.ChatRate)
+{
+	asio::post(AcceptStrand, [this]() { _accept(); });
+
+	for (unsigned i = 0; i < std::max(1u, Options.Threads); i++)
+		Threads.emplace_back([this]() { Context.run(); });
+}
+
+
+// Destructor
+//
+Twitch::FakeTwitch::~FakeTwitch()
+{
+	stop();
+}
+
+
+// _accept
+//
+// takes connections until we stop.  A connection that arrives as
+// we stop is dropped, as stop only closes the sessions it can see
+void Twitch::FakeTwitch::_accept()
+{
+	Acceptor.async_accept(asio::bind_executor(AcceptStrand, [this](const asio::error_code &e, asio::ip::tcp::socket socket)
+	{
+		if (e)
+			return;
+
+		auto session = std::make_shared<Session>(*this, std::move(socket));
+
+		{
+			std::lock_guard<std::mutex> guard(Lock);
+
+			if (Stopping)
+				return;
+
+			Sessions.insert(session);
+		}
+
+		Count.Accepted++;
+		Count.Connections++;
+
+		session->start();
+
+		_accept();
+	}));
+}
+
+
+// _each
+//
+// runs fn for every open session, on that session's strand
+void Twitch::FakeTwitch::_each(std::function<void(Session &)> fn)
+{
+	std::vector<std::shared_ptr<Session>> all;
+
+	{
+		std::lock_guard<std::mutex> guard(Lock);
+		all.assign(Sessions.begin(), Sessions.end());
+	}
+
+	for (auto &session : all)
+		asio::post(session->strand(), [session, fn]() { fn(*session); });
+}
+
+
+bool Twitch::FakeTwitch::_rejects(std::string_view nick)
+{
+	std::lock_guard<std::mutex> guard(Lock);
+	return RejectAll || Rejected.find(nick) != Rejected.end();
+}
+
+
+bool Twitch::FakeTwitch::_suspended(std::string_view channel)
+{
+	std::lock_guard<std::mutex> guard(Lock);
+	return Suspended.find(channel) != Suspended.end();
+}
+
+
+void Twitch::FakeTwitch::_heard(std::string line)
+{
+	std::lock_guard<std::mutex> guard(Lock);
+
+	Chat.push_back(std::move(line));
+	if (Chat.size() > ChatKept)
+		Chat.pop_front();
+}
+
+
+void Twitch::FakeTwitch::_timed(Clock::duration latency)
+{
+	std::lock_guard<std::mutex> guard(Lock);
+	Latencies.push_back(latency);
+}
+
+
+void Twitch::FakeTwitch::_closed(const std::shared_ptr<Session> &session)
+{
+	{
+		std::lock_guard<std::mutex> guard(Lock);
+		Sessions.erase(session);
+	}
+
+	Count.Connections--;
+}
+
+
+// port
+//
+unsigned short Twitch::FakeTwitch::port() const
+{
+	return Acceptor.local_endpoint().port();
+}
+
+
+// stop
+//
+// stops taking connections, closes every one there is, and waits
+// for the server's threads to finish what they were doing
+void Twitch::FakeTwitch::stop()
+{
+	if (Threads.empty())
+		return;
+
+	{
+		std::lock_guard<std::mutex> guard(Lock);
+		Stopping = true;
+	}
+
+	asio::post(AcceptStrand, [this]()
+	{
+		asio::error_code ignored;
+		Acceptor.close(ignored);
+	});
+
+	dropAll();
+
+	// with nothing left to wait on, the threads return
+	Work.reset();
+
+	for (auto &thread : Threads)
+		thread.join();
+
+	Threads.clear();
+}
+
+
+// stats
+//
+Twitch::FakeTwitchStats Twitch::FakeTwitch::stats() const
+{
+	FakeTwitchStats stats;
+
+	stats.Accepted = Count.Accepted;
+	stats.Connections = Count.Connections;
+	stats.LoggedIn = Count.LoggedIn;
+	stats.Logins = Count.Logins;
+	stats.AuthFailures = Count.AuthFailures;
+	stats.Joins = Count.Joins;
+	stats.Parts = Count.Parts;
+	stats.ChatSent = Count.ChatSent;
+	stats.ChatReceived = Count.ChatReceived;
+	stats.Pongs = Count.Pongs;
+	stats.Ignored = Count.Ignored;
+
+	return stats;
+}
+
+
+void Twitch::FakeTwitch::rejectLogins(const std::string &nick, bool reject)
+{
+	std::lock_guard<std::mutex> guard(Lock);
+
+	if (reject)
+		Rejected.insert(nick);
+	else
+		Rejected.erase(nick);
+}
+
+
+void Twitch::FakeTwitch::rejectAllLogins(bool reject)
+{
+	std::lock_guard<std::mutex> guard(Lock);
+	RejectAll = reject;
+}
+
+
+void Twitch::FakeTwitch::suspendChannel(const std::string &channel)
+{
+	std::lock_guard<std::mutex> guard(Lock);
+	Suspended.insert(channel);
+}
+
+
+void Twitch::FakeTwitch::broadcast(const std::string &line)
+{
+	_each([line](Session &session) { session.sendLine(line); });
+}
+
+
+// say
+//
+// sent to every connection that has joined the channel
+void Twitch::FakeTwitch::say(const std::string &channel, const std::string &user, const std::string &text)
+{
+	_each([channel, user, text](Session &session)
+	{
+		if (session.inChannel(channel))
+			session.say(channel, user, text, 0);
+	});
+}
+
+
+void Twitch::FakeTwitch::reconnectAll()
+{
+	broadcast(":tmi.twitch.tv RECONNECT");
+}
+
+
+void Twitch::FakeTwitch::dropAll()
+{
+	_each([](Session &session) { session.close(); });
+}
+
+
+std::vector<std::string> Twitch::FakeTwitch::chatReceived()
+{
+	std::lock_guard<std::mutex> guard(Lock);
+	return std::vector<std::string>(Chat.begin(), Chat.end());
+}
+
+
+std::vector<Twitch::Clock::duration> Twitch::FakeTwitch::pingLatencies()
+{
+	std::lock_guard<std::mutex> guard(Lock);
+	return std::exchange(Latencies, {});
+}
+
+
+// waitUntil
+//
+// polls the stats, which is plenty for tests and the load test's reports
+bool Twitch::FakeTwitch::waitUntil(std::function<bool(const FakeTwitchStats &)> done, Clock::duration timeout)
+{
+	auto until = Clock::now() + timeout;
+
+	while (!done(stats()))
+	{
+		if (Clock::now() >= until)
+			return false;
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	return true;
+}
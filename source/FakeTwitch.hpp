@@ -0,0 +1,178 @@
+/* FakeTwitch.hpp - Miles Shamo
+ *
+ * A stand-in for Twitch's IRC server, for tests
+ * and load testing (see tools/loadtest.cpp).
+ *
+ * It listens on the loopback interface and speaks
+ * enough of Twitch's IRC for a bot not to notice:
+ * CAP, PASS/NICK logins (with the welcome numerics),
+ * JOIN (with NAMES, USERSTATE and ROOMSTATE), PART,
+ * PING/PONG and PRIVMSG.  It can also turn logins
+ * away (as an expired token would be), refuse JOINs
+ * with Twitch's NOTICEs, send RECONNECT, or drop
+ * everyone as a network blip would.
+ *
+ * Chat load is generated per joined channel, at a
+ * rate that can be changed while it runs, as real
+ * looking tagged PRIVMSGs from a pool of viewers.
+ * Optionally it PINGs every connection regularly
+ * and times the PONGs, which gives the latency of
+ * the bots' read to write path under that load.
+ *
+ * Everything runs on its own io_context and
+ * threads, so it never shares a thread with the
+ * bots it is serving.  Every method may be called
+ * from any thread.
+ */
+
+#ifndef TWITCH_FAKE_TWITCH
+#define TWITCH_FAKE_TWITCH
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <asio.hpp>
+
+#include "RateLimiter.hpp"
+
+namespace Twitch
+{
+	struct FakeTwitchOptions
+	{
+		// 0 picks any free port (see port())
+		unsigned short Port = 0;
+		unsigned Threads = 1;
+
+		// chat lines a second generated in each channel, per connection in it
+		double ChatRate = 0;
+
+		// how many viewers that chat comes from
+		std::size_t Chatters = 50;
+
+		// every this many generated lines is a "!echo" (0 for none)
+		std::size_t CommandEvery = 0;
+
+		// how often every connection is PINGed and timed (zero for never)
+		Clock::duration PingInterval = Clock::duration::zero();
+	};
+
+	struct FakeTwitchStats
+	{
+		std::size_t Accepted = 0;		// connections since startup
+		std::size_t Connections = 0;	// connections open now
+		std::size_t LoggedIn = 0;		// of those, logged in
+		std::size_t Logins = 0;			// successful logins since startup
+		std::size_t AuthFailures = 0;
+		std::size_t Joins = 0;			// channels joined (each channel in a JOIN)
+		std::size_t Parts = 0;
+		std::size_t ChatSent = 0;		// PRIVMSGs sent to the bots
+		std::size_t ChatReceived = 0;	// PRIVMSGs from the bots
+		std::size_t Pongs = 0;			// answers to our timed PINGs
+		std::size_t Ignored = 0;		// lines sent before logging in (dropped)
+	};
+
+	class FakeTwitch
+	{
+		private:
+			class Session;
+
+			FakeTwitchOptions Options;
+
+			asio::io_context Context;
+			asio::executor_work_guard<asio::io_context::executor_type> Work;
+			asio::ip::tcp::acceptor Acceptor;
+
+			// the acceptor is only touched on this strand
+			asio::strand<asio::io_context::executor_type> AcceptStrand;
+
+			std::vector<std::thread> Threads;
+
+			// everyone connected, and the logins and channels we turn away
+			std::mutex Lock;
+			std::set<std::shared_ptr<Session>> Sessions;
+			std::set<std::string, std::less<>> Rejected;
+			std::set<std::string, std::less<>> Suspended;
+			bool RejectAll = false;
+			bool Stopping = false;
+
+			// the last few PRIVMSGs from the bots ("nick #channel :text")
+			std::deque<std::string> Chat;
+
+			// PONG round trips since the last call to pingLatencies
+			std::vector<Clock::duration> Latencies;
+
+			std::atomic<double> ChatRate;
+
+			struct Counters
+			{
+				std::atomic<std::size_t> Accepted{0}, Connections{0}, LoggedIn{0}, Logins{0},
+					AuthFailures{0}, Joins{0}, Parts{0}, ChatSent{0}, ChatReceived{0}, Pongs{0}, Ignored{0};
+			} Count;
+
+			void _accept();
+
+			// calls fn on every session's strand
+			void _each(std::function<void(Session &)> fn);
+
+			// used by the sessions
+			bool _rejects(std::string_view nick);
+			bool _suspended(std::string_view channel);
+			void _heard(std::string line);
+			void _timed(Clock::duration latency);
+			void _closed(const std::shared_ptr<Session> &session);
+
+		public:
+			explicit FakeTwitch(const FakeTwitchOptions &options = FakeTwitchOptions());
+			FakeTwitch(const FakeTwitch &) = delete;
+			~FakeTwitch();
+
+			// the port it's listening on
+			unsigned short port() const;
+
+			// closes every connection and stops (the destructor does this too)
+			void stop();
+
+			FakeTwitchStats stats() const;
+
+			// changes the generated chat rate (lines a second, per channel per connection)
+			void setChatRate(double perChannel) { ChatRate = perChannel; }
+
+			// turns away logins as a bad token would, for one user or for all
+			void rejectLogins(const std::string &nick, bool reject = true);
+			void rejectAllLogins(bool reject = true);
+
+			// refuses JOINs to a channel, as if it were suspended
+			void suspendChannel(const std::string &channel);
+
+			// sends a raw line (without "\r\n") to every connection
+			void broadcast(const std::string &line);
+
+			// a viewer says something in a channel
+			void say(const std::string &channel, const std::string &user, const std::string &text);
+
+			// asks every connection to reconnect, as Twitch does before maintenance
+			void reconnectAll();
+
+			// drops every connection without a word, like a network failure
+			void dropAll();
+
+			// the last PRIVMSGs the bots sent, as "nick #channel :text"
+			std::vector<std::string> chatReceived();
+
+			// the PONG round trips measured since the last call
+			std::vector<Clock::duration> pingLatencies();
+
+			// waits until done(stats()) is true, or the timeout passes
+			bool waitUntil(std::function<bool(const FakeTwitchStats &)> done, Clock::duration timeout);
+	};
+}
+#endif
@@ -0,0 +1,238 @@
+/* FolderWatcher.cpp - Miles Shamo
+ *
+ * Implementation of the inotify folder watcher
+ *
+ */
+
+#include "FolderWatcher.hpp"
+
+#include <dirent.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <utility>
+#include <vector>
+
+namespace
+{
+	// a file written and closed, moved in (an editor's rename over it) or removed
+	constexpr std::uint32_t WatchMask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE;
+}
+
+
+Twitch::FolderWatcher::FolderWatcher(asio::io_context &context, std::chrono::steady_clock::duration settle)
+	:	_Strand(asio::make_strand(context)),
+		Descriptor(context),
+		SettleTimer(context),
+		Settle(settle)
+{
+	int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+	if (fd >= 0)
+	{
+		Descriptor.assign(fd);
+		_read();
+	}
+}
+
+
+Twitch::FolderWatcher::~FolderWatcher()
+{
+	asio::error_code ignored;
+	Descriptor.close(ignored);
+}
+
+
+// watch
+//
+// inotify gives the same descriptor back for a folder it is
+// already watching, so watching again just swaps the callback
+bool Twitch::FolderWatcher::watch(const std::string &folder, Callback onChange)
+{
+	if (!Descriptor.is_open())
+		return false;
+
+	int wd = inotify_add_watch(Descriptor.native_handle(), folder.c_str(), WatchMask);
+	if (wd < 0)
+		return false;
+
+	std::lock_guard<std::mutex> guard(Lock);
+
+	Watches[wd] = Watch{folder, std::move(onChange)};
+	Descriptors[folder] = wd;
+
+	return true;
+}
+
+
+void Twitch::FolderWatcher::unwatch(const std::string &folder)
+{
+	std::lock_guard<std::mutex> guard(Lock);
+
+	auto found = Descriptors.find(folder);
+	if (found == Descriptors.end())
+		return;
+
+	inotify_rm_watch(Descriptor.native_handle(), found->second);
+
+	Watches.erase(found->second);
+	Descriptors.erase(found);
+}
+
+
+// stop
+//
+// forgets every watch now (so nothing more is reported), and
+// closes the descriptor on the strand, where the read is
+void Twitch::FolderWatcher::stop()
+{
+	{
+		std::lock_guard<std::mutex> guard(Lock);
+
+		Watches.clear();
+		Descriptors.clear();
+	}
+
+	asio::post(_Strand, [this]()
+	{
+		asio::error_code ignored;
+
+		Descriptor.close(ignored);
+		SettleTimer.cancel();
+	});
+}
+
+
+void Twitch::FolderWatcher::_read()
+{
+	Descriptor.async_read_some(asio::buffer(Events, sizeof(Events)),
+			asio::bind_executor(_Strand,
+				[this](const asio::error_code &e, std::size_t size)
+				{
+					_onRead(e, size);
+				}));
+}
+
+
+// _onRead
+//
+// A read always holds whole events.  Each names the file that
+// changed (or none, for the folder itself), and they're held
+// until the folder settles
+void Twitch::FolderWatcher::_onRead(const asio::error_code &e, std::size_t size)
+{
+	if (e)
+		return;
+
+	for (std::size_t offset = 0; offset + sizeof(inotify_event) <= size;)
+	{
+		auto *event = reinterpret_cast<const inotify_event *>(Events + offset);
+		offset += sizeof(inotify_event) + event->len;
+
+		// the kernel's queue filled up and events were lost, so any
+		// file could have changed
+		if (event->mask & IN_Q_OVERFLOW)
+		{
+			_changedAll();
+			continue;
+		}
+
+		// the folder went away (or was unwatched)
+		if (event->mask & IN_IGNORED)
+		{
+			std::lock_guard<std::mutex> guard(Lock);
+
+			auto found = Watches.find(event->wd);
+			if (found != Watches.end())
+			{
+				Descriptors.erase(found->second.Folder);
+				Watches.erase(found);
+			}
+
+			continue;
+		}
+
+		if (event->len > 0)
+			Changed.emplace(event->wd, std::string(event->name));
+	}
+
+	if (!Changed.empty() && !SettleArmed)
+	{
+		SettleArmed = true;
+
+		SettleTimer.expires_after(Settle);
+		SettleTimer.async_wait(asio::bind_executor(_Strand,
+					[this](const asio::error_code &e)
+					{
+						SettleArmed = false;
+
+						if (!e)
+							_settled();
+					}));
+	}
+
+	_read();
+}
+
+
+// _changedAll
+//
+// counts every file in every watched folder as changed (after an
+// overflow).  The folders are copied out first, so the lock isn't
+// held while they're listed
+void Twitch::FolderWatcher::_changedAll()
+{
+	std::vector<std::pair<int, std::string>> folders;
+
+	{
+		std::lock_guard<std::mutex> guard(Lock);
+
+		for (const auto &watch : Watches)
+			folders.emplace_back(watch.first, watch.second.Folder);
+	}
+
+	for (const auto &folder : folders)
+	{
+		DIR *listing = opendir(folder.second.c_str());
+		if (!listing)
+			continue;
+
+		while (dirent *entry = readdir(listing))
+		{
+			std::string name = entry->d_name;
+
+			if (name != "." && name != "..")
+				Changed.emplace(folder.first, std::move(name));
+		}
+
+		closedir(listing);
+	}
+}
+
+
+// _settled
+//
+// reports each changed file once.  The callbacks are copied out
+// first, so they can watch or unwatch without deadlocking
+void Twitch::FolderWatcher::_settled()
+{
+	auto changed = std::move(Changed);
+	Changed.clear();
+
+	for (const auto &file : changed)
+	{
+		Callback onChange;
+
+		{
+			std::lock_guard<std::mutex> guard(Lock);
+
+			auto found = Watches.find(file.first);
+			if (found == Watches.end())
+				continue;
+
+			onChange = found->second.OnChange;
+		}
+
+		onChange(file.second);
+	}
+}
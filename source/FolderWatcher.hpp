@@ -0,0 +1,96 @@
+/* FolderWatcher.hpp - Miles Shamo
+ *
+ * Watches client folders (with inotify) and says
+ * which of their files changed, so a running bot
+ * can pick up an edited channels.txt or command
+ * file without being restarted.
+ *
+ * Editors rarely save a file in one go (a write
+ * then a rename, or several writes), so changes are
+ * collected for a moment after the first one, and
+ * each file that changed is reported once.  If so
+ * many changes come at once that inotify drops some
+ * (its queue overflows), every file in every watched
+ * folder is reported, so nothing is missed.
+ *
+ * The inotify descriptor is read on the io_context
+ * like any socket; callbacks run there too, on the
+ * watcher's own strand.  watch() and unwatch() can
+ * be called from any thread, but the io_context must
+ * be stopped before the watcher is destroyed.
+ */
+
+#ifndef TWITCH_FOLDER_WATCHER
+#define TWITCH_FOLDER_WATCHER
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+
+#include <asio.hpp>
+
+namespace Twitch
+{
+	class FolderWatcher
+	{
+		public:
+			// called with the name of a file in the folder that changed
+			using Callback = std::function<void(const std::string &file)>;
+
+		private:
+			asio::strand<asio::io_context::executor_type> _Strand;
+
+			// the inotify instance (not open if inotify isn't available)
+			asio::posix::stream_descriptor Descriptor;
+
+			// waits out a burst of changes
+			asio::steady_timer SettleTimer;
+			std::chrono::steady_clock::duration Settle;
+
+			struct Watch
+			{
+				std::string Folder;
+				Callback OnChange;
+			};
+
+			// guards the two maps below (watch and unwatch come from any thread)
+			std::mutex Lock;
+			std::map<int, Watch> Watches;
+			std::map<std::string, int> Descriptors;
+
+			// files changed since the timer was armed, by watch descriptor (strand only)
+			std::set<std::pair<int, std::string>> Changed;
+			bool SettleArmed = false;
+
+			// inotify events are read into this
+			alignas(8) char Events[4096];
+
+			void _read();
+			void _onRead(const asio::error_code &e, std::size_t size);
+			void _changedAll();
+			void _settled();
+
+		public:
+			FolderWatcher(asio::io_context &context,
+					std::chrono::steady_clock::duration settle = std::chrono::milliseconds(250));
+			~FolderWatcher();
+
+			FolderWatcher(const FolderWatcher &) = delete;
+			FolderWatcher &operator=(const FolderWatcher &) = delete;
+
+			// starts (or, for a folder already watched, replaces) a watch.
+			// Returns false if the folder can't be watched
+			bool watch(const std::string &folder, Callback onChange);
+
+			// stops watching a folder
+			void unwatch(const std::string &folder);
+
+			// stops watching everything
+			void stop();
+	};
+}
+#endif
@@ -0,0 +1,161 @@
+/* HTTPSPool.cpp - Miles Shamo
+ *
+ * Implementation of the HTTPS session pool
+ *
+ */
+
+#include "HTTPSPool.hpp"
+
+#include <utility>
+
+#include <Poco/Exception.h>
+#include <Poco/Timespan.h>
+
+Twitch::HTTPSPool::HTTPSPool(std::size_t maxPerHost, std::size_t maxIdle, Poco::Net::Context::Ptr context)
+	:	TLS(context),
+		MaxPerHost(maxPerHost),
+		MaxIdle(maxIdle)
+{
+	if (!TLS)
+	{
+		TLS = new Poco::Net::Context(Poco::Net::Context::CLIENT_USE, "", "", "",
+				Poco::Net::Context::VERIFY_RELAXED, 9, true);
+	}
+
+	// lets a new connection resume the last one's TLS session
+	TLS->enableSessionCache(true);
+}
+
+
+// acquire
+//
+// An idle session is reused if there is one.  A new one is only
+// opened if the host is under its limit; otherwise we wait for a
+// lease on that host to end.
+Twitch::HTTPSPool::Lease Twitch::HTTPSPool::acquire(const Poco::URI &uri, bool fresh)
+{
+	std::string key = uri.getHost() + ":" + std::to_string(uri.getPort());
+
+	std::unique_lock<std::mutex> guard(Lock);
+
+	Host &host = Hosts[key];
+
+	Freed.wait(guard, [&]()
+	{
+		return host.Active < MaxPerHost;
+	});
+
+	host.Active++;
+
+	// if one idle session was closed under us, the rest likely were too
+	if (fresh)
+		host.Idle.clear();
+
+	if (!host.Idle.empty())
+	{
+		auto session = std::move(host.Idle.back());
+		host.Idle.pop_back();
+
+		return Lease(this, std::move(key), std::move(session), true);
+	}
+
+	auto session = std::make_unique<Session>(uri.getHost(), uri.getPort(), TLS, host.TLSSession);
+
+	session->setKeepAlive(true);
+	session->setKeepAliveTimeout(Poco::Timespan(30, 0));
+	session->setTimeout(Poco::Timespan(10, 0));
+
+	return Lease(this, std::move(key), std::move(session), false);
+}
+
+
+// exchange
+//
+// The first lease is handed back (closed) before the retry asks for
+// another, so a host at its limit doesn't wait on itself.  A request
+// on a new session isn't retried: the server really is unreachable
+void Twitch::HTTPSPool::exchange(const Poco::URI &uri, const std::function<void(Lease &)> &request)
+{
+	{
+		Lease lease = acquire(uri);
+
+		try
+		{
+			request(lease);
+			return;
+		}
+		catch (const Poco::IOException &)
+		{
+			if (!lease.Reused)
+				throw;
+
+			lease.Reusable = false;
+		}
+	}
+
+	Lease lease = acquire(uri, true);
+	request(lease);
+}
+
+
+// _release
+//
+// A session goes back to the idle list only if its response was read
+// in full (or the next request would read the end of this one).  Either
+// way, its TLS session is kept to resume on the next new connection.
+void Twitch::HTTPSPool::_release(const std::string &key, std::unique_ptr<Session> session, bool reusable)
+{
+	{
+		std::lock_guard<std::mutex> guard(Lock);
+
+		Host &host = Hosts[key];
+
+		host.Active--;
+
+		if (session && session->connected())
+		{
+			auto tls = session->sslSession();
+			if (tls)
+				host.TLSSession = tls;
+		}
+
+		if (reusable && session && host.Idle.size() < MaxIdle)
+			host.Idle.push_back(std::move(session));
+	}
+
+	Freed.notify_all();
+}
+
+
+std::size_t Twitch::HTTPSPool::idleCount()
+{
+	std::lock_guard<std::mutex> guard(Lock);
+
+	std::size_t idle = 0;
+	for (auto &host : Hosts)
+		idle += host.second.Idle.size();
+
+	return idle;
+}
+
+
+//--------------------------------------------------------
+// Lease
+
+Twitch::HTTPSPool::Lease::Lease(HTTPSPool *pool, std::string key, std::unique_ptr<Session> session, bool reused)
+	:	Pool(pool),
+		Key(std::move(key)),
+		Connection(std::move(session)),
+		Reused(reused)
+{
+}
+
+
+Twitch::HTTPSPool::Lease::~Lease()
+{
+	// moved from
+	if (!Pool || !Connection)
+		return;
+
+	Pool->_release(Key, std::move(Connection), Reusable);
+}
@@ -0,0 +1,120 @@
+/* HTTPSPool.hpp - Miles Shamo
+ *
+ * A shared pool of keep-alive HTTPS sessions.
+ *
+ * Every request to Twitch's OAuth and Helix
+ * endpoints used to open its own session, paying
+ * for a TCP connect and a full TLS handshake before
+ * the request itself.  Sessions here are kept open
+ * after use and handed to the next request for the
+ * same host, so a request normally costs just the
+ * one round trip.  When a connection has to be
+ * opened again (the server closed it), the TLS
+ * session from the last one is resumed instead of
+ * negotiated from scratch.
+ *
+ * A session left idle may have been closed by the
+ * server without our noticing until it's used, so a
+ * request that fails on a reused session is tried
+ * once more on a new one (see exchange).
+ *
+ * Each host is limited to a few sessions at once;
+ * past that, acquire() waits for one to be freed.
+ * As that (and any request) blocks, the pool must
+ * never be used from an IO thread (see TokenService).
+ */
+
+#ifndef TWITCH_HTTPS_POOL
+#define TWITCH_HTTPS_POOL
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <Poco/URI.h>
+#include <Poco/Net/Context.h>
+#include <Poco/Net/HTTPSClientSession.h>
+
+namespace Twitch
+{
+	class HTTPSPool
+	{
+		private:
+			using Session = Poco::Net::HTTPSClientSession;
+
+			struct Host
+			{
+				// open sessions waiting to be reused
+				std::vector<std::unique_ptr<Session>> Idle;
+
+				// sessions currently lent out
+				std::size_t Active = 0;
+
+				// the last TLS session, to resume on a new connection
+				Poco::Net::Session::Ptr TLSSession;
+			};
+
+			std::mutex Lock;
+			std::condition_variable Freed;
+
+			// by "host:port"
+			std::map<std::string, Host> Hosts;
+
+			Poco::Net::Context::Ptr TLS;
+
+			std::size_t MaxPerHost;
+			std::size_t MaxIdle;
+
+			void _release(const std::string &key, std::unique_ptr<Session> session, bool reusable);
+
+		public:
+			// A session on loan from the pool.  Call reuse() once the whole response
+			// has been read to hand it back open; otherwise it's closed when dropped
+			class Lease
+			{
+				private:
+					HTTPSPool *Pool;
+					std::string Key;
+					std::unique_ptr<Session> Connection;
+					bool Reusable = false;
+
+					// whether the session was used before (rather than new)
+					bool Reused;
+
+					friend HTTPSPool;
+					Lease(HTTPSPool *pool, std::string key, std::unique_ptr<Session> session, bool reused);
+
+				public:
+					Lease(Lease &&other) = default;
+					Lease &operator=(Lease &&) = delete;
+					~Lease();
+
+					Session &session() { return *Connection; }
+
+					// the response was read in full, so the connection can be used again
+					void reuse() { Reusable = true; }
+			};
+
+			// With no context given, certificates are checked against the system's CAs
+			explicit HTTPSPool(std::size_t maxPerHost = 4, std::size_t maxIdle = 2,
+					Poco::Net::Context::Ptr context = Poco::Net::Context::Ptr());
+
+			// Borrows a session for the URI's host, waiting if the host is at its limit.
+			// A fresh one is always newly opened (and the host's idle ones are closed)
+			Lease acquire(const Poco::URI &uri, bool fresh = false);
+
+			// Runs a whole request and response on a borrowed session.  If a reused
+			// session fails with a network error it's dropped, and the request is
+			// run once more on a fresh one; any other failure is passed on
+			void exchange(const Poco::URI &uri, const std::function<void(Lease &)> &request);
+
+			// sessions for every host, open and idle (for the console and tests)
+			std::size_t idleCount();
+	};
+}
+#endif
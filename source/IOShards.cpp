@@ -0,0 +1,374 @@
+/* IOShards.cpp - Miles Shamo
+ *
+ * Implementation of the sharded IO runtime
+ * and the thread sizing
+ *
+ */
+
+#include "IOShards.hpp"
+
+#include <algorithm>
+#include <ctime>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+Twitch::IOShards::IOShards(asio::io_context &main)
+{
+	Shards.push_back({&main, nullptr, nullptr, 0});
+}
+
+
+Twitch::IOShards::~IOShards()
+{
+	stop();
+}
+
+
+// start
+//
+// The main context's work guard belongs to the Overseer; the
+// extra contexts get their own so they don't run out of work
+// before any bots are placed on them
+void Twitch::IOShards::start(std::size_t threads, bool sharded, bool pin, Runner run,
+		bool resizable, const ThreadSizing &sizing)
+{
+	std::lock_guard<std::mutex> guard(Lock);
+
+	Run = std::move(run);
+	Sharded = sharded;
+
+	std::size_t cores = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+
+	if (threads == 0)
+		threads = cores;
+
+	if (sharded)
+	{
+		for (std::size_t i = 1; i < threads; i++)
+		{
+			Shard shard;
+			shard.Owned = std::make_unique<asio::io_context>(1);
+			shard.Context = shard.Owned.get();
+			shard.Work = std::make_unique<asio::executor_work_guard<asio::io_context::executor_type>>(
+					asio::make_work_guard(*shard.Context));
+
+			Shards.push_back(std::move(shard));
+		}
+
+		for (std::size_t i = 0; i < threads; i++)
+			_spawn(*Shards[i].Context, i % cores, pin);
+
+		Target = threads;
+		return;
+	}
+
+	// shared mode
+	Sizing = sizing;
+	Resizable = resizable;
+
+	if (!Resizable)
+		Sizing.Min = Sizing.Max = threads;
+	if (Sizing.Min == 0)
+		Sizing.Min = 1;
+	if (Sizing.Max == 0)
+		Sizing.Max = std::max(cores * 2, Sizing.Min);
+
+	Target = std::clamp(threads, Sizing.Min, Sizing.Max);
+
+	for (std::size_t i = 0; i < Target; i++)
+		_spawn(*Shards.front().Context, i % cores, pin);
+
+	if (Resizable)
+	{
+		Sampler = std::make_unique<asio::steady_timer>(*Shards.front().Context);
+		LastSample = std::chrono::steady_clock::now();
+		LastCPU = _cpuTime();
+
+		_scheduleSample();
+	}
+}
+
+
+void Twitch::IOShards::stop()
+{
+	std::vector<Worker> workers;
+
+	{
+		std::lock_guard<std::mutex> guard(Lock);
+
+		Stopping = true;
+
+		for (auto &shard : Shards)
+		{
+			shard.Work.reset();
+			shard.Context->stop();
+		}
+
+		workers.swap(Workers);
+	}
+
+	for (auto &worker : workers)
+	{
+		if (worker.Thread.joinable())
+			worker.Thread.join();
+	}
+}
+
+
+// resize
+//
+// New threads just start running the main context.  To retire one
+// we post a handler that throws Retire; whichever thread picks it
+// up leaves its run loop once it gets there, after finishing
+// whatever it was doing.
+void Twitch::IOShards::resize(std::size_t threads)
+{
+	std::lock_guard<std::mutex> guard(Lock);
+
+	if (Sharded || Stopping)
+		return;
+
+	threads = std::max<std::size_t>(threads, 1);
+
+	_reap();
+
+	asio::io_context &main = *Shards.front().Context;
+
+	std::size_t cores = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+
+	for (; Target < threads; Target++)
+		_spawn(main, Target % cores, false);
+
+	for (; Target > threads; Target--)
+	{
+		asio::post(main, []()
+		{
+			throw Retire();
+		});
+	}
+}
+
+
+// _spawn
+//
+// Retire ends the Runner as it isn't caught there, so it's caught here
+void Twitch::IOShards::_spawn(asio::io_context &context, std::size_t core, bool pin)
+{
+	Worker worker;
+	worker.Finished = std::make_shared<std::atomic<bool>>(false);
+
+	auto finished = worker.Finished;
+	auto run = Run;
+
+	worker.Thread = std::thread([run, &context, finished]()
+	{
+		try
+		{
+			run(context);
+		}
+		catch (const Retire &)
+		{
+		}
+
+		*finished = true;
+	});
+
+	if (pin)
+		_pin(worker.Thread, core);
+
+	Workers.push_back(std::move(worker));
+}
+
+
+// _reap
+//
+// joins the threads that have retired (so joining never waits)
+void Twitch::IOShards::_reap()
+{
+	for (auto iter = Workers.begin(); iter != Workers.end();)
+	{
+		if (*iter->Finished)
+		{
+			iter->Thread.join();
+			iter = Workers.erase(iter);
+		}
+		else
+		{
+			++iter;
+		}
+	}
+}
+
+
+void Twitch::IOShards::_scheduleSample()
+{
+	Sampler->expires_after(Sizing.Interval);
+	Sampler->async_wait([this](const asio::error_code &e)
+	{
+		if (!e)
+			_sample();
+	});
+}
+
+
+// _sample
+//
+// How late the sampler's own timer ran says how long handlers are
+// queueing for a thread; CPU time over wall time (per thread) says
+// how busy the threads are.  Either being high adds a thread at
+// once, while retiring one waits for a run of quiet samples.
+void Twitch::IOShards::_sample()
+{
+	using namespace std::chrono;
+
+	std::size_t target = 0;
+
+	{
+		std::lock_guard<std::mutex> guard(Lock);
+
+		if (Stopping)
+			return;
+
+		auto now = steady_clock::now();
+		auto cpu = _cpuTime();
+
+		Latency = std::max(duration_cast<microseconds>(now - Sampler->expiry()), microseconds::zero());
+
+		double wall = duration<double>(now - LastSample).count() * Target;
+		Busy = wall > 0 ? duration<double>(cpu - LastCPU).count() / wall : 0;
+
+		LastSample = now;
+		LastCPU = cpu;
+
+		target = Target;
+
+		if (Latency > Sizing.GrowLatency || Busy > Sizing.GrowBusy)
+		{
+			QuietSamples = 0;
+
+			if (Target < Sizing.Max)
+				target = Target + 1;
+		}
+		else if (Latency < Sizing.ShrinkLatency && Busy < Sizing.ShrinkBusy)
+		{
+			if (++QuietSamples >= Sizing.ShrinkAfter && Target > Sizing.Min)
+			{
+				QuietSamples = 0;
+				target = Target - 1;
+			}
+		}
+		else
+		{
+			QuietSamples = 0;
+		}
+	}
+
+	resize(target);
+
+	_scheduleSample();
+}
+
+
+asio::io_context &Twitch::IOShards::place()
+{
+	std::lock_guard<std::mutex> guard(Lock);
+
+	Shard *least = &Shards.front();
+
+	for (auto &shard : Shards)
+	{
+		if (shard.Load < least->Load)
+			least = &shard;
+	}
+
+	least->Load++;
+
+	return *least->Context;
+}
+
+
+void Twitch::IOShards::release(asio::io_context &context)
+{
+	std::lock_guard<std::mutex> guard(Lock);
+
+	for (auto &shard : Shards)
+	{
+		if (shard.Context == &context && shard.Load > 0)
+		{
+			shard.Load--;
+			return;
+		}
+	}
+}
+
+
+std::vector<std::size_t> Twitch::IOShards::loads()
+{
+	std::lock_guard<std::mutex> guard(Lock);
+
+	std::vector<std::size_t> counts;
+	for (auto &shard : Shards)
+		counts.push_back(shard.Load);
+
+	return counts;
+}
+
+
+std::size_t Twitch::IOShards::threadCount()
+{
+	std::lock_guard<std::mutex> guard(Lock);
+
+	return Target;
+}
+
+
+std::chrono::microseconds Twitch::IOShards::latency()
+{
+	std::lock_guard<std::mutex> guard(Lock);
+
+	return Latency;
+}
+
+
+double Twitch::IOShards::busy()
+{
+	std::lock_guard<std::mutex> guard(Lock);
+
+	return Busy;
+}
+
+
+void Twitch::IOShards::_pin(std::thread &thread, std::size_t core)
+{
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(core, &set);
+
+	pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+	(void)thread;
+	(void)core;
+#endif
+}
+
+
+std::chrono::microseconds Twitch::IOShards::_cpuTime()
+{
+#if defined(__unix__) || defined(__APPLE__)
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	return std::chrono::seconds(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+		std::chrono::microseconds(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+#else
+	return std::chrono::microseconds(std::clock() * 1000000LL / CLOCKS_PER_SEC);
+#endif
+}
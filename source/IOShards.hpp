@@ -0,0 +1,161 @@
+/* IOShards.hpp - Miles Shamo
+ *
+ * Spreads the Overseer's IO work over threads.
+ *
+ * By default every thread runs the one shared
+ * io_context, so every bot's strand goes through
+ * that context's single queue and lock.  With many
+ * threads and thousands of bots that queue is where
+ * they all wait.
+ *
+ * In sharded mode each thread runs an io_context of
+ * its own (optionally pinned to a core), and each new
+ * bot is placed on whichever has the fewest bots
+ * (stopped bots are released, so it's the bots
+ * running now that count).  A
+ * bot only ever uses the context it was built with,
+ * through its strand, so handlers can't tell which
+ * mode they're running in.  The Overseer's own work
+ * (admission control, token renewals) stays on the
+ * first, main context.
+ *
+ * In shared mode the number of threads follows the
+ * load.  Every so often we look at how late a timer
+ * on the main context fires (how long handlers are
+ * queueing) and how much CPU the process used, and
+ * add or retire a thread.  Threads are retired by
+ * posting them a handler that ends their run, so no
+ * connection notices.  Sharded mode keeps one thread
+ * per context, as its contexts aren't locked.
+ */
+
+#ifndef TWITCH_IO_SHARDS
+#define TWITCH_IO_SHARDS
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <asio.hpp>
+
+namespace Twitch
+{
+	// how the shared mode thread count follows the load
+	struct ThreadSizing
+	{
+		// bounds (zero for the defaults, from the number of cores)
+		std::size_t Min = 0;
+		std::size_t Max = 0;
+
+		// how often the load is looked at
+		std::chrono::milliseconds Interval = std::chrono::seconds(1);
+
+		// grow when handlers wait this long, or the threads are this busy
+		std::chrono::microseconds GrowLatency = std::chrono::milliseconds(2);
+		double GrowBusy = 0.75;
+
+		// shrink after this many samples in a row under both of these
+		std::chrono::microseconds ShrinkLatency = std::chrono::microseconds(500);
+		double ShrinkBusy = 0.25;
+		unsigned ShrinkAfter = 5;
+	};
+
+	class IOShards
+	{
+		public:
+			// runs one context on the calling thread until it's stopped
+			using Runner = std::function<void(asio::io_context &)>;
+
+		private:
+			struct Shard
+			{
+				// the main context is the Overseer's; the rest are ours
+				asio::io_context *Context;
+				std::unique_ptr<asio::io_context> Owned;
+				std::unique_ptr<asio::executor_work_guard<asio::io_context::executor_type>> Work;
+
+				// bots placed here and not yet released
+				std::size_t Load = 0;
+			};
+
+			struct Worker
+			{
+				std::thread Thread;
+				std::shared_ptr<std::atomic<bool>> Finished;
+			};
+
+			// thrown from a handler to end the thread running it
+			struct Retire {};
+
+			std::mutex Lock;
+
+			std::vector<Shard> Shards;
+			std::vector<Worker> Workers;
+
+			Runner Run;
+			bool Sharded = false;
+			bool Stopping = false;
+
+			// threads that should be running (shared mode), and their bounds
+			std::size_t Target = 0;
+			ThreadSizing Sizing;
+			bool Resizable = false;
+
+			// load sampling (on the main context)
+			std::unique_ptr<asio::steady_timer> Sampler;
+			std::chrono::steady_clock::time_point LastSample;
+			std::chrono::microseconds LastCPU;
+			unsigned QuietSamples = 0;
+
+			// the latest measurements
+			std::chrono::microseconds Latency;
+			double Busy = 0;
+
+			void _spawn(asio::io_context &context, std::size_t core, bool pin);
+			void _reap();
+			void _sample();
+			void _scheduleSample();
+
+			// pins a thread to one core (where the platform allows it)
+			static void _pin(std::thread &thread, std::size_t core);
+
+			// CPU time used by the whole process so far
+			static std::chrono::microseconds _cpuTime();
+
+		public:
+			explicit IOShards(asio::io_context &main);
+			~IOShards();
+
+			// Starts the threads.  Shared: they all run the main context, threads is
+			// where they start (0 to size from the cores) and they're resized with the
+			// load if resizable.  Sharded: one context per thread, the first the main one
+			void start(std::size_t threads, bool sharded, bool pin, Runner run,
+					bool resizable = true, const ThreadSizing &sizing = ThreadSizing());
+
+			// stops every context and joins the threads
+			void stop();
+
+			// sets the number of threads (shared mode only)
+			void resize(std::size_t threads);
+
+			// the context a new bot should be built on
+			asio::io_context &place();
+
+			// a bot placed on context has been stopped
+			void release(asio::io_context &context);
+
+			// bots on each context
+			std::vector<std::size_t> loads();
+
+			// threads currently running, and the latest load measurements
+			std::size_t threadCount();
+			std::chrono::microseconds latency();
+			double busy();
+	};
+}
+#endif
@@ -0,0 +1,166 @@
+/* IRCCommand.hpp - Miles Shamo
+ *
+ * Every IRC command we expect from Twitch, and
+ * a perfect hash from a command's text to it,
+ * built at compile time.
+ *
+ * The IRCCorrelator used to find a command's
+ * handler in a std::map, which is a string compare
+ * at every level of the tree on every line we read.
+ * Since the set of commands is small and fixed, the
+ * hash is instead seeded (by the compiler) so that
+ * no two of them share a slot in a 128 entry table.
+ * Looking up a command is then one hash of its text,
+ * one table load and one string compare to make sure
+ * it really was that command.
+ *
+ * Anything not listed here is IRCCommand::Unknown.
+ * Adding a command means adding it to the enum and
+ * to IRCCommandNames in the same place; if the new
+ * set doesn't fit the table, the build fails.
+ */
+
+#ifndef TWITCH_IRC_COMMAND
+#define TWITCH_IRC_COMMAND
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace Twitch
+{
+	enum class IRCCommand : std::uint8_t
+	{
+		// messages
+		Privmsg,
+		Notice,
+		UserNotice,
+		Whisper,
+
+		// connection
+		Ping,
+		Pong,
+		Cap,
+		Reconnect,
+
+		// channels and their state
+		Join,
+		Part,
+		UserState,
+		GlobalUserState,
+		RoomState,
+		ClearChat,
+		ClearMsg,
+		HostTarget,
+
+		// numeric replies
+		Welcome,		// 001
+		YourHost,		// 002
+		Created,		// 003
+		MyInfo,			// 004
+		NamesReply,		// 353
+		EndOfNames,		// 366
+		Motd,			// 372
+		MotdStart,		// 375
+		EndOfMotd,		// 376
+		UnknownCommand,	// 421
+
+		// anything else (this must stay last)
+		Unknown
+	};
+
+	constexpr std::size_t IRCCommandCount = static_cast<std::size_t>(IRCCommand::Unknown);
+
+	// the text of each command, in the order of the enum
+	constexpr std::array<std::string_view, IRCCommandCount> IRCCommandNames =
+	{
+		"PRIVMSG", "NOTICE", "USERNOTICE", "WHISPER",
+		"PING", "PONG", "CAP", "RECONNECT",
+		"JOIN", "PART", "USERSTATE", "GLOBALUSERSTATE", "ROOMSTATE", "CLEARCHAT", "CLEARMSG", "HOSTTARGET",
+		"001", "002", "003", "004", "353", "366", "372", "375", "376", "421"
+	};
+
+	namespace IRCCommandHash
+	{
+		constexpr std::size_t TableSize = 128;
+
+		// FNV-1a, started from a seed
+		constexpr std::uint32_t hash(std::string_view text, std::uint32_t seed)
+		{
+			std::uint32_t h = 2166136261u ^ seed;
+
+			for (char c : text)
+			{
+				h ^= static_cast<unsigned char>(c);
+				h *= 16777619u;
+			}
+
+			return h ^ (h >> 16);
+		}
+
+		constexpr std::size_t slot(std::string_view text, std::uint32_t seed)
+		{
+			return hash(text, seed) & (TableSize - 1);
+		}
+
+		// the first seed that puts every command in a slot of its own (0 if none is found)
+		constexpr std::uint32_t findSeed()
+		{
+			for (std::uint32_t seed = 1; seed < 10000; seed++)
+			{
+				bool used[TableSize] = {};
+				bool collides = false;
+
+				for (auto name : IRCCommandNames)
+				{
+					auto index = slot(name, seed);
+
+					collides = collides || used[index];
+					used[index] = true;
+				}
+
+				if (!collides)
+					return seed;
+			}
+
+			return 0;
+		}
+
+		constexpr std::uint32_t Seed = findSeed();
+		static_assert(Seed != 0, "no perfect hash for the IRC commands; try a bigger table");
+
+		constexpr std::array<IRCCommand, TableSize> buildTable()
+		{
+			std::array<IRCCommand, TableSize> table = {};
+
+			for (auto &entry : table)
+				entry = IRCCommand::Unknown;
+
+			for (std::size_t i = 0; i < IRCCommandCount; i++)
+				table[slot(IRCCommandNames[i], Seed)] = static_cast<IRCCommand>(i);
+
+			return table;
+		}
+
+		constexpr std::array<IRCCommand, TableSize> Table = buildTable();
+	}
+
+	// the command a line's command text names (IRCCommand::Unknown if it isn't one of ours)
+	constexpr IRCCommand ircCommand(std::string_view text)
+	{
+		IRCCommand found = IRCCommandHash::Table[IRCCommandHash::slot(text, IRCCommandHash::Seed)];
+
+		if (found == IRCCommand::Unknown || IRCCommandNames[static_cast<std::size_t>(found)] != text)
+			return IRCCommand::Unknown;
+
+		return found;
+	}
+
+	// the text of a command (empty for IRCCommand::Unknown)
+	constexpr std::string_view ircCommandName(IRCCommand command)
+	{
+		return command == IRCCommand::Unknown ? std::string_view() : IRCCommandNames[static_cast<std::size_t>(command)];
+	}
+}
+#endif
@@ -1,20 +1,19 @@
 /* IRCCorrelator.cpp - Miles Shamo
  *
  * This is the implementation file for
- * the IRCCorrelator, a glorified map
- * of IRC command strings to functions
+ * the IRCCorrelator, a glorified table
+ * of IRC commands to functions
  * handling those commands.  
  *
  * This file mainly implements the
- * constructor, where the map is
+ * constructor, where the table is
  * populated with each command.
  *
  * Each command is a lambda expression
  * with a matching argument signature.
  *
- * All return true if successful and false otherwise;
- * other necessary data is returned through the 
- * IRCResults struct in the function signature.
+ * All return a short description of what
+ * they did, which the caller writes to the log.
  *
  */
 
@@ -25,25 +24,19 @@
 // IRCBot included for use
 #include "TIRCBot.hpp"
 
-// TODO - delete
-#include <iostream>
-
-#include <regex>
-
 using std::string;
 
-// the constructor which populates the map
+// the constructor which populates the handlers
 Twitch::IRCCorrelator::IRCCorrelator()
 {
 	// for reference in ALL commands:
 	//	
-	// The smatch's capture groups are as follows
-	// [0] - Entire command (0-1)@TAGS (0-1):PREFIX COMMAND PARAMETERS :FINAL PARAMETER
-	// [1] - All tags supplied (if any)
-	// [2] - Prefix (if any)
-	// [3] - Command (all caps or number if correct form; this is more general)
-	// [4] - Parameters
-	// [5] - Optional final parameter
+	// The IRCMessage's fields are as follows (see IRCMessage.hpp)
+	// tags()    - All tags supplied (if any), looked up with tag()/rawTag()
+	// prefix()  - Prefix (if any), nick() gives the user in it
+	// command() - Command (all caps or number if correct form; this is more general)
+	// params()  - Parameters, channel() gives the first
+	// text()    - Optional final parameter
 
 
 	// NOTICE
@@ -56,9 +49,9 @@ Twitch::IRCCorrelator::IRCCorrelator()
 	// to record, but often require no response.  Thus, unless
 	// the message specifically requires a response, we only
 	// record.
-	SFM["NOTICE"] = [](std::smatch &Sm, Twitch::IRCBot *Caller) -> string
+	Handlers[_slot(IRCCommand::Notice)] = [](const IRCMessage &Msg, Twitch::IRCBot *Caller) -> const char *
 	{
-		if (Sm[5].str() == "Login authentication failed") // need to restart
+		if (Msg.text() == "Login authentication failed") // need to restart
 		{
 			// creates proper token path
 			auto cPath = Poco::Path(Caller->Path);
@@ -66,57 +59,116 @@ Twitch::IRCCorrelator::IRCCorrelator()
 			throw loginException("IRCCorrelator: AUTH FAILED", Caller, cPath);
 		}
 
+		// Twitch refusing a JOIN for good (suspended or banned from the channel)
+		std::string_view id;
+		if (Msg.rawTag("msg-id", id) &&
+			(id == "msg_channel_suspended" || id == "msg_banned" || 
+			 id == "msg_channel_blocked"   || id == "tos_ban"))
+		{
+			Caller->Joins.failed(Msg.channel());
+
+			return R"(Command NOTICE recieved, channel can't be joined)";
+		}
+
 		return R"(Command NOTICE recieved)";
 	};
 
 
+	// 001 (RPL_WELCOME)
+	//
+	// The first reply to a successful login.  Once we get
+	// here the connection is good, so the reconnect backoff
+	// starts over.
+	Handlers[_slot(IRCCommand::Welcome)] = [](const IRCMessage &, Twitch::IRCBot *Caller) -> const char *
+	{
+		Caller->loggedIn();
+
+		return R"(Command 001 recieved, logged in)";
+	};
+
+
+	// RECONNECT
+	//
+	// Twitch sends this before restarting the server we're
+	// on.  It will drop us soon anyway, so we go first and
+	// connect again (to a fresh server) right away.
+	Handlers[_slot(IRCCommand::Reconnect)] = [](const IRCMessage &, Twitch::IRCBot *Caller) -> const char *
+	{
+		Caller->reconnect();
+
+		return R"(Command RECONNECT recieved, reconnecting)";
+	};
+
+
+	// JOIN
+	//
+	// With the membership capability we see every JOIN in our
+	// channels, including our own.  Ours confirm that a channel
+	// was joined (see JoinScheduler.hpp); everyone else's are only
+	// of interest to the log.  One for a channel that was dropped
+	// from channels.txt while its JOIN was out is left straight away
+	Handlers[_slot(IRCCommand::Join)] = [](const IRCMessage &Msg, Twitch::IRCBot *Caller) -> const char *
+	{
+		if (Msg.nick() != Caller->Token.username)
+			return R"(Command JOIN recieved)";
+
+		if (!Caller->Joins.joined(Msg.channel()))
+		{
+			Caller->write({"PART ", Msg.channel()});
+
+			return R"(Command JOIN recieved, channel no longer wanted)";
+		}
+
+		return R"(Command JOIN recieved, channel joined)";
+	};
+
+
 	// PING
 	//
 	// Ping commands are used to keep connection alive.  
 	// It is simply a request for a matching "pong" response
-	SFM["PING"] = [](std::smatch &Sm, Twitch::IRCBot *Caller) -> string
+	Handlers[_slot(IRCCommand::Ping)] = [](const IRCMessage &Msg, Twitch::IRCBot *Caller) -> const char *
 	{
-		// queues an output
-		Caller->write("PONG :" + Sm[5].str());
+		// queues an output (ahead of anything else waiting)
+		Caller->write({"PONG :", Msg.text()}, Priority::Protocol);
 
 		// temporary write
-		Caller->write("PRIVMSG #baricus :Hi!  This is a Bot (not the streamer, just whats typing) that I'm working on.  I'm currently working on setting up actual commands and I thought I might as well stream it.  ");
+		Caller->write("PRIVMSG #baricus :Hi!  This is a Bot (not the streamer, just whats typing) that I'm working on.  I'm currently working on setting up actual commands and I thought I might as well stream it.  ", Priority::Bulk);
 
 		return R"(Command PING recieved)";
 	};
 
 
+	// USERSTATE
+	//
+	// USERSTATE is sent whenever we join or speak in a channel
+	// and tells us about ourselves there.  We only care whether
+	// we're a moderator (or the broadcaster), which raises our
+	// PRIVMSG rate limits in that channel.
+	Handlers[_slot(IRCCommand::UserState)] = [](const IRCMessage &Msg, Twitch::IRCBot *Caller) -> const char *
+	{
+		std::string_view mod, badges;
+
+		bool isModerator = (Msg.rawTag("mod", mod) && mod == "1") ||
+			(Msg.rawTag("badges", badges) && badges.find("broadcaster/") != std::string_view::npos);
+
+		Caller->Acct->Chat.setModerator(Msg.channel(), isModerator);
+
+		return isModerator ? R"(Command USERSTATE recieved, moderator)" 
+						   : R"(Command USERSTATE recieved, not a moderator)";
+	};
+
+
 	// PRIVMSG
 	//
 	// PRIVMSG is (since this is a client) a message sent to us,
 	// either because it was sent into a channel, or sent directly.
 	//
-	SFM["PRIVMSG"] = [](std::smatch &sm, Twitch::IRCBot *Caller) -> string
+	// User commands ("!name args") in it never get here; the bot
+	// runs those itself against its own view of the shared commands
+	// (see IRCBot::_dispatchToChannel and CommandTable.hpp).
+	Handlers[_slot(IRCCommand::Privmsg)] = [](const IRCMessage &, Twitch::IRCBot *) -> const char *
 	{
-		static const std::regex CommandMatch(R"(!(\w+)\s*(.*))", std::regex_constants::ECMAScript | std::regex_constants::optimize);
-
-		// copy message body for static use matching
-		std::string message(sm[5].str());
-
-		std::smatch commandStringMatch;
-			
-		// if we have a command
-		if(std::regex_match(message, commandStringMatch, CommandMatch))
-		{
-			auto iter = Caller->Commands.SFM.find(commandStringMatch[1].str());
-
-			// if command doesn't exist
-			if (iter == Caller->Commands.SFM.end())
-			{
-				return R"(Command PRIVMSG recieved, no user command found)";
-			}
-			else
-			{
-				return R"(Command PRIVMSG recieved, )" + 
-					iter->second(sm, commandStringMatch, Caller);
-			}
-		}
-
-		return R"(Command PRIVMSG recieved, wrong format)";
+		return R"(Command PRIVMSG recieved, no user command)";
 	};
 }
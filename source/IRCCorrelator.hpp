@@ -6,16 +6,16 @@
  * of friend classes, queues up any necessary returns,
  * logging, etc.  
  *
- * To ensure the function worked, it returns true on
- * succesful completion and false if any error occured.
+ * Each function is handed the parsed IRCMessage
+ * and returns a short (static) description of what
+ * it did, for the bot's log.
  *
- * If necessary, the map can be made private and access
- * to the required member functions (find, [], etc) can
- * be made available in implementation.  At present,
- * with only one coder working and only one set use,
- * this is not needed to prevent misuse.  However, I will
- * strive to ensure that this can always be done later
- * (I won't alter the map outside of this class).
+ * Handlers are kept in an array indexed by the
+ * command, which is found from the line's text with
+ * a perfect hash worked out at compile time (see
+ * IRCCommand.hpp), rather than by searching a map.
+ * Commands we don't know, or don't handle, have no
+ * handler; the bot just logs those.
  *
  * If any functions require storing data, private members
  * can be created and used within them.
@@ -24,21 +24,35 @@
 #ifndef TWITCH_IRC_CORRELATOR
 #define TWITCH_IRC_CORRELATOR
 
-#include <map>		//...map
-#include <string>	//...string
-#include <regex> 	//smatch
+#include <array>		//...array
+#include <cstddef>		//size_t
+#include <string_view>	//...string_view
+
+#include "IRCCommand.hpp"
+#include "IRCMessage.hpp"
 
 namespace Twitch
 {
 	// forward declaration of IRCBot
 	class IRCBot;
 
+	// a command's handler, returning what it did
+	using IRCHandler = const char *(*)(const IRCMessage &, Twitch::IRCBot *Caller);
+
 	class IRCCorrelator
 	{
+		private:
+			// one handler per command (IRCCommand::Unknown's slot stays empty)
+			std::array<IRCHandler, IRCCommandCount + 1> Handlers = {};
+
+			static constexpr std::size_t _slot(IRCCommand command) { return static_cast<std::size_t>(command); }
+
 		public:
-			std::map<std::string, std::string (*)(std::smatch &, Twitch::IRCBot *Caller)> SFM;
+			IRCCorrelator(); // constructor to populate the handlers
 
-			IRCCorrelator(); // constructor to populate map
+			// the handler for a command (nullptr if it has none)
+			IRCHandler find(IRCCommand command) const { return Handlers[_slot(command)]; }
+			IRCHandler find(std::string_view command) const { return find(ircCommand(command)); }
 	};
 }
 #endif
@@ -0,0 +1,152 @@
+/* IRCMessage.cpp - Miles Shamo
+ *
+ * Implementation of the IRCMessage wrapper.
+ *
+ * Nothing here allocates apart from tag(),
+ * which writes into a string the caller owns.
+ */
+
+#include "IRCMessage.hpp"
+
+#include <cstddef>
+
+namespace
+{
+	// \w in ECMAScript regex
+	inline bool isWordChar(char c)
+	{
+		return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+			   (c >= '0' && c <= '9') || c == '_';
+	}
+
+	// \s in ECMAScript regex
+	inline bool isSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+	}
+}
+
+// Constructor
+//
+// Splits a user command out of the trailing parameter
+// in the same way the old "!(\w+)\s*(.*)" regex did:
+// a '!', a word, any whitespace, and then the arguments.
+Twitch::IRCMessage::IRCMessage(const IRCLine &line) : Line(line)
+{
+	std::string_view text = Line.trailing;
+
+	if (text.size() < 2 || text[0] != '!')
+		return;
+
+	std::size_t end = 1;
+	while (end < text.size() && isWordChar(text[end]))
+		end++;
+
+	if (end == 1)
+		return;
+
+	UserCommand = text.substr(1, end - 1);
+
+	while (end < text.size() && isSpace(text[end]))
+		end++;
+
+	UserArgs = text.substr(end);
+	HasUserCommand = true;
+}
+
+
+// channel
+//
+// The channel is the first middle parameter
+std::string_view Twitch::IRCMessage::channel() const
+{
+	std::string_view params = Line.params;
+
+	return params.substr(0, params.find(' '));
+}
+
+
+// nick
+//
+// Twitch prefixes are always "nick!nick@nick.tmi.twitch.tv",
+// so the nick is everything up to the '!'
+std::string_view Twitch::IRCMessage::nick() const
+{
+	std::size_t bang = Line.prefix.find('!');
+
+	if (bang == std::string_view::npos)
+		return std::string_view();
+
+	return Line.prefix.substr(0, bang);
+}
+
+
+// rawTag
+//
+// Walks the "key=value;key=value" tag list until the key is found.
+// Tags are only ever looked at when asked for, so a handler that never
+// reads them never pays for them.
+bool Twitch::IRCMessage::rawTag(std::string_view key, std::string_view &value) const
+{
+	std::string_view tags = Line.tags;
+
+	while (!tags.empty())
+	{
+		std::size_t end = tags.find(';');
+		std::string_view entry = tags.substr(0, end);
+
+		std::size_t equals = entry.find('=');
+		if (entry.substr(0, equals) == key)
+		{
+			// a tag with no '=' has an empty value
+			value = equals == std::string_view::npos ? std::string_view() : entry.substr(equals + 1);
+			return true;
+		}
+
+		if (end == std::string_view::npos)
+			break;
+
+		tags.remove_prefix(end + 1);
+	}
+
+	return false;
+}
+
+
+// tag
+//
+// Looks up a tag and undoes the IRCv3 escaping on it
+// ("\:" -> ';', "\s" -> ' ', "\\" -> '\', "\r", "\n")
+bool Twitch::IRCMessage::tag(std::string_view key, std::string &out) const
+{
+	std::string_view raw;
+
+	if (!rawTag(key, raw))
+		return false;
+
+	out.clear();
+
+	for (std::size_t i = 0; i < raw.size(); i++)
+	{
+		if (raw[i] != '\\')
+		{
+			out += raw[i];
+			continue;
+		}
+
+		// a trailing lone backslash is dropped
+		if (++i == raw.size())
+			break;
+
+		switch (raw[i])
+		{
+			case ':': out += ';';  break;
+			case 's': out += ' ';  break;
+			case 'r': out += '\r'; break;
+			case 'n': out += '\n'; break;
+			default:  out += raw[i]; break;
+		}
+	}
+
+	return true;
+}
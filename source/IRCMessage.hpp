@@ -0,0 +1,67 @@
+/* IRCMessage.hpp - Miles Shamo
+ *
+ * A small wrapper around a parsed IRCLine which
+ * is handed to every IRCCorrelator and
+ * CommandCorrelator function (in place of the
+ * old std::smatch).
+ *
+ * Like the IRCLine it is built from, it only
+ * holds views into the receive buffer, so it
+ * must not outlive the handler it was passed to.
+ *
+ * The pieces most handlers want (the channel, the
+ * sender's nick, and a "!command args" split of
+ * the text) are split out once on construction.
+ * Tags are left alone until one is asked for, and
+ * are only unescaped if the caller asks for that.
+ */
+
+#ifndef TWITCH_IRC_MESSAGE
+#define TWITCH_IRC_MESSAGE
+
+#include <string>
+#include <string_view>
+
+#include "IRCParser.hpp"
+
+namespace Twitch
+{
+	class IRCMessage
+	{
+		private:
+			// the parsed line (tags, prefix, command, params, trailing)
+			IRCLine Line;
+
+			// pre-split "!command args" from the trailing parameter (if any)
+			std::string_view UserCommand, UserArgs;
+			bool HasUserCommand = false;
+
+		public:
+			explicit IRCMessage(const IRCLine &line);
+
+			// raw fields
+			const IRCLine &line() const { return Line; }
+			std::string_view command() const { return Line.command; }
+			std::string_view params() const { return Line.params; }
+			std::string_view text() const { return Line.trailing; }
+			std::string_view prefix() const { return Line.prefix; }
+
+			// the first parameter ("#channel" for PRIVMSG, NOTICE, etc)
+			std::string_view channel() const;
+
+			// the nick from a "nick!user@host" prefix (empty if there is no '!')
+			std::string_view nick() const;
+
+			// a user command ("!name args") in the trailing parameter
+			bool isUserCommand() const { return HasUserCommand; }
+			std::string_view userCommand() const { return UserCommand; }
+			std::string_view userArgs() const { return UserArgs; }
+
+			// finds a tag's raw (still escaped) value.  Returns false if the tag is missing
+			bool rawTag(std::string_view key, std::string_view &value) const;
+
+			// finds a tag and unescapes it into out (reusing out's storage)
+			bool tag(std::string_view key, std::string &out) const;
+	};
+}
+#endif
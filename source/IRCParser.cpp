@@ -0,0 +1,221 @@
+/* IRCParser.cpp - Miles Shamo
+ *
+ * Implementation of the single pass IRC
+ * line parser.  The structure follows the old
+ * regex group by group so the two can be
+ * compared directly.
+ *
+ * All scanning is done on indices into the
+ * original view, so nothing is copied.
+ */
+
+#include "IRCParser.hpp"
+
+#include <cstddef>
+
+namespace
+{
+	// the same characters ECMAScript's \s matches (ASCII only)
+	inline bool isSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+	}
+
+	// returns the index one past a run of non space (\S) characters starting at i
+	inline std::size_t scanWord(std::string_view s, std::size_t i)
+	{
+		while (i < s.size() && !isSpace(s[i]))
+			i++;
+
+		return i;
+	}
+
+	// returns the index one past a run of ' ' starting at i
+	inline std::size_t skipSpaces(std::string_view s, std::size_t i)
+	{
+		while (i < s.size() && s[i] == ' ')
+			i++;
+
+		return i;
+	}
+
+	// matches the "(?:@(\S+) +)?" and "(?::(\S+) +)?" groups.
+	//
+	// If the marker is followed by a word and at least one space,
+	// the word is stored and the index past the spaces is returned.
+	// Otherwise the group did not match and i is returned as is.
+	inline std::size_t matchMarkedWord(std::string_view s, std::size_t i, char marker, std::string_view &word)
+	{
+		if (i >= s.size() || s[i] != marker)
+			return i;
+
+		std::size_t end = scanWord(s, i + 1);
+
+		// needs at least one character and a space after it
+		if (end == i + 1 || end >= s.size() || s[end] != ' ')
+			return i;
+
+		word = s.substr(i + 1, end - i - 1);
+
+		return skipSpaces(s, end);
+	}
+
+	// parses everything from the command onwards ("(\S+)" and later).
+	//
+	// This part of the regex never backtracks into the groups before it,
+	// so it is deterministic given a starting index.
+	bool parseCommand(std::string_view body, std::size_t i, Twitch::IRCLine &out)
+	{
+		// [3] command (required)
+		std::size_t commandEnd = scanWord(body, i);
+		if (commandEnd == i)
+			return false;
+
+		out.command = body.substr(i, commandEnd - i);
+		out.params = out.trailing = std::string_view();
+		out.hasParams = out.hasTrailing = false;
+
+		// no arguments at all
+		if (commandEnd == body.size())
+			return true;
+
+		// anything but a space here (a stray '\r', a tab...) would not have matched
+		if (body[commandEnd] != ' ')
+			return false;
+
+		std::size_t p = skipSpaces(body, commandEnd);
+
+		// only spaces after the command; the regex gave back the last one as a parameter
+		// (which it could only do with at least two of them)
+		if (p == body.size())
+		{
+			if (p - commandEnd < 2)
+				return false;
+
+			out.params = body.substr(body.size() - 1);
+			out.hasParams = true;
+
+			return true;
+		}
+
+		// no middle parameters, just a trailing one ("PING :tmi.twitch.tv")
+		if (body[p] == ':')
+		{
+			for (std::size_t j = p + 1; j < body.size(); j++)
+			{
+				if (body[j] == '\r' || body[j] == '\n')
+					return false;
+			}
+
+			out.trailing = body.substr(p + 1);
+			out.hasTrailing = true;
+
+			return true;
+		}
+
+		// [4] parameters run up to the first " :" that has text after it,
+		// [5] is everything after that
+		std::size_t split = body.size();
+		for (std::size_t j = p; j < body.size(); j++)
+		{
+			char c = body[j];
+
+			if (c == '\r' || c == '\n')
+				return false;
+
+			if (split == body.size() && c == ' ' && j > p &&
+					j + 2 < body.size() && body[j + 1] == ':')
+			{
+				split = j;
+			}
+		}
+
+		out.params = body.substr(p, split - p);
+		out.hasParams = true;
+
+		if (split != body.size())
+		{
+			out.trailing = body.substr(split + 2);
+			out.hasTrailing = true;
+		}
+
+		return true;
+	}
+}
+
+// parseIRCLine
+//
+// Walks the line once, left to right, filling in each
+// field of the IRCLine as it goes.  See IRCParser.hpp
+// for how the fields map onto the old regex groups.
+//
+// For a well formed line this is a single pass.  Only
+// malformed lines fall back to retrying without the
+// prefix and tags, which is what the regex would have
+// backtracked into.
+bool Twitch::parseIRCLine(std::string_view line, IRCLine &out)
+{
+	out = IRCLine();
+
+	// the regex only matched lines terminated with "\r\n"
+	if (line.size() < 2 || line[line.size() - 2] != '\r' || line.back() != '\n')
+		return false;
+
+	std::string_view body = line.substr(0, line.size() - 2);
+
+	// [1] tags and [2] prefix
+	std::size_t afterTags = matchMarkedWord(body, 0, '@', out.tags);
+	std::size_t afterPrefix = matchMarkedWord(body, afterTags, ':', out.prefix);
+
+	out.hasTags = afterTags != 0;
+	out.hasPrefix = afterPrefix != afterTags;
+
+	if (parseCommand(body, afterPrefix, out))
+		return true;
+
+	// give back the prefix
+	if (out.hasPrefix)
+	{
+		out.prefix = std::string_view();
+		out.hasPrefix = false;
+
+		if (parseCommand(body, afterTags, out))
+			return true;
+	}
+
+	// give back the tags (a prefix can't start at '@')
+	if (out.hasTags)
+	{
+		out = IRCLine();
+
+		if (parseCommand(body, 0, out))
+			return true;
+	}
+
+	return false;
+}
+
+
+// rebaseIRCLine
+//
+// every field keeps its offset into the line, just in the new buffer
+Twitch::IRCLine Twitch::rebaseIRCLine(const IRCLine &line, std::string_view from, std::string_view to)
+{
+	auto move = [&](std::string_view field) -> std::string_view
+	{
+		if (field.data() == nullptr)
+			return field;
+
+		return std::string_view(to.data() + (field.data() - from.data()), field.size());
+	};
+
+	IRCLine rebased = line;
+
+	rebased.tags = move(line.tags);
+	rebased.prefix = move(line.prefix);
+	rebased.command = move(line.command);
+	rebased.params = move(line.params);
+	rebased.trailing = move(line.trailing);
+
+	return rebased;
+}
@@ -0,0 +1,56 @@
+/* IRCParser.hpp - Miles Shamo
+ *
+ * A hand written, single pass parser for
+ * IRC lines.  It replaces the IRCLine regex
+ * that _onMessage used to run on every line.
+ *
+ * The parser never allocates or copies.  Every
+ * field of the resulting IRCLine is a view into
+ * the buffer that was parsed, so the line is only
+ * valid as long as that buffer is left untouched.
+ *
+ * The fields mirror the old regex capture groups:
+ * [1] - tags      (after '@', without it)
+ * [2] - prefix    (after ':', without it)
+ * [3] - command
+ * [4] - parameters (middle parameters)
+ * [5] - trailing  (after " :", without it)
+ *
+ * The one intentional difference is a line with no
+ * middle parameters, e.g. "PING :tmi.twitch.tv".  The
+ * regex put ":tmi.twitch.tv" in group [4] and left [5]
+ * empty (so we answered pings with an empty PONG);
+ * here it is reported as a trailing parameter.
+ */
+
+#ifndef TWITCH_IRC_PARSER
+#define TWITCH_IRC_PARSER
+
+#include <string_view>
+
+namespace Twitch
+{
+	struct IRCLine
+	{
+		std::string_view tags;
+		std::string_view prefix;
+		std::string_view command;
+		std::string_view params;
+		std::string_view trailing;
+
+		// the regex groups could be unmatched, so we track that too
+		bool hasTags = false;
+		bool hasPrefix = false;
+		bool hasParams = false;
+		bool hasTrailing = false;
+	};
+
+	// parses a single line, which must end in "\r\n" (as the regex required).
+	// Returns false if the line is not a valid IRC line.
+	bool parseIRCLine(std::string_view line, IRCLine &out);
+
+	// points a line parsed from one buffer at a copy of that buffer (so it
+	// can be handed off without being parsed again)
+	IRCLine rebaseIRCLine(const IRCLine &line, std::string_view from, std::string_view to);
+}
+#endif
@@ -29,24 +29,94 @@
 #include <Poco/File.h>
 
 #include <asio/executor_work_guard.hpp>
+#include <algorithm>
+#include <csignal>
 #include <cstdlib>
 #include <ios>
 #include <iostream>
 #include <istream>
 #include <fstream>
+#include <future>
 #include <stdexcept>
 #include <thread>
 
 
+namespace
+{
+	// reads a count from the environment (fallback if unset or not a number)
+	std::size_t envNumber(const char *name, std::size_t fallback)
+	{
+		const char *value = std::getenv(name);
+
+		if (!value)
+			return fallback;
+
+		char *end = nullptr;
+		unsigned long number = std::strtoul(value, &end, 10);
+
+		return (end != value && *end == '\0') ? number : fallback;
+	}
+
+	// reads a yes/no from the environment ("1", "y" or "yes" are yes)
+	bool envFlag(const char *name)
+	{
+		const char *value = std::getenv(name);
+
+		if (!value)
+			return false;
+
+		std::string flag(value);
+
+		return flag == "1" || flag == "y" || flag == "yes";
+	}
+
+	// reads a string from the environment (fallback if unset or empty)
+	std::string envString(const char *name, const std::string &fallback)
+	{
+		const char *value = std::getenv(name);
+
+		return (value && *value) ? value : fallback;
+	}
+
+	// login pacing, which a load test against a local server can open up:
+	// 		BARIBOT_LOGIN_RATE=n           logins per 10 seconds from this machine
+	// 		BARIBOT_ACCOUNT_LOGIN_RATE=n   logins per 10 seconds for any one account
+	Twitch::AdmissionLimits admissionLimits()
+	{
+		Twitch::AdmissionLimits limits;
+
+		limits.Attempts = envNumber("BARIBOT_LOGIN_RATE", limits.Attempts);
+		limits.AccountAttempts = envNumber("BARIBOT_ACCOUNT_LOGIN_RATE", limits.AccountAttempts);
+
+		return limits;
+	}
+}
+
+
 /* Overseer (Constructor)
  *
  * starts a IO work to prevent stoppage
  *
  * and sets up filesystem
  *
+ * The IRC server can be changed from the environment
+ * (BARIBOT_IRC_SERVER and BARIBOT_IRC_PORT), which is
+ * how load tests point every client at a FakeTwitch.
+ *
  * TODO setup configurable directories
  */
-Twitch::Overseer::Overseer() : work(make_work_guard(Context))
+Twitch::Overseer::Overseer() 
+	:	work(make_work_guard(Context)), 
+		Shards(Context),
+		SharedCommands(MasterCommandCorrelator),
+		Gate(Context, admissionLimits()),
+		Watcher(Context),
+		Tokens(Context, [this](Twitch::token &tok)
+		{
+			return _renewToken(tok);
+		}),
+		Server(envString("BARIBOT_IRC_SERVER", "irc.chat.twitch.tv")),
+		Port(envString("BARIBOT_IRC_PORT", "6667"))
 {
 	// path to tokens
 	TokenPath = Poco::Path(false);
@@ -64,25 +134,24 @@ Twitch::Overseer::Overseer() : work(make_work_guard(Context))
 
 /* ~Overseer (destructor)
  *
- * stops IO service and joins threads
+ * stops IO services and joins threads
  *
  * then deletes every client
  *
  */
 Twitch::Overseer::~Overseer()
 {
-	Context.stop();
-
-	for (auto &T : Threads)
-	{
-		if (T.joinable())
-			T.join();
-	}
+	Shards.stop();
 	
 	for (auto C : Clients)
 	{
 		delete C;
 	}
+
+	for (auto C : StoppedClients)
+	{
+		delete C;
+	}
 }
 
 
@@ -91,6 +160,12 @@ Twitch::Overseer::~Overseer()
  * renewToken takes a token and replaces it with
  * a new token through POSTS to id.twitch.tv.  
  *
+ * This blocks for the whole request, so it's only
+ * ever called from the TokenService's own thread.
+ * The connection comes from the shared HTTPS pool,
+ * so a renewal after the first is one round trip
+ * (or two, if the pooled one had gone stale).
+ *
  * TODO Modify to renew both standard and client
  * tokens (client tokens used for twitch api calls)
  * 		- this may not be needed
@@ -105,25 +180,40 @@ bool Twitch::Overseer::_renewToken(Twitch::token &tok)
 					"&client_secret=" + ClientSecret);
 
 
-	// creates the https connection and the proper request
-	Poco::Net::HTTPSClientSession session(renew.getHost(), renew.getPort());
-	Poco::Net::HTTPRequest request(Poco::Net::HTTPRequest::HTTP_POST, renew.toString(), Poco::Net::HTTPMessage::HTTP_1_1);
+	// borrows a (likely already open) connection and builds the request.  
+	// The query is sent in the request line, so there's no body.  If the
+	// connection turns out to have been closed while idle, the pool runs
+	// this again on a new one
+	Poco::Net::HTTPResponse::HTTPStatus status = Poco::Net::HTTPResponse::HTTP_OK;
+	std::stringstream rawJSON;
 
+	Https.exchange(renew, [&](HTTPSPool::Lease &lease)
+	{
+		auto &session = lease.session();
 
-	// catches the response header and raw output
-	Poco::Net::HTTPResponse response;
-	session.sendRequest(request);
-	// output comes as a stream
-	std::istream& outputRecieved = session.receiveResponse(response);
+		Poco::Net::HTTPRequest request(Poco::Net::HTTPRequest::HTTP_POST, renew.getPathAndQuery(), Poco::Net::HTTPMessage::HTTP_1_1);
+		request.setKeepAlive(true);
+		request.setContentLength(0);
 
 
-	// if we recieved JSON back (an OK request)
-	if (response.getStatus() == Poco::Net::HTTPResponse::HTTP_OK)
-	{
-		// convert output to stringstream to JSON
-		std::stringstream rawJSON;
+		// catches the response header and raw output
+		Poco::Net::HTTPResponse response;
+		session.sendRequest(request);
+		// output comes as a stream
+		std::istream& outputRecieved = session.receiveResponse(response);
+
+		// the whole body is read (whatever the status) so the connection can be reused
+		rawJSON.str(std::string());
 		Poco::StreamCopier::copyStream(outputRecieved, rawJSON);
+		lease.reuse();
 
+		status = response.getStatus();
+	});
+
+
+	// if we recieved JSON back (an OK request)
+	if (status == Poco::Net::HTTPResponse::HTTP_OK)
+	{
 		// parse to a dynamic "Var" and extract to an "Object"
 		Poco::JSON::Parser parser;
 		auto result = parser.parse(rawJSON);
@@ -145,71 +235,118 @@ bool Twitch::Overseer::_renewToken(Twitch::token &tok)
 /* _runContext
  *
  * runContext is a blocking function
- * to provide a thread for the IOContext
+ * to provide a thread for an IOContext
  * to use in asyncronous operations.  It
  * simply runs the context and deals with
  * any errors thrown, until the context is
  * stopped.  
  *
+ * When sharded, each thread runs a context
+ * of its own; otherwise all of them run the
+ * main one.
+ *
  */
-void Twitch::Overseer::_runContext()
+void Twitch::Overseer::_runContext(asio::io_context &context)
 {
-	while(!Context.stopped())
+	while(!context.stopped())
 	{
 		try
 		{
-			Context.run();		
+			context.run();		
 		}
-		// handles login exceptions by reneweing the token and re-creating client
+		// handles login exceptions by reneweing the token and re-creating client.
+		// The renewal runs on the token service's thread, so this thread goes
+		// straight back to serving the other clients.  The failed client is
+		// stopped first, so only the new one is ever connected
 		catch(const loginException &e)
 		{
-			// opens the token (client path + token.tok" and renews
+			_stopClient(e.Caller);
+
+			// the token is the client path + "token.tok"
 			Poco::Path clientPath = e.ClientPath;
 			clientPath.append("token.tok");
-			Poco::File expiredToken(clientPath.toString());
-			if (!expiredToken.isFile())
+
+			if (!Poco::File(clientPath).isFile())
 			{
 				// TODO - log failure in file
 				std::cout << "ERROR, WRONG PATH: " << clientPath.toString() << std::endl;
+				continue;
 			}
-			else
-			{
-				std::ifstream input(expiredToken.path().c_str());
 
-				if (!input.is_open())
-				{
-					//TODO - log failed open
-				}
-				else
+			Poco::Path relaunchPath = e.ClientPath;
+
+			Tokens.renew(clientPath, [this, relaunchPath](bool renewed)
+			{
+				if (!renewed)
 				{
-					// stream into memory and renew
-					Twitch::token temp;
-					input >> temp;
-
-					if (!_renewToken(temp))
-					{
-						//TODO - log failure
-					}
-					else
-					{
-						input.close();
-
-						std::ofstream output(expiredToken.path().c_str(), std::ofstream::trunc);
-
-						output << temp;
-						output.close();
-
-						// create a new client
-						auto client = Poco::File(e.ClientPath);
-						launchClientInstance(client, Server, Port);
-					}
+					//TODO - log failure
+					return;
 				}
-			}
+
+				// create a new client
+				auto client = Poco::File(relaunchPath);
+				launchClientInstance(client, Server, Port);
+			});
 		}// end catch for login exceptions
 	}
 }
 
 
+/* _stopClient
+ *
+ * stops a client (on its own strand) and moves it from
+ * Clients to StoppedClients, so nothing else reaches it:
+ * its folder is no longer watched, its context's load
+ * goes down, and its connection, timers, log and place in
+ * the login queue are all let go.
+ * The object itself lives on until its cancelled handlers
+ * have all run, and is then freed by _reclaimClient.  Any
+ * still stopping when the threads are stopped are freed by
+ * the destructor instead
+ *
+ */
+bool Twitch::Overseer::_stopClient(const Twitch::IRCBot *client)
+{
+	std::lock_guard<std::mutex> guard(ClientsLock);
+
+	auto found = std::find(Clients.begin(), Clients.end(), client);
+	if (found == Clients.end())
+		return false;
+
+	IRCBot *stopping = *found;
+	Clients.erase(found);
+
+	Watcher.unwatch(stopping->folder());
+	Shards.release(stopping->context());
+	stopping->stop([this](IRCBot *stopped) { _reclaimClient(stopped); });
+
+	StoppedClients.push_back(stopping);
+
+	return true;
+}
+
+
+/* _reclaimClient
+ *
+ * frees a stopped client, once it says nothing can reach it
+ * any more.  Called from the client's own strand, as the last
+ * thing it runs, so every renewal doesn't leave one behind
+ *
+ */
+void Twitch::Overseer::_reclaimClient(Twitch::IRCBot *client)
+{
+	std::lock_guard<std::mutex> guard(ClientsLock);
+
+	auto found = std::find(StoppedClients.begin(), StoppedClients.end(), client);
+	if (found == StoppedClients.end())
+		return;
+
+	StoppedClients.erase(found);
+
+	delete client;
+}
+
+
 /* setAppCreds
  *
  * a simple setter function for the ClientID and clientSecret
@@ -244,8 +381,16 @@ void Twitch::Overseer::init()
 
 	std::string ID, secret;
 
+	// credentials given in the environment (for running without a terminal)
+	if (std::getenv("BARIBOT_CLIENT_ID") && std::getenv("BARIBOT_CLIENT_SECRET"))
+	{
+		cout << "Using credentials from the environment..." << endl;
+
+		ID = std::getenv("BARIBOT_CLIENT_ID");
+		secret = std::getenv("BARIBOT_CLIENT_SECRET");
+	}
 	// prompt for new creds
-	if (!credsFile.exists())
+	else if (!credsFile.exists())
 	{
 		cout << "No credentials saved"          << endl
 			 << "Please enter the Client ID: ";
@@ -320,16 +465,28 @@ void Twitch::Overseer::init()
 		cout << "Found " << StoredClients.size() << " stored clients" << endl;	
 	}
 
-	// get's a number of threads
-	cout << "Please input a number of threads to work IO: " << endl << "> ";
-	int threadCount;
-	cin >> threadCount;
-	
-	for (int i = 0; i < threadCount; i++)
+	// threads are sized from the cores and the load unless told otherwise.  
+	// All of this comes from the environment, so nothing here needs a terminal:
+	// 		BARIBOT_THREADS=n    a fixed number of threads
+	// 		BARIBOT_SHARDED=1    one IO context per thread
+	// 		BARIBOT_PIN=1        pin sharded threads to cores
+	std::size_t threadCount = envNumber("BARIBOT_THREADS", 0);
+	bool sharded = envFlag("BARIBOT_SHARDED");
+	bool pinned = sharded && envFlag("BARIBOT_PIN");
+
+	// how handler time is shared between clients
+	// 		BARIBOT_HANDLER_SLOTS=n      handlers running at once (default: one per core)
+	// 		BARIBOT_FAIR_PER_CHANNEL=1   share it per channel rather than per client
+	Fairness.configure(envNumber("BARIBOT_HANDLER_SLOTS", 0), envFlag("BARIBOT_FAIR_PER_CHANNEL"));
+
+	// runs the context(s) with new threads
+	Shards.start(threadCount, sharded, pinned, [this](asio::io_context &context)
 	{
-		// runs context with new threads
-		Threads.push_back(std::thread(&Twitch::Overseer::_runContext, this));
-	}
+		_runContext(context);
+	}, threadCount == 0);
+
+	cout << "Running IO on " << Shards.threadCount() << " threads"
+		 << (sharded ? " (sharded)" : (threadCount == 0 ? " (sized to load)" : "")) << endl;
 }
 
 
@@ -427,6 +584,10 @@ void Twitch::Overseer::run()
 	};
 
 
+	// launches every stored client straight away if asked to (BARIBOT_LAUNCH_ALL=1)
+	if (envFlag("BARIBOT_LAUNCH_ALL"))
+		launchStored();
+
 	cout << "Starting I/O loop" << endl << endl;
 	
 
@@ -447,9 +608,35 @@ void Twitch::Overseer::run()
 			  << "\t4 - List all stored Clients"	  << endl
 			  << "\t5 - Create a new client Instance" << endl
 			  << "\t6 - Launch a client instance"     << endl
-			  << "\t7 - Stop client instance"         << endl;
+			  << "\t7 - Stop client instance"         << endl
+			  << endl
+			  << "\t8 - Show reconnect backlog"       << endl
+			  << "\t9 - Show handler fairness"        << endl;
 		cout  << "> ";
 		cin >> menuChoice;
+
+		// no console (or it was closed), so the clients keep running until
+		// we're told to stop (SIGINT or SIGTERM).  Returning then shuts down
+		// as exiting from the menu does: the destructor stops the threads and
+		// the clients, and the logs are flushed on the way out
+		if (cin.eof())
+		{
+			cout << endl << "No console input; running headless until stopped" << endl;
+
+			std::promise<int> stopped;
+
+			asio::signal_set signals(Context, SIGINT, SIGTERM);
+			signals.async_wait([&stopped](const asio::error_code &, int signal)
+			{
+				stopped.set_value(signal);
+			});
+
+			int signal = stopped.get_future().get();
+
+			cout << "Stopping on signal " << signal << endl;
+			return;
+		}
+
 		cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
 		cin.clear();
 
@@ -493,6 +680,14 @@ void Twitch::Overseer::run()
 
 				break;
 
+			case 8: // reconnect backlog
+				printBacklog(cout);
+				break;
+
+			case 9: // handler fairness
+				printFairness(cout);
+				break;
+
 			default:
 				// do nothing
 				break;
@@ -590,14 +785,75 @@ void Twitch::Overseer::deleteToken(int index)
 }
 
 
+/* printBacklog
+ *
+ * prints how many clients are waiting on admission
+ * control to connect, and how long they've waited.
+ * After an outage this shows how far through
+ * recovering we are.
+ *
+ */
+void Twitch::Overseer::printBacklog(std::ostream &out)
+{
+	using std::chrono::duration_cast;
+	using std::chrono::milliseconds;
+
+	auto stats = Gate.stats();
+
+	out << "Clients waiting to connect: " << stats.Waiting << std::endl
+		<< "\tOldest has waited "         << duration_cast<milliseconds>(stats.OldestWait).count() << "ms" << std::endl
+		<< "\tConnections granted: "      << stats.Granted << std::endl
+		<< "\tLongest wait so far "       << duration_cast<milliseconds>(stats.MaxWait).count() << "ms" << std::endl;
+}
+
+
+/* printFairness
+ *
+ * prints each client's (or channel's) share of
+ * handler time.  A client that is often throttled
+ * with long waits is getting more work than its
+ * weight allows, and is the one slowing down.
+ *
+ */
+void Twitch::Overseer::printFairness(std::ostream &out)
+{
+	using std::chrono::duration_cast;
+	using std::chrono::milliseconds;
+
+	auto all = Fairness.stats();
+
+	out << "Handler time by client:" << std::endl;
+
+	for (auto &tenant : all)
+	{
+		auto average = tenant.Run ? tenant.TotalWait / static_cast<Clock::duration::rep>(tenant.Run) : Clock::duration::zero();
+
+		out << "\t"              << tenant.Tenant    << " (weight " << tenant.Weight << ")" << std::endl
+			<< "\t\tQueued: "    << tenant.Queued    << ", run: "   << tenant.Run << std::endl
+			<< "\t\tThrottled: " << tenant.Throttled << " times"    << std::endl
+			<< "\t\tWait: "      << duration_cast<milliseconds>(average).count() << "ms average, "
+			<< duration_cast<milliseconds>(tenant.MaxWait).count() << "ms worst" << std::endl;
+	}
+}
+
+
 /* launchClientInstance
  *
  * creates a new TwitchIRC client instance
  * and binds it to the current token to return.  
  *
  * If the token is invalid, the client throws an authentication error
- * which is caught here.  This prompts a token renewal and a
- * retry.
+ * which is caught in _runContext.  This prompts a token renewal and a
+ * retry (which calls this from an IO thread, hence the lock).
+ *
+ * The client's folder is then watched, so that editing its
+ * channels.txt or command files reaches the running client
+ * (see clientFileChanged).  A client launched again for the
+ * same folder takes the watch over.
+ *
+ * The watcher may already be calling back as a client is
+ * stopped, so the callback only passes the change on if the
+ * client is still running (see _clientFileChanged)
  *
  * TODO add async connection to ensure that we don't block main thread
  * 			- likely one extra thread dedicated to launching clients
@@ -608,12 +864,74 @@ void Twitch::Overseer::launchClientInstance(
 		std::string port
 		)
 {
-	// creates a client
+	std::lock_guard<std::mutex> guard(ClientsLock);
+
+	// creates a client (on the least busy context when sharded)
 	Clients.push_back(
-			new Twitch::IRCBot(Context, server, port, 
+			new Twitch::IRCBot(Shards.place(), server, port, 
 							   MasterIRCCorrelator, 
-							   MasterCommandCorrelator,
+							   SharedCommands,
+							   Accounts,
+							   Gate,
+							   Fairness,
 							   clientFile.path()));
+
+	IRCBot *client = Clients.back();
+
+	if (!Watcher.watch(client->folder(), [this, client](const std::string &file) { _clientFileChanged(client, file); }))
+		std::cout << "Not watching " << clientFile.path() << " for changes" << std::endl;
+}
+
+
+/* _clientFileChanged
+ *
+ * passes a change on to a client, if it's still running.  A
+ * stopped client is freed once it's done (see _stopClient), so
+ * it mustn't be reached from here
+ *
+ */
+void Twitch::Overseer::_clientFileChanged(IRCBot *client, const std::string &file)
+{
+	std::lock_guard<std::mutex> guard(ClientsLock);
+
+	auto found = std::find(Clients.begin(), Clients.end(), client);
+	if (found == Clients.end())
+		return;
+
+	clientFileChanged(client, file);
+}
+
+
+/* clientFileChanged
+ *
+ * applies an edit to a client's folder in place, with no
+ * reconnect: channels.txt is diffed against the channels the
+ * client has (only those added or removed are JOINed or PARTed),
+ * and new command files are loaded into a new command set, which
+ * is swapped in whole.  Anything else in the folder is ignored
+ *
+ */
+void Twitch::Overseer::clientFileChanged(IRCBot *client, const std::string &file)
+{
+	if (file == "channels.txt")
+		client->reloadChannels();
+	else if (file == "customCommands.txt" || file == "disabledCommands.txt" || file == "cooldowns.txt")
+		client->reloadCommands();
+}
+
+
+/* launchStored
+ *
+ * launches every stored client, as BARIBOT_LAUNCH_ALL
+ * does on startup (and the load test does after init)
+ *
+ */
+void Twitch::Overseer::launchStored()
+{
+	std::cout << "Launching all " << StoredClients.size() << " stored clients" << std::endl;
+
+	for (auto &client : StoredClients)
+		launchClientInstance(client, Server, Port);
 }
 
 
@@ -667,6 +985,7 @@ bool Twitch::Overseer::createClient(std::istream &in, const Poco::File &token)
 	std::ofstream 	log(folder + "/log.txt"), 
 				 	disabled(folder + "/disabledCommands.txt"),
 					custom(folder + "/customCommands.txt"),
+					cooldowns(folder + "/cooldowns.txt"),
 					channels(folder + "/channels.txt");
 
 	// TODO -- ADD headers where applicable
@@ -17,6 +17,7 @@
 
 #include <asio/executor_work_guard.hpp>
 #include <map>
+#include <mutex>
 #include <vector>
 #include <utility>
 
@@ -27,6 +28,14 @@
 
 #include "IRCCorrelator.hpp"
 #include "CommandCorrelator.hpp"
+#include "CommandTable.hpp"
+#include "Account.hpp"
+#include "Admission.hpp"
+#include "TokenService.hpp"
+#include "HTTPSPool.hpp"
+#include "IOShards.hpp"
+#include "FairScheduler.hpp"
+#include "FolderWatcher.hpp"
 
 namespace Twitch
 {
@@ -37,8 +46,8 @@ namespace Twitch
 			asio::io_context Context;
 			asio::executor_work_guard<asio::io_context::executor_type> work;
 
-			// a vector of threads to work on that context
-			std::vector<std::thread> Threads;
+			// the threads that work that context (and, when sharded, one context each)
+			IOShards Shards;
 
 			// a vector of Token files
 			std::vector<Poco::File> TokenFiles;
@@ -51,6 +60,10 @@ namespace Twitch
 			// Running client list
 			std::vector<Twitch::IRCBot *> Clients;
 
+			// clients that have been stopped.  Their handlers may still be
+			// queued, so each is only deleted once it says they've all run
+			std::vector<Twitch::IRCBot *> StoppedClients;
+
 			// a path to a folder of clients (each a folder)
 			Poco::Path ClientPath;
 
@@ -61,16 +74,51 @@ namespace Twitch
 			// and user command
 			IRCCorrelator MasterIRCCorrelator;
 			CommandCorrelator MasterCommandCorrelator;
+
+			// the user commands every client shares (one copy, swapped whole on changes)
+			CommandRegistry SharedCommands;
+
+			// state shared between clients on the same account (rate limits)
+			AccountRegistry Accounts;
+
+			// paces connections and logins across every client (see Admission.hpp)
+			Admission Gate;
+
+			// shares handler time fairly between clients (see FairScheduler.hpp)
+			FairScheduler Fairness;
+
+			// watches client folders, so edits reach running clients without a reconnect
+			FolderWatcher Watcher;
+
+			// keep-alive HTTPS connections for OAuth and API calls
+			HTTPSPool Https;
+
+			// renews expired tokens off of the IO threads (uses the creds and pool above)
+			TokenService Tokens;
+
+			// guards Clients and StoppedClients, which the console, token
+			// renewals and stopping clients all change
+			std::mutex ClientsLock;
 	
 			// a function to renew those tokens as needed (to pass to clients)
 			bool _renewToken(Twitch::token &);
 
-			// a function to spawn threads from to run the IO context
-			void _runContext();
+			// a function to spawn threads from to run an IO context
+			void _runContext(asio::io_context &context);
+
+			// stops a running client and takes it out of Clients (false if it wasn't there)
+			bool _stopClient(const Twitch::IRCBot *client);
+
+			// frees a stopped client once its handlers have all run
+			void _reclaimClient(Twitch::IRCBot *client);
+
+			// passes a change to a client's folder on, if it's still running
+			void _clientFileChanged(IRCBot *client, const std::string &file);
 
 			// strings containing the server and port to connect to
-			const std::string Server = "irc.chat.twitch.tv";
-			const std::string Port = "6667";
+			// (irc.chat.twitch.tv:6667 unless the environment says otherwise)
+			const std::string Server;
+			const std::string Port;
 
 			// path to credentials
 			Poco::Path CredsPath;
@@ -89,12 +137,24 @@ namespace Twitch
 			// function to create a new instance from a token.
 			void launchClientInstance(Poco::File &ClientFile, std::string server, std::string port);
 
+			// passes a change to a file in a running client's folder on to it
+			static void clientFileChanged(IRCBot *client, const std::string &file);
+
+			// launches every stored client (found by init)
+			void launchStored();
+
 			// a function to create a token file
 			void createToken(std::istream &in, Poco::Path &dir);
 
 			// a function to delete a token file and update the list of tokens accordingly
 			void deleteToken(int index);
 
+			// prints the clients waiting to (re)connect
+			void printBacklog(std::ostream &out);
+
+			// prints how much handler time each client is getting
+			void printFairness(std::ostream &out);
+
 			// function to startup baribot
 			void init();
 
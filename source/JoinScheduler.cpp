@@ -0,0 +1,231 @@
+/* JoinScheduler.cpp - Miles Shamo
+ *
+ * Implementation of the channel JOIN scheduler
+ *
+ */
+
+#include "JoinScheduler.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <set>
+
+
+std::string Twitch::JoinScheduler::_name(std::string_view channel)
+{
+	if (!channel.empty() && channel.front() == '#')
+		channel.remove_prefix(1);
+
+	if (channel.empty())
+		return std::string();
+
+	// Twitch channel names are all lower case
+	std::string name = "#";
+	for (char c : channel)
+		name += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+
+	return name;
+}
+
+
+void Twitch::JoinScheduler::add(std::string_view channel)
+{
+	std::string name = _name(channel);
+
+	if (name.empty())
+		return;
+
+	if (Channels.emplace(name, Channel()).second)
+		Queue.push_back(std::move(name));
+}
+
+
+// update
+//
+// Only the difference is touched: a channel in both lists keeps its
+// state (and its place in the queue), so a bot that is already in
+// it never leaves and joins again
+std::size_t Twitch::JoinScheduler::update(const std::vector<std::string> &channels, std::vector<std::string> &leave)
+{
+	std::set<std::string, std::less<>> wanted;
+	for (const auto &channel : channels)
+	{
+		std::string name = _name(channel);
+
+		if (!name.empty())
+			wanted.insert(std::move(name));
+	}
+
+	for (auto iter = Channels.begin(); iter != Channels.end();)
+	{
+		if (wanted.count(iter->first))
+		{
+			++iter;
+			continue;
+		}
+
+		switch (iter->second.State)
+		{
+			case JoinState::Pending:
+				Queue.erase(std::find(Queue.begin(), Queue.end(), iter->first));
+				break;
+			case JoinState::Sent:
+				// nothing to leave yet; if the JOIN does go through,
+				// the bot sees a channel we no longer have and leaves then
+				break;
+			case JoinState::Joined:
+				leave.push_back(iter->first);
+				JoinedCount--;
+				break;
+			case JoinState::Failed:
+				FailedCount--;
+				break;
+		}
+
+		iter = Channels.erase(iter);
+	}
+
+	std::size_t added = 0;
+	for (const auto &name : wanted)
+	{
+		if (Channels.emplace(name, Channel()).second)
+		{
+			Queue.push_back(name);
+			added++;
+		}
+	}
+
+	return added;
+}
+
+
+bool Twitch::JoinScheduler::contains(std::string_view channel) const
+{
+	return Channels.find(_name(channel)) != Channels.end();
+}
+
+
+void Twitch::JoinScheduler::clear()
+{
+	Channels.clear();
+	Queue.clear();
+
+	JoinedCount = 0;
+	FailedCount = 0;
+}
+
+
+// nextBatch
+//
+// takes channels from the front of the queue until either we run out
+// of allowed JOINs or the next name won't fit on the line
+std::size_t Twitch::JoinScheduler::nextBatch(std::size_t allowed, std::string &line, Clock::time_point now)
+{
+	std::size_t count = 0;
+
+	line = "JOIN ";
+
+	while (count < allowed && !Queue.empty())
+	{
+		const std::string &name = Queue.front();
+
+		// +1 for the comma
+		if (count > 0 && line.size() + 1 + name.size() > MaxLine)
+			break;
+
+		if (count > 0)
+			line += ',';
+		line += name;
+
+		auto &channel = Channels.find(name)->second;
+		channel.State = JoinState::Sent;
+		channel.Attempts++;
+		channel.Sent = now;
+
+		Queue.pop_front();
+		count++;
+	}
+
+	return count;
+}
+
+
+// expire
+//
+// Twitch doesn't always say why a JOIN went nowhere, so one that
+// hasn't come back in time is simply sent again, until it runs out
+// of attempts
+Twitch::Clock::time_point Twitch::JoinScheduler::expire(Clock::duration timeout, unsigned maxAttempts, Clock::time_point now)
+{
+	auto next = Clock::time_point::max();
+
+	for (auto &channel : Channels)
+	{
+		if (channel.second.State != JoinState::Sent)
+			continue;
+
+		if (now - channel.second.Sent < timeout)
+		{
+			next = std::min(next, channel.second.Sent + timeout);
+			continue;
+		}
+
+		if (channel.second.Attempts >= maxAttempts)
+		{
+			channel.second.State = JoinState::Failed;
+			FailedCount++;
+		}
+		else
+		{
+			channel.second.State = JoinState::Pending;
+			Queue.push_back(channel.first);
+		}
+	}
+
+	return next;
+}
+
+
+bool Twitch::JoinScheduler::joined(std::string_view channel)
+{
+	auto iter = Channels.find(channel);
+
+	if (iter == Channels.end())
+		return false;
+
+	if (iter->second.State == JoinState::Joined)
+		return true;
+
+	// a late confirmation for a channel we already queued again
+	if (iter->second.State == JoinState::Pending)
+		Queue.erase(std::find(Queue.begin(), Queue.end(), iter->first));
+	else if (iter->second.State == JoinState::Failed)
+		FailedCount--;
+
+	iter->second.State = JoinState::Joined;
+	JoinedCount++;
+
+	return true;
+}
+
+
+bool Twitch::JoinScheduler::failed(std::string_view channel)
+{
+	auto iter = Channels.find(channel);
+
+	if (iter == Channels.end())
+		return false;
+
+	if (iter->second.State == JoinState::Failed)
+		return true;
+
+	if (iter->second.State == JoinState::Pending)
+		Queue.erase(std::find(Queue.begin(), Queue.end(), iter->first));
+	else if (iter->second.State == JoinState::Joined)
+		JoinedCount--;
+
+	iter->second.State = JoinState::Failed;
+	FailedCount++;
+
+	return true;
+}
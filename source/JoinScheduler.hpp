@@ -0,0 +1,112 @@
+/* JoinScheduler.hpp - Miles Shamo
+ *
+ * Keeps track of the channels a bot should be in.
+ *
+ * Joining every channel in channels.txt at once
+ * goes straight over Twitch's JOIN limit, and the
+ * channels over it are silently never joined.  So
+ * channels wait here and go out as multi-channel
+ * JOINs ("JOIN #a,#b,#c"), only as many at a time
+ * as the account's JOIN window allows (see
+ * ChatLimiter::acquireJoins, which is shared by
+ * every bot on the account).
+ *
+ * With the membership capability Twitch echoes our
+ * own JOIN back for every channel we get into, so
+ * a channel only counts as joined once that echo
+ * arrives.  A JOIN that isn't confirmed in time is
+ * tried again, up to a limit, and one Twitch refuses
+ * outright (a suspended channel, a ban) is given up.
+ *
+ * When channels.txt changes under a running bot,
+ * update() diffs it against the channels we have:
+ * new ones are queued like any other, and dropped
+ * ones we were in are handed back to be PARTed.
+ * Channels in both are left exactly as they were.
+ *
+ * This does no locking; the IRCBot only touches it
+ * from its strand.
+ */
+
+#ifndef TWITCH_JOIN_SCHEDULER
+#define TWITCH_JOIN_SCHEDULER
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "RateLimiter.hpp"
+
+namespace Twitch
+{
+	class JoinScheduler
+	{
+		private:
+			enum class JoinState
+			{
+				Pending,	// waiting to be sent
+				Sent,		// sent, waiting for our JOIN to come back
+				Joined,
+				Failed		// refused, or out of attempts
+			};
+
+			struct Channel
+			{
+				JoinState State = JoinState::Pending;
+				unsigned Attempts = 0;
+				Clock::time_point Sent;
+			};
+
+			// every channel, by name (with the '#')
+			std::map<std::string, Channel, std::less<>> Channels;
+
+			// pending channels in the order they're to be sent
+			std::deque<std::string> Queue;
+
+			std::size_t JoinedCount = 0;
+			std::size_t FailedCount = 0;
+
+			// the longest JOIN line (IRC allows 512 bytes with the "\r\n")
+			static constexpr std::size_t MaxLine = 510;
+
+			// "#name" in lower case (empty if there is no name)
+			static std::string _name(std::string_view channel);
+
+		public:
+			// adds a channel (with or without the '#'); duplicates are ignored
+			void add(std::string_view channel);
+
+			// forgets every channel
+			void clear();
+
+			// makes channels the whole list (with or without their '#'s).  Dropped channels
+			// we had joined are added to leave, to be PARTed.  Returns the number of new channels
+			std::size_t update(const std::vector<std::string> &channels, std::vector<std::string> &leave);
+
+			// whether a channel is in the list (in any state)
+			bool contains(std::string_view channel) const;
+
+			// number of channels waiting to be sent
+			std::size_t pending() const { return Queue.size(); }
+
+			// Builds one JOIN for up to allowed pending channels into line (without "\r\n").
+			// Returns the number of channels in it
+			std::size_t nextBatch(std::size_t allowed, std::string &line, Clock::time_point now = Clock::now());
+
+			// Puts channels that weren't confirmed within timeout back in the queue.
+			// Returns when the next unconfirmed JOIN times out (max if none are waiting)
+			Clock::time_point expire(Clock::duration timeout, unsigned maxAttempts, Clock::time_point now = Clock::now());
+
+			// Twitch confirmed or refused a JOIN.  Returns false for a channel we never asked for
+			bool joined(std::string_view channel);
+			bool failed(std::string_view channel);
+
+			std::size_t joinedCount() const { return JoinedCount; }
+			std::size_t failedCount() const { return FailedCount; }
+	};
+}
+#endif
@@ -0,0 +1,82 @@
+/* LineBuffer.cpp - Miles Shamo
+ *
+ * Implementation of the IRCBot's receive buffer
+ *
+ */
+
+#include "LineBuffer.hpp"
+
+#include <cstring>
+
+Twitch::LineBuffer::LineBuffer(std::size_t capacity) : Data(capacity)
+{
+}
+
+
+// prepare
+//
+// Makes room at the end of the buffer.  Once everything
+// read has been handed out, we can just start over at the
+// front for free; otherwise the leftover partial line is
+// moved down only if the remaining space is too small.
+char *Twitch::LineBuffer::prepare(std::size_t minimum)
+{
+	if (Begin == End)
+		Begin = End = Scanned = 0;
+
+	if (Data.size() - End < minimum)
+	{
+		std::size_t length = End - Begin;
+
+		if (Begin != 0)
+		{
+			std::memmove(Data.data(), Data.data() + Begin, length);
+
+			Scanned -= Begin;
+			Begin = 0;
+			End = length;
+		}
+
+		// a single line bigger than the buffer, so make it bigger
+		if (Data.size() - End < minimum)
+			Data.resize(End + minimum);
+	}
+
+	return Data.data() + End;
+}
+
+
+// commit
+//
+// records n bytes read into the space from prepare()
+void Twitch::LineBuffer::commit(std::size_t n)
+{
+	End += n;
+}
+
+
+// nextLine
+//
+// finds the next '\n' after what was already searched, so
+// a partial line is never searched twice
+bool Twitch::LineBuffer::nextLine(std::string_view &line)
+{
+	if (Scanned < Begin)
+		Scanned = Begin;
+
+	const char *start = Data.data() + Scanned;
+	const void *found = std::memchr(start, '\n', End - Scanned);
+
+	if (!found)
+	{
+		Scanned = End;
+		return false;
+	}
+
+	std::size_t lineEnd = static_cast<const char *>(found) - Data.data() + 1;
+
+	line = std::string_view(Data.data() + Begin, lineEnd - Begin);
+	Begin = Scanned = lineEnd;
+
+	return true;
+}
@@ -0,0 +1,62 @@
+/* LineBuffer.hpp - Miles Shamo
+ *
+ * A reusable receive buffer for the IRCBot.
+ *
+ * The socket reads as much as it can straight
+ * into the free space at the end of the buffer,
+ * and then every complete line is handed out as
+ * a view, in place.  Whatever is left over (the
+ * start of a line that hasn't fully arrived yet)
+ * simply stays where it is for the next read.
+ *
+ * The only time bytes move is when the free space
+ * at the end runs low, at which point the (partial)
+ * leftover is shifted to the front.  If a single line
+ * is larger than the whole buffer, it grows.
+ */
+
+#ifndef TWITCH_LINE_BUFFER
+#define TWITCH_LINE_BUFFER
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+namespace Twitch
+{
+	class LineBuffer
+	{
+		private:
+			std::vector<char> Data;
+
+			// [Begin, End) is unread data, [End, Data.size()) is free space
+			std::size_t Begin = 0, End = 0;
+
+			// where the search for the next '\n' picks up from
+			std::size_t Scanned = 0;
+
+		public:
+			explicit LineBuffer(std::size_t capacity = 16384);
+
+			// returns free space to read into, making sure there is at least minimum of it
+			char *prepare(std::size_t minimum = 4096);
+			std::size_t space() const { return Data.size() - End; }
+
+			// marks n bytes written to prepare()'s pointer as recieved
+			void commit(std::size_t n);
+
+			// the last n bytes commited (what a read just brought in)
+			std::string_view recent(std::size_t n) const { return std::string_view(Data.data() + End - n, n); }
+
+			// hands out the next complete line (including its "\r\n").
+			// The view is valid until the next call to prepare().
+			bool nextLine(std::string_view &line);
+
+			// bytes of a partial line waiting on more data
+			std::size_t pending() const { return End - Begin; }
+
+			// drops everything (used when the connection is reset)
+			void clear() { Begin = End = Scanned = 0; }
+	};
+}
+#endif
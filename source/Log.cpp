@@ -0,0 +1,1052 @@
+/* Log.cpp - Miles Shamo
+ *
+ * Implementation of the logging: the per thread
+ * rings, the background thread that writes them
+ * out, and the one that archives rotated logs.
+ *
+ */
+
+#include "Log.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// compression and cleanup of rotated logs
+#include <Poco/DeflatingStream.h>
+#include <Poco/File.h>
+#include <Poco/Path.h>
+#include <Poco/StreamCopier.h>
+
+// an open file, and the lines read for it but not yet written.
+// Only the background thread touches these
+struct Twitch::LogFile
+{
+	std::FILE *Handle = nullptr;
+	std::string Pending;
+
+	// binary logs, and which formats have been written to this one
+	bool Binary = false;
+	std::vector<bool> Defined;
+
+	// where it is and who writes it (for rotating it)
+	std::string Path;
+	std::string Source;
+
+	// the current segment's size, and when it was started
+	std::uintmax_t Size = 0;
+	std::chrono::steady_clock::time_point Started;
+
+	~LogFile()
+	{
+		if (Handle)
+			std::fclose(Handle);
+	}
+};
+
+namespace
+{
+	using namespace std::chrono_literals;
+
+	// per thread ring size (a power of two), and when to write
+	constexpr std::size_t RingSize = 1 << 18;
+	constexpr std::size_t FlushBytes = 1 << 16;
+	constexpr auto FlushInterval = 100ms;
+
+	// appends a value's bytes to a binary record
+	template <class T>
+	void appendRaw(std::string &out, T value)
+	{
+		out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+	}
+
+	// every LogFormat, by id (0 is plain text, so it's left empty)
+	struct FormatRegistry
+	{
+		std::mutex Lock;
+		std::vector<const Twitch::LogFormat *> Formats{nullptr};
+
+		static FormatRegistry &instance()
+		{
+			static FormatRegistry registry;
+			return registry;
+		}
+	};
+
+	// writes a format's definition into a file, the first time it's used there
+	void define(Twitch::LogFile &file, std::uint32_t id)
+	{
+		if (id < file.Defined.size() && file.Defined[id])
+			return;
+
+		const Twitch::LogFormat *format = Twitch::LogFormat::find(id);
+		if (!format)
+			return;
+
+		if (id >= file.Defined.size())
+			file.Defined.resize(id + 1);
+		file.Defined[id] = true;
+
+		std::string_view text = format->text();
+
+		file.Pending.push_back(Twitch::LogRecordKind::Format);
+		appendRaw(file.Pending, id);
+		appendRaw(file.Pending, static_cast<std::uint8_t>(format->fields().size()));
+		for (auto field : format->fields())
+			file.Pending.push_back(static_cast<char>(field));
+		appendRaw(file.Pending, static_cast<std::uint16_t>(text.size()));
+		file.Pending.append(text.substr(0, UINT16_MAX));
+	}
+
+	// starts a binary session, so its events can be given a time
+	void startSession(Twitch::LogFile &file)
+	{
+		auto wall = std::chrono::system_clock::now().time_since_epoch();
+		std::string_view source = std::string_view(file.Source).substr(0, UINT16_MAX);
+
+		file.Pending.push_back(Twitch::LogRecordKind::Session);
+		appendRaw(file.Pending, Twitch::logClock());
+		appendRaw(file.Pending, static_cast<std::int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(wall).count()));
+		appendRaw(file.Pending, static_cast<std::uint16_t>(source.size()));
+		file.Pending.append(source);
+	}
+
+	// A rotated segment is named after its log and the time it was
+	// rotated (log.txt.20201231-235959), with a count after it for
+	// the second and later ones in the same second (.1, .2 and so
+	// on).  Compressing one adds a .gz
+	std::string segmentName(const std::string &path)
+	{
+		std::time_t now = std::time(nullptr);
+		std::tm parts;
+		localtime_r(&now, &parts);
+
+		char stamp[32];
+		std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &parts);
+
+		std::string name = path + "." + stamp;
+
+		// rotated twice in a second
+		for (int i = 1; Poco::File(name).exists() || Poco::File(name + ".gz").exists(); i++)
+			name = path + "." + stamp + "." + std::to_string(i);
+
+		return name;
+	}
+
+	// Compresses rotated segments and removes the ones past the
+	// retention limit.  This can take a while, so it has a thread of
+	// its own and the writer only ever hands it work.
+	class LogArchiver
+	{
+		private:
+			struct Job
+			{
+				std::string Segment;
+				std::string Live;
+				Twitch::LogRotation Policy;
+			};
+
+			std::mutex Lock;
+			std::condition_variable Wake, Idle;
+
+			std::deque<Job> Jobs;
+			bool Busy = false;
+			bool Stopping = false;
+
+			std::thread Thread;
+
+			void _run();
+			void _compress(const std::string &segment);
+			void _prune(const std::string &live, std::size_t keep);
+
+		public:
+			LogArchiver() : Thread(&LogArchiver::_run, this) {}
+
+			~LogArchiver()
+			{
+				{
+					std::lock_guard<std::mutex> guard(Lock);
+					Stopping = true;
+				}
+
+				Wake.notify_one();
+				Thread.join();
+			}
+
+			void add(std::string segment, std::string live, const Twitch::LogRotation &policy)
+			{
+				{
+					std::lock_guard<std::mutex> guard(Lock);
+					Jobs.push_back({std::move(segment), std::move(live), policy});
+				}
+
+				Wake.notify_one();
+			}
+
+			// waits for everything handed over so far to be done
+			void wait()
+			{
+				std::unique_lock<std::mutex> guard(Lock);
+				Idle.wait(guard, [this]() { return Jobs.empty() && !Busy; });
+			}
+	};
+
+
+	// _run
+	//
+	// works through the jobs, finishing any left when stopping
+	void LogArchiver::_run()
+	{
+		std::unique_lock<std::mutex> guard(Lock);
+
+		while (true)
+		{
+			Wake.wait(guard, [this]() { return Stopping || !Jobs.empty(); });
+
+			if (Jobs.empty())
+				return;
+
+			Job job = std::move(Jobs.front());
+			Jobs.pop_front();
+			Busy = true;
+
+			guard.unlock();
+
+			// a failure only costs us this segment's cleanup
+			try
+			{
+				if (job.Policy.Compress)
+					_compress(job.Segment);
+
+				if (job.Policy.Keep)
+					_prune(job.Live, job.Policy.Keep);
+			}
+			catch (const std::exception &)
+			{
+			}
+
+			guard.lock();
+
+			Busy = false;
+			Idle.notify_all();
+		}
+	}
+
+
+	// _compress
+	//
+	// gzips a segment next to itself, then removes the original
+	void LogArchiver::_compress(const std::string &segment)
+	{
+		std::ifstream in(segment, std::ios::binary);
+		std::ofstream out(segment + ".gz", std::ios::binary);
+
+		if (!in || !out)
+			return;
+
+		Poco::DeflatingOutputStream deflate(out, Poco::DeflatingStreamBuf::STREAM_GZIP);
+		Poco::StreamCopier::copyStream(in, deflate);
+		deflate.close();
+		out.close();
+
+		if (out)
+			Poco::File(segment).remove();
+		else
+			Poco::File(segment + ".gz").remove();
+	}
+
+
+	// _prune
+	//
+	// removes all but the newest keep segments of a log
+	void LogArchiver::_prune(const std::string &live, std::size_t keep)
+	{
+		Poco::Path livePath(live);
+		std::string prefix = livePath.getFileName() + ".";
+		std::string folder = livePath.parent().toString();
+
+		if (folder.empty())
+			folder = ".";
+
+		std::vector<std::string> names, segments;
+		Poco::File(folder).list(names);
+
+		for (auto &name : names)
+		{
+			if (name.size() > prefix.size() && name.compare(0, prefix.size(), prefix) == 0)
+				segments.push_back(name);
+		}
+
+		if (segments.size() <= keep)
+			return;
+
+		// oldest first, whether or not they've been compressed yet.  The
+		// count isn't padded (.10 comes after .9), so it's compared as a number
+		auto age = [&](const std::string &name)
+		{
+			std::string_view key = name;
+			key.remove_prefix(prefix.size());
+			if (key.size() > 3 && key.substr(key.size() - 3) == ".gz")
+				key.remove_suffix(3);
+
+			unsigned long count = 0;
+			auto dot = key.find('.');
+			if (dot != std::string_view::npos)
+			{
+				std::from_chars(key.data() + dot + 1, key.data() + key.size(), count);
+				key = key.substr(0, dot);
+			}
+
+			return std::make_pair(key, count);
+		};
+
+		std::sort(segments.begin(), segments.end(), [&](const auto &a, const auto &b) { return age(a) < age(b); });
+
+		for (std::size_t i = 0; i + keep < segments.size(); i++)
+			Poco::File(Poco::Path(Poco::Path(folder), segments[i])).remove();
+	}
+
+	// each line in a ring is a header followed by its text
+	struct RecordHeader
+	{
+		Twitch::LogFile *File;
+		std::uint32_t Size;
+	};
+
+	// Head only moves forward on the logging thread, and Tail on the
+	// background one, so neither needs a lock.  Both only ever grow;
+	// the position in Data is the index modulo RingSize.
+	struct Ring
+	{
+		std::unique_ptr<char[]> Data = std::make_unique<char[]>(RingSize);
+
+		std::atomic<std::size_t> Head{0};
+		std::atomic<std::size_t> Tail{0};
+
+		// its thread has exited, so it can go once it's empty
+		std::atomic<bool> Orphaned{false};
+
+		void put(std::size_t at, const void *from, std::size_t size)
+		{
+			std::size_t offset = at & (RingSize - 1);
+			std::size_t first = std::min(size, RingSize - offset);
+
+			std::memcpy(Data.get() + offset, from, first);
+			std::memcpy(Data.get(), static_cast<const char *>(from) + first, size - first);
+		}
+
+		void get(std::size_t at, void *to, std::size_t size) const
+		{
+			std::size_t offset = at & (RingSize - 1);
+			std::size_t first = std::min(size, RingSize - offset);
+
+			std::memcpy(to, Data.get() + offset, first);
+			std::memcpy(static_cast<char *>(to) + first, Data.get(), size - first);
+		}
+	};
+
+	class LogWriter
+	{
+		private:
+			std::mutex Lock;
+			std::condition_variable Wake, Done;
+
+			std::vector<std::shared_ptr<Ring>> Rings;
+			std::vector<std::shared_ptr<Twitch::LogFile>> Files;
+
+			bool Stopping = false;
+			bool Notified = false;
+
+			// flush() requests, and how many have been served
+			std::size_t Requested = 0, Completed = 0;
+
+			// how and when files are rotated
+			Twitch::LogRotation Rotation = Twitch::defaultLogRotation();
+			LogArchiver Archiver;
+
+			std::thread Thread;
+
+			void _run();
+			void _cycle();
+			void _rotate(Twitch::LogFile &file, const Twitch::LogRotation &rotation);
+			bool _reopen(Twitch::LogFile &file);
+
+		public:
+			LogWriter() : Thread(&LogWriter::_run, this) {}
+
+			~LogWriter()
+			{
+				{
+					std::lock_guard<std::mutex> guard(Lock);
+					Stopping = true;
+				}
+
+				Wake.notify_one();
+				Thread.join();
+			}
+
+			static LogWriter &instance()
+			{
+				static LogWriter writer;
+				return writer;
+			}
+
+			std::shared_ptr<Ring> addRing()
+			{
+				auto ring = std::make_shared<Ring>();
+
+				std::lock_guard<std::mutex> guard(Lock);
+				Rings.push_back(ring);
+
+				return ring;
+			}
+
+			std::shared_ptr<Twitch::LogFile> open(const std::string &path, bool binary, std::string_view source)
+			{
+				std::FILE *handle = std::fopen(path.c_str(), binary ? "ab" : "a");
+				if (!handle)
+					return nullptr;
+
+				auto file = std::make_shared<Twitch::LogFile>();
+				file->Handle = handle;
+				file->Binary = binary;
+				file->Path = path;
+				file->Source = source;
+				file->Started = std::chrono::steady_clock::now();
+
+				// picks up where the last run left the file
+				if (std::fseek(handle, 0, SEEK_END) == 0)
+					file->Size = std::max(std::ftell(handle), 0L);
+
+				if (binary)
+					startSession(*file);
+
+				std::lock_guard<std::mutex> guard(Lock);
+				Files.push_back(file);
+
+				return file;
+			}
+
+			// wakes the writer early (a ring is filling up)
+			void notify()
+			{
+				{
+					std::lock_guard<std::mutex> guard(Lock);
+					Notified = true;
+				}
+
+				Wake.notify_one();
+			}
+
+			void setRotation(const Twitch::LogRotation &rotation)
+			{
+				std::lock_guard<std::mutex> guard(Lock);
+				Rotation = rotation;
+			}
+
+			void flush()
+			{
+				{
+					std::unique_lock<std::mutex> guard(Lock);
+
+					std::size_t ticket = ++Requested;
+					Wake.notify_one();
+
+					Done.wait(guard, [&]()
+					{
+						return Completed >= ticket || Stopping;
+					});
+				}
+
+				Archiver.wait();
+			}
+	};
+
+	// this thread's ring and line buffer
+	struct ThreadState
+	{
+		std::shared_ptr<Ring> Lines;
+		std::string Buffer;
+
+		~ThreadState()
+		{
+			if (Lines)
+				Lines->Orphaned = true;
+		}
+	};
+
+	thread_local ThreadState State;
+
+
+	// push
+	//
+	// copies one finished line into this thread's ring
+	void push(Twitch::LogFile *file, std::string_view text)
+	{
+		LogWriter &writer = LogWriter::instance();
+
+		if (!State.Lines)
+			State.Lines = writer.addRing();
+
+		Ring &ring = *State.Lines;
+
+		// a single line can't take more than half the ring
+		text = text.substr(0, RingSize / 2 - sizeof(RecordHeader));
+
+		RecordHeader header{file, static_cast<std::uint32_t>(text.size())};
+		std::size_t need = sizeof(header) + text.size();
+
+		std::size_t head = ring.Head.load(std::memory_order_relaxed);
+
+		// full, so wait for the writer (this should be rare)
+		while (RingSize - (head - ring.Tail.load(std::memory_order_acquire)) < need)
+		{
+			writer.notify();
+			std::this_thread::yield();
+		}
+
+		ring.put(head, &header, sizeof(header));
+		ring.put(head + sizeof(header), text.data(), text.size());
+
+		ring.Head.store(head + need, std::memory_order_release);
+
+		if (head + need - ring.Tail.load(std::memory_order_relaxed) >= FlushBytes)
+			writer.notify();
+	}
+
+
+	// _run
+	//
+	// writes everything out every FlushInterval, or sooner if woken,
+	// and once more when stopping
+	void LogWriter::_run()
+	{
+		std::unique_lock<std::mutex> guard(Lock);
+
+		while (true)
+		{
+			Wake.wait_for(guard, FlushInterval, [this]()
+			{
+				return Stopping || Notified || Requested > Completed;
+			});
+
+			bool stopping = Stopping;
+			std::size_t requested = Requested;
+			Notified = false;
+
+			guard.unlock();
+			_cycle();
+			guard.lock();
+
+			Completed = requested;
+			Done.notify_all();
+
+			if (stopping)
+				return;
+		}
+	}
+
+
+	// _cycle
+	//
+	// Reads every ring, then writes each file's lines with one write.  
+	// A file only we still hold can't be logged to any more, so it's
+	// closed once this pass has read its last lines.  The same goes
+	// for a ring whose thread has gone.
+	void LogWriter::_cycle()
+	{
+		std::vector<std::shared_ptr<Ring>> rings;
+		std::vector<std::shared_ptr<Twitch::LogFile>> files;
+		std::vector<std::shared_ptr<Ring>> finished;
+		Twitch::LogRotation rotation;
+
+		{
+			std::lock_guard<std::mutex> guard(Lock);
+
+			rotation = Rotation;
+
+			// kept in the order they were opened, so a file that was
+			// closed and opened again is still written in order
+			files = Files;
+
+			// held only by Files and the copy, so nothing can log to it
+			Files.erase(std::remove_if(Files.begin(), Files.end(),
+						[](const auto &file) { return file.use_count() == 2; }), Files.end());
+
+			for (auto iter = Rings.begin(); iter != Rings.end();)
+			{
+				if ((*iter)->Orphaned)
+				{
+					finished.push_back(std::move(*iter));
+					iter = Rings.erase(iter);
+				}
+				else
+				{
+					rings.push_back(*iter);
+					++iter;
+				}
+			}
+		}
+
+		rings.insert(rings.end(), finished.begin(), finished.end());
+
+		// a segment that couldn't be started last time is tried again
+		// (before reading, so a binary one's session comes first)
+		for (auto &file : files)
+		{
+			if (!file->Handle)
+				_reopen(*file);
+		}
+
+		for (auto &ring : rings)
+		{
+			std::size_t tail = ring->Tail.load(std::memory_order_relaxed);
+			std::size_t head = ring->Head.load(std::memory_order_acquire);
+
+			while (tail < head)
+			{
+				RecordHeader header;
+				ring->get(tail, &header, sizeof(header));
+
+				// a binary event's format is written before its first use
+				if (header.File->Binary && header.Size >= Twitch::LogRecordKind::EventHeader)
+				{
+					std::uint32_t id;
+					ring->get(tail + sizeof(header) + 1, &id, sizeof(id));
+
+					if (id != 0)
+						define(*header.File, id);
+				}
+
+				auto &pending = header.File->Pending;
+				std::size_t at = pending.size();
+
+				pending.resize(at + header.Size);
+				ring->get(tail + sizeof(header), pending.data() + at, header.Size);
+
+				tail += sizeof(header) + header.Size;
+			}
+
+			ring->Tail.store(tail, std::memory_order_release);
+		}
+
+		auto now = std::chrono::steady_clock::now();
+
+		for (auto &file : files)
+		{
+			if (!file->Pending.empty() && file->Handle)
+			{
+				std::fwrite(file->Pending.data(), 1, file->Pending.size(), file->Handle);
+				std::fflush(file->Handle);
+
+				file->Size += file->Pending.size();
+			}
+
+			file->Pending.clear();
+
+			bool full = rotation.MaxBytes && file->Size >= rotation.MaxBytes;
+			bool old = rotation.MaxAge.count() && now - file->Started >= rotation.MaxAge;
+
+			if (file->Handle && file->Size && (full || old))
+				_rotate(*file, rotation);
+		}
+	}
+
+
+	// _rotate
+	//
+	// Moves a file's current segment aside and starts a new one.
+	// That's only a rename and an open, so it's done right here;
+	// compressing the old segment is left to the archiver
+	void LogWriter::_rotate(Twitch::LogFile &file, const Twitch::LogRotation &rotation)
+	{
+		std::fclose(file.Handle);
+		file.Handle = nullptr;
+
+		std::string segment = segmentName(file.Path);
+		bool moved = std::rename(file.Path.c_str(), segment.c_str()) == 0;
+
+		_reopen(file);
+
+		if (moved)
+			Archiver.add(segment, file.Path, rotation);
+	}
+
+
+	// _reopen
+	//
+	// Starts a new segment at the file's path.  If that fails, the
+	// file's lines are dropped and every cycle tries again until it
+	// works (so a full disk or a missing folder only loses what was
+	// logged while it lasted)
+	bool LogWriter::_reopen(Twitch::LogFile &file)
+	{
+		file.Size = 0;
+		file.Started = std::chrono::steady_clock::now();
+
+		file.Handle = std::fopen(file.Path.c_str(), file.Binary ? "ab" : "a");
+		if (!file.Handle)
+			return false;
+
+		// picks up anything already there (if the rename failed)
+		if (std::fseek(file.Handle, 0, SEEK_END) == 0)
+			file.Size = std::max(std::ftell(file.Handle), 0L);
+
+		// a new binary segment has to stand on its own
+		if (file.Binary)
+		{
+			file.Defined.clear();
+			startSession(file);
+		}
+
+		return true;
+	}
+}
+
+
+Twitch::LogLevel Twitch::defaultLogLevel()
+{
+	static const LogLevel level = []()
+	{
+		const char *name = std::getenv("BARIBOT_LOG_LEVEL");
+
+		LogLevel value = LogLevel::Info;
+		if (name)
+			parseLogLevel(name, value);
+
+		return value;
+	}();
+
+	return level;
+}
+
+
+bool Twitch::parseLogLevel(std::string_view name, LogLevel &level)
+{
+	for (auto candidate : {LogLevel::Debug, LogLevel::Info, LogLevel::Warning, LogLevel::Error, LogLevel::Off})
+	{
+		if (name == logLevelName(candidate))
+		{
+			level = candidate;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+const char *Twitch::logLevelName(LogLevel level)
+{
+	switch (level)
+	{
+		case LogLevel::Debug:   return "debug";
+		case LogLevel::Info:    return "info";
+		case LogLevel::Warning: return "warning";
+		case LogLevel::Error:   return "error";
+		case LogLevel::Off:     return "off";
+	}
+
+	return "unknown";
+}
+
+
+Twitch::LogRotation Twitch::defaultLogRotation()
+{
+	auto number = [](const char *name, double fallback)
+	{
+		const char *value = std::getenv(name);
+		return value ? std::strtod(value, nullptr) : fallback;
+	};
+
+	LogRotation rotation;
+
+	rotation.MaxBytes = static_cast<std::uintmax_t>(number("BARIBOT_LOG_MAX_MB", rotation.MaxBytes >> 20) * (1 << 20));
+	rotation.MaxAge = std::chrono::seconds(static_cast<long long>(number("BARIBOT_LOG_MAX_HOURS", rotation.MaxAge.count() / 3600.0) * 3600));
+	rotation.Keep = static_cast<std::size_t>(number("BARIBOT_LOG_KEEP", rotation.Keep));
+	rotation.Compress = number("BARIBOT_LOG_COMPRESS", 1) != 0;
+
+	return rotation;
+}
+
+
+Twitch::LogEncoding Twitch::defaultLogEncoding()
+{
+	static const LogEncoding encoding = []()
+	{
+		const char *name = std::getenv("BARIBOT_LOG_FORMAT");
+
+		if (name && std::string_view(name) == "binary")
+			return LogEncoding::Binary;
+
+		return LogEncoding::Text;
+	}();
+
+	return encoding;
+}
+
+
+std::uint64_t Twitch::logClock()
+{
+	auto now = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+
+//--------------------------------------------------------
+// LogFormat
+
+Twitch::LogFormat::LogFormat(const char *text, std::initializer_list<LogField> fields)
+	:	Text(text),
+		Fields(fields)
+{
+	auto &registry = FormatRegistry::instance();
+	std::lock_guard<std::mutex> guard(registry.Lock);
+
+	Id = static_cast<std::uint32_t>(registry.Formats.size());
+	registry.Formats.push_back(this);
+}
+
+
+const Twitch::LogFormat *Twitch::LogFormat::find(std::uint32_t id)
+{
+	auto &registry = FormatRegistry::instance();
+	std::lock_guard<std::mutex> guard(registry.Lock);
+
+	return id < registry.Formats.size() ? registry.Formats[id] : nullptr;
+}
+
+
+//--------------------------------------------------------
+// LogLine
+
+Twitch::LogLine::LogLine(LogFile *file, bool enabled, LogLevel level, LogEncoding encoding)
+	:	File(file),
+		Buffer(enabled ? &State.Buffer : nullptr),
+		Binary(encoding == LogEncoding::Binary)
+{
+	// lines can nest (a line logged while building another), so
+	// each one only owns the end of the buffer from where it began
+	if (!Buffer)
+		return;
+
+	Start = Buffer->size();
+
+	// a binary line is an event of format 0, whose one argument's
+	// length is filled in once the line is done
+	if (Binary)
+	{
+		Buffer->push_back(LogRecordKind::Event);
+		appendRaw(*Buffer, std::uint32_t(0));
+		appendRaw(*Buffer, static_cast<std::uint8_t>(level));
+		appendRaw(*Buffer, logClock());
+		appendRaw(*Buffer, std::uint8_t(1));
+		Buffer->push_back(LogRecordKind::String);
+		appendRaw(*Buffer, std::uint32_t(0));
+	}
+}
+
+
+Twitch::LogLine::LogLine(LogLine &&other)
+	:	File(other.File),
+		Buffer(other.Buffer),
+		Start(other.Start),
+		Binary(other.Binary)
+{
+	other.Buffer = nullptr;
+}
+
+
+Twitch::LogLine::~LogLine()
+{
+	if (!Buffer)
+		return;
+
+	std::size_t header = Binary ? LogRecordKind::EventHeader + 1 + 4 : 0;
+
+	if (Buffer->size() > Start + header)
+	{
+		if (Binary)
+		{
+			auto length = static_cast<std::uint32_t>(Buffer->size() - Start - header);
+			std::memcpy(Buffer->data() + Start + header - 4, &length, sizeof(length));
+		}
+
+		push(File, std::string_view(*Buffer).substr(Start));
+	}
+
+	Buffer->resize(Start);
+}
+
+
+void Twitch::LogLine::_appendNumber(long long value)
+{
+	char digits[24];
+	auto result = std::to_chars(digits, digits + sizeof(digits), value);
+	Buffer->append(digits, result.ptr);
+}
+
+
+void Twitch::LogLine::_appendNumber(unsigned long long value)
+{
+	char digits[24];
+	auto result = std::to_chars(digits, digits + sizeof(digits), value);
+	Buffer->append(digits, result.ptr);
+}
+
+
+void Twitch::LogLine::_appendNumber(double value)
+{
+	char digits[32];
+	int length = std::snprintf(digits, sizeof(digits), "%g", value);
+	Buffer->append(digits, length > 0 ? length : 0);
+}
+
+
+//--------------------------------------------------------
+// LogRecord
+
+Twitch::LogRecord::LogRecord(LogFile *file, LogLevel level, LogEncoding encoding, const LogFormat &format)
+	:	File(file),
+		Buffer(&State.Buffer),
+		Start(State.Buffer.size()),
+		Binary(encoding == LogEncoding::Binary),
+		Rest(format.text())
+{
+	if (Binary)
+	{
+		Buffer->push_back(LogRecordKind::Event);
+		appendRaw(*Buffer, format.id());
+		appendRaw(*Buffer, static_cast<std::uint8_t>(level));
+		appendRaw(*Buffer, logClock());
+		appendRaw(*Buffer, std::uint8_t(0));
+	}
+}
+
+
+Twitch::LogRecord::~LogRecord()
+{
+	if (!Binary)
+	{
+		Buffer->append(Rest);
+		Buffer->push_back('\n');
+	}
+
+	push(File, std::string_view(*Buffer).substr(Start));
+	Buffer->resize(Start);
+}
+
+
+// _text
+//
+// writes the format up to its next "{}", then the argument
+void Twitch::LogRecord::_text(std::string_view value)
+{
+	const char *next = std::strstr(Rest, "{}");
+
+	if (next)
+	{
+		Buffer->append(Rest, next);
+		Rest = next + 2;
+	}
+
+	Buffer->append(value);
+}
+
+
+void Twitch::LogRecord::add(std::string_view value)
+{
+	if (!Binary)
+		return _text(value);
+
+	value = value.substr(0, UINT32_MAX);
+
+	(*Buffer)[Start + LogRecordKind::EventHeader - 1]++;
+	Buffer->push_back(LogRecordKind::String);
+	appendRaw(*Buffer, static_cast<std::uint32_t>(value.size()));
+	Buffer->append(value);
+}
+
+
+void Twitch::LogRecord::_addNumber(long long value)
+{
+	if (!Binary)
+	{
+		char digits[24];
+		auto result = std::to_chars(digits, digits + sizeof(digits), value);
+		return _text(std::string_view(digits, result.ptr - digits));
+	}
+
+	(*Buffer)[Start + LogRecordKind::EventHeader - 1]++;
+	Buffer->push_back(LogRecordKind::Signed);
+	appendRaw(*Buffer, static_cast<std::int64_t>(value));
+}
+
+
+void Twitch::LogRecord::_addNumber(unsigned long long value)
+{
+	if (!Binary)
+	{
+		char digits[24];
+		auto result = std::to_chars(digits, digits + sizeof(digits), value);
+		return _text(std::string_view(digits, result.ptr - digits));
+	}
+
+	(*Buffer)[Start + LogRecordKind::EventHeader - 1]++;
+	Buffer->push_back(LogRecordKind::Unsigned);
+	appendRaw(*Buffer, static_cast<std::uint64_t>(value));
+}
+
+
+void Twitch::LogRecord::_addNumber(double value)
+{
+	if (!Binary)
+	{
+		char digits[32];
+		int length = std::snprintf(digits, sizeof(digits), "%g", value);
+		return _text(std::string_view(digits, length > 0 ? length : 0));
+	}
+
+	(*Buffer)[Start + LogRecordKind::EventHeader - 1]++;
+	Buffer->push_back(LogRecordKind::Double);
+	appendRaw(*Buffer, value);
+}
+
+
+//--------------------------------------------------------
+// Log
+
+void Twitch::Log::open(const std::string &path, std::string_view source)
+{
+	File = LogWriter::instance().open(path, Encoding == LogEncoding::Binary, source);
+}
+
+
+void Twitch::Log::close()
+{
+	File.reset();
+}
+
+
+void Twitch::Log::setRotation(const LogRotation &rotation)
+{
+	LogWriter::instance().setRotation(rotation);
+}
+
+
+void Twitch::Log::flush()
+{
+	LogWriter::instance().flush();
+}
@@ -0,0 +1,340 @@
+/* Log.hpp - Miles Shamo
+ *
+ * The bots' logging.
+ *
+ * A bot used to write straight to an ofstream,
+ * flushing with every endl, so every chat line
+ * cost a few write() calls on the thread handling
+ * it.  Now a line is built in a buffer belonging
+ * to the thread that logs it, and a single
+ * background thread collects those buffers and
+ * writes each file's lines out together, once
+ * enough has built up or every so often.
+ *
+ * The per thread buffers are rings with one reader
+ * (the background thread) and one writer (their
+ * thread), so logging takes no locks.  If a ring is
+ * ever full the logging thread waits for it to be
+ * emptied rather than lose lines.
+ *
+ * Lines have a level, and each Log only keeps
+ * lines at or above its own.  A line below it is
+ * never formatted, so the per message debug lines
+ * cost next to nothing when they're turned off.
+ * The default level comes from BARIBOT_LOG_LEVEL
+ * (debug, info, warning or error; info if unset).
+ *
+ * Usage is the same as the ofstream it replaces:
+ * 		log << "Connected to " << server << endl;
+ * 		log.debug() << "IRC " << command << endl;
+ * with a line written when the statement ends.
+ *
+ * Busy lines can instead be recorded against a
+ * LogFormat, registered once:
+ * 		static const LogFormat Received("IRC {} RECIEVED", {LogField::Command});
+ * 		log.record(LogLevel::Debug, Received, command);
+ * In a text log that's the same line as before.  In
+ * a binary log (BARIBOT_LOG_FORMAT=binary) only the
+ * format's id, a timestamp and the arguments are
+ * kept, and the format's text is written once per
+ * file.  Arguments tagged as a channel or a command
+ * can then be filtered on by baribot-logcat, which
+ * decodes binary logs (see LogDecoder.hpp).
+ *
+ * Logs are rotated once they reach a size or an
+ * age (see LogRotation).  The old segment is renamed
+ * aside by the writer, which then carries on with a
+ * new file, and a second background thread gzips it
+ * and removes segments past the retention limit, so
+ * rotating never holds up logging.
+ *
+ * A binary log is a series of records, each
+ * starting with a one byte kind, in the host's byte
+ * order:
+ * 		'S' a session (every time the file is opened)
+ * 			u64 steady clock ns, i64 system clock ns, u16 length, source name
+ * 		'F' a format (before its first event in a session)
+ * 			u32 id, u8 count, count LogFields, u16 length, text
+ * 		'E' an event
+ * 			u32 format id, u8 level, u64 steady clock ns, u8 count, count arguments
+ * where each argument is 'i' i64, 'u' u64, 'd' a double,
+ * or 's' u32 length and the text.  Format 0 is a plain
+ * text line (with its own newlines), with one argument.
+ */
+
+#ifndef TWITCH_LOG
+#define TWITCH_LOG
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace Twitch
+{
+	enum class LogLevel
+	{
+		Debug,
+		Info,
+		Warning,
+		Error,
+		Off
+	};
+
+	// the level from BARIBOT_LOG_LEVEL
+	LogLevel defaultLogLevel();
+
+	// levels by name (debug, info, warning, error or off)
+	bool parseLogLevel(std::string_view name, LogLevel &level);
+	const char *logLevelName(LogLevel level);
+
+	enum class LogEncoding
+	{
+		Text,
+		Binary
+	};
+
+	// the encoding from BARIBOT_LOG_FORMAT (text or binary; text if unset)
+	LogEncoding defaultLogEncoding();
+
+	// when logs are rotated, and what happens to the old segments
+	struct LogRotation
+	{
+		// rotate once a file is this big, or this old (zero for never)
+		std::uintmax_t MaxBytes = 64 << 20;
+		std::chrono::seconds MaxAge = std::chrono::hours(24);
+
+		// old segments kept per log (zero keeps them all), and gzipped
+		std::size_t Keep = 7;
+		bool Compress = true;
+	};
+
+	// the defaults, overridden by BARIBOT_LOG_MAX_MB, BARIBOT_LOG_MAX_HOURS,
+	// BARIBOT_LOG_KEEP and BARIBOT_LOG_COMPRESS (0 or 1)
+	LogRotation defaultLogRotation();
+
+	// what a format's argument means, for filtering binary logs
+	enum class LogField : unsigned char
+	{
+		Value,
+		Channel,
+		Command
+	};
+
+	// the kinds of binary records, and argument types (see above)
+	namespace LogRecordKind
+	{
+		constexpr char Session = 'S';
+		constexpr char Format = 'F';
+		constexpr char Event = 'E';
+
+		constexpr char Signed = 'i';
+		constexpr char Unsigned = 'u';
+		constexpr char Double = 'd';
+		constexpr char String = 's';
+
+		// the size of an event before its arguments
+		constexpr std::size_t EventHeader = 1 + 4 + 1 + 8 + 1;
+	}
+
+	// the clock binary logs are stamped with (steady, in nanoseconds)
+	std::uint64_t logClock();
+
+	// A format string with a "{}" for each argument.  Each is given
+	// an id when it's constructed, so they should be static
+	class LogFormat
+	{
+		private:
+			const char *Text;
+			std::vector<LogField> Fields;
+			std::uint32_t Id;
+
+		public:
+			LogFormat(const char *text, std::initializer_list<LogField> fields = {});
+			LogFormat(const LogFormat &) = delete;
+
+			const char *text() const { return Text; }
+			const std::vector<LogField> &fields() const { return Fields; }
+			std::uint32_t id() const { return Id; }
+
+			// a format by its id (nullptr if there isn't one)
+			static const LogFormat *find(std::uint32_t id);
+	};
+
+	// an open log file (owned by the background writer; see Log.cpp)
+	struct LogFile;
+
+	// one line being built, written out when it's destroyed
+	class LogLine
+	{
+		private:
+			LogFile *File;
+
+			// this thread's buffer (nullptr if the line is disabled),
+			// and where this line starts in it
+			std::string *Buffer;
+			std::size_t Start = 0;
+
+			// in a binary log, the line is built after an event header
+			bool Binary = false;
+
+			void _appendNumber(long long value);
+			void _appendNumber(unsigned long long value);
+			void _appendNumber(double value);
+
+		public:
+			LogLine(LogFile *file, bool enabled, LogLevel level = LogLevel::Info, LogEncoding encoding = LogEncoding::Text);
+			LogLine(LogLine &&other);
+			LogLine(const LogLine &) = delete;
+			~LogLine();
+
+			LogLine &operator<<(std::string_view text)
+			{
+				if (Buffer)
+					Buffer->append(text);
+				return *this;
+			}
+
+			LogLine &operator<<(const char *text) { return *this << std::string_view(text); }
+			LogLine &operator<<(const std::string &text) { return *this << std::string_view(text); }
+
+			LogLine &operator<<(char c)
+			{
+				if (Buffer)
+					Buffer->push_back(c);
+				return *this;
+			}
+
+			template <class T, std::enable_if_t<std::is_arithmetic_v<T>, int> = 0>
+			LogLine &operator<<(T value)
+			{
+				if (Buffer)
+				{
+					if constexpr (std::is_floating_point_v<T>)
+						_appendNumber(static_cast<double>(value));
+					else if constexpr (std::is_signed_v<T>)
+						_appendNumber(static_cast<long long>(value));
+					else
+						_appendNumber(static_cast<unsigned long long>(value));
+				}
+				return *this;
+			}
+
+			// std::endl (and any other manipulator) ends a line of text
+			LogLine &operator<<(std::ostream &(*)(std::ostream &))
+			{
+				if (Buffer)
+					Buffer->push_back('\n');
+				return *this;
+			}
+	};
+
+	// one event being recorded against a LogFormat
+	class LogRecord
+	{
+		private:
+			LogFile *File;
+			std::string *Buffer;
+			std::size_t Start;
+
+			bool Binary;
+
+			// text logs: how much of the format has been written
+			const char *Rest;
+
+			void _text(std::string_view value);
+			void _addNumber(long long value);
+			void _addNumber(unsigned long long value);
+			void _addNumber(double value);
+
+		public:
+			LogRecord(LogFile *file, LogLevel level, LogEncoding encoding, const LogFormat &format);
+			LogRecord(const LogRecord &) = delete;
+			~LogRecord();
+
+			void add(std::string_view value);
+			void add(const char *value) { add(std::string_view(value)); }
+			void add(const std::string &value) { add(std::string_view(value)); }
+
+			template <class T, std::enable_if_t<std::is_arithmetic_v<T>, int> = 0>
+			void add(T value)
+			{
+				if constexpr (std::is_floating_point_v<T>)
+					_addNumber(static_cast<double>(value));
+				else if constexpr (std::is_signed_v<T>)
+					_addNumber(static_cast<long long>(value));
+				else
+					_addNumber(static_cast<unsigned long long>(value));
+			}
+	};
+
+	class Log
+	{
+		private:
+			std::shared_ptr<LogFile> File;
+			LogLevel Level = defaultLogLevel();
+			LogEncoding Encoding = defaultLogEncoding();
+
+		public:
+			// Opens (appends to) a file; lines logged before this go nowhere.
+			// A binary log names its source in each session's header
+			void open(const std::string &path, std::string_view source = "");
+
+			void setEncoding(LogEncoding encoding) { Encoding = encoding; }
+			LogEncoding encoding() const { return Encoding; }
+
+			// stops logging (lines already logged are still written)
+			void close();
+
+			void setLevel(LogLevel level) { Level = level; }
+			bool enabled(LogLevel level) const { return File && level >= Level; }
+
+			LogLine at(LogLevel level) { return LogLine(File.get(), enabled(level), level, Encoding); }
+
+			LogLine debug()   { return at(LogLevel::Debug); }
+			LogLine info()    { return at(LogLevel::Info); }
+			LogLine warning() { return at(LogLevel::Warning); }
+			LogLine error()   { return at(LogLevel::Error); }
+
+			// plain "log << ..." lines are info
+			template <class T>
+			LogLine operator<<(const T &value)
+			{
+				LogLine line = info();
+				line << value;
+				return line;
+			}
+
+			LogLine operator<<(std::ostream &(*manipulator)(std::ostream &))
+			{
+				LogLine line = info();
+				line << manipulator;
+				return line;
+			}
+
+			// sets the rotation for every log
+			static void setRotation(const LogRotation &rotation);
+
+			// records an event with one argument per "{}" in the format
+			template <class... Args>
+			void record(LogLevel level, const LogFormat &format, const Args &... args)
+			{
+				if (!enabled(level))
+					return;
+
+				LogRecord event(File.get(), level, Encoding, format);
+				(event.add(args), ...);
+			}
+
+			// writes out everything logged so far (on any thread) and
+			// archives any rotated segments, waiting for both
+			static void flush();
+	};
+}
+#endif
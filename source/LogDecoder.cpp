@@ -0,0 +1,232 @@
+/* LogDecoder.cpp - Miles Shamo
+ *
+ * Implementation of the binary log decoder
+ *
+ */
+
+#include "LogDecoder.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+template <class T>
+bool Twitch::LogDecoder::_read(T &value)
+{
+	return static_cast<bool>(In.read(reinterpret_cast<char *>(&value), sizeof(value)));
+}
+
+
+bool Twitch::LogDecoder::_readString(std::string &value, std::size_t length)
+{
+	value.resize(length);
+	return length == 0 || In.read(value.data(), length);
+}
+
+
+// _session
+//
+// a new session starts over with no formats
+bool Twitch::LogDecoder::_session()
+{
+	std::uint16_t length;
+
+	if (!_read(SessionClock) || !_read(SessionWall) || !_read(length) || !_readString(Source, length))
+		return false;
+
+	InSession = true;
+	Formats.clear();
+
+	return true;
+}
+
+
+bool Twitch::LogDecoder::_format()
+{
+	std::uint32_t id;
+	std::uint8_t count;
+
+	if (!_read(id) || !_read(count))
+		return false;
+
+	Format format;
+	format.Fields.resize(count);
+
+	if (count && !In.read(reinterpret_cast<char *>(format.Fields.data()), count))
+		return false;
+
+	std::uint16_t length;
+	if (!_read(length) || !_readString(format.Text, length))
+		return false;
+
+	Formats[id] = std::move(format);
+
+	return true;
+}
+
+
+// _event
+//
+// Reads an event's arguments and puts them into its format.  Plain
+// text lines (format 0) are their one argument, as it was logged
+bool Twitch::LogDecoder::_event(LogEvent &event)
+{
+	std::uint32_t id;
+	std::uint8_t level, count;
+	std::uint64_t clock;
+
+	if (!_read(id) || !_read(level) || !_read(clock) || !_read(count))
+		return false;
+
+	if (!InSession)
+		throw std::runtime_error("LogDecoder: event before any session");
+
+	const Format *format = nullptr;
+	if (id != 0)
+	{
+		auto found = Formats.find(id);
+		if (found == Formats.end())
+			throw std::runtime_error("LogDecoder: event with an undefined format " + std::to_string(id));
+
+		format = &found->second;
+	}
+
+	event.Source = Source;
+	event.Level = static_cast<LogLevel>(level);
+	event.Time = std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+				std::chrono::nanoseconds(SessionWall + static_cast<std::int64_t>(clock - SessionClock))));
+	event.Text.clear();
+	event.Channels.clear();
+	event.Commands.clear();
+
+	std::size_t rest = 0;
+
+	for (std::size_t i = 0; i < count; i++)
+	{
+		char type;
+		std::string value;
+
+		if (!_read(type))
+			return false;
+
+		if (type == LogRecordKind::String)
+		{
+			std::uint32_t length;
+			if (!_read(length) || !_readString(value, length))
+				return false;
+		}
+		else if (type == LogRecordKind::Signed)
+		{
+			std::int64_t number;
+			if (!_read(number))
+				return false;
+			value = std::to_string(number);
+		}
+		else if (type == LogRecordKind::Unsigned)
+		{
+			std::uint64_t number;
+			if (!_read(number))
+				return false;
+			value = std::to_string(number);
+		}
+		else if (type == LogRecordKind::Double)
+		{
+			double number;
+			if (!_read(number))
+				return false;
+
+			char digits[32];
+			int length = std::snprintf(digits, sizeof(digits), "%g", number);
+			value.assign(digits, length > 0 ? length : 0);
+		}
+		else
+		{
+			throw std::runtime_error("LogDecoder: unknown argument type");
+		}
+
+		if (!format)
+		{
+			event.Text += value;
+			continue;
+		}
+
+		// the format's text up to this argument's "{}"
+		std::size_t next = format->Text.find("{}", rest);
+		if (next != std::string::npos)
+		{
+			event.Text.append(format->Text, rest, next - rest);
+			rest = next + 2;
+		}
+
+		LogField field = i < format->Fields.size() ? format->Fields[i] : LogField::Value;
+
+		if (field == LogField::Channel)
+			event.Channels.push_back(value);
+		else if (field == LogField::Command)
+			event.Commands.push_back(value);
+
+		event.Text += value;
+	}
+
+	if (format)
+		event.Text.append(format->Text, std::min(rest, format->Text.size()));
+	else if (!event.Text.empty() && event.Text.back() == '\n')
+		event.Text.pop_back();
+
+	return true;
+}
+
+
+// next
+//
+// reads records until the next event
+bool Twitch::LogDecoder::next(LogEvent &event)
+{
+	char kind;
+
+	while (_read(kind))
+	{
+		bool complete;
+
+		if (kind == LogRecordKind::Session)
+			complete = _session();
+		else if (kind == LogRecordKind::Format)
+			complete = _format();
+		else if (kind == LogRecordKind::Event)
+			return _event(event);
+		else
+			throw std::runtime_error("LogDecoder: not a binary log (unknown record)");
+
+		if (!complete)
+			return false;
+	}
+
+	return false;
+}
+
+
+//--------------------------------------------------------
+// LogFilter
+
+bool Twitch::LogFilter::matches(const LogEvent &event) const
+{
+	if (event.Level < MinLevel)
+		return false;
+
+	if (!Source.empty() && event.Source != Source)
+		return false;
+
+	if (!Channel.empty() && std::find(event.Channels.begin(), event.Channels.end(), Channel) == event.Channels.end())
+		return false;
+
+	if (!Command.empty() && std::find(event.Commands.begin(), event.Commands.end(), Command) == event.Commands.end())
+		return false;
+
+	if (Since && event.Time < *Since)
+		return false;
+
+	if (Until && event.Time > *Until)
+		return false;
+
+	return true;
+}
@@ -0,0 +1,92 @@
+/* LogDecoder.hpp - Miles Shamo
+ *
+ * Reads binary logs (see Log.hpp) back into text.
+ *
+ * Each event is turned back into the line a text
+ * log would have had, along with when it happened,
+ * which bot wrote it, and the channels and commands
+ * it was about, so baribot-logcat can filter on
+ * them without any text matching.
+ *
+ * A log that's cut short (the bot was killed
+ * mid-write) just ends at its last whole record;
+ * anything that isn't a binary log at all throws
+ * a std::runtime_error.
+ */
+
+#ifndef TWITCH_LOG_DECODER
+#define TWITCH_LOG_DECODER
+
+#include <chrono>
+#include <cstdint>
+#include <istream>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "Log.hpp"
+
+namespace Twitch
+{
+	struct LogEvent
+	{
+		std::string Source;
+		LogLevel Level = LogLevel::Info;
+		std::chrono::system_clock::time_point Time;
+
+		// the line as a text log would have it (without its last newline)
+		std::string Text;
+
+		// the arguments tagged as channels and commands
+		std::vector<std::string> Channels;
+		std::vector<std::string> Commands;
+	};
+
+	// which events to keep; anything left empty matches everything
+	struct LogFilter
+	{
+		std::string Source;
+		std::string Channel;
+		std::string Command;
+		LogLevel MinLevel = LogLevel::Debug;
+		std::optional<std::chrono::system_clock::time_point> Since, Until;
+
+		bool matches(const LogEvent &event) const;
+	};
+
+	class LogDecoder
+	{
+		private:
+			struct Format
+			{
+				std::vector<LogField> Fields;
+				std::string Text;
+			};
+
+			std::istream &In;
+
+			// the current session, and the formats defined in it
+			bool InSession = false;
+			std::string Source;
+			std::uint64_t SessionClock = 0;
+			std::int64_t SessionWall = 0;
+			std::map<std::uint32_t, Format> Formats;
+
+			// reads a value, false at the end of the log
+			template <class T>
+			bool _read(T &value);
+			bool _readString(std::string &value, std::size_t length);
+
+			bool _session();
+			bool _format();
+			bool _event(LogEvent &event);
+
+		public:
+			explicit LogDecoder(std::istream &in) : In(in) {}
+
+			// reads the next event, false once there are none left
+			bool next(LogEvent &event);
+	};
+}
+#endif
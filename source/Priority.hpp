@@ -0,0 +1,44 @@
+/* Priority.hpp - Miles Shamo
+ *
+ * How important an outbound message is, from
+ * most to least important.
+ *
+ * Protocol traffic (PONG, CAP, PASS/NICK) keeps
+ * the connection alive, so it always goes first.
+ * Moderation (CLEARCHAT, bans) is next, then
+ * normal replies to commands.  Bulk messages
+ * (announcements and the like) are dropped instead
+ * if they would have to wait too long, so that
+ * they never build up a backlog.
+ *
+ * Higher classes jump ahead of lower ones, but a
+ * lower class message that has waited long enough
+ * is promoted (see RateLimits::PromoteAfter), and
+ * every write batch saves a few slots for lower
+ * classes, so nothing waits forever.
+ */
+
+#ifndef TWITCH_PRIORITY
+#define TWITCH_PRIORITY
+
+#include <cstddef>
+
+namespace Twitch
+{
+	enum class Priority
+	{
+		Protocol,
+		Moderation,
+		Normal,
+		Bulk
+	};
+
+	// number of classes, for arrays indexed by priority
+	constexpr std::size_t PriorityCount = 4;
+
+	constexpr std::size_t priorityIndex(Priority p)
+	{
+		return static_cast<std::size_t>(p);
+	}
+}
+#endif
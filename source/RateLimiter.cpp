@@ -0,0 +1,188 @@
+/* RateLimiter.cpp - Miles Shamo
+ *
+ * Implementation of the send windows and the
+ * account wide chat limiter
+ *
+ */
+
+#include "RateLimiter.hpp"
+
+#include <algorithm>
+
+//--------------------------------------------------------
+// SendWindow
+
+Twitch::SendWindow::SendWindow(std::size_t capacity, Clock::duration period)
+	:	Capacity(capacity), Period(period)
+{
+}
+
+
+// _expire
+//
+// forgets the sends that have left the window
+void Twitch::SendWindow::_expire(Clock::time_point now)
+{
+	while (!Sent.empty() && Sent.front() + Period <= now)
+		Sent.pop_front();
+}
+
+
+bool Twitch::SendWindow::tryTake(Clock::time_point now)
+{
+	_expire(now);
+
+	if (Sent.size() >= Capacity)
+		return false;
+
+	Sent.push_back(now);
+	return true;
+}
+
+
+// waitTime
+//
+// Room for count more opens up when enough of the oldest sends
+// have left the window.  Asking for more than Capacity at once is
+// treated as asking for Capacity
+Twitch::Clock::duration Twitch::SendWindow::waitTime(Clock::time_point now, std::size_t count)
+{
+	_expire(now);
+
+	count = std::min(count, Capacity);
+
+	if (Sent.size() + count <= Capacity)
+		return Clock::duration::zero();
+
+	std::size_t leaving = Sent.size() + count - Capacity;
+
+	return Sent[leaving - 1] + Period - now;
+}
+
+
+//--------------------------------------------------------
+// ChatLimiter
+
+Twitch::ChatLimiter::ChatLimiter(const RateLimits &limits)
+	:	Limits(limits),
+		UserWindow(limits.UserMessages, limits.AccountPeriod),
+		ModWindow(limits.ModMessages, limits.AccountPeriod),
+		JoinWindow(limits.JoinAttempts, limits.JoinPeriod)
+{
+}
+
+
+// acquire
+//
+// A message to a channel we moderate only counts against the
+// moderator limit.  Anywhere else it counts against the user limit,
+// the moderator limit (as that one covers every message), and the
+// channel's own window.  Either every window involved takes the
+// send, or none of them do.
+Twitch::RateDecision Twitch::ChatLimiter::acquire(std::string_view channel, Clock::time_point now)
+{
+	std::lock_guard<std::mutex> guard(Lock);
+
+	RateDecision decision;
+
+	bool moderator = Moderated.find(channel) != Moderated.end();
+
+	Clock::duration accountWait = ModWindow.waitTime(now);
+	if (!moderator)
+		accountWait = std::max(accountWait, UserWindow.waitTime(now));
+
+	if (accountWait > Clock::duration::zero())
+	{
+		Limited++;
+
+		decision.Wait = accountWait;
+		decision.AccountLimited = true;
+		return decision;
+	}
+
+	if (moderator)
+	{
+		ModWindow.take(now);
+
+		decision.Allowed = true;
+		return decision;
+	}
+
+	auto iter = Channels.find(channel);
+	if (iter == Channels.end())
+	{
+		iter = Channels.emplace(std::string(channel),
+				SendWindow(Limits.ChannelMessages, Limits.ChannelPeriod)).first;
+	}
+
+	Clock::duration channelWait = iter->second.waitTime(now);
+	if (channelWait > Clock::duration::zero())
+	{
+		Limited++;
+
+		decision.Wait = channelWait;
+		return decision;
+	}
+
+	iter->second.take(now);
+	UserWindow.take(now);
+	ModWindow.take(now);
+
+	decision.Allowed = true;
+	return decision;
+}
+
+
+// acquireJoins
+//
+// Hands out JOINs a batch at a time, so a long channel list goes
+// out in a few large JOINs rather than one channel every time an
+// old JOIN leaves the window.  Nothing is handed out until there's
+// room for a batch (or for everything wanted, if that's less).
+std::size_t Twitch::ChatLimiter::acquireJoins(std::size_t wanted, Clock::duration &wait, Clock::time_point now)
+{
+	std::lock_guard<std::mutex> guard(Lock);
+
+	if (wanted == 0)
+		return 0;
+
+	std::size_t batch = std::min({wanted, Limits.JoinBatch, Limits.JoinAttempts});
+
+	wait = JoinWindow.waitTime(now, batch);
+	if (wait > Clock::duration::zero())
+	{
+		Limited++;
+		return 0;
+	}
+
+	std::size_t allowed = 0;
+
+	while (allowed < wanted && JoinWindow.tryTake(now))
+		allowed++;
+
+	return allowed;
+}
+
+
+// setModerator
+//
+// USERSTATE tells us this every time we join or speak in a channel
+void Twitch::ChatLimiter::setModerator(std::string_view channel, bool isModerator)
+{
+	std::lock_guard<std::mutex> guard(Lock);
+
+	auto iter = Moderated.find(channel);
+
+	if (isModerator && iter == Moderated.end())
+		Moderated.emplace(channel);
+	else if (!isModerator && iter != Moderated.end())
+		Moderated.erase(iter);
+}
+
+
+std::size_t Twitch::ChatLimiter::limitedCount()
+{
+	std::lock_guard<std::mutex> guard(Lock);
+
+	return Limited;
+}
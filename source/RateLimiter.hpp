@@ -0,0 +1,165 @@
+/* RateLimiter.hpp - Miles Shamo
+ *
+ * Keeps chat output under Twitch's limits.
+ *
+ * Going over the PRIVMSG limits (20 per 30 seconds,
+ * or 100 per 30 seconds in channels where we are a
+ * moderator) gets the whole account locked out for
+ * a while, which is far worse than just waiting.  So
+ * every PRIVMSG has to find room in its account's
+ * windows, and in its channel's window, before it is
+ * allowed onto the socket.
+ *
+ * The limits are for any 30 seconds, not per refill,
+ * so a token bucket starting full would let nearly
+ * twice as many through (a full burst, then everything
+ * that trickled back in before the burst aged out).
+ * Instead each window keeps the times of the sends
+ * still inside it, and only lets another through once
+ * there's room.
+ *
+ * JOINs have an account wide limit of their own,
+ * which is kept here as well.  Login attempts (see
+ * Admission.hpp) are paced by the same windows.
+ *
+ * A ChatLimiter belongs to an account, not to a bot,
+ * since every bot logged in with the same token
+ * counts against the same limits.  Bots share it
+ * through the AccountRegistry (see Account.hpp),
+ * so it is locked internally.
+ */
+
+#ifndef TWITCH_RATE_LIMITER
+#define TWITCH_RATE_LIMITER
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+
+namespace Twitch
+{
+	using Clock = std::chrono::steady_clock;
+
+	// at most Capacity sends in any Period long span, kept as a log of send times
+	class SendWindow
+	{
+		private:
+			std::size_t Capacity;
+			Clock::duration Period;
+
+			// oldest first, never more than Capacity of them
+			std::deque<Clock::time_point> Sent;
+
+			void _expire(Clock::time_point now);
+
+		public:
+			SendWindow(std::size_t capacity, Clock::duration period);
+
+			// takes a send if there's room for one
+			bool tryTake(Clock::time_point now);
+
+			// how long until count sends fit (zero if they do)
+			Clock::duration waitTime(Clock::time_point now, std::size_t count = 1);
+
+			// takes a send that was already checked for with waitTime
+			void take(Clock::time_point now) { Sent.push_back(now); }
+	};
+
+	// the limits themselves (defaults are Twitch's documented ones)
+	struct RateLimits
+	{
+		// account wide, in any channel
+		std::size_t UserMessages = 20;
+		// account wide, counting only channels where we are a moderator
+		std::size_t ModMessages = 100;
+		Clock::duration AccountPeriod = std::chrono::seconds(30);
+
+		// per channel, where we are not a moderator
+		std::size_t ChannelMessages = 1;
+		Clock::duration ChannelPeriod = std::chrono::seconds(1);
+
+		// how long a bulk message can wait before we give up on it
+		Clock::duration MaxBulkWait = std::chrono::seconds(10);
+
+		// a held message moves up one priority class for every this long it waits
+		Clock::duration PromoteAfter = std::chrono::seconds(5);
+
+		// account wide JOINs (each channel in a multi-channel JOIN counts)
+		std::size_t JoinAttempts = 20;
+		Clock::duration JoinPeriod = std::chrono::seconds(10);
+
+		// once the JOIN window is full, wait for this many before sending more
+		std::size_t JoinBatch = 10;
+
+		// how long a JOIN waits to be confirmed, and how many tries it gets
+		Clock::duration JoinTimeout = std::chrono::seconds(15);
+		unsigned MaxJoinAttempts = 3;
+	};
+
+	// the result of asking to send a message
+	struct RateDecision
+	{
+		// the message can be sent now (and its tokens were taken)
+		bool Allowed = false;
+		// otherwise, how long until it's worth asking again
+		Clock::duration Wait = Clock::duration::zero();
+		// was it the account (rather than the channel) that ran out
+		bool AccountLimited = false;
+	};
+
+	// per bot numbers on how the outbound side is coping
+	struct RateStats
+	{
+		std::size_t Queued = 0;		// messages currently held back
+		std::size_t Delayed = 0;	// messages that had to wait at all
+		std::size_t Dropped = 0;	// bulk messages given up on
+		Clock::duration TotalWait = Clock::duration::zero();
+		Clock::duration MaxWait = Clock::duration::zero();
+	};
+
+	class ChatLimiter
+	{
+		private:
+			std::mutex Lock;
+
+			RateLimits Limits;
+
+			SendWindow UserWindow;
+			SendWindow ModWindow;
+			SendWindow JoinWindow;
+
+			// per channel windows (only used where we aren't a moderator)
+			std::map<std::string, SendWindow, std::less<>> Channels;
+
+			// channels where we are a moderator (learned from USERSTATE)
+			std::set<std::string, std::less<>> Moderated;
+
+			// how many times a message was held back
+			std::size_t Limited = 0;
+
+		public:
+			explicit ChatLimiter(const RateLimits &limits);
+
+			// asks to send one PRIVMSG to the channel
+			RateDecision acquire(std::string_view channel, Clock::time_point now = Clock::now());
+
+			// Asks to join up to wanted channels.  Returns how many may be joined
+			// now; if none, wait is set to how long until a full batch may
+			std::size_t acquireJoins(std::size_t wanted, Clock::duration &wait, Clock::time_point now = Clock::now());
+
+			// records whether we are a moderator in a channel
+			void setModerator(std::string_view channel, bool isModerator);
+
+			const RateLimits &limits() const { return Limits; }
+
+			// number of times any bot on this account had to wait
+			std::size_t limitedCount();
+	};
+}
+#endif
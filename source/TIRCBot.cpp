@@ -11,14 +11,18 @@
 #include <asio/bind_executor.hpp>
 #include <asio/buffer.hpp>
 #include <asio/error_code.hpp>
-#include <asio/read_until.hpp>
+#include <asio/post.hpp>
 #include <asio/steady_timer.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <exception>
+#include <utility>
 #include <asio/write.hpp>
 
-// regex for parsing
-#include <regex>
+// zero copy line parsing
+#include <string_view>
+#include "IRCParser.hpp"
 
 // chrono used for system time
 #include <chrono>
@@ -33,6 +37,19 @@ using std::endl;
 using std::chrono::system_clock;
 using std::ctime;
 
+// the per message log lines, recorded against formats so a binary
+// log only keeps their arguments (see Log.hpp)
+namespace
+{
+	using Twitch::LogField;
+
+	const Twitch::LogFormat Received("IRC {} RECIEVED", {LogField::Command});
+	const Twitch::LogFormat Unhandled("\tNo command found for {}.", {LogField::Command});
+	const Twitch::LogFormat Handled("\tCommand {} found:\n\t\t{}", {LogField::Command, LogField::Value});
+	const Twitch::LogFormat HandledIn("\tCommand {} found in {}:\n\t\t{}", {LogField::Command, LogField::Channel, LogField::Value});
+	const Twitch::LogFormat BulkDropped("Dropped a bulk message to {} after waiting too long", {LogField::Channel});
+}
+
 // Constructor
 // 
 // Initilizes members with initialization lists
@@ -46,25 +63,31 @@ Twitch::IRCBot::IRCBot(
 		std::string serv, 
 		std::string portNum,
 		IRCCorrelator &IRCCor,
-		CommandCorrelator &Comms,
+		CommandRegistry &Comms,
+		AccountRegistry &Accounts,
+		Admission &gate,
+		FairScheduler &fairness,
 		const Poco::Path dirPath)
 	
 	:	Context(context),
 		Server(serv), PortNumber(portNum),
 		_Strand(asio::make_strand(context)),
 		IPresolver(context), TCPsocket(context),
-		inString(new std::string()), 
-		inBuffer(*inString),
+		ConnectTimer(_Strand),
+		Gate(gate),
+		Fairness(fairness),
+		RateTimer(_Strand),
+		JoinTimer(_Strand),
 		Path(dirPath),
+		Name(dirPath.getBaseName()),
 		IRC(IRCCor),
-		Commands(Comms)
+		SharedCommands(Comms)
 {
 	// opens log file
 	auto logPath = dirPath;
-	logPath.append("log.txt");
+	logPath.append(log.encoding() == LogEncoding::Binary ? "log.bin" : "log.txt");
 
-
-	log = std::ofstream(logPath.toString(), std::ios_base::app);
+	log.open(logPath.toString(), Name);
 
 	auto time = system_clock::to_time_t(system_clock::now());
 
@@ -85,11 +108,49 @@ Twitch::IRCBot::IRCBot(
 
 	log << "Loaded token for login as " << Token.username << endl;
 
-	// connects bot after everything is set
-	_connect();
+	// every bot on this account shares its rate limits
+	Acct = Accounts.get(Token.username);
 
-	// starts client once connected
-	start();
+	// our share of handler time (weight.txt is optional, and defaults to 1)
+	auto weightPath = dirPath;
+	weightPath.append("weight.txt");
+	std::ifstream weightFile(weightPath.toString());
+
+	double weight = 1;
+	if (weightFile >> weight)
+		log << "Handler weight set to " << weight << endl;
+
+	Fairness.setWeight(Name, weight);
+
+	// the shared commands, less any this client has turned off,
+	// plus its own text commands and its cooldowns
+	auto disabledPath = dirPath, customPath = dirPath, cooldownsPath = dirPath;
+	disabledPath.append("disabledCommands.txt");
+	customPath.append("customCommands.txt");
+	cooldownsPath.append("cooldowns.txt");
+
+	Overrides = CommandOverrides::load(disabledPath.toString(), customPath.toString(), cooldownsPath.toString());
+	Commands = std::make_shared<const CommandSet>(SharedCommands.current(), Overrides, &Cooldown);
+
+	if (!Overrides->Disabled.empty())
+		log << "Disabled " << Overrides->Disabled.size() << " commands" << endl;
+
+	if (!Overrides->Custom.empty())
+		log << "Loaded " << Overrides->Custom.size() << " custom commands" << endl;
+
+	// raw traffic is recorded for replaying later (see TrafficRecorder.hpp)
+	if (std::getenv("BARIBOT_RECORD"))
+	{
+		auto recordPath = dirPath;
+		recordPath.append("traffic.rec");
+
+		if (Recorder.open(recordPath.toString()))
+			log << "Recording inbound traffic to " << recordPath.toString() << endl;
+	}
+
+	// connects bot after everything is set.  This only queues up the
+	// connection; the bot logs in (start) once it is actually connected
+	_requestConnect();
 }
 
 
@@ -98,53 +159,404 @@ Twitch::IRCBot::IRCBot(
 Twitch::IRCBot::~IRCBot()
 {
 	log.close();
+}
+
+
+// _requestConnect
+//
+// Every connection starts by waiting its turn with the Overseer's
+// admission control, so that bots recovering from the same outage
+// log in at a steady rate instead of all at once.
+void Twitch::IRCBot::_requestConnect()
+{
+	if (State == ConnectionState::Stopped)
+		return;
+
+	State = ConnectionState::Queued;
+
+	Pending++;
 
-	delete inString;
+	GateTicket = Gate.request(Token.username, [this]()
+	{
+		asio::post(_Strand, [this]()
+		{
+			if (_completed())
+				return;
+
+			_connect();
+		});
+	});
 }
 
 
 // _connect
 //
 // connect handles connecting to a given server.
-// It is called on construction and if the connection
-// needs to be re-opened.  
+// It is called (through _requestConnect) on construction
+// and if the connection needs to be re-opened.  
 //
-// connect simply opens the connection.  It does not
-// authenticate, etc. 
+// Connecting is a chain of asyncronous steps, all on the strand
+// (once admission control has let us go):
+// 		_connect    -> async_resolve
+// 		_onResolve  -> async_connect
+// 		_onConnect  -> start (login)
+// A failure at any step goes to _disconnected, which retries on
+// a timer, so no thread is ever held up waiting on the network.
+void Twitch::IRCBot::_connect()
+{
+	if (State == ConnectionState::Stopped)
+		return;
+
+	State = ConnectionState::Resolving;
+
+	log << "Connecting to " << Server << ":" << PortNumber << endl;
+
+	Pending++;
+
+	IPresolver.async_resolve(Server, PortNumber,
+			asio::bind_executor(_Strand,
+				[this](const asio::error_code &e, asio::ip::tcp::resolver::results_type endpoints)
+				{
+					if (_completed())
+						return;
+
+					_onResolve(e, endpoints);
+				}));
+}
+
+
+// _onResolve
+//
+// tries each address the DNS lookup gave us in turn
+void Twitch::IRCBot::_onResolve(const asio::error_code &e, const asio::ip::tcp::resolver::results_type &endpoints)
+{
+	if (e)
+	{
+		_disconnected("DNS lookup failed", e);
+		return;
+	}
+
+	State = ConnectionState::Connecting;
+
+	Pending++;
+
+	asio::async_connect(TCPsocket, endpoints,
+			asio::bind_executor(_Strand,
+				[this](const asio::error_code &e, const asio::ip::tcp::endpoint &)
+				{
+					if (_completed())
+						return;
+
+					_onConnect(e);
+				}));
+}
+
+
+// _onConnect
 //
-// seconds is used to delay repeated reconnects using
-// asio async_wait 
-void Twitch::IRCBot::_connect(long delay)
+// Once the socket is open we can log in.  Nagle's algorithm is
+// turned off first: our writes (PONGs, replies) are small and
+// latency bound, and holding them for the server's delayed ACK
+// adds ~40ms to each one.
+void Twitch::IRCBot::_onConnect(const asio::error_code &e)
 {
-	try
+	if (e)
 	{
-	// DNS lookup
-	auto endpoints = this->IPresolver.resolve(Server, PortNumber, error);
+		_disconnected("Connection failed", e);
+		return;
+	}
+
+	asio::error_code ignored;
+	TCPsocket.set_option(asio::ip::tcp::no_delay(true), ignored);
+
+	State = ConnectionState::Connected;
 
-	// attempts to connect
-	asio::connect(this->TCPsocket, endpoints);
+	log << "Connected" << endl;
+
+	start();
+}
+
+
+// _disconnected
+//
+// Handles a failed connection attempt or a dropped connection.  
+// The socket is closed (which cancels anything else waiting on it)
+// and another attempt is scheduled on the backoff timer.  Only the
+// first failure for a connection does this, as a read and a write
+// can both fail when the socket drops.
+//
+// Lines still waiting to be written were meant for the old
+// connection.  PONGs, JOINs and PARTs mean nothing on the next one
+// (which rebuilds its JOINs on login), so they're dropped, and chat
+// goes back to be held until the next login.
+void Twitch::IRCBot::_disconnected(const char *reason, const asio::error_code &e)
+{
+	if (State == ConnectionState::Waiting || State == ConnectionState::Queued || State == ConnectionState::Stopped)
+		return;
+
+	log.warning() << "***" << reason << " with error:" << endl
+		  << "\t"  << e.value()   << endl
+		  << "\t"  << e.message() << endl;
+
+	State = ConnectionState::Waiting;
+	LoggedIn = false;
+
+	asio::error_code ignored;
+	IPresolver.cancel();
+	TCPsocket.close(ignored);
+
+	auto now = Clock::now();
+	auto rehold = Held.begin();
+	std::size_t dropped = 0;
+
+	for (auto &pending : Outbound.takePending())
+	{
+		if (chatChannel(pending.first).empty())
+			dropped++;
+		else
+			Held.insert(rehold, HeldMessage{std::move(pending.first), pending.second, now});
 	}
-	catch(...)
+
+	Stats.Queued = Held.size();
+
+	if (dropped > 0)
+		log << "Dropped " << dropped << " lines meant for the old connection" << endl;
+
+	// anything half read belongs to the old connection
+	inBuffer.clear();
+
+	auto delay = Reconnect.next();
+
+	log << "Reconnecting in " << delay.count() << "ms (attempt " << Reconnect.attempts() << ")" << endl;
+
+	Pending++;
+
+	ConnectTimer.expires_after(delay);
+	ConnectTimer.async_wait(asio::bind_executor(_Strand,
+				[this](const asio::error_code &e)
+				{
+					if (_completed())
+						return;
+
+					if (!e)
+						_requestConnect();
+				}));
+}
+
+
+// reconnect
+//
+// drops the current connection and connects again (for Twitch's
+// RECONNECT command).  Safe to call from any thread.
+void Twitch::IRCBot::reconnect()
+{
+	asio::post(_Strand, [this]()
+	{
+		_disconnected("Reconnect requested", asio::error_code());
+	});
+}
+
+
+// stop
+//
+// Stops the bot for good: its place in the login queue is given up,
+// the connection is closed and the timers are cancelled.  Whatever
+// then fails (or is granted) finds us Stopped and goes no further,
+// and anything handlers still write is dropped.
+//
+// Chat handlers already handed to a channel can still log, so the log
+// is only closed once each channel's strand has got through them
+// (a last task per channel, counting down to the close).  Their
+// writes and replies are posted here before that, so they run first.
+// Our tenants in the fair scheduler are let go then too.
+//
+// The bot is handed to reclaim once that's done and the last of the
+// cancelled operations has come back (see _reclaim)
+void Twitch::IRCBot::stop(std::function<void(IRCBot *)> reclaim)
+{
+	asio::post(_Strand, [this, reclaim = std::move(reclaim)]() mutable
 	{
-		log << "Connection failed...retrying" << endl;
+		if (State == ConnectionState::Stopped)
+			return;
+
+		State = ConnectionState::Stopped;
+		LoggedIn = false;
+		Reclaim = std::move(reclaim);
+
+		// a request still in the queue will never call us back
+		if (Gate.cancel(GateTicket))
+			Pending--;
 
-		// resets the socket
-		TCPsocket.close();
-		TCPsocket = asio::ip::tcp::socket(Context);
+		asio::error_code ignored;
+		IPresolver.cancel();
+		TCPsocket.close(ignored);
 
-		// if we hit an arbitrary limit on time, just throw
-		if (delay > 100)
+		ConnectTimer.cancel();
+		RateTimer.cancel();
+		JoinTimer.cancel();
+
+		Held.clear();
+
+		log << "Client " << Name << " stopped" << endl;
+
+		auto left = std::make_shared<std::atomic<std::size_t>>(ChannelStrands.size() + 1);
+		auto closeLog = [this, left]()
+		{
+			if (--*left == 0)
+			{
+				asio::post(_Strand, [this]()
+				{
+					log.close();
+					Fairness.forget(Name);
+
+					Drained = true;
+					_reclaim();
+				});
+			}
+		};
+
+		for (auto &channel : ChannelStrands)
+			Fairness.submit(Name, channel.first, channel.second.Where, closeLog);
+
+		closeLog();
+	});
+}
+
+
+// _completed
+//
+// Called first thing by the handler of every async operation we
+// start.  A stopped bot's handlers are only ever the cancelled ones
+// coming back, so they do nothing beyond letting us go
+bool Twitch::IRCBot::_completed()
+{
+	Pending--;
+
+	if (State != ConnectionState::Stopped)
+		return false;
+
+	_reclaim();
+	return true;
+}
+
+
+// _reclaim
+//
+// A stopped bot starts nothing new, so once the channels are drained
+// and nothing is pending, the only things left that can reach it are
+// tasks already on the strand.  Reclaim is run from a task of its own
+// behind them, which is the last thing to touch the bot
+void Twitch::IRCBot::_reclaim()
+{
+	if (!Drained || Pending > 0 || !Reclaim)
+		return;
+
+	asio::post(_Strand, [this, reclaim = std::move(Reclaim)]()
+	{
+		reclaim(this);
+	});
+
+	Reclaim = nullptr;
+}
+
+
+// reloadCommands
+//
+// picks up changes to disabledCommands.txt, customCommands.txt and
+// cooldowns.txt.  Lines already handed to their channels finish with
+// the commands they had, custom commands keep their {count}s and
+// cooldowns that are running carry on
+void Twitch::IRCBot::reloadCommands()
+{
+	asio::post(_Strand, [this]()
+	{
+		auto disabledPath = Path, customPath = Path, cooldownsPath = Path;
+		disabledPath.append("disabledCommands.txt");
+		customPath.append("customCommands.txt");
+		cooldownsPath.append("cooldowns.txt");
+
+		Overrides = CommandOverrides::load(disabledPath.toString(), customPath.toString(),
+				cooldownsPath.toString(), Overrides.get());
+		_refreshCommands();
+
+		log << "Reloaded commands (" << Overrides->Disabled.size() << " disabled, "
+			<< Overrides->Custom.size() << " custom)" << endl;
+	});
+}
+
+
+// reloadChannels
+//
+// picks up changes to channels.txt without reconnecting.  Only
+// the channels that changed are touched: new ones are queued for
+// JOINs (against the account's JOIN budget, as at login) and
+// dropped ones are PARTed
+void Twitch::IRCBot::reloadChannels()
+{
+	asio::post(_Strand, [this]()
+	{
+		std::vector<std::string> leave;
+		std::size_t added = Joins.update(_channelList(), leave);
+
+		// without a login, the next one joins only what's in the file anyway
+		for (const auto &channel : leave)
 		{
-			log << "Failed to connect" << endl;
-			
-			throw std::runtime_error("Could not connect");
+			if (LoggedIn)
+				write({"PART ", channel});
+
+			_retireChannel(channel);
 		}
-		// if we failed to connect, retry on a falloff timer
-		asio::steady_timer timer(Context, asio::chrono::seconds(delay));
-		timer.wait();
 
-		_connect(delay * 2 + 1);
-	}
+		log << "Reloaded channels (" << added << " to join, " << leave.size() << " left)" << endl;
+
+		// not connected yet, these go out once we log in
+		if (added > 0)
+			_sendJoins();
+	});
+}
+
+
+// _channelList
+//
+// the channels in channels.txt, one per line
+std::vector<std::string> Twitch::IRCBot::_channelList() const
+{
+	auto chanPath = Path;
+	chanPath.append("channels.txt");
+
+	std::ifstream in(chanPath.toString());
+
+	std::vector<std::string> channels;
+
+	std::string channel;
+	while ((in >> channel))
+		channels.push_back(channel);
+
+	return channels;
+}
+
+
+// _refreshCommands
+//
+// layers our overrides over the shared table's current version
+void Twitch::IRCBot::_refreshCommands()
+{
+	Commands = std::make_shared<const CommandSet>(SharedCommands.current(), Overrides, &Cooldown);
+}
+
+
+// loggedIn
+//
+// the server has welcomed us, so the next drop starts its backoff over
+// and we can start joining channels
+void Twitch::IRCBot::loggedIn()
+{
+	Reconnect.reset();
+
+	LoggedIn = true;
+
+	_releaseHeld();
+	_sendJoins();
 }
 
 
@@ -157,157 +569,225 @@ void Twitch::IRCBot::_connect(long delay)
 //
 // Thus, we simply listen and then use the onMessage function
 // to handle commands
+//
+// Everything here runs on the bot's strand, as it shares the
+// socket with the read and write handlers.  Since the write queue
+// sends messages in order, the JOINs are only sent after we log in.
 void Twitch::IRCBot::start()
 {
-	log << "Logging in as " << Token.username << endl;
+	asio::post(_Strand, [this]()
+	{
+		log << "Logging in as " << Token.username << endl;
 
-	// queues up a first write for capability requesting, password (oauth), and nickname
-	asio::async_write(TCPsocket, 
-			asio::buffer("CAP REQ :twitch.tv/tags twitch.tv/commands twitch.tv/membership\r\n"
-						 "PASS oauth:" + Token.accessToken + "\r\n"
-						 "NICK " + Token.username + "\r\n"),
-			asio::bind_executor(_Strand,
+		// queues up a first write for capability requesting, password (oauth), and nickname
+		write("CAP REQ :twitch.tv/tags twitch.tv/commands twitch.tv/membership", Priority::Protocol);
+		write({"PASS oauth:", Token.accessToken}, Priority::Protocol);
+		write({"NICK ", Token.username}, Priority::Protocol);
+
+		log  << "login info queued as "  << Token.username << endl
+			 << "Scopes requested are: " << endl
+			 << "\t"                     << Token.scopes   << endl;
+
+		// start reading from the socket
+		_read();
+
+		// loads the channel list (re-read on every login, so edits are picked up).
+		// They're joined once the server has accepted the login
+		Joins.clear();
+
+		for (const auto &channel : _channelList())
+			Joins.add(channel);
+		
+		log << "Loaded " << Joins.pending() << " channels to join" << endl;
+	});
+}
+
+// _read
+//
+// queues up a single large read into the free space of
+// the receive buffer.  Everything that arrives is handled
+// in one go by _onRead, which then calls this again.
+void Twitch::IRCBot::_read()
+{
+	char *space = inBuffer.prepare();
+
+	Pending++;
 
-				// lambda to call after write completes
+	TCPsocket.async_read_some(asio::buffer(space, inBuffer.space()),
+			asio::bind_executor(_Strand,
 				[this](const asio::error_code &e, size_t size)
-				{	
-					// if nothing goes wrong
-					if (!e)
-					{
-						log  << "login info sent as "    << Token.username << endl
-							 << "Scopes requested are: " << endl
-							 << "\t"                     << Token.scopes   << endl;
-
-						// queue up an asyncronous read over the socket
-						asio::async_read_until(
-							this->TCPsocket, 
-							this->inBuffer, 
-							'\n', 
-							asio::bind_executor(_Strand,
-								// lambda to call the onMessage function
-								[this](const asio::error_code &e, size_t size)
-								{
-									this->_onMessage(e, size);
-								}
-								));
-
-						// opens channel lists
-						auto chanPath = Path;
-						chanPath.append("channels.txt");
-
-						std::ifstream in(chanPath.toString());
-
-						// joins each channel in the list
-						std::string channel;
-						int count = 0;
-						while ((in >> channel))
-						{
-							write("JOIN #" + channel);
-							count++;
-						}
-						
-						log << "Joined " << count << " channels" << endl;
-					}
-					else
-					{
-						log  << "Login write failed with error:" << endl
-							 << "\t"                             << e.value()   << endl
-							 << "\t"                             << e.message() << endl;
+				{
+					if (_completed())
+						return;
 
-						//TODO throw error upstream
-					}
+					this->_onRead(e, size);
 				}
-			));
+				));
 }
 
-// _onMessage
+
+// _onRead
 //
-// onMessage is a message handler that runs on every line recieved
-// over the TCP socket.  It then can handle any and all interactions
-// accordingly, usually by calling other functions
-void Twitch::IRCBot::_onMessage(const asio::error_code &e, std::size_t size)
+// onRead runs once per read from the socket, which (during
+// busy chat) can hold many lines.  Every complete line is 
+// handled before the next read is queued, and a partial line
+// at the end is left in the buffer to be finished by the next read.
+void Twitch::IRCBot::_onRead(const asio::error_code &e, std::size_t size)
 {
 	// if we have an error, the socket is likely closed so we'll need a new one
 	if (e)
 	{
-		log   << "***message read failed with error:" << endl
-			  << "\t"                                 << e.value()   << endl
-			  << "\t"                                 << e.message() << endl;
+		_disconnected("Message read failed", e);
+		return;
+	}
 
-		// ERR OUT, so shut down
-		TCPsocket.close();
+	inBuffer.commit(size);
 
-		// TODO - throw proper error upstream
-		return;
+	if (Recorder.recording())
+		Recorder.record(inBuffer.recent(size));
+
+	// handles every line we have in full
+	std::string_view line;
+	while (inBuffer.nextLine(line))
+	{
+		_onMessage(line);
 	}
 
-	// gets line from buffer (keeping '\n') and clears it
-	std::string line;
-	line = inString->substr(0, size);
-	inString->erase(0, size);
-
-	// A regex expression to parse an IRC command into a smatch.  
-	// The expression is in EMCAscript regex and is set to prefer
-	// fast match times over memory/compile time (since it's static).
-	//
-	// This expression is based on a command by Garrett W. 
-	// which can be found at https://regexr.com/39dn4
-	//
-	// This modified version (mainly to account for tags) is
-	// located at https://regexr.com/56llm
-	//
-	// Due to errors in C++11 EMCAregex, the ^ and $ assertions
-	// fail to properly function here.  Thus, we kept the \n on the
-	// end of the string to create a functionally equivalent regex.  
-	// This could be fixed in C++17 with the multiline flag but,
-	// as I already decided to stick with '11, we'll just deal with it.
-	//
-	// The smatch's capture groups are as follows
-	// [0] - Entire command (0-1)@TAGS (0-1):PREFIX COMMAND PARAMETERS :FINAL PARAMETER
-	// [1] - All tags supplied (if any)
-	// [2] - Prefix (if any)
-	// [3] - Command (all caps or number if correct form; this is more general)
-	// [4] - Parameters
-	// [5] - Optional final parameter
-	const static std::regex IRCLine
-	(R"Delim((?:@(\S+) +)?(?::(\S+) +)?(\S+)(?: +([^\n\r]+?)(?!:))?(?: :([^\n\r]+))?\r\n)Delim", 
-		 std::regex_constants::ECMAScript | std::regex_constants::optimize);	
-	
-	// test the regex against the recieved line
-	std::smatch sm;
-	if (!std::regex_match(line, sm, IRCLine))
+	// rebinds handler
+	_read();
+}
+
+
+// _onMessage
+//
+// onMessage is a message handler that runs on every line recieved
+// over the TCP socket.  It then can handle any and all interactions
+// accordingly, usually by calling other functions
+//
+// The line is a view (keeping "\r\n") into the receive buffer, so
+// nothing here needs to copy it.
+void Twitch::IRCBot::_onMessage(std::string_view lineView)
+{
+	// parses the line without copying it.  See IRCParser.hpp for the
+	// fields, which handlers get wrapped in an IRCMessage
+	IRCLine line;
+	if (!parseIRCLine(lineView, line))
 	{
-		log  << "Failed to parse IRC message: " << endl
-			 << "\t"                            << line << endl;
+		log.warning() << "Failed to parse IRC message: " << endl
+					  << "\t"                            << lineView << endl;
 	}
 	else // we have a good line
 	{
-		log << "IRC " << sm[3] << " RECIEVED" << endl;
+		// per message lines are debug, so they cost nothing unless asked for
+		log.record(LogLevel::Debug, Received, line.command);
 
 		// to handle commands, we use the IRC Correlator to find the proper function
-		auto iter = IRC.SFM.find(sm[3].str());
+		IRCCommand command = ircCommand(line.command);
+		Handler handler = IRC.find(command);
 
 		// if we can't find the command
-		if (iter == IRC.SFM.end())
+		if (!handler)
+		{
+			log.record(LogLevel::Debug, Unhandled, line.command);
+		}
+		// chat (and the user commands in it) runs on the channel's own strand
+		else if (_channelScoped(command))
 		{
-			log << "\tNo command found." << endl;
+			_dispatchToChannel(handler, line, lineView);
 		}
 		else //else, we got our response
 		{
-			log << "\tCommand found:" << endl;
 			// call the function related to the command
-			log << "\t\t" << iter->second(sm, this) << endl;
+			const char *result = handler(IRCMessage(line), this);
+
+			log.record(LogLevel::Debug, Handled, line.command, result);
 		}
 	}
+}
 
-	// rebinds handler
-	asio::async_read_until(TCPsocket, inBuffer, '\n', 
-			asio::bind_executor(_Strand,
-				[this](const asio::error_code &e, size_t size)
-				{
-					this->_onMessage(e, size);
-				}
-				));
+
+// _channelScoped
+//
+// Commands whose handlers only act on their own channel, and so
+// can run on that channel's strand.  Anything that touches the
+// connection's state (logins, JOIN tracking, PONGs) must not.
+bool Twitch::IRCBot::_channelScoped(IRCCommand command)
+{
+	return command == IRCCommand::Privmsg;
+}
+
+
+// _dispatchToChannel
+//
+// Hands a parsed line to its channel's strand, so a bot's busy
+// channels are handled in parallel while each one still sees its
+// messages in order.  It gets there through the fair scheduler,
+// so a flood here doesn't take the threads from other bots.
+//
+// The line is copied out of the read buffer (which the next read
+// reuses) and its fields moved onto the copy.
+// The log can be written from any thread, so the handler's result
+// is logged right there.
+//
+// User commands ("!name args") are run against the command set as it
+// was when the line arrived, which goes along with the line.  Picking
+// up a new version of the shared commands costs one atomic load here
+// (and a lock only when there is a new one), so the handlers never lock.
+void Twitch::IRCBot::_dispatchToChannel(Handler handler, const IRCLine &line, std::string_view lineView)
+{
+	std::string_view channel = IRCMessage(line).channel();
+
+	auto strand = ChannelStrands.find(channel);
+	if (strand == ChannelStrands.end())
+		strand = ChannelStrands.emplace(std::string(channel), ChannelStrand{asio::make_strand(Context)}).first;
+
+	strand->second.Handed++;
+
+	auto text = std::make_shared<const std::string>(lineView);
+	IRCLine moved = rebaseIRCLine(line, lineView, *text);
+
+	if (Commands->version() != SharedCommands.version())
+		_refreshCommands();
+
+	Fairness.submit(Name, channel, strand->second.Where, [this, handler, text, moved, commands = Commands]()
+	{
+		IRCMessage message(moved);
+		const char *result = message.isUserCommand() ? commands->run(message, this, text) : handler(message, this);
+
+		log.record(LogLevel::Debug, HandledIn, moved.command, message.channel(), result);
+	});
+}
+
+
+// _retireChannel
+//
+// A channel we've left may still have handlers waiting for its strand
+// (in the fair scheduler or on the strand itself), and those reach
+// us.  So the strand is kept until a last task has gone through
+// behind them; stop only drains the strands it can still find.  If
+// anything was handed to it after that task (a line that beat the
+// PART, or a rejoin) it's kept instead, so that one channel never has
+// two strands running at once
+void Twitch::IRCBot::_retireChannel(const std::string &channel)
+{
+	auto found = ChannelStrands.find(channel);
+	if (found == ChannelStrands.end())
+		return;
+
+	std::uint64_t handed = ++found->second.Handed;
+
+	Fairness.submit(Name, channel, found->second.Where, [this, channel, handed]()
+	{
+		asio::post(_Strand, [this, channel, handed]()
+		{
+			auto found = ChannelStrands.find(channel);
+			if (found == ChannelStrands.end() || found->second.Handed != handed)
+				return;
+
+			ChannelStrands.erase(found);
+			Fairness.forget(Name, channel);
+		});
+	});
 }
 
 
@@ -315,30 +795,384 @@ void Twitch::IRCBot::_onMessage(const asio::error_code &e, std::size_t size)
 //
 // write queues a message to asyncronously be written to
 // the TCP socket (and properly logs it)
-void Twitch::IRCBot::write(const std::string messageString)
+void Twitch::IRCBot::write(const std::string messageString, Priority priority)
 {
-	// the buffer needs a string which is gaurenteed to be in scope, so
-	// we re-allocate on the heap as a string
-	//
-	// we also add proper line termination here to ensure it is only one place
-	std::string *message = new std::string(messageString + "\r\n");
-	
-	// queues up write with a simple handler to write to logs and clean up
-	asio::async_write(TCPsocket, asio::buffer(*message),
+	write({messageString}, priority);
+}
+
+
+// write
+//
+// an overload of write for handlers, which joins the pieces
+// of a message straight into the outbound string.  This means
+// building a reply from views into the recieved line never
+// needs any temporary strings.
+//
+// On the strand (connection handlers like PING) the message is
+// built in a recycled buffer and queued directly.  Chat handlers
+// run on their channel's strand, so from there it is built in a
+// fresh string and posted over (custom commands avoid this; see
+// reply).
+void Twitch::IRCBot::write(std::initializer_list<std::string_view> pieces, Priority priority)
+{
+	write(pieces.begin(), pieces.end(), priority);
+}
+
+
+// write
+//
+// the same, for a number of pieces only known at run time
+// (a custom command's compiled reply, for one)
+void Twitch::IRCBot::write(const std::string_view *first, const std::string_view *last, Priority priority)
+{
+	bool onStrand = _Strand.running_in_this_thread();
+
+	std::string message = onStrand ? Outbound.acquire() : std::string();
+
+	// we add proper line termination here to ensure it is only one place
+	std::size_t length = 2;
+	for (auto piece = first; piece != last; ++piece)
+		length += piece->size();
+
+	message.reserve(length);
+
+	for (auto piece = first; piece != last; ++piece)
+		message.append(*piece);
+
+	message.append("\r\n");
+
+	if (onStrand)
+	{
+		_queueWrite(std::move(message), priority);
+	}
+	else
+	{
+		asio::post(_Strand, 
+				[this, message = std::move(message), priority]() mutable
+				{
+					_queueWrite(std::move(message), priority);
+				});
+	}
+}
+
+
+// reply
+//
+// Custom command replies are views into the compiled commands and
+// the line, so rather than joining them into a fresh string on the
+// channel's strand, the line is posted to the bot's strand (keeping
+// the commands and the line alive) and the reply is rendered there,
+// straight into a recycled buffer.  Posts from one channel run in
+// order, so its replies (and their {count}s) keep their order too.
+void Twitch::IRCBot::reply(std::shared_ptr<const CustomCommands> custom, const IRCMessage &message,
+		std::shared_ptr<const std::string> text)
+{
+	if (!text || _Strand.running_in_this_thread())
+	{
+		CustomCommands::Reply pieces;
+
+		if (custom->reply(message, pieces))
+			write(pieces.begin(), pieces.end());
+
+		return;
+	}
+
+	asio::post(_Strand,
+			[this, custom = std::move(custom), text = std::move(text), line = message.line()]()
+			{
+				CustomCommands::Reply pieces;
+
+				if (custom->reply(IRCMessage(line), pieces))
+					write(pieces.begin(), pieces.end());
+			});
+}
+
+
+// _queueWrite
+//
+// adds a finished message to the write queue, and
+// starts a write if there isn't one already going.
+//
+// Chat messages (PRIVMSG) count against Twitch's rate limits,
+// so they go through the held queue and the account's limiter first.
+void Twitch::IRCBot::_queueWrite(std::string &&message, Priority priority)
+{
+	if (State == ConnectionState::Stopped)
+		return;
+
+	if (!chatChannel(message).empty())
+	{
+		Held.push_back(HeldMessage{std::move(message), priority, Clock::now()});
+		_releaseHeld();
+
+		return;
+	}
+
+	// anything else is for the connection it was written on, so
+	// without one it's dropped (the next would send it before its login)
+	if (State != ConnectionState::Connected)
+		return;
+
+	Outbound.push(std::move(message), priority);
+
+	if (!Outbound.writing())
+		_flush();
+}
+
+
+// chatChannel
+//
+// returns the channel of a "PRIVMSG #channel :..." line, or an
+// empty view for anything that isn't chat
+std::string_view Twitch::IRCBot::chatChannel(std::string_view message)
+{
+	constexpr std::string_view privmsg = "PRIVMSG ";
+
+	if (message.substr(0, privmsg.size()) != privmsg)
+		return std::string_view();
+
+	message.remove_prefix(privmsg.size());
+
+	return message.substr(0, message.find(' '));
+}
+
+
+// _releaseHeld
+//
+// Moves every held message the limiter allows onto the write queue.
+// Messages are tried most important first (and oldest first within
+// a class), where every PromoteAfter a message has waited counts as
+// one class higher.  That lets moderation jump ahead of a backlog of
+// replies, without leaving old replies or announcements stuck forever.
+//
+// Once a channel runs out, later messages to it stay put, but other
+// channels can still go ahead.  Once the account runs out, nothing else can.
+//
+// Bulk messages that have waited too long are dropped, and if anything
+// is still held a timer brings us back when the next token is due.
+void Twitch::IRCBot::_releaseHeld()
+{
+	// chat waits for the login (which calls us again)
+	if (!LoggedIn)
+		return;
+
+	const RateLimits &limits = Acct->Chat.limits();
+
+	auto now = Clock::now();
+	auto nextWait = Clock::duration::max();
+	bool released = false;
+
+	// drops bulk messages we've given up on
+	for (auto iter = Held.begin(); iter != Held.end();)
+	{
+		if (iter->Level == Priority::Bulk && now - iter->Queued > limits.MaxBulkWait)
+		{
+			Stats.Dropped++;
+			log.record(LogLevel::Info, BulkDropped, chatChannel(iter->Message));
+
+			iter = Held.erase(iter);
+		}
+		else
+		{
+			++iter;
+		}
+	}
+
+	// the order to try messages in (the list itself stays in arrival order)
+	auto effectiveLevel = [&](const HeldMessage &held) -> long
+	{
+		long promotions = limits.PromoteAfter > Clock::duration::zero() ?
+			static_cast<long>((now - held.Queued) / limits.PromoteAfter) : 0;
+
+		return std::max(0L, static_cast<long>(priorityIndex(held.Level)) - promotions);
+	};
+
+	std::vector<std::list<HeldMessage>::iterator> order;
+	order.reserve(Held.size());
+	for (auto iter = Held.begin(); iter != Held.end(); ++iter)
+		order.push_back(iter);
+
+	std::stable_sort(order.begin(), order.end(),
+			[&](const auto &a, const auto &b)
+			{
+				return effectiveLevel(*a) < effectiveLevel(*b);
+			});
+
+	// channels we already know are out of tokens this pass
+	std::vector<std::string_view> blocked;
+
+	for (auto iter : order)
+	{
+		std::string_view channel = chatChannel(iter->Message);
+
+		if (std::find(blocked.begin(), blocked.end(), channel) != blocked.end())
+			continue;
+
+		RateDecision decision = Acct->Chat.acquire(channel, now);
+
+		if (!decision.Allowed)
+		{
+			nextWait = std::min(nextWait, decision.Wait);
+
+			if (decision.AccountLimited)
+				break;
+
+			blocked.push_back(channel);
+			continue;
+		}
+
+		auto waited = now - iter->Queued;
+		if (waited > Clock::duration::zero())
+		{
+			Stats.Delayed++;
+			Stats.TotalWait += waited;
+			Stats.MaxWait = std::max(Stats.MaxWait, waited);
+		}
+
+		// the view into this message is done with before it's moved
+		Outbound.push(std::move(iter->Message), iter->Level);
+		Held.erase(iter);
+		released = true;
+	}
+
+	Stats.Queued = Held.size();
+
+	if (released && !Outbound.writing())
+		_flush();
+
+	if (!Held.empty() && !RateTimerArmed)
+	{
+		// never sleep forever, whatever the limiter said
+		if (nextWait == Clock::duration::max())
+			nextWait = limits.PromoteAfter;
+
+		RateTimerArmed = true;
+
+		log << "Rate limited: " << Held.size() << " messages held for "
+			<< std::chrono::duration_cast<std::chrono::milliseconds>(nextWait).count() << "ms" << endl;
+
+		Pending++;
+
+		RateTimer.expires_after(nextWait);
+		RateTimer.async_wait(asio::bind_executor(_Strand,
+					[this](const asio::error_code &e)
+					{
+						if (_completed())
+							return;
+
+						RateTimerArmed = false;
+
+						if (!e)
+							_releaseHeld();
+					}));
+	}
+}
+
+
+// _sendJoins
+//
+// Takes as many JOINs as the account has left and sends them in as
+// few lines as will fit.  Anything still waiting (or waiting to be
+// confirmed) brings us back here on the join timer.
+void Twitch::IRCBot::_sendJoins()
+{
+	if (State != ConnectionState::Connected || !LoggedIn)
+		return;
+
+	const RateLimits &limits = Acct->Chat.limits();
+
+	auto now = Clock::now();
+
+	// unconfirmed JOINs go back in the queue first, so they're sent again now
+	auto wakeAt = Joins.expire(limits.JoinTimeout, limits.MaxJoinAttempts, now);
+
+	Clock::duration wait = Clock::duration::zero();
+	std::size_t allowed = Acct->Chat.acquireJoins(Joins.pending(), wait, now);
+
+	std::string line;
+	while (allowed > 0)
+	{
+		allowed -= Joins.nextBatch(allowed, line, now);
+
+		write(line);
+	}
+
+	if (Joins.pending() > 0)
+		wakeAt = std::min(wakeAt, now + wait);
+
+	// the join timer brings us back here (all JOINs confirmed leaves it unarmed)
+	if (wakeAt != Clock::time_point::max() && !JoinTimerArmed)
+	{
+		JoinTimerArmed = true;
+
+		Pending++;
+
+		JoinTimer.expires_at(wakeAt);
+		JoinTimer.async_wait(asio::bind_executor(_Strand,
+					[this](const asio::error_code &e)
+					{
+						if (_completed())
+							return;
+
+						JoinTimerArmed = false;
+
+						if (!e)
+							_sendJoins();
+					}));
+	}
+}
+
+
+// outboundStats
+//
+// how the rate limited side of the bot is doing (call on the strand)
+Twitch::RateStats Twitch::IRCBot::outboundStats() const
+{
+	return Stats;
+}
+
+
+// _flush
+//
+// writes everything in the queue as a single gathered write.
+// Only one of these is ever in flight; anything queued while
+// it is goes out in the next batch once it completes.
+void Twitch::IRCBot::_flush()
+{
+	// nothing is written without a connection.  Before the login, all
+	// that's queued is the login itself (see _disconnected and _releaseHeld)
+	if (State != ConnectionState::Connected)
+		return;
+
+	if (!Outbound.startBatch())
+		return;
+
+	outBuffers.clear();
+	for (const auto &message : Outbound.batch())
+		outBuffers.push_back(asio::buffer(message));
+
+	Pending++;
+
+	asio::async_write(TCPsocket, outBuffers,
 			asio::bind_executor(_Strand,
-				[this, message](const asio::error_code &e, size_t size)
+				[this](const asio::error_code &e, size_t)
 				{
+					if (_completed())
+						return;
+
+					// as the batch is now sent (or lost), recycle it
+					Outbound.finishBatch();
+
 					if (e)
 					{
-						log    << "Standard write failed with error:" << endl
-							   << "\t"                                << e.value()   << endl
-							   << "\t"                                << e.message() << endl;
+						_disconnected("Standard write failed", e);
+						return;
 					}
 
 					// TODO - log message
 
-					// as message is now used, we can delete it
-					delete message;
+					// send whatever is next
+					_flush();
 				}
 			));
 }
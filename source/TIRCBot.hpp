@@ -15,10 +15,13 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <list>
+#include <memory>
+#include <functional>
 #include <fstream>
 
-// for smatch
-#include <regex>
+#include <string_view>
+#include <initializer_list>
 
 // asio main header
 #include <asio.hpp>
@@ -26,11 +29,36 @@
 // tokens
 #include "token.hpp"
 
+// receive buffer and write queue
+#include "LineBuffer.hpp"
+#include "WriteQueue.hpp"
+
+// reconnect backoff and login admission
+#include "Backoff.hpp"
+#include "Admission.hpp"
+
+// fair handler scheduling between bots
+#include "FairScheduler.hpp"
+
+// outbound rate limiting
+#include "Priority.hpp"
+#include "RateLimiter.hpp"
+#include "Account.hpp"
+
+// paced channel JOINs
+#include "JoinScheduler.hpp"
+
+// buffered, levelled logging
+#include "Log.hpp"
+
+// raw inbound traffic recording, for replays
+#include "TrafficRecorder.hpp"
+
 // analysis of IRC commands
 #include "IRCCorrelator.hpp"
 
-// analysis of user commands
-#include "CommandCorrelator.hpp"
+// user commands, shared between bots
+#include "CommandTable.hpp"
 
 namespace Twitch
 {
@@ -46,64 +74,223 @@ namespace Twitch
 			// connection data
 			std::string Server, PortNumber;
 
-			// strand for handle execution (currently unneeded)
+			// strand for the connection: reads, parsing, writes and everything
+			// but chat handlers
 			asio::strand<asio::io_context::executor_type> _Strand;
 
+			// a strand per channel, for handling its chat, and how many tasks
+			// have been handed to it (only used from _Strand)
+			struct ChannelStrand
+			{
+				asio::strand<asio::io_context::executor_type> Where;
+				std::uint64_t Handed = 0;
+			};
+			std::map<std::string, ChannelStrand, std::less<>> ChannelStrands;
+
 			// resolver
 			asio::ip::tcp::resolver IPresolver;
 
 			//basic stream socket
 			asio::ip::tcp::socket TCPsocket;
 
+			// where we are in (re)connecting
+			enum class ConnectionState
+			{
+				Queued,			// waiting for the Overseer to let us log in
+				Resolving,		// waiting on DNS
+				Connecting,		// waiting on the TCP connection
+				Connected,		// connected (and logging in or logged in)
+				Waiting,		// dropped, waiting to try again
+				Stopped			// stopped for good (see stop)
+			};
+			ConnectionState State = ConnectionState::Queued;
+
+			// the server has accepted our login on this connection.  Until it
+			// has, only the login itself is written (see _disconnected)
+			bool LoggedIn = false;
+
+			// Async operations started and not yet finished (our place in the
+			// login queue, DNS, the socket and the timers), so a stopped bot
+			// knows when nothing is left that could reach it (on the strand only)
+			std::size_t Pending = 0;
+
+			// once stopped: whether the channels and the log are done with, and
+			// what to call when the bot can be let go (see stop)
+			bool Drained = false;
+			std::function<void(IRCBot *)> Reclaim;
+
+			// reconnect delays, and the timer that waits them out
+			Backoff Reconnect;
+			asio::steady_timer ConnectTimer;
+
+			// hands out login attempts between every bot (owned by the Overseer),
+			// and our place in its queue
+			Admission &Gate;
+			std::uint64_t GateTicket = 0;
+
+			// shares handler time fairly between bots (owned by the Overseer)
+			FairScheduler &Fairness;
+
 			//ASIO error system
 			asio::error_code error;
 
-			//read buffer (string has to be heap for...reasons??)
-			std::string *inString;
-			asio::dynamic_string_buffer
-			<std::string::value_type, std::string::traits_type, std::string::allocator_type>
-				inBuffer;
+			// read buffer, which lines are parsed from in place
+			LineBuffer inBuffer;
+
+			// outbound messages, and the buffer list for the write in flight
+			WriteQueue Outbound;
+			std::vector<asio::const_buffer> outBuffers;
+
+			// chat messages held back by the rate limiter (oldest first)
+			struct HeldMessage
+			{
+				std::string Message;
+				Priority Level;
+				Clock::time_point Queued;
+			};
+			std::list<HeldMessage> Held;
+
+			// wakes us up when the limiter has tokens again
+			asio::steady_timer RateTimer;
+			bool RateTimerArmed = false;
+
+			RateStats Stats;
+
+			// channels to join, and the timer that paces them
+			JoinScheduler Joins;
+			asio::steady_timer JoinTimer;
+			bool JoinTimerArmed = false;
 
 			//--------------------------------------------------------
 			// All non-network related members
 
-			// path to client files
+			// path to client files, and the client's name (its folder)
 			const Poco::Path Path;
+			const std::string Name;
+
+			// the bot's log.txt (see Log.hpp)
+			Log log;
 
-			// log filestream
-			std::ofstream log;
+			// everything read from the socket, when recording (on the strand only)
+			TrafficRecorder Recorder;
 
 			// Auth Token and username (stored in case of reconnection)
 			Twitch::token Token;
 
+			// state shared with every bot on the same account (rate limits)
+			std::shared_ptr<Account> Acct;
+
 			// a helper that correlates IRC commands to functions
 			IRCCorrelator &IRC;
 
-			// a helper that correlates USER commands to functions
-			CommandCorrelator Commands;
+			// the USER commands every bot shares (owned by the Overseer), this
+			// bot's overrides, and the two together (both on the strand only)
+			CommandRegistry &SharedCommands;
+			std::shared_ptr<const CommandOverrides> Overrides;
+			std::shared_ptr<const CommandSet> Commands;
+
+			// the cooldowns running on this bot's commands (checked from any channel)
+			Cooldowns Cooldown;
 
 			// private functions
 			
-			// Connection related functions
-			void _connect(long delay=0);
+			// Connection related functions (the async connect chain)
+			void _requestConnect();
+			void _connect();
+			void _onResolve(const asio::error_code &e, const asio::ip::tcp::resolver::results_type &endpoints);
+			void _onConnect(const asio::error_code &e);
+			void _disconnected(const char *reason, const asio::error_code &e);
+
+			// counts an async operation as finished.  True if we've stopped,
+			// in which case its handler must do nothing more
+			bool _completed();
+
+			// hands the bot to Reclaim once nothing can reach it any more
+			void _reclaim();
+
+			// socket read loop (one read can hold many lines)
+			void _read();
+			void _onRead(const asio::error_code &e, std::size_t size);
+
+			// message recieve handler (one complete line)
+			void _onMessage(std::string_view line);
+
+			// running a handler on a channel's strand rather than the connection's
+			using Handler = IRCHandler;
+			static bool _channelScoped(IRCCommand command);
+			void _dispatchToChannel(Handler handler, const IRCLine &line, std::string_view lineView);
+
+			// lets go of a channel's strand once its handlers have all run
+			void _retireChannel(const std::string &channel);
+
+			// write queue handling (on the strand only)
+			void _queueWrite(std::string &&message, Priority priority);
+			void _releaseHeld();
+			void _flush();
+
+			// sends as many pending JOINs as the account's limit allows
+			void _sendJoins();
+
+			// rebuilds Commands from the shared table's current version
+			void _refreshCommands();
 
-			// message recieve handler
-			void _onMessage(const asio::error_code &e, std::size_t size);
+			// reads channels.txt
+			std::vector<std::string> _channelList() const;
+
+			// the channel a PRIVMSG is sent to (empty for anything else)
+			static std::string_view chatChannel(std::string_view message);
 			
 		public:
 			// constructor
 			IRCBot(asio::io_context &context, std::string server, std::string portNum,
 					IRCCorrelator &IRCCor,
-					CommandCorrelator &Comms,
+					CommandRegistry &Comms,
+					AccountRegistry &Accounts,
+					Admission &Gate,
+					FairScheduler &Fairness,
 					const Poco::Path dirPath);
 			// destrcutor
 			virtual ~IRCBot();
 
-			// starts the event handle loop
+			// starts the event handle loop (logs in once connected)
 			void start();
 
+			// drops the connection and connects again
+			void reconnect();
+
+			// Closes the connection and stops for good (safe from any thread).
+			// Once every handler that could reach the bot has run, reclaim is
+			// called with it (on its strand) to free it.  Without one, the bot
+			// must outlive its contexts' threads
+			void stop(std::function<void(IRCBot *)> reclaim = nullptr);
+
+			// re-reads disabledCommands.txt, customCommands.txt and cooldowns.txt (safe from any thread)
+			void reloadCommands();
+
+			// re-reads channels.txt, joining and leaving only what changed (safe from any thread)
+			void reloadChannels();
+
+			// the server accepted our login
+			void loggedIn();
+
 			// function to write lines to the socket
-			void write(const std::string messageString);
+			void write(const std::string messageString, Priority priority = Priority::Normal);
+
+			// writes a line built from several pieces (without temporary strings)
+			void write(std::initializer_list<std::string_view> pieces, Priority priority = Priority::Normal);
+			void write(const std::string_view *first, const std::string_view *last, Priority priority = Priority::Normal);
+
+			// writes a custom command's reply to message.  Off the strand, text
+			// (what message's views point into) keeps the line alive until it's written
+			void reply(std::shared_ptr<const CustomCommands> custom, const IRCMessage &message,
+					std::shared_ptr<const std::string> text);
+
+			// queue depth and wait times for rate limited messages
+			RateStats outboundStats() const;
+
+			// the context the bot was built on, and its client folder
+			asio::io_context &context() const { return Context; }
+			std::string folder() const { return Path.toString(); }
 
 			// a friend class to handle correlation (likely to be removed)
 			friend IRCCorrelator;
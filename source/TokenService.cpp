@@ -0,0 +1,160 @@
+/* TokenService.cpp - Miles Shamo
+ *
+ * Implementation of the token renewal service
+ *
+ */
+
+#include "TokenService.hpp"
+
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+Twitch::TokenService::TokenService(asio::io_context &context, Renewer renew)
+	:	Context(context),
+		Renew(std::move(renew)),
+		Worker(&Twitch::TokenService::_work, this)
+{
+}
+
+
+// ~TokenService
+//
+// a renewal that's already running is let finish, but nothing
+// new is started
+Twitch::TokenService::~TokenService()
+{
+	{
+		std::lock_guard<std::mutex> guard(Lock);
+		Stopping = true;
+	}
+
+	Wake.notify_all();
+
+	if (Worker.joinable())
+		Worker.join();
+}
+
+
+// renew
+//
+// Renewals are keyed by the username in the token, as every
+// client on an account has its own link to the same file.  The
+// file is small and local, so reading it here is fine.
+void Twitch::TokenService::renew(const Poco::Path &tokenFile, Callback done)
+{
+	token current;
+
+	std::ifstream input(tokenFile.toString());
+	input >> current;
+
+	// (scopes may be empty, so only the username says it was read)
+	if (current.username.empty())
+	{
+		asio::post(Context, [done]()
+		{
+			done(false);
+		});
+		return;
+	}
+
+	std::lock_guard<std::mutex> guard(Lock);
+
+	auto iter = InFlight.find(current.username);
+
+	// already being renewed, so just wait for that one
+	if (iter != InFlight.end())
+	{
+		iter->second.Waiting.push_back(std::move(done));
+		return;
+	}
+
+	Renewal renewal{tokenFile, {}};
+	renewal.Waiting.push_back(std::move(done));
+
+	InFlight.emplace(current.username, std::move(renewal));
+	Jobs.push_back(current.username);
+
+	Wake.notify_one();
+}
+
+
+std::size_t Twitch::TokenService::inFlight()
+{
+	std::lock_guard<std::mutex> guard(Lock);
+
+	return InFlight.size();
+}
+
+
+// _work
+//
+// The worker thread.  Renewals for different accounts run one after
+// another, which is plenty as they're rare.
+void Twitch::TokenService::_work()
+{
+	std::unique_lock<std::mutex> guard(Lock);
+
+	while (true)
+	{
+		Wake.wait(guard, [this]()
+		{
+			return Stopping || !Jobs.empty();
+		});
+
+		if (Stopping)
+			return;
+
+		std::string username = std::move(Jobs.front());
+		Jobs.pop_front();
+
+		Poco::Path tokenFile = InFlight[username].TokenFile;
+
+		// the request itself runs unlocked, so others can still join in
+		guard.unlock();
+		bool renewed = _renewFile(tokenFile);
+		guard.lock();
+
+		auto waiting = std::move(InFlight[username].Waiting);
+		InFlight.erase(username);
+
+		for (auto &done : waiting)
+		{
+			asio::post(Context, [done = std::move(done), renewed]()
+			{
+				done(renewed);
+			});
+		}
+	}
+}
+
+
+// _renewFile
+//
+// reads the token fresh (it may have changed since it was asked
+// for), renews it and writes it back over the shared file
+bool Twitch::TokenService::_renewFile(const Poco::Path &tokenFile)
+{
+	token current;
+
+	std::ifstream input(tokenFile.toString());
+	input >> current;
+	input.close();
+
+	// a failed request (no network, TLS errors) just counts as not renewed
+	try
+	{
+		if (!Renew(current))
+			return false;
+	}
+	catch (const std::exception &)
+	{
+		return false;
+	}
+
+	// truncates in place (rather than replacing the file) so every hard link sees it
+	std::ofstream output(tokenFile.toString(), std::ofstream::trunc);
+	output << current;
+
+	return static_cast<bool>(output);
+}
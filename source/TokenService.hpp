@@ -0,0 +1,90 @@
+/* TokenService.hpp - Miles Shamo
+ *
+ * Renews tokens off of the IO threads.
+ *
+ * Renewing a token is a blocking HTTPS POST to
+ * id.twitch.tv (see Overseer::_renewToken).  Done
+ * on an IO thread, it holds up every bot that
+ * thread would otherwise be serving for a full TLS
+ * handshake and request, so renewals run on a
+ * thread of their own instead.
+ *
+ * Clients on one account share a hard linked token
+ * file, so when its token expires they all fail to
+ * log in at about the same time.  Each renewal
+ * hands out a new refresh token and can invalidate
+ * the last one, so only one renewal per account is
+ * ever in flight; anyone else asking while it runs
+ * waits on that one and gets its result.
+ */
+
+#ifndef TWITCH_TOKEN_SERVICE
+#define TWITCH_TOKEN_SERVICE
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <asio.hpp>
+
+#include <Poco/Path.h>
+
+#include "token.hpp"
+
+namespace Twitch
+{
+	class TokenService
+	{
+		public:
+			// called (on the io_context) with whether the token was renewed
+			using Callback = std::function<void(bool renewed)>;
+
+			// does the actual renewal, updating the token in place
+			using Renewer = std::function<bool(token &)>;
+
+		private:
+			asio::io_context &Context;
+
+			Renewer Renew;
+
+			// one renewal per account, and everyone waiting on it
+			struct Renewal
+			{
+				Poco::Path TokenFile;
+				std::vector<Callback> Waiting;
+			};
+
+			std::mutex Lock;
+			std::condition_variable Wake;
+
+			std::map<std::string, Renewal> InFlight;
+
+			// accounts whose renewal hasn't started yet
+			std::deque<std::string> Jobs;
+
+			bool Stopping = false;
+
+			// the thread the HTTPS requests block
+			std::thread Worker;
+
+			void _work();
+			bool _renewFile(const Poco::Path &tokenFile);
+
+		public:
+			TokenService(asio::io_context &context, Renewer renew);
+			~TokenService();
+
+			// Renews the token in tokenFile (if nobody else already is) and calls
+			// done when it's finished.  Never blocks on the network
+			void renew(const Poco::Path &tokenFile, Callback done);
+
+			// number of accounts with a renewal queued or running
+			std::size_t inFlight();
+	};
+}
+#endif
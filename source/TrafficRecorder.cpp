@@ -0,0 +1,150 @@
+/* TrafficRecorder.cpp - Miles Shamo
+ *
+ * Implementation of traffic recording and reading
+ *
+ */
+
+#include "TrafficRecorder.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+	constexpr char Magic[] = "BARIREC1";
+	constexpr std::size_t MagicSize = sizeof(Magic) - 1;
+
+	constexpr char Read = 'R';
+
+	// big enough that recording busy chat rarely writes
+	constexpr std::size_t BufferSize = 1 << 20;
+}
+
+
+bool Twitch::TrafficRecorder::open(const std::string &path)
+{
+	close();
+
+	File = std::fopen(path.c_str(), "ab");
+	if (!File)
+		return false;
+
+	std::setvbuf(File, nullptr, _IOFBF, BufferSize);
+
+	Last = std::chrono::steady_clock::now();
+
+	auto wall = std::chrono::system_clock::now().time_since_epoch();
+	std::int64_t started = std::chrono::duration_cast<std::chrono::nanoseconds>(wall).count();
+
+	std::fwrite(Magic, 1, MagicSize, File);
+	std::fwrite(&started, sizeof(started), 1, File);
+
+	return true;
+}
+
+
+void Twitch::TrafficRecorder::close()
+{
+	if (File)
+		std::fclose(File);
+
+	File = nullptr;
+}
+
+
+// _varint
+//
+// seven bits a byte, lowest first
+void Twitch::TrafficRecorder::_varint(std::uint64_t value)
+{
+	unsigned char bytes[10];
+	std::size_t count = 0;
+
+	do
+	{
+		bytes[count] = value & 0x7f;
+		value >>= 7;
+
+		if (value)
+			bytes[count] |= 0x80;
+
+		count++;
+	} while (value);
+
+	std::fwrite(bytes, 1, count, File);
+}
+
+
+void Twitch::TrafficRecorder::record(std::string_view bytes, std::chrono::steady_clock::time_point now)
+{
+	if (!File || bytes.empty())
+		return;
+
+	auto gap = std::chrono::duration_cast<std::chrono::nanoseconds>(now - Last).count();
+	Last = now;
+
+	std::fputc(Read, File);
+	_varint(gap > 0 ? gap : 0);
+	_varint(bytes.size());
+	std::fwrite(bytes.data(), 1, bytes.size(), File);
+}
+
+
+//--------------------------------------------------------
+// TrafficReader
+
+bool Twitch::TrafficReader::_varint(std::uint64_t &value)
+{
+	value = 0;
+
+	for (int shift = 0; shift < 64; shift += 7)
+	{
+		int byte = In.get();
+		if (byte == std::char_traits<char>::eof())
+			return false;
+
+		value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+
+		if (!(byte & 0x80))
+			return true;
+	}
+
+	throw std::runtime_error("TrafficReader: bad length in recording");
+}
+
+
+// next
+//
+// reads the next chunk.  Session headers just carry on the times
+bool Twitch::TrafficReader::next(TrafficChunk &chunk)
+{
+	while (In.peek() == Magic[0])
+	{
+		char magic[MagicSize];
+		std::int64_t started;
+
+		if (!In.read(magic, MagicSize) || !In.read(reinterpret_cast<char *>(&started), sizeof(started)))
+			return false;
+
+		if (std::memcmp(magic, Magic, MagicSize) != 0)
+			throw std::runtime_error("TrafficReader: not a traffic recording");
+	}
+
+	int kind = In.get();
+	if (kind == std::char_traits<char>::eof())
+		return false;
+
+	if (kind != Read)
+		throw std::runtime_error("TrafficReader: not a traffic recording");
+
+	std::uint64_t gap, size;
+	if (!_varint(gap) || !_varint(size))
+		return false;
+
+	At += std::chrono::nanoseconds(gap);
+
+	chunk.At = At;
+	chunk.Bytes.resize(size);
+
+	return size == 0 || In.read(chunk.Bytes.data(), size);
+}
@@ -0,0 +1,84 @@
+/* TrafficRecorder.hpp - Miles Shamo
+ *
+ * Records a bot's raw inbound traffic, so real
+ * chat can be replayed through it later (see
+ * tools/replay.cpp) for benchmarks and regression
+ * tests.
+ *
+ * When BARIBOT_RECORD is set, every read from the
+ * socket is appended to traffic.rec in the bot's
+ * folder exactly as it arrived, with the time since
+ * the read before it.  A recording starts with
+ * 		"BARIREC1", i64 system clock ns at the start
+ * followed by the reads, each
+ * 		'R', varint ns since the last read, varint length, bytes
+ * A bot that's started again appends a new header,
+ * and the reader carries its times on from the end
+ * of the last session.
+ *
+ * Writes go through a large stdio buffer, so
+ * recording costs a copy per read and a write()
+ * every megabyte or so.
+ */
+
+#ifndef TWITCH_TRAFFIC_RECORDER
+#define TWITCH_TRAFFIC_RECORDER
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <istream>
+#include <string>
+#include <string_view>
+
+namespace Twitch
+{
+	class TrafficRecorder
+	{
+		private:
+			std::FILE *File = nullptr;
+			std::chrono::steady_clock::time_point Last;
+
+			void _varint(std::uint64_t value);
+
+		public:
+			TrafficRecorder() = default;
+			TrafficRecorder(const TrafficRecorder &) = delete;
+			~TrafficRecorder() { close(); }
+
+			// starts (appending to) a recording; false if it couldn't be opened
+			bool open(const std::string &path);
+			void close();
+
+			bool recording() const { return File != nullptr; }
+
+			// records one read
+			void record(std::string_view bytes, std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+	};
+
+	// one read, and when it arrived (from the start of the recording)
+	struct TrafficChunk
+	{
+		std::chrono::nanoseconds At{0};
+		std::string Bytes;
+	};
+
+	class TrafficReader
+	{
+		private:
+			std::istream &In;
+
+			// when the last chunk arrived
+			std::chrono::nanoseconds At{0};
+
+			bool _varint(std::uint64_t &value);
+
+		public:
+			explicit TrafficReader(std::istream &in) : In(in) {}
+
+			// Reads the next chunk, false at the end (or at a chunk cut short).
+			// Throws a std::runtime_error if this isn't a recording
+			bool next(TrafficChunk &chunk);
+	};
+}
+#endif
@@ -0,0 +1,153 @@
+/* WriteQueue.cpp - Miles Shamo
+ *
+ * Implementation of the outbound write queue
+ *
+ */
+
+#include "WriteQueue.hpp"
+
+#include <algorithm>
+#include <utility>
+
+Twitch::WriteQueue::WriteQueue(std::size_t maxPooled, std::size_t maxBatch, std::size_t minShare)
+	:	MaxPooled(maxPooled),
+		MaxBatch(maxBatch),
+		MinShare(minShare)
+{
+}
+
+
+// acquire
+//
+// hands out a pooled string if we have one
+std::string Twitch::WriteQueue::acquire()
+{
+	if (Pool.empty())
+		return std::string();
+
+	std::string buffer = std::move(Pool.back());
+	Pool.pop_back();
+
+	return buffer;
+}
+
+
+// push
+//
+// queues a message behind the current batch
+void Twitch::WriteQueue::push(std::string &&message, Priority priority)
+{
+	Pending[priorityIndex(priority)].push_back(std::move(message));
+	PendingCount++;
+}
+
+
+// _take
+//
+// moves messages from the front of one class's queue into the batch.
+// The queue itself is only compacted once it has been emptied (or is
+// mostly sent messages), so this rarely shifts the messages left behind.
+void Twitch::WriteQueue::_take(std::size_t level, std::size_t count)
+{
+	auto &queue = Pending[level];
+	auto &front = PendingFront[level];
+
+	count = std::min(count, queue.size() - front);
+
+	for (std::size_t i = 0; i < count; i++)
+		InFlight.push_back(std::move(queue[front++]));
+
+	PendingCount -= count;
+
+	if (front == queue.size())
+	{
+		queue.clear();
+		front = 0;
+	}
+	// a queue that never quite empties is compacted once it's mostly sent
+	else if (front > MaxBatch && front * 2 > queue.size())
+	{
+		queue.erase(queue.begin(), queue.begin() + front);
+		front = 0;
+	}
+}
+
+
+// startBatch
+//
+// Fills a batch from the most important class down.  Before
+// that, each lower class that has something waiting is promised
+// MinShare of the slots, so a flood of higher priority messages
+// can slow it down but never stop it.
+bool Twitch::WriteQueue::startBatch()
+{
+	if (writing() || PendingCount == 0)
+		return false;
+
+	std::array<std::size_t, PriorityCount> reserved = {};
+	std::size_t reservedTotal = 0;
+
+	for (std::size_t level = 1; level < PriorityCount; level++)
+	{
+		std::size_t waiting = Pending[level].size() - PendingFront[level];
+
+		reserved[level] = std::min(waiting, MinShare);
+		reservedTotal += reserved[level];
+	}
+
+	std::size_t room = MaxBatch > reservedTotal ? MaxBatch - reservedTotal : 0;
+
+	for (std::size_t level = 0; level < PriorityCount; level++)
+	{
+		std::size_t waiting = Pending[level].size() - PendingFront[level];
+		std::size_t extra = std::min(waiting - reserved[level], room);
+
+		room -= extra;
+		_take(level, reserved[level] + extra);
+	}
+
+	return true;
+}
+
+
+// finishBatch
+//
+// recycles the written buffers (up to the pool's limit)
+void Twitch::WriteQueue::finishBatch()
+{
+	for (auto &buffer : InFlight)
+	{
+		if (Pool.size() >= MaxPooled)
+			break;
+
+		buffer.clear();
+		Pool.push_back(std::move(buffer));
+	}
+
+	InFlight.clear();
+}
+
+
+// takePending
+//
+// for when the connection they were meant for is gone
+std::vector<std::pair<std::string, Twitch::Priority>> Twitch::WriteQueue::takePending()
+{
+	std::vector<std::pair<std::string, Priority>> taken;
+	taken.reserve(PendingCount);
+
+	for (std::size_t level = 0; level < PriorityCount; level++)
+	{
+		auto &queue = Pending[level];
+
+		for (std::size_t i = PendingFront[level]; i < queue.size(); i++)
+			taken.emplace_back(std::move(queue[i]), static_cast<Priority>(level));
+
+		queue.clear();
+		PendingFront[level] = 0;
+	}
+
+	PendingCount = 0;
+
+	return taken;
+}
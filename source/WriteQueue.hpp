@@ -0,0 +1,90 @@
+/* WriteQueue.hpp - Miles Shamo
+ *
+ * The outbound side of an IRCBot.
+ *
+ * Only one write may be in flight on a socket at
+ * a time, so messages wait here while one is being
+ * sent.  When it finishes, everything that piled up
+ * in the meantime goes out together as a single
+ * scatter/gather write.
+ *
+ * Messages wait in one queue per Priority, and
+ * each batch is filled from the most important
+ * queue down.  A batch is capped in size so that a
+ * PONG never waits behind more than one batch, and
+ * every lower class with something waiting gets a
+ * few guaranteed slots so it is never starved.
+ *
+ * The strings messages are built in are recycled
+ * through a small pool, so once a bot has warmed up
+ * writing a message doesn't allocate at all.
+ *
+ * This does no locking of its own; the IRCBot only
+ * touches it from its strand.
+ */
+
+#ifndef TWITCH_WRITE_QUEUE
+#define TWITCH_WRITE_QUEUE
+
+#include <array>
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Priority.hpp"
+
+namespace Twitch
+{
+	class WriteQueue
+	{
+		private:
+			// messages waiting for the current write to finish, by priority
+			std::array<std::vector<std::string>, PriorityCount> Pending;
+			std::size_t PendingCount = 0;
+
+			// where each queue's unsent messages start (so taking from the front is cheap)
+			std::array<std::size_t, PriorityCount> PendingFront = {};
+
+			// the batch currently being written
+			std::vector<std::string> InFlight;
+
+			// spare buffers (cleared, with their capacity kept)
+			std::vector<std::string> Pool;
+			std::size_t MaxPooled;
+
+			// most messages in one batch, and the slots saved for each lower class
+			std::size_t MaxBatch;
+			std::size_t MinShare;
+
+			// moves up to count messages of one class into the batch
+			void _take(std::size_t level, std::size_t count);
+
+		public:
+			explicit WriteQueue(std::size_t maxPooled = 256, std::size_t maxBatch = 64, std::size_t minShare = 4);
+
+			// gets an empty string to build a message in
+			std::string acquire();
+
+			// queues a complete message (including "\r\n")
+			void push(std::string &&message, Priority priority = Priority::Normal);
+
+			// is a batch currently being written
+			bool writing() const { return !InFlight.empty(); }
+
+			// number of messages waiting behind the current batch
+			std::size_t pending() const { return PendingCount; }
+
+			// moves the most important pending messages into a new batch.  Returns false if there was nothing
+			bool startBatch();
+			const std::vector<std::string> &batch() const { return InFlight; }
+
+			// the batch has been written, so its buffers go back to the pool
+			void finishBatch();
+
+			// takes every pending message back out (not the batch being written),
+			// most important class first and in order within each
+			std::vector<std::pair<std::string, Priority>> takePending();
+	};
+}
+#endif
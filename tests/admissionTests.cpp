@@ -0,0 +1,147 @@
+/* admissionTests.cpp - Miles Shamo
+ *
+ * Tests for the login admission control.  These
+ * run a real io_context for a moment, with limits
+ * set so that nothing leaves a window while they
+ * run (except where that is what is tested).
+ *
+ */
+
+#include "catch.hpp"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "../source/Admission.hpp"
+
+using namespace std::chrono_literals;
+
+SCENARIO("Admitting logins")
+{
+	asio::io_context context;
+
+	Twitch::AdmissionLimits limits;
+	limits.Attempts = 3;
+	limits.Period = 1h;
+	limits.AccountAttempts = 2;
+	limits.AccountPeriod = 1h;
+
+	Twitch::Admission gate(context, limits);
+
+	std::vector<std::string> granted;
+
+	auto request = [&](const std::string &username)
+	{
+		return gate.request(username, [&granted, username]()
+		{
+			granted.push_back(username);
+		});
+	};
+
+	GIVEN("More requests from one account than it is allowed")
+	{
+		request("a");
+		request("a");
+		request("a");
+
+		context.run_for(50ms);
+
+		THEN("Only its share are granted, and the rest wait")
+		{
+			CHECK(granted.size() == 2);
+			CHECK(gate.stats().Waiting == 1);
+			CHECK(gate.stats().Granted == 2);
+		}
+	}
+
+	GIVEN("A busy account ahead of a quiet one")
+	{
+		request("a");
+		request("a");
+		request("a");
+		request("b");
+
+		context.run_for(50ms);
+
+		THEN("The quiet account doesn't wait behind it")
+		{
+			REQUIRE(granted.size() == 3);
+			CHECK(granted[2] == "b");
+		}
+	}
+
+	GIVEN("More requests than the global limit")
+	{
+		request("a");
+		request("b");
+		request("c");
+		request("d");
+
+		context.run_for(50ms);
+
+		THEN("They are granted in the order they came in")
+		{
+			REQUIRE(granted.size() == 3);
+			CHECK(granted[0] == "a");
+			CHECK(granted[1] == "b");
+			CHECK(granted[2] == "c");
+			CHECK(gate.stats().Waiting == 1);
+		}
+	}
+
+	GIVEN("A request cancelled before its turn")
+	{
+		request("a");
+		request("a");
+		auto ticket = request("a");
+		request("b");
+
+		bool cancelled = gate.cancel(ticket);
+
+		context.run_for(50ms);
+
+		THEN("It is never granted, and nothing waits")
+		{
+			CHECK(cancelled);
+			REQUIRE(granted.size() == 3);
+			CHECK(granted[2] == "b");
+			CHECK(gate.stats().Waiting == 0);
+		}
+
+		THEN("It can't be cancelled again")
+		{
+			CHECK_FALSE(gate.cancel(ticket));
+		}
+	}
+}
+
+SCENARIO("Admitting logins after an outage")
+{
+	asio::io_context context;
+
+	Twitch::AdmissionLimits limits;
+	limits.Attempts = 3;
+	limits.Period = 400ms;
+	limits.AccountAttempts = 10;
+	limits.AccountPeriod = 400ms;
+
+	Twitch::Admission gate(context, limits);
+
+	std::size_t granted = 0;
+
+	GIVEN("Twice the limit, all at once")
+	{
+		for (int i = 0; i < 6; i++)
+			gate.request("bot" + std::to_string(i), [&granted]() { granted++; });
+
+		THEN("A full burst goes, then nothing until the period after it")
+		{
+			context.run_for(300ms);
+			CHECK(granted == 3);
+
+			context.run_for(300ms);
+			CHECK(granted == 6);
+		}
+	}
+}
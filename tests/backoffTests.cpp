@@ -0,0 +1,59 @@
+/* backoffTests.cpp - Miles Shamo
+ *
+ * Tests for the reconnect backoff.  The delays
+ * are random, so these only check the bounds.
+ *
+ */
+
+#include "catch.hpp"
+
+#include <chrono>
+
+#include "../source/Backoff.hpp"
+
+using namespace std::chrono_literals;
+
+SCENARIO("Reconnect backoff")
+{
+	GIVEN("A backoff from 1 second up to 1 minute")
+	{
+		Twitch::Backoff backoff(1s, 1min);
+
+		THEN("The window doubles with each attempt, up to the cap")
+		{
+			CHECK(backoff.window() == 1s);
+			backoff.next();
+			CHECK(backoff.window() == 2s);
+			backoff.next();
+			CHECK(backoff.window() == 4s);
+
+			for (int i = 0; i < 100; i++)
+				backoff.next();
+
+			CHECK(backoff.window() == 1min);
+		}
+
+		THEN("Every delay falls inside its window")
+		{
+			for (int i = 0; i < 20; i++)
+			{
+				auto window = backoff.window();
+				auto delay = backoff.next();
+
+				REQUIRE(delay >= 0ms);
+				REQUIRE(delay <= window);
+			}
+		}
+
+		THEN("Resetting starts over")
+		{
+			for (int i = 0; i < 5; i++)
+				backoff.next();
+
+			backoff.reset();
+
+			CHECK(backoff.attempts() == 0);
+			CHECK(backoff.window() == 1s);
+		}
+	}
+}
@@ -0,0 +1,208 @@
+/* bufferTests.cpp - Miles Shamo
+ *
+ * Tests for the IRCBot's receive buffer,
+ * mostly to make sure lines split across
+ * reads come out whole, and for its write queue.
+ *
+ */
+
+#include "catch.hpp"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../source/LineBuffer.hpp"
+#include "../source/WriteQueue.hpp"
+
+namespace
+{
+	// "reads" data into the buffer the same way the socket does
+	void recieve(Twitch::LineBuffer &buffer, const std::string &data)
+	{
+		char *space = buffer.prepare(data.size());
+
+		REQUIRE(buffer.space() >= data.size());
+
+		std::memcpy(space, data.data(), data.size());
+		buffer.commit(data.size());
+	}
+
+	std::vector<std::string> drain(Twitch::LineBuffer &buffer)
+	{
+		std::vector<std::string> lines;
+		std::string_view line;
+
+		while (buffer.nextLine(line))
+			lines.emplace_back(line);
+
+		return lines;
+	}
+}
+
+SCENARIO("Reading lines out of the receive buffer")
+{
+	Twitch::LineBuffer buffer(64);
+
+	GIVEN("Several lines in one read")
+	{
+		recieve(buffer, "PING :a\r\nPING :b\r\nPING :c\r\n");
+
+		THEN("All of them come out, in order")
+		{
+			auto lines = drain(buffer);
+
+			REQUIRE(lines.size() == 3);
+			CHECK(lines[0] == "PING :a\r\n");
+			CHECK(lines[2] == "PING :c\r\n");
+			CHECK(buffer.pending() == 0);
+		}
+	}
+
+	GIVEN("A line split across two reads")
+	{
+		recieve(buffer, "PING :a\r\nPRIVMSG #chan");
+
+		THEN("Only the complete line comes out until the rest arrives")
+		{
+			auto lines = drain(buffer);
+
+			REQUIRE(lines.size() == 1);
+			CHECK(buffer.pending() == std::strlen("PRIVMSG #chan"));
+
+			recieve(buffer, " :hello\r\n");
+			lines = drain(buffer);
+
+			REQUIRE(lines.size() == 1);
+			CHECK(lines[0] == "PRIVMSG #chan :hello\r\n");
+		}
+	}
+
+	GIVEN("A line longer than the buffer")
+	{
+		std::string longLine = "PRIVMSG #chan :" + std::string(200, 'a') + "\r\n";
+
+		THEN("The buffer grows to hold it")
+		{
+			for (std::size_t i = 0; i < longLine.size(); i += 32)
+				recieve(buffer, longLine.substr(i, 32));
+
+			auto lines = drain(buffer);
+
+			REQUIRE(lines.size() == 1);
+			CHECK(lines[0] == longLine);
+		}
+	}
+}
+
+SCENARIO("Queueing outbound messages")
+{
+	Twitch::WriteQueue queue;
+
+	GIVEN("Messages queued while a write is in flight")
+	{
+		queue.push("PONG :tmi.twitch.tv\r\n");
+		REQUIRE(queue.startBatch());
+
+		queue.push("PRIVMSG #a :one\r\n");
+		queue.push("PRIVMSG #a :two\r\n");
+
+		THEN("They wait, and then go out together in order")
+		{
+			CHECK(queue.writing());
+			CHECK_FALSE(queue.startBatch());
+			CHECK(queue.pending() == 2);
+
+			queue.finishBatch();
+
+			REQUIRE(queue.startBatch());
+			REQUIRE(queue.batch().size() == 2);
+			CHECK(queue.batch()[0] == "PRIVMSG #a :one\r\n");
+			CHECK(queue.batch()[1] == "PRIVMSG #a :two\r\n");
+		}
+	}
+
+	GIVEN("A connection dropped with messages still waiting")
+	{
+		queue.push("PONG :tmi.twitch.tv\r\n", Twitch::Priority::Protocol);
+		REQUIRE(queue.startBatch());
+
+		queue.push("PRIVMSG #a :one\r\n");
+		queue.push("JOIN #b\r\n", Twitch::Priority::Protocol);
+		queue.push("PRIVMSG #a :two\r\n");
+
+		THEN("They can all be taken back, leaving the batch in flight alone")
+		{
+			auto taken = queue.takePending();
+
+			REQUIRE(taken.size() == 3);
+			CHECK(taken[0].first == "JOIN #b\r\n");
+			CHECK(taken[0].second == Twitch::Priority::Protocol);
+			CHECK(taken[1].first == "PRIVMSG #a :one\r\n");
+			CHECK(taken[2].first == "PRIVMSG #a :two\r\n");
+			CHECK(taken[2].second == Twitch::Priority::Normal);
+
+			CHECK(queue.pending() == 0);
+			CHECK(queue.writing());
+
+			queue.finishBatch();
+			CHECK_FALSE(queue.startBatch());
+		}
+	}
+
+	GIVEN("A written batch")
+	{
+		std::string message = queue.acquire();
+		message.assign(200, 'a');
+		const char *storage = message.data();
+
+		queue.push(std::move(message));
+		queue.startBatch();
+		queue.finishBatch();
+
+		THEN("Its buffers are handed out again, empty")
+		{
+			std::string reused = queue.acquire();
+
+			CHECK(reused.empty());
+			CHECK(reused.data() == storage);
+		}
+	}
+}
+
+SCENARIO("Prioritising outbound messages")
+{
+	// small batches, with one slot saved for each lower class
+	Twitch::WriteQueue queue(256, 4, 1);
+
+	GIVEN("A backlog of chat and then a PONG")
+	{
+		for (int i = 0; i < 10; i++)
+			queue.push("PRIVMSG #a :" + std::to_string(i) + "\r\n", Twitch::Priority::Normal);
+
+		queue.push("PONG :tmi.twitch.tv\r\n", Twitch::Priority::Protocol);
+
+		THEN("The PONG goes out first")
+		{
+			REQUIRE(queue.startBatch());
+			CHECK(queue.batch()[0] == "PONG :tmi.twitch.tv\r\n");
+			CHECK(queue.batch()[1] == "PRIVMSG #a :0\r\n");
+		}
+	}
+
+	GIVEN("A flood of moderation and a bulk message")
+	{
+		for (int i = 0; i < 10; i++)
+			queue.push("CLEARCHAT\r\n", Twitch::Priority::Moderation);
+
+		queue.push("PRIVMSG #a :announcement\r\n", Twitch::Priority::Bulk);
+
+		THEN("The bulk message still makes it into the first batch")
+		{
+			REQUIRE(queue.startBatch());
+			REQUIRE(queue.batch().size() == 4);
+			CHECK(queue.batch()[3] == "PRIVMSG #a :announcement\r\n");
+			CHECK(queue.pending() == 7);
+		}
+	}
+}
@@ -0,0 +1,174 @@
+/* commandTableTests.cpp - Miles Shamo
+ *
+ * Tests for the shared command tables, their
+ * updates, and a bot's overrides on top of them.
+ *
+ */
+
+#include "catch.hpp"
+
+#include <atomic>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "../source/CommandCorrelator.hpp"
+#include "../source/CommandTable.hpp"
+#include "../source/IRCParser.hpp"
+
+namespace
+{
+	const char *added(const Twitch::IRCMessage &, Twitch::IRCBot *) { return "added"; }
+	const char *replaced(const Twitch::IRCMessage &, Twitch::IRCBot *) { return "replaced"; }
+
+	std::shared_ptr<const Twitch::CommandOverrides> disabling(std::initializer_list<const char *> names)
+	{
+		auto overrides = std::make_shared<Twitch::CommandOverrides>();
+
+		for (auto name : names)
+			overrides->Disabled.insert(name);
+
+		return overrides;
+	}
+}
+
+SCENARIO("Sharing commands between bots")
+{
+	Twitch::CommandCorrelator builtIns;
+	Twitch::CommandRegistry registry(builtIns);
+
+	GIVEN("A new registry")
+	{
+		THEN("It holds the built in commands as version 1")
+		{
+			auto table = registry.current();
+
+			CHECK(registry.version() == 1);
+			CHECK(table->version() == 1);
+			CHECK(table->find("echo") != nullptr);
+			CHECK(table->find("nothing") == nullptr);
+		}
+	}
+
+	GIVEN("A table taken before an update")
+	{
+		auto before = registry.current();
+
+		registry.update([](Twitch::CommandHandlers &handlers)
+		{
+			handlers["added"] = added;
+			handlers.erase("echo");
+		});
+
+		THEN("The update is a new version, and the old one is left as it was")
+		{
+			auto after = registry.current();
+
+			CHECK(registry.version() == 2);
+			CHECK(after->version() == 2);
+			CHECK(after->find("added") == added);
+			CHECK(after->find("echo") == nullptr);
+
+			CHECK(before->version() == 1);
+			CHECK(before->find("added") == nullptr);
+			CHECK(before->find("echo") != nullptr);
+		}
+	}
+
+	GIVEN("A bot's overrides")
+	{
+		Twitch::CommandSet commands(registry.current(), disabling({"echo"}));
+
+		THEN("Disabled commands are hidden, and the rest come from the shared table")
+		{
+			CHECK(commands.find("echo") == nullptr);
+			CHECK(commands.find("test") == registry.current()->find("test"));
+		}
+
+		THEN("Running a command that isn't there says so")
+		{
+			std::string text = ":viewer!viewer@viewer.tmi.twitch.tv PRIVMSG #a :!echo hello\r\n";
+			Twitch::IRCLine line;
+			REQUIRE(Twitch::parseIRCLine(text, line));
+
+			CHECK(std::string(commands.run(Twitch::IRCMessage(line), nullptr)) == "Command PRIVMSG recieved, no user command found");
+		}
+
+		THEN("A command can be run through the set")
+		{
+			registry.update([](Twitch::CommandHandlers &handlers) { handlers["added"] = added; });
+			Twitch::CommandSet updated(registry.current(), disabling({"echo"}));
+
+			std::string text = ":viewer!viewer@viewer.tmi.twitch.tv PRIVMSG #a :!added\r\n";
+			Twitch::IRCLine line;
+			REQUIRE(Twitch::parseIRCLine(text, line));
+
+			CHECK(std::string(updated.run(Twitch::IRCMessage(line), nullptr)) == "added");
+			CHECK(updated.version() == 2);
+		}
+	}
+
+	GIVEN("A disabledCommands.txt")
+	{
+		std::string path = "/tmp/baribot-" + std::to_string(getpid()) + "-disabledCommands.txt";
+		std::ofstream(path) << "!echo" << std::endl << "purge" << std::endl << std::endl;
+
+		auto overrides = Twitch::CommandOverrides::load(path);
+		std::remove(path.c_str());
+
+		THEN("Each line disables a command, with or without its '!'")
+		{
+			CHECK(overrides->Disabled.size() == 2);
+			CHECK(overrides->Disabled.count("echo") == 1);
+			CHECK(overrides->Disabled.count("purge") == 1);
+		}
+
+		THEN("A missing file disables nothing")
+		{
+			CHECK(Twitch::CommandOverrides::load(path)->Disabled.empty());
+		}
+	}
+
+	GIVEN("Readers running while the table is updated")
+	{
+		registry.update([](Twitch::CommandHandlers &handlers) { handlers["swapped"] = added; });
+
+		std::atomic<bool> done{false};
+		std::atomic<std::size_t> mismatches{0};
+
+		std::vector<std::thread> readers;
+		for (int i = 0; i < 4; i++)
+			readers.emplace_back([&]()
+			{
+				// what a bot does: check the version, and fetch only when it moved
+				auto table = registry.current();
+
+				while (!done)
+				{
+					if (table->version() != registry.version())
+						table = registry.current();
+
+					// every version has one or the other, never neither
+					auto handler = table->find("swapped");
+					if (handler != added && handler != replaced)
+						mismatches++;
+				}
+			});
+
+		for (int i = 0; i < 2000; i++)
+			registry.update([i](Twitch::CommandHandlers &handlers) { handlers["swapped"] = (i % 2) ? added : replaced; });
+
+		done = true;
+		for (auto &reader : readers)
+			reader.join();
+
+		THEN("Every reader always sees a whole table")
+		{
+			CHECK(registry.version() == 2002);
+			CHECK(mismatches == 0);
+		}
+	}
+}
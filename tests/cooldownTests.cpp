@@ -0,0 +1,374 @@
+/* cooldownTests.cpp - Miles Shamo
+ *
+ * Tests for the command cooldowns and the timing
+ * wheel that ends them.  Time is passed in by hand
+ * so nothing here actually waits.  The benchmark at
+ * the bottom checks commands against a million
+ * running cooldowns; it is hidden by default, so
+ * run it with
+ *
+ * 		./TEST.out "[benchmark]"
+ *
+ */
+
+// benchmarks have to be enabled in every file that uses them
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include "catch.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <random>
+#include <string>
+#include <tuple>
+
+#include <unistd.h>
+
+#include "../source/CommandCorrelator.hpp"
+#include "../source/CommandTable.hpp"
+#include "../source/Cooldowns.hpp"
+#include "../source/IRCParser.hpp"
+
+using namespace std::chrono_literals;
+
+namespace
+{
+	Twitch::CooldownRule rule(Twitch::Clock::duration global, Twitch::Clock::duration channel, Twitch::Clock::duration user)
+	{
+		Twitch::CooldownRule made;
+		made.Global = global;
+		made.Channel = channel;
+		made.User = user;
+
+		return made;
+	}
+
+	const char *ran(const Twitch::IRCMessage &, Twitch::IRCBot *) { return "ran"; }
+}
+
+SCENARIO("Cooling commands down")
+{
+	auto start = Twitch::Clock::now();
+	Twitch::Cooldowns cooldowns(start);
+
+	GIVEN("A per user cooldown")
+	{
+		auto perUser = rule(0s, 0s, 3s);
+
+		REQUIRE(cooldowns.tryUse(perUser, "echo", "#a", "viewer", start));
+
+		THEN("The same user can't use it again until it ends")
+		{
+			CHECK_FALSE(cooldowns.tryUse(perUser, "echo", "#a", "viewer", start + 1s));
+			CHECK_FALSE(cooldowns.tryUse(perUser, "echo", "#a", "viewer", start + 2990ms));
+			CHECK(cooldowns.tryUse(perUser, "echo", "#a", "viewer", start + 3s));
+		}
+
+		THEN("Other users, channels and commands aren't held up")
+		{
+			CHECK(cooldowns.tryUse(perUser, "echo", "#a", "other", start));
+			CHECK(cooldowns.tryUse(perUser, "echo", "#b", "viewer", start));
+			CHECK(cooldowns.tryUse(perUser, "test", "#a", "viewer", start));
+		}
+
+		THEN("It is forgotten once it ends")
+		{
+			CHECK(cooldowns.running() == 1);
+
+			cooldowns.tryUse(perUser, "test", "#a", "viewer", start + 10s);
+			CHECK(cooldowns.running() == 1);
+		}
+	}
+
+	GIVEN("Channel and global cooldowns")
+	{
+		auto shared = rule(10s, 5s, 0s);
+
+		REQUIRE(cooldowns.tryUse(shared, "echo", "#a", "viewer", start));
+
+		THEN("The channel's cooldown holds up everyone in it")
+		{
+			CHECK_FALSE(cooldowns.tryUse(rule(0s, 5s, 0s), "echo", "#a", "other", start + 1s));
+			CHECK(cooldowns.tryUse(rule(0s, 5s, 0s), "echo", "#b", "other", start + 1s));
+		}
+
+		THEN("The global one holds up every channel")
+		{
+			CHECK_FALSE(cooldowns.tryUse(shared, "echo", "#b", "other", start + 9s));
+			CHECK(cooldowns.tryUse(shared, "echo", "#b", "other", start + 10s));
+		}
+
+		THEN("A use that is refused starts nothing")
+		{
+			CHECK_FALSE(cooldowns.tryUse(shared, "echo", "#b", "other", start + 1s));
+			CHECK(cooldowns.running() == 2);
+		}
+	}
+
+	GIVEN("Cooldowns covering every command")
+	{
+		Twitch::AnyCommandRule perUser;
+		perUser.User = 5s;
+
+		Twitch::AnyCommandRule perChannel;
+		perChannel.Channel = 5s;
+
+		auto none = rule(0s, 0s, 0s);
+
+		THEN("A user can't get around them by taking turns with commands")
+		{
+			REQUIRE(cooldowns.tryUse(none, perUser, "hi", "#a", "viewer", start));
+			CHECK_FALSE(cooldowns.tryUse(none, perUser, "echo", "#a", "viewer", start + 1s));
+			CHECK_FALSE(cooldowns.tryUse(none, perUser, "lurk", "#a", "viewer", start + 2s));
+			CHECK(cooldowns.tryUse(none, perUser, "lurk", "#a", "viewer", start + 5s));
+		}
+
+		THEN("The user's covers only them, in that channel")
+		{
+			REQUIRE(cooldowns.tryUse(none, perUser, "hi", "#a", "viewer", start));
+			CHECK(cooldowns.tryUse(none, perUser, "echo", "#a", "other", start));
+			CHECK(cooldowns.tryUse(none, perUser, "echo", "#b", "viewer", start));
+		}
+
+		THEN("The channel's holds up everyone in it, whatever they use")
+		{
+			REQUIRE(cooldowns.tryUse(none, perChannel, "hi", "#a", "viewer", start));
+			CHECK_FALSE(cooldowns.tryUse(none, perChannel, "echo", "#a", "other", start + 1s));
+			CHECK(cooldowns.tryUse(none, perChannel, "echo", "#b", "other", start + 1s));
+		}
+
+		THEN("They sit alongside the command's own")
+		{
+			REQUIRE(cooldowns.tryUse(rule(0s, 0s, 10s), perUser, "hi", "#a", "viewer", start));
+			CHECK(cooldowns.running() == 2);
+
+			CHECK_FALSE(cooldowns.tryUse(rule(0s, 0s, 10s), perUser, "hi", "#a", "viewer", start + 6s));
+			CHECK(cooldowns.tryUse(rule(0s, 0s, 10s), perUser, "echo", "#a", "viewer", start + 6s));
+		}
+	}
+
+	GIVEN("Cooldowns ending on every level of the wheel")
+	{
+		THEN("Each ends on time, and nothing is left behind")
+		{
+			for (Twitch::Clock::duration length : {10ms, 2550ms, 2560ms, 2570ms, 655350ms, 655360ms, 700000ms, 180000000ms})
+			{
+				Twitch::Cooldowns wheel(start);
+				auto perUser = rule(0s, 0s, length);
+
+				REQUIRE(wheel.tryUse(perUser, "echo", "#a", "viewer", start + 5ms));
+
+				// started in the first tick, so it ends on the tick its length is
+				CHECK_FALSE(wheel.tryUse(perUser, "echo", "#a", "viewer", start + length - 10ms));
+				CHECK(wheel.tryUse(perUser, "echo", "#a", "viewer", start + length));
+
+				wheel.tryUse(perUser, "test", "#a", "viewer", start + 2 * length + 1s);
+				CHECK(wheel.running() == 1);
+			}
+		}
+	}
+
+	GIVEN("Random uses against a simple model")
+	{
+		std::mt19937 random(42);
+
+		// when each (scope, command, channel, user) cools down, in ticks
+		std::map<std::tuple<int, int, int, int>, long long> model;
+
+		const Twitch::Clock::duration lengths[] = {0ms, 10ms, 250ms, 3s, 40s, 15min};
+
+		auto now = start;
+		std::size_t mismatches = 0, allowed = 0;
+
+		for (int i = 0; i < 200000; i++)
+		{
+			now += std::chrono::milliseconds(random() % 50);
+
+			int command = random() % 4, channel = random() % 8, user = random() % 500;
+			auto used = rule(lengths[(command == 0) ? random() % 3 : 0], lengths[random() % 3], lengths[random() % 6]);
+
+			long long tick = (now - start) / Twitch::Cooldowns::Tick;
+
+			const std::tuple<int, int, int, int> keys[] =
+			{
+				{0, command, 0, 0}, {1, command, channel, 0}, {2, command, channel, user}
+			};
+			const Twitch::Clock::duration durations[] = {used.Global, used.Channel, used.User};
+
+			bool expected = true;
+			for (int k = 0; k < 3; k++)
+			{
+				auto found = model.find(keys[k]);
+				if (durations[k] > 0ms && found != model.end() && found->second > tick)
+					expected = false;
+			}
+
+			bool actual = cooldowns.tryUse(used, std::to_string(command), "#" + std::to_string(channel),
+					std::to_string(user), now);
+
+			if (expected)
+			{
+				for (int k = 0; k < 3; k++)
+				{
+					if (durations[k] > 0ms)
+						model[keys[k]] = tick + (durations[k] + Twitch::Cooldowns::Tick - 1ns) / Twitch::Cooldowns::Tick;
+				}
+			}
+
+			mismatches += expected != actual;
+			allowed += actual;
+		}
+
+		THEN("It agrees with the model on every use")
+		{
+			CHECK(mismatches == 0);
+			CHECK(allowed > 1000);
+		}
+	}
+
+	GIVEN("A million users using a command")
+	{
+		auto perUser = rule(0s, 0s, 30s);
+
+		for (int i = 0; i < 1000000; i++)
+			cooldowns.tryUse(perUser, "echo", "#a", std::to_string(i), start + std::chrono::microseconds(i));
+
+		THEN("Each has a cooldown, and all of them end")
+		{
+			CHECK(cooldowns.running() == 1000000);
+			CHECK_FALSE(cooldowns.tryUse(perUser, "echo", "#a", "123456", start + 29s));
+
+			cooldowns.tryUse(perUser, "echo", "#a", "latecomer", start + 32s);
+			CHECK(cooldowns.running() == 1);
+		}
+	}
+}
+
+SCENARIO("Cooldown rules")
+{
+	GIVEN("A cooldowns.txt")
+	{
+		std::string path = "/tmp/baribot-" + std::to_string(getpid()) + "-cooldowns.txt";
+		std::ofstream(path) << "# command global channel user" << std::endl
+			<< "* 0 1 5" << std::endl
+			<< "!echo 0.5 0 2" << std::endl
+			<< "test 0 0 0" << std::endl
+			<< "broken 1 2" << std::endl
+			<< "@ 2 4" << std::endl;
+
+		auto rules = Twitch::CooldownRules::load(path);
+		std::remove(path.c_str());
+
+		THEN("Each command gets its own line, and the rest the default")
+		{
+			CHECK(rules.find("echo").Global == 500ms);
+			CHECK(rules.find("echo").User == 2s);
+			CHECK_FALSE(rules.find("test").any());
+			CHECK(rules.find("broken").Channel == 1s);
+			CHECK(rules.find("other").User == 5s);
+		}
+
+		THEN("The \"@\" line covers every command")
+		{
+			CHECK(rules.anyCommand().Channel == 2s);
+			CHECK(rules.anyCommand().User == 4s);
+		}
+	}
+
+	GIVEN("No cooldowns.txt")
+	{
+		Twitch::CooldownRules rules;
+
+		THEN("Each user can use each command once every 3 seconds")
+		{
+			CHECK(rules.find("echo").User == 3s);
+			CHECK(rules.find("echo").Global == 0s);
+			CHECK_FALSE(rules.anyCommand().any());
+		}
+	}
+
+	GIVEN("A bot's commands with cooldowns")
+	{
+		Twitch::CommandCorrelator builtIns;
+		Twitch::CommandRegistry registry(builtIns);
+		registry.update([](Twitch::CommandHandlers &handlers) { handlers["ran"] = ran; });
+
+		Twitch::Cooldowns running;
+		Twitch::CommandSet commands(registry.current(), Twitch::CommandOverrides::load(""), &running);
+
+		std::string text = ":viewer!viewer@viewer.tmi.twitch.tv PRIVMSG #a :!ran\r\n";
+		std::string unknown = ":viewer!viewer@viewer.tmi.twitch.tv PRIVMSG #a :!madeup\r\n";
+		Twitch::IRCLine line, unknownLine;
+		REQUIRE(Twitch::parseIRCLine(text, line));
+		REQUIRE(Twitch::parseIRCLine(unknown, unknownLine));
+
+		THEN("A command used again straight away is held back")
+		{
+			CHECK(std::string(commands.run(Twitch::IRCMessage(line), nullptr)) == "ran");
+			CHECK(std::string(commands.run(Twitch::IRCMessage(line), nullptr)) == "Command PRIVMSG recieved, command cooling down");
+		}
+
+		THEN("Commands that don't exist start no cooldowns")
+		{
+			commands.run(Twitch::IRCMessage(unknownLine), nullptr);
+			CHECK(running.running() == 0);
+		}
+	}
+
+	GIVEN("A bot with a per user cooldown over every command")
+	{
+		std::string path = "/tmp/baribot-" + std::to_string(getpid()) + "-anycommand.txt";
+		std::ofstream(path) << "* 0 0 0" << std::endl << "@ 0 5" << std::endl;
+
+		Twitch::CommandCorrelator builtIns;
+		Twitch::CommandRegistry registry(builtIns);
+		registry.update([](Twitch::CommandHandlers &handlers) { handlers["ran"] = ran; handlers["also"] = ran; });
+
+		Twitch::Cooldowns running;
+		Twitch::CommandSet commands(registry.current(), Twitch::CommandOverrides::load("", "", path), &running);
+		std::remove(path.c_str());
+
+		std::string first = ":viewer!viewer@viewer.tmi.twitch.tv PRIVMSG #a :!ran\r\n";
+		std::string second = ":viewer!viewer@viewer.tmi.twitch.tv PRIVMSG #a :!also\r\n";
+		std::string other = ":other!other@other.tmi.twitch.tv PRIVMSG #a :!also\r\n";
+		Twitch::IRCLine firstLine, secondLine, otherLine;
+		REQUIRE(Twitch::parseIRCLine(first, firstLine));
+		REQUIRE(Twitch::parseIRCLine(second, secondLine));
+		REQUIRE(Twitch::parseIRCLine(other, otherLine));
+
+		THEN("Switching commands doesn't get around it, but other users aren't held up")
+		{
+			CHECK(std::string(commands.run(Twitch::IRCMessage(firstLine), nullptr)) == "ran");
+			CHECK(std::string(commands.run(Twitch::IRCMessage(secondLine), nullptr)) == "Command PRIVMSG recieved, command cooling down");
+			CHECK(std::string(commands.run(Twitch::IRCMessage(otherLine), nullptr)) == "ran");
+		}
+	}
+}
+
+TEST_CASE("Checking cooldowns", "[.][benchmark]")
+{
+	auto start = Twitch::Clock::now();
+	Twitch::Cooldowns cooldowns(start);
+
+	Twitch::CooldownRule perUser;
+	perUser.User = 1h;
+
+	std::vector<std::string> users;
+	for (int i = 0; i < 1000000; i++)
+		users.push_back("user" + std::to_string(i));
+
+	for (const auto &user : users)
+		cooldowns.tryUse(perUser, "echo", "#channel", user, start);
+
+	std::size_t next = 0;
+
+	BENCHMARK("a cooled down user, among a million (100 checks)")
+	{
+		std::size_t passed = 0;
+
+		for (int i = 0; i < 100; i++)
+			passed += cooldowns.tryUse(perUser, "echo", "#channel", users[(next += 7919) % users.size()], start + 1s);
+
+		return passed;
+	};
+}
@@ -0,0 +1,284 @@
+/* customCommandsTests.cpp - Miles Shamo
+ *
+ * Tests for compiling and answering the custom
+ * text commands in a customCommands.txt.  The
+ * benchmark at the bottom answers commands out of
+ * a file of fifty thousand of them; it is hidden
+ * by default, so run it with
+ *
+ * 		./TEST.out "[benchmark]"
+ *
+ */
+
+// benchmarks have to be enabled in every file that uses them
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include "catch.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "../source/CommandCorrelator.hpp"
+#include "../source/CommandTable.hpp"
+#include "../source/CustomCommands.hpp"
+#include "../source/IRCParser.hpp"
+
+namespace
+{
+	Twitch::CustomCommands compile(const std::string &file)
+	{
+		Twitch::CustomCommands commands;
+
+		std::istringstream in(file);
+		commands.read(in);
+
+		return commands;
+	}
+
+	// a chat line from viewer in #chan (text must outlive the message)
+	Twitch::IRCMessage chat(const std::string &text)
+	{
+		Twitch::IRCLine line;
+		REQUIRE(Twitch::parseIRCLine(text, line));
+
+		return Twitch::IRCMessage(line);
+	}
+
+	// what the bot would write for a reply
+	std::string joined(const Twitch::CustomCommands::Reply &reply)
+	{
+		std::string out;
+
+		for (auto piece : reply)
+			out.append(piece);
+
+		return out;
+	}
+
+	std::string line(const std::string &text)
+	{
+		return ":viewer!viewer@viewer.tmi.twitch.tv PRIVMSG #chan :" + text + "\r\n";
+	}
+}
+
+SCENARIO("Compiling custom commands")
+{
+	GIVEN("A customCommands.txt")
+	{
+		auto commands = compile(
+				"# a comment\n"
+				"\n"
+				"!hi hello {user}, welcome to {channel}\r\n"
+				"lurk   {user} is lurking with {args}\n"
+				"!count used {count} times\n"
+				"!braces {these} aren't {user placeholders}\n"
+				"!noreply\n"
+				"!again first\n"
+				"!again second\n");
+
+		THEN("Every command with a reply is kept, with or without its '!'")
+		{
+			CHECK(commands.size() == 5);
+
+			for (auto name : {"hi", "lurk", "count", "braces", "again"})
+				CHECK(commands.contains(name));
+
+			CHECK_FALSE(commands.contains("noreply"));
+			CHECK_FALSE(commands.contains("#"));
+			CHECK_FALSE(commands.contains("!hi"));
+		}
+
+		THEN("Placeholders are filled in from the message")
+		{
+			auto text = line("!hi");
+			auto message = chat(text);
+
+			Twitch::CustomCommands::Reply reply;
+			REQUIRE(commands.reply(message, reply));
+			CHECK(joined(reply) == "PRIVMSG #chan :hello viewer, welcome to chan");
+
+			text = line("!lurk a snack");
+			message = chat(text);
+
+			REQUIRE(commands.reply(message, reply));
+			CHECK(joined(reply) == "PRIVMSG #chan :viewer is lurking with a snack");
+		}
+
+		THEN("Each use is counted")
+		{
+			auto text = line("!count");
+			auto message = chat(text);
+
+			for (int i = 1; i <= 12; i++)
+			{
+				Twitch::CustomCommands::Reply reply;
+				REQUIRE(commands.reply(message, reply));
+				CHECK(joined(reply) == "PRIVMSG #chan :used " + std::to_string(i) + " times");
+			}
+
+			CHECK(commands.uses("count") == 12);
+			CHECK(commands.uses("hi") == 0);
+		}
+
+		THEN("Other braces are left alone, and a later line replaces an earlier one")
+		{
+			auto text = line("!braces");
+			auto message = chat(text);
+
+			Twitch::CustomCommands::Reply reply;
+			REQUIRE(commands.reply(message, reply));
+			CHECK(joined(reply) == "PRIVMSG #chan :{these} aren't {user placeholders}");
+
+			text = line("!again");
+			message = chat(text);
+
+			REQUIRE(commands.reply(message, reply));
+			CHECK(joined(reply) == "PRIVMSG #chan :second");
+		}
+
+		THEN("Anything else isn't answered")
+		{
+			auto text = line("!echo hello");
+			auto message = chat(text);
+
+			Twitch::CustomCommands::Reply reply;
+			CHECK_FALSE(commands.reply(message, reply));
+		}
+	}
+
+	GIVEN("A reply with more placeholders than a reply can hold")
+	{
+		std::string reply;
+		for (std::size_t i = 0; i < Twitch::CustomCommands::MaxPlaceholders + 5; i++)
+			reply += "{user} ";
+
+		auto commands = compile("!many " + reply + "\n");
+
+		THEN("The ones past the limit are left as text")
+		{
+			auto text = line("!many");
+			auto message = chat(text);
+
+			Twitch::CustomCommands::Reply out;
+			REQUIRE(commands.reply(message, out));
+
+			std::string expected = "PRIVMSG #chan :";
+			for (std::size_t i = 0; i < Twitch::CustomCommands::MaxPlaceholders; i++)
+				expected += "viewer ";
+			for (int i = 0; i < 5; i++)
+				expected += "{user} ";
+
+			CHECK(joined(out) == expected);
+		}
+	}
+
+	GIVEN("Tens of thousands of commands")
+	{
+		std::string file;
+		for (int i = 0; i < 50000; i++)
+			file += "!command" + std::to_string(i) + " reply " + std::to_string(i) + " to {user}\n";
+
+		auto commands = compile(file);
+
+		THEN("Every one of them is found")
+		{
+			REQUIRE(commands.size() == 50000);
+
+			for (int i = 0; i < 50000; i += 997)
+			{
+				auto text = line("!command" + std::to_string(i));
+				auto message = chat(text);
+
+				Twitch::CustomCommands::Reply reply;
+				REQUIRE(commands.reply(message, reply));
+				CHECK(joined(reply) == "PRIVMSG #chan :reply " + std::to_string(i) + " to viewer");
+			}
+		}
+	}
+
+	GIVEN("A client's files")
+	{
+		std::string base = "/tmp/baribot-" + std::to_string(getpid());
+		std::string disabledPath = base + "-disabledCommands.txt", customPath = base + "-customCommands.txt";
+
+		std::ofstream(disabledPath) << "!hidden" << std::endl;
+		std::ofstream(customPath) << "!shown used {count}" << std::endl << "!hidden never" << std::endl;
+
+		auto overrides = Twitch::CommandOverrides::load(disabledPath, customPath);
+
+		auto text = line("!shown");
+		auto message = chat(text);
+
+		Twitch::CustomCommands::Reply reply;
+		REQUIRE(overrides->Custom.reply(message, reply));
+		REQUIRE(overrides->Custom.reply(message, reply));
+
+		THEN("Reloading keeps the counts of commands still in the file")
+		{
+			std::ofstream(customPath) << "!shown now used {count}" << std::endl << "!new {count}" << std::endl;
+
+			auto reloaded = Twitch::CommandOverrides::load(disabledPath, customPath, std::string(), overrides.get());
+
+			REQUIRE(reloaded->Custom.reply(message, reply));
+			CHECK(joined(reply) == "PRIVMSG #chan :now used 3");
+			CHECK(reloaded->Custom.uses("new") == 0);
+			CHECK_FALSE(reloaded->Custom.contains("hidden"));
+		}
+
+		THEN("A disabled name hides a custom command too")
+		{
+			Twitch::CommandCorrelator builtIns;
+			Twitch::CommandRegistry registry(builtIns);
+			Twitch::CommandSet commands(registry.current(), overrides);
+
+			auto hiddenText = line("!hidden");
+
+			CHECK(std::string(commands.run(chat(hiddenText), nullptr)) == "Command PRIVMSG recieved, no user command found");
+		}
+
+		std::remove(disabledPath.c_str());
+		std::remove(customPath.c_str());
+	}
+}
+
+TEST_CASE("Answering custom commands", "[.][benchmark]")
+{
+	std::string file;
+	for (int i = 0; i < 50000; i++)
+		file += "!command" + std::to_string(i) + " hello {user}, you are number {count} in {channel}\n";
+
+	auto commands = compile(file);
+
+	std::vector<std::string> texts;
+	for (int i = 0; i < 100; i++)
+		texts.push_back(line("!command" + std::to_string(i * 487) + " some args"));
+
+	std::vector<Twitch::IRCMessage> messages;
+	for (const auto &text : texts)
+		messages.push_back(chat(text));
+
+	std::string buffer;
+	buffer.reserve(512);
+
+	BENCHMARK("lookup and render into a reused buffer (100 commands)")
+	{
+		std::size_t written = 0;
+
+		for (const auto &message : messages)
+		{
+			Twitch::CustomCommands::Reply reply;
+			commands.reply(message, reply);
+
+			buffer.clear();
+			for (auto piece : reply)
+				buffer.append(piece);
+
+			written += buffer.size();
+		}
+
+		return written;
+	};
+}
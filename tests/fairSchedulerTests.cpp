@@ -0,0 +1,211 @@
+/* fairSchedulerTests.cpp - Miles Shamo
+ *
+ * Tests for sharing handler time between bots.
+ * Everything is queued before the context runs,
+ * and only one handler runs at a time, so the
+ * order they ran in is the order they were picked.
+ *
+ */
+
+#include "catch.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../source/FairScheduler.hpp"
+
+SCENARIO("Fair handler scheduling")
+{
+	asio::io_context context;
+	auto strand = asio::make_strand(context);
+
+	Twitch::FairScheduler scheduler(1);
+
+	std::vector<std::string> order;
+
+	auto submit = [&](const std::string &bot, int count)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			scheduler.submit(bot, "#chan", strand, [&order, bot]()
+			{
+				order.push_back(bot);
+			});
+		}
+	};
+
+	auto position = [&](const std::string &bot)
+	{
+		for (std::size_t i = 0; i < order.size(); i++)
+		{
+			if (order[i] == bot)
+				return i;
+		}
+
+		return order.size();
+	};
+
+	GIVEN("A flooded bot and a quiet one")
+	{
+		submit("flooded", 20);
+		submit("quiet", 2);
+
+		context.run_for(std::chrono::milliseconds(50));
+
+		THEN("The quiet bot doesn't wait behind the flood")
+		{
+			REQUIRE(order.size() == 22);
+			CHECK(position("quiet") <= 2);
+		}
+
+		THEN("The flooded bot shows up as throttled")
+		{
+			for (auto &tenant : scheduler.stats())
+			{
+				if (tenant.Tenant == "flooded")
+					CHECK(tenant.Throttled > 0);
+				else
+					CHECK(tenant.Run == 2);
+			}
+		}
+	}
+
+	GIVEN("Two busy bots with different weights")
+	{
+		scheduler.setWeight("heavy", 3);
+
+		submit("heavy", 30);
+		submit("light", 30);
+
+		context.run_for(std::chrono::milliseconds(50));
+
+		THEN("They share the handlers by weight")
+		{
+			REQUIRE(order.size() == 60);
+
+			int heavy = 0;
+			for (int i = 0; i < 20; i++)
+				heavy += order[i] == "heavy";
+
+			CHECK(heavy == 15);
+		}
+	}
+}
+
+SCENARIO("Forgetting tenants")
+{
+	asio::io_context context;
+	auto strand = asio::make_strand(context);
+
+	Twitch::FairScheduler scheduler(1, true);
+
+	auto tenants = [&]()
+	{
+		std::vector<std::string> names;
+		for (auto &tenant : scheduler.stats())
+			names.push_back(tenant.Tenant);
+
+		return names;
+	};
+
+	int ran = 0;
+	auto submit = [&](const std::string &bot, const std::string &channel)
+	{
+		scheduler.submit(bot, channel, strand, [&ran]() { ran++; });
+	};
+
+	submit("bot", "#a");
+	submit("bot", "#b");
+	submit("botter", "#a");
+
+	GIVEN("Tenants with nothing left to run")
+	{
+		context.run_for(std::chrono::milliseconds(50));
+
+		THEN("A left channel is let go, and only that one")
+		{
+			scheduler.forget("bot", "#a");
+			CHECK(tenants() == std::vector<std::string>{"bot/#b", "botter/#a"});
+		}
+
+		THEN("A stopped bot's are all let go, but not those of a bot sharing its prefix")
+		{
+			scheduler.forget("bot");
+			CHECK(tenants() == std::vector<std::string>{"botter/#a"});
+		}
+	}
+
+	GIVEN("A tenant forgotten with handlers still queued")
+	{
+		scheduler.forget("bot");
+
+		THEN("They still run, and it's let go after")
+		{
+			CHECK(tenants().size() == 3);
+
+			context.run_for(std::chrono::milliseconds(50));
+
+			// the last tenant to run is only let go at the next dispatch
+			submit("botter", "#a");
+			context.restart();
+			context.run_for(std::chrono::milliseconds(50));
+
+			CHECK(ran == 4);
+			CHECK(tenants() == std::vector<std::string>{"botter/#a"});
+		}
+	}
+}
+
+SCENARIO("Handlers for a channel stay in order")
+{
+	GIVEN("A channel's handlers submitted while others finish on several threads")
+	{
+		asio::io_context context;
+		auto work = asio::make_work_guard(context);
+		auto strand = asio::make_strand(context);
+		auto other = asio::make_strand(context);
+
+		Twitch::FairScheduler scheduler(2);
+
+		// only touched from the channel's strand
+		std::vector<int> order;
+
+		std::vector<std::thread> threads;
+		for (int i = 0; i < 4; i++)
+			threads.emplace_back([&context]() { context.run(); });
+
+		// a busy neighbour keeps handlers finishing (and dispatching) all along
+		for (int i = 0; i < 2000; i++)
+			scheduler.submit("other", "#b", other, []() {});
+
+		for (int i = 0; i < 2000; i++)
+			scheduler.submit("bot", "#a", strand, [&order, i]() { order.push_back(i); });
+
+		for (int i = 0; i < 200; i++)
+		{
+			std::atomic<std::size_t> ran{0};
+			asio::post(strand, [&]() { ran = order.size(); });
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+			if (ran == 2000)
+				break;
+		}
+
+		work.reset();
+		context.stop();
+		for (auto &thread : threads)
+			thread.join();
+
+		THEN("They run in the order they were submitted")
+		{
+			REQUIRE(order.size() == 2000);
+
+			for (int i = 0; i < 2000; i++)
+				REQUIRE(order[i] == i);
+		}
+	}
+}
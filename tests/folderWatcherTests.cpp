@@ -0,0 +1,171 @@
+/* folderWatcherTests.cpp - Miles Shamo
+ *
+ * Tests for the inotify folder watcher, on a
+ * temporary folder and an io_context of its own.
+ *
+ */
+
+#include "catch.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+#include <Poco/File.h>
+
+#include "../source/FolderWatcher.hpp"
+
+using namespace std::chrono_literals;
+
+namespace
+{
+	// counts the changes reported for each file
+	struct Changes
+	{
+		std::mutex Lock;
+		std::condition_variable Changed;
+		std::map<std::string, int> Count;
+
+		void operator()(const std::string &file)
+		{
+			std::lock_guard<std::mutex> guard(Lock);
+
+			Count[file]++;
+			Changed.notify_all();
+		}
+
+		// waits for file to have been reported at least times times
+		bool waitFor(const std::string &file, int times, std::chrono::milliseconds timeout = 5000ms)
+		{
+			std::unique_lock<std::mutex> guard(Lock);
+
+			return Changed.wait_for(guard, timeout, [&]() { return Count[file] >= times; });
+		}
+
+		int count(const std::string &file)
+		{
+			std::lock_guard<std::mutex> guard(Lock);
+			return Count[file];
+		}
+	};
+}
+
+SCENARIO("Watching a client folder")
+{
+	std::string folder = "/tmp/baribot-" + std::to_string(getpid()) + "-watched";
+	Poco::File(folder).createDirectories();
+
+	asio::io_context context;
+	auto work = asio::make_work_guard(context);
+
+	Twitch::FolderWatcher watcher(context, 50ms);
+	Changes changes;
+
+	std::thread runner([&]() { context.run(); });
+
+	REQUIRE(watcher.watch(folder, [&](const std::string &file) { changes(file); }));
+
+	GIVEN("A file written in the folder")
+	{
+		std::ofstream(folder + "/channels.txt") << "#one" << std::endl;
+
+		THEN("Its change is reported by name")
+		{
+			CHECK(changes.waitFor("channels.txt", 1));
+		}
+	}
+
+	GIVEN("A burst of edits to one file")
+	{
+		for (int i = 0; i < 5; i++)
+			std::ofstream(folder + "/customCommands.txt") << "!hi hello " << i << std::endl;
+
+		THEN("They are reported once")
+		{
+			REQUIRE(changes.waitFor("customCommands.txt", 1));
+
+			std::this_thread::sleep_for(200ms);
+			CHECK(changes.count("customCommands.txt") == 1);
+		}
+	}
+
+	GIVEN("A file saved the way editors do, by renaming over it")
+	{
+		std::ofstream(folder + "/.disabledCommands.txt.swp") << "!echo" << std::endl;
+		std::rename((folder + "/.disabledCommands.txt.swp").c_str(), (folder + "/disabledCommands.txt").c_str());
+
+		THEN("The renamed file is reported")
+		{
+			CHECK(changes.waitFor("disabledCommands.txt", 1));
+		}
+	}
+
+	GIVEN("A folder that is no longer watched")
+	{
+		watcher.unwatch(folder);
+
+		std::ofstream(folder + "/channels.txt") << "#two" << std::endl;
+
+		THEN("Nothing is reported")
+		{
+			std::this_thread::sleep_for(200ms);
+			CHECK(changes.count("channels.txt") == 0);
+		}
+	}
+
+	watcher.stop();
+
+	work.reset();
+	context.stop();
+	runner.join();
+
+	Poco::File(folder).remove(true);
+}
+
+
+SCENARIO("Changes that overflow inotify's queue")
+{
+	std::string folder = "/tmp/baribot-" + std::to_string(getpid()) + "-overflowed";
+	Poco::File(folder).createDirectories();
+
+	std::ofstream(folder + "/channels.txt") << "#one" << std::endl;
+
+	asio::io_context context;
+	auto work = asio::make_work_guard(context);
+
+	Twitch::FolderWatcher watcher(context, 50ms);
+	Changes changes;
+
+	REQUIRE(watcher.watch(folder, [&](const std::string &file) { changes(file); }));
+
+	GIVEN("More events than the queue holds before anything is read, and then an edit")
+	{
+		// two files in turn, so the kernel can't merge the events
+		for (int i = 0; i < 20000; i++)
+			std::ofstream(folder + ((i % 2) ? "/a.txt" : "/b.txt")) << i;
+
+		std::ofstream(folder + "/channels.txt") << "#two" << std::endl;
+
+		std::thread runner([&]() { context.run(); });
+
+		THEN("The edit lost in the overflow is still reported")
+		{
+			CHECK(changes.waitFor("channels.txt", 1));
+		}
+
+		watcher.stop();
+
+		work.reset();
+		context.stop();
+		runner.join();
+	}
+
+	Poco::File(folder).remove(true);
+}
@@ -0,0 +1,225 @@
+/* httpsPoolTests.cpp - Miles Shamo
+ *
+ * Tests for the HTTPS session pool, against a
+ * local HTTPS server standing in for Twitch.  It
+ * uses the self signed certificate in tests/data,
+ * so these must be run from the repository root
+ * (as "make test" does).
+ *
+ */
+
+#include "catch.hpp"
+
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+#include <Poco/StreamCopier.h>
+#include <Poco/Timespan.h>
+#include <Poco/URI.h>
+#include <Poco/Net/Context.h>
+#include <Poco/Net/HTTPRequest.h>
+#include <Poco/Net/HTTPResponse.h>
+#include <Poco/Net/HTTPServer.h>
+#include <Poco/Net/HTTPServerParams.h>
+#include <Poco/Net/HTTPRequestHandler.h>
+#include <Poco/Net/HTTPRequestHandlerFactory.h>
+#include <Poco/Net/HTTPServerRequest.h>
+#include <Poco/Net/HTTPServerResponse.h>
+#include <Poco/Net/SecureServerSocket.h>
+
+#include "../source/HTTPSPool.hpp"
+
+namespace
+{
+	// every client port the stand-in has seen a request from
+	struct SeenPorts
+	{
+		std::mutex Lock;
+		std::set<unsigned short> Ports;
+	};
+
+	class StandIn : public Poco::Net::HTTPRequestHandler
+	{
+		private:
+			SeenPorts &Seen;
+
+		public:
+			explicit StandIn(SeenPorts &seen) : Seen(seen) {}
+
+			void handleRequest(Poco::Net::HTTPServerRequest &request, Poco::Net::HTTPServerResponse &response) override
+			{
+				{
+					std::lock_guard<std::mutex> guard(Seen.Lock);
+					Seen.Ports.insert(request.clientAddress().port());
+				}
+
+				std::string body = R"({"access_token":"new","refresh_token":"next"})";
+
+				response.setContentType("application/json");
+				response.setContentLength(body.size());
+				response.send() << body;
+			}
+	};
+
+	class StandInFactory : public Poco::Net::HTTPRequestHandlerFactory
+	{
+		private:
+			SeenPorts &Seen;
+
+		public:
+			explicit StandInFactory(SeenPorts &seen) : Seen(seen) {}
+
+			Poco::Net::HTTPRequestHandler *createRequestHandler(const Poco::Net::HTTPServerRequest &) override
+			{
+				return new StandIn(Seen);
+			}
+	};
+
+	// posts to uri on a leased session, handing it back for reuse if the body is read
+	std::string post(Twitch::HTTPSPool::Lease &lease, const Poco::URI &uri, bool readBody)
+	{
+		Poco::Net::HTTPRequest request(Poco::Net::HTTPRequest::HTTP_POST, uri.getPathAndQuery(), Poco::Net::HTTPMessage::HTTP_1_1);
+		request.setKeepAlive(true);
+		request.setContentLength(0);
+
+		Poco::Net::HTTPResponse response;
+		lease.session().sendRequest(request);
+		std::istream &in = lease.session().receiveResponse(response);
+
+		std::string body;
+		if (readBody)
+		{
+			Poco::StreamCopier::copyToString(in, body);
+			lease.reuse();
+		}
+
+		return body;
+	}
+}
+
+SCENARIO("Reusing HTTPS connections")
+{
+	SeenPorts seen;
+
+	Poco::Net::Context::Ptr serverContext = new Poco::Net::Context(Poco::Net::Context::SERVER_USE,
+			"tests/data/localhost.pem", "tests/data/localhost.pem", "", Poco::Net::Context::VERIFY_NONE);
+
+	Poco::Net::SecureServerSocket socket(0, 64, serverContext);
+	Poco::Net::HTTPServer server(new StandInFactory(seen), socket, new Poco::Net::HTTPServerParams);
+	server.start();
+
+	// the stand-in's certificate is self signed
+	Poco::Net::Context::Ptr clientContext = new Poco::Net::Context(Poco::Net::Context::CLIENT_USE,
+			"", "", "", Poco::Net::Context::VERIFY_NONE);
+
+	Twitch::HTTPSPool pool(2, 2, clientContext);
+
+	Poco::URI uri("https://127.0.0.1:" + std::to_string(socket.address().port()) + "/oauth2/token?grant_type=refresh_token");
+
+	auto post = [&](bool readBody) -> std::string
+	{
+		auto lease = pool.acquire(uri);
+
+		return ::post(lease, uri, readBody);
+	};
+
+	GIVEN("Several requests one after another")
+	{
+		for (int i = 0; i < 3; i++)
+			REQUIRE(post(true).find("access_token") != std::string::npos);
+
+		THEN("They all go over the same connection")
+		{
+			CHECK(seen.Ports.size() == 1);
+			CHECK(pool.idleCount() == 1);
+		}
+	}
+
+	GIVEN("A response that wasn't read in full")
+	{
+		post(false);
+
+		THEN("Its connection is closed rather than reused")
+		{
+			CHECK(pool.idleCount() == 0);
+
+			post(true);
+			CHECK(seen.Ports.size() == 2);
+		}
+	}
+
+	server.stop();
+}
+
+SCENARIO("Retrying on a connection the server closed")
+{
+	SeenPorts seen;
+
+	Poco::Net::Context::Ptr serverContext = new Poco::Net::Context(Poco::Net::Context::SERVER_USE,
+			"tests/data/localhost.pem", "tests/data/localhost.pem", "", Poco::Net::Context::VERIFY_NONE);
+
+	// the stand-in hangs up on connections left idle for long
+	auto params = new Poco::Net::HTTPServerParams;
+	params->setKeepAliveTimeout(Poco::Timespan(0, 200000));
+
+	Poco::Net::SecureServerSocket socket(0, 64, serverContext);
+	Poco::Net::HTTPServer server(new StandInFactory(seen), socket, params);
+	server.start();
+
+	Poco::Net::Context::Ptr clientContext = new Poco::Net::Context(Poco::Net::Context::CLIENT_USE,
+			"", "", "", Poco::Net::Context::VERIFY_NONE);
+
+	// one session at most, so the retry can't wait on the failed one
+	Twitch::HTTPSPool pool(1, 1, clientContext);
+
+	Poco::URI uri("https://127.0.0.1:" + std::to_string(socket.address().port()) + "/oauth2/token?grant_type=refresh_token");
+
+	int attempts = 0;
+	std::string body;
+
+	auto exchange = [&]()
+	{
+		pool.exchange(uri, [&](Twitch::HTTPSPool::Lease &lease)
+		{
+			attempts++;
+			body = post(lease, uri, true);
+		});
+	};
+
+	GIVEN("A pooled session the server has since closed")
+	{
+		exchange();
+		REQUIRE(pool.idleCount() == 1);
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(600));
+
+		THEN("The request is tried again on a new connection, and succeeds")
+		{
+			body.clear();
+			REQUIRE_NOTHROW(exchange());
+
+			// one for the first request, and at least one more for the second
+			CHECK(body.find("access_token") != std::string::npos);
+			CHECK(attempts >= 2);
+			CHECK(seen.Ports.size() == 2);
+			CHECK(pool.idleCount() == 1);
+		}
+	}
+
+	GIVEN("A server that isn't there")
+	{
+		server.stop();
+		socket.close();
+
+		THEN("A new connection failing isn't retried")
+		{
+			CHECK_THROWS(exchange());
+			CHECK(attempts == 1);
+		}
+	}
+
+	server.stop();
+}
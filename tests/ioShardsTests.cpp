@@ -0,0 +1,143 @@
+/* ioShardsTests.cpp - Miles Shamo
+ *
+ * Tests for placing bots on IO contexts, shared
+ * and sharded.
+ *
+ */
+
+#include "catch.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "../source/IOShards.hpp"
+
+SCENARIO("Placing bots on IO contexts")
+{
+	asio::io_context main;
+	auto work = asio::make_work_guard(main);
+
+	Twitch::IOShards shards(main);
+
+	auto run = [](asio::io_context &context)
+	{
+		context.run();
+	};
+
+	GIVEN("Shared mode")
+	{
+		shards.start(4, false, false, run);
+
+		THEN("Every bot goes on the main context")
+		{
+			for (int i = 0; i < 8; i++)
+				CHECK(&shards.place() == &main);
+		}
+	}
+
+	GIVEN("Sharded mode")
+	{
+		shards.start(3, true, false, run);
+
+		THEN("Bots are spread evenly, starting on the main context")
+		{
+			CHECK(&shards.place() == &main);
+
+			for (int i = 0; i < 5; i++)
+				shards.place();
+
+			auto loads = shards.loads();
+			REQUIRE(loads.size() == 3);
+			CHECK(loads[0] == 2);
+			CHECK(loads[1] == 2);
+			CHECK(loads[2] == 2);
+		}
+
+		THEN("Stopped bots are released, and their context is placed on next")
+		{
+			std::vector<asio::io_context *> placed;
+			for (int i = 0; i < 6; i++)
+				placed.push_back(&shards.place());
+
+			shards.release(*placed[1]);
+			shards.release(*placed[4]);
+
+			auto loads = shards.loads();
+			REQUIRE(loads.size() == 3);
+			CHECK(loads[0] + loads[1] + loads[2] == 4);
+
+			CHECK(&shards.place() == placed[1]);
+		}
+
+		THEN("Every context is being run")
+		{
+			std::atomic<int> ran{0};
+
+			for (int i = 0; i < 3; i++)
+			{
+				asio::post(shards.place(), [&ran]()
+				{
+					ran++;
+				});
+			}
+
+			for (int tries = 0; ran < 3 && tries < 200; tries++)
+				std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+			CHECK(ran == 3);
+		}
+	}
+
+	GIVEN("Shared mode, resized while running")
+	{
+		shards.start(2, false, false, run);
+
+		std::atomic<int> ran{0};
+		auto runAll = [&](int count)
+		{
+			ran = 0;
+
+			for (int i = 0; i < count; i++)
+			{
+				asio::post(main, [&ran]()
+				{
+					ran++;
+				});
+			}
+
+			for (int tries = 0; ran < count && tries < 200; tries++)
+				std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+			return ran == count;
+		};
+
+		THEN("Threads can be added and retired without stopping the context")
+		{
+			shards.resize(4);
+			CHECK(shards.threadCount() == 4);
+			CHECK(runAll(10));
+
+			shards.resize(1);
+			CHECK(shards.threadCount() == 1);
+			CHECK(runAll(10));
+
+			shards.resize(3);
+			CHECK(shards.threadCount() == 3);
+			CHECK(runAll(10));
+		}
+	}
+
+	GIVEN("Sharded mode, asked to resize")
+	{
+		shards.start(2, true, false, run);
+		shards.resize(5);
+
+		THEN("The thread count stays the same")
+		{
+			CHECK(shards.threadCount() == 2);
+		}
+	}
+
+	shards.stop();
+}
@@ -0,0 +1,157 @@
+/* ircCommandTests.cpp - Miles Shamo
+ *
+ * Tests for the compile time command table the
+ * IRCCorrelator dispatches with.  The benchmark at
+ * the bottom compares it with the std::map it
+ * replaced, on the commands of some typical chat
+ * traffic; it is hidden by default, so run it with
+ *
+ * 		./TEST.out "[benchmark]"
+ *
+ */
+
+// benchmarks have to be enabled in every file that uses them
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include "catch.hpp"
+
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../source/IRCCommand.hpp"
+#include "../source/IRCCorrelator.hpp"
+
+using Twitch::IRCCommand;
+using Twitch::ircCommand;
+
+// the lookup happens at compile time too
+static_assert(ircCommand("PRIVMSG") == IRCCommand::Privmsg, "PRIVMSG");
+static_assert(ircCommand("366") == IRCCommand::EndOfNames, "366");
+static_assert(ircCommand("PRIV") == IRCCommand::Unknown, "a prefix is not a command");
+
+namespace
+{
+	// the commands of some chat traffic, mostly PRIVMSGs as it usually is
+	std::vector<std::string> trafficCommands()
+	{
+		std::vector<std::string> commands;
+
+		for (int i = 0; i < 100; i++)
+		{
+			commands.push_back("PRIVMSG");
+
+			if (i % 10 == 0)
+				commands.push_back("JOIN");
+			if (i % 20 == 0)
+				commands.push_back("PART");
+			if (i % 25 == 0)
+				commands.push_back("USERNOTICE");
+			if (i % 50 == 0)
+				commands.push_back("CLEARCHAT");
+		}
+
+		for (auto name : {"PING", "USERSTATE", "ROOMSTATE", "NOTICE", "001", "353", "366", "CAP", "HOSTTARGET"})
+			commands.push_back(name);
+
+		return commands;
+	}
+
+	const char *handled(const Twitch::IRCMessage &, Twitch::IRCBot *) { return "handled"; }
+
+	// the map the correlator used to be, with the commands it had handlers for
+	template <class Compare>
+	std::map<std::string, Twitch::IRCHandler, Compare> oldMap()
+	{
+		std::map<std::string, Twitch::IRCHandler, Compare> map;
+
+		for (auto name : {"NOTICE", "001", "RECONNECT", "JOIN", "PING", "USERSTATE", "PRIVMSG"})
+			map[name] = handled;
+
+		return map;
+	}
+}
+
+SCENARIO("Looking up IRC commands")
+{
+	THEN("Every command is found from its own text")
+	{
+		for (std::size_t i = 0; i < Twitch::IRCCommandCount; i++)
+		{
+			auto command = static_cast<IRCCommand>(i);
+			auto name = Twitch::ircCommandName(command);
+
+			REQUIRE_FALSE(name.empty());
+			CHECK(ircCommand(name) == command);
+		}
+	}
+
+	THEN("Anything else is unknown, including lower case commands and other numerics")
+	{
+		for (auto text : {"", "privmsg", "PRIVMSGS", "PRIVMS", "005", "999", "JOIN ", "FOO", "RECONNECTING"})
+			CHECK(ircCommand(text) == IRCCommand::Unknown);
+
+		CHECK(Twitch::ircCommandName(IRCCommand::Unknown).empty());
+	}
+
+	GIVEN("The correlator")
+	{
+		Twitch::IRCCorrelator correlator;
+
+		THEN("Commands with handlers have them, whether found by text or not")
+		{
+			CHECK(correlator.find("PRIVMSG") != nullptr);
+			CHECK(correlator.find("001") != nullptr);
+			CHECK(correlator.find(IRCCommand::Ping) == correlator.find("PING"));
+		}
+
+		THEN("Known commands without handlers, and unknown ones, have none")
+		{
+			CHECK(correlator.find("ROOMSTATE") == nullptr);
+			CHECK(correlator.find("FOO") == nullptr);
+			CHECK(correlator.find(IRCCommand::Unknown) == nullptr);
+		}
+	}
+}
+
+TEST_CASE("IRC command dispatch against the old map", "[.][benchmark]")
+{
+	auto commands = trafficCommands();
+
+	std::vector<std::string_view> views(commands.begin(), commands.end());
+
+	auto stringMap = oldMap<std::less<std::string>>();
+	auto viewMap = oldMap<std::less<>>();
+	Twitch::IRCCorrelator correlator;
+
+	BENCHMARK("std::map (a std::string per lookup)")
+	{
+		std::size_t found = 0;
+
+		for (auto command : views)
+			found += stringMap.find(std::string(command)) != stringMap.end();
+
+		return found;
+	};
+
+	BENCHMARK("std::map (looked up by string_view)")
+	{
+		std::size_t found = 0;
+
+		for (auto command : views)
+			found += viewMap.find(command) != viewMap.end();
+
+		return found;
+	};
+
+	BENCHMARK("perfect hash")
+	{
+		std::size_t found = 0;
+
+		for (auto command : views)
+			found += correlator.find(command) != nullptr;
+
+		return found;
+	};
+}
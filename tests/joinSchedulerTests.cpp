@@ -0,0 +1,148 @@
+/* joinSchedulerTests.cpp - Miles Shamo
+ *
+ * Tests for the channel JOIN scheduler.  Time is
+ * passed in by hand so nothing here actually waits.
+ *
+ */
+
+#include "catch.hpp"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "../source/JoinScheduler.hpp"
+
+using namespace std::chrono_literals;
+
+SCENARIO("Scheduling channel JOINs")
+{
+	auto now = Twitch::Clock::now();
+
+	Twitch::JoinScheduler joins;
+	std::string line;
+
+	GIVEN("A few channels from channels.txt")
+	{
+		joins.add("Baricus");
+		joins.add("#other");
+		joins.add("third");
+		joins.add("baricus");
+
+		THEN("Names are normalized and duplicates dropped")
+		{
+			CHECK(joins.pending() == 3);
+		}
+
+		THEN("They go out together in one JOIN")
+		{
+			CHECK(joins.nextBatch(10, line, now) == 3);
+			CHECK(line == "JOIN #baricus,#other,#third");
+			CHECK(joins.pending() == 0);
+		}
+
+		THEN("No more are sent than allowed")
+		{
+			CHECK(joins.nextBatch(2, line, now) == 2);
+			CHECK(line == "JOIN #baricus,#other");
+			CHECK(joins.pending() == 1);
+		}
+
+		WHEN("Some are confirmed and the rest time out")
+		{
+			joins.nextBatch(10, line, now);
+
+			CHECK(joins.joined("#baricus"));
+			CHECK_FALSE(joins.joined("#unknown"));
+
+			auto next = joins.expire(15s, 3, now + 1s);
+			CHECK(next == now + 15s);
+			CHECK(joins.pending() == 0);
+
+			joins.expire(15s, 3, now + 16s);
+
+			THEN("Only the unconfirmed ones are sent again")
+			{
+				CHECK(joins.joinedCount() == 1);
+				CHECK(joins.nextBatch(10, line, now + 16s) == 2);
+				CHECK(line == "JOIN #other,#third");
+			}
+		}
+
+		WHEN("A channel never confirms")
+		{
+			for (int i = 0; i < 3; i++)
+			{
+				joins.nextBatch(10, line, now);
+				joins.expire(15s, 3, now + 16s);
+			}
+
+			THEN("It is given up on after its attempts")
+			{
+				CHECK(joins.failedCount() == 3);
+				CHECK(joins.pending() == 0);
+			}
+		}
+
+		WHEN("Twitch refuses a channel")
+		{
+			joins.failed("#other");
+
+			THEN("It is never sent")
+			{
+				CHECK(joins.nextBatch(10, line, now) == 2);
+				CHECK(line == "JOIN #baricus,#third");
+			}
+		}
+	}
+
+	GIVEN("A channels.txt edited while the bot is running")
+	{
+		for (auto channel : {"kept", "joined", "sent", "pending", "refused"})
+			joins.add(channel);
+
+		joins.nextBatch(3, line, now);
+		joins.joined("#kept");
+		joins.joined("#joined");
+		joins.failed("#refused");
+
+		std::vector<std::string> leave;
+		std::size_t added = joins.update({"#Kept", "new", "another", "new"}, leave);
+
+		THEN("Only the new channels are queued")
+		{
+			CHECK(added == 2);
+			CHECK(joins.pending() == 2);
+			CHECK(joins.nextBatch(10, line, now) == 2);
+			CHECK(line == "JOIN #another,#new");
+		}
+
+		THEN("Dropped channels we were in are left, and the rest forgotten")
+		{
+			CHECK(leave == std::vector<std::string>{"#joined"});
+
+			CHECK(joins.joinedCount() == 1);
+			CHECK(joins.failedCount() == 0);
+			CHECK(joins.contains("kept"));
+			CHECK_FALSE(joins.contains("#pending"));
+			CHECK_FALSE(joins.contains("#sent"));
+
+			// a JOIN that was already out comes back for a channel we don't have
+			CHECK_FALSE(joins.joined("#sent"));
+		}
+	}
+
+	GIVEN("More channels than fit on one line")
+	{
+		for (int i = 0; i < 100; i++)
+			joins.add("a_fairly_long_channel_" + std::to_string(i));
+
+		THEN("Each JOIN stays under the IRC line limit")
+		{
+			std::size_t sent = joins.nextBatch(100, line, now);
+
+			CHECK(sent < 100);
+			CHECK(line.size() <= 510);
+		}
+	}
+}
@@ -0,0 +1,350 @@
+/* logTests.cpp - Miles Shamo
+ *
+ * Tests for the buffered bot logs.  Each test
+ * writes to its own file under /tmp, and uses
+ * Log::flush to wait for the background writer.
+ *
+ */
+
+#include "catch.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <Poco/DeflatingStream.h>
+#include <Poco/File.h>
+
+#include "../source/Log.hpp"
+#include "../source/LogDecoder.hpp"
+
+using std::endl;
+
+using Twitch::LogField;
+using Twitch::LogLevel;
+
+namespace
+{
+	const Twitch::LogFormat Seen("{} seen in {} ({} times)", {LogField::Command, LogField::Channel, LogField::Value});
+
+	std::string tempLog(const char *name)
+	{
+		std::string path = "/tmp/baribot-" + std::to_string(getpid()) + "-" + name + ".txt";
+		std::remove(path.c_str());
+		return path;
+	}
+
+	std::string readAll(const std::string &path)
+	{
+		std::ifstream in(path);
+		std::stringstream contents;
+		contents << in.rdbuf();
+		return contents.str();
+	}
+}
+
+SCENARIO("Writing a log")
+{
+	GIVEN("A log at the info level")
+	{
+		auto path = tempLog("levels");
+
+		Twitch::Log log;
+		log.open(path);
+		log.setLevel(Twitch::LogLevel::Info);
+
+		THEN("Lines are written once flushed, in order")
+		{
+			log << "first " << 1 << endl;
+			log.warning() << "second " << 2.5 << endl;
+			Twitch::Log::flush();
+
+			CHECK(readAll(path) == "first 1\nsecond 2.5\n");
+		}
+
+		THEN("Debug lines are dropped, and never formatted")
+		{
+			int formatted = 0;
+			auto count = [&]() { formatted++; return "x"; };
+
+			if (log.enabled(Twitch::LogLevel::Debug))
+				log.debug() << count() << endl;
+
+			log.debug() << "hidden" << endl;
+			log.info() << "shown" << endl;
+			Twitch::Log::flush();
+
+			CHECK(formatted == 0);
+			CHECK(readAll(path) == "shown\n");
+		}
+
+		THEN("A line logged while building another doesn't mix with it")
+		{
+			auto inner = [&]()
+			{
+				log << "inner" << endl;
+				return "result";
+			};
+
+			log << "outer " << inner() << endl;
+			Twitch::Log::flush();
+
+			CHECK(readAll(path) == "inner\nouter result\n");
+		}
+
+		THEN("Formatted events read like any other line")
+		{
+			log.record(LogLevel::Info, Seen, "PRIVMSG", "#a", 3);
+			log.record(LogLevel::Debug, Seen, "PRIVMSG", "#b", 4);
+			Twitch::Log::flush();
+
+			CHECK(readAll(path) == "PRIVMSG seen in #a (3 times)\n");
+		}
+
+		THEN("Nothing is written after it's closed")
+		{
+			log << "before" << endl;
+			log.close();
+			log << "after" << endl;
+			Twitch::Log::flush();
+
+			CHECK(readAll(path) == "before\n");
+		}
+	}
+
+	GIVEN("Several threads logging to the same file")
+	{
+		auto path = tempLog("threads");
+
+		Twitch::Log log;
+		log.open(path);
+		log.setLevel(Twitch::LogLevel::Info);
+
+		const int threadCount = 4;
+		const int linesEach = 20000;
+
+		std::vector<std::thread> threads;
+		for (int t = 0; t < threadCount; t++)
+			threads.emplace_back([&, t]()
+			{
+				for (int i = 0; i < linesEach; i++)
+					log << "thread " << t << " line " << i << endl;
+			});
+
+		for (auto &thread : threads)
+			thread.join();
+
+		Twitch::Log::flush();
+
+		THEN("Every line arrives whole, and each thread's lines stay in order")
+		{
+			std::ifstream in(path);
+			std::vector<int> next(threadCount, 0);
+			std::string word, lineWord;
+			int thread, line;
+			int total = 0;
+
+			while (in >> word >> thread >> lineWord >> line)
+			{
+				REQUIRE(word == "thread");
+				REQUIRE(line == next[thread]);
+				next[thread]++;
+				total++;
+			}
+
+			CHECK(total == threadCount * linesEach);
+		}
+	}
+
+	GIVEN("A binary log")
+	{
+		auto path = tempLog("binary");
+
+		Twitch::Log log;
+		log.setEncoding(Twitch::LogEncoding::Binary);
+		log.setLevel(LogLevel::Debug);
+
+		auto before = std::chrono::system_clock::now() - std::chrono::seconds(1);
+
+		log.open(path, "bari");
+		log << "plain " << 1 << endl;
+		log.record(LogLevel::Debug, Seen, "PRIVMSG", "#a", 3);
+		log.record(LogLevel::Warning, Seen, "JOIN", "#b", -1);
+		log.close();
+
+		// a second session in the same file
+		log.open(path, "other");
+		log.record(LogLevel::Info, Seen, "PART", "#a", 2.5);
+		log.close();
+
+		Twitch::Log::flush();
+
+		std::ifstream in(path, std::ios::binary);
+		Twitch::LogDecoder decoder(in);
+
+		std::vector<Twitch::LogEvent> events;
+		Twitch::LogEvent event;
+		while (decoder.next(event))
+			events.push_back(event);
+
+		THEN("It decodes back to the same lines")
+		{
+			REQUIRE(events.size() == 4);
+
+			CHECK(events[0].Text == "plain 1");
+			CHECK(events[1].Text == "PRIVMSG seen in #a (3 times)");
+			CHECK(events[2].Text == "JOIN seen in #b (-1 times)");
+			CHECK(events[3].Text == "PART seen in #a (2.5 times)");
+
+			CHECK(events[0].Source == "bari");
+			CHECK(events[3].Source == "other");
+			CHECK(events[2].Level == LogLevel::Warning);
+
+			CHECK(events[0].Time > before);
+			CHECK(events[1].Time >= events[0].Time);
+		}
+
+		THEN("It can be filtered by source, channel, command and level")
+		{
+			auto count = [&](const Twitch::LogFilter &filter)
+			{
+				return std::count_if(events.begin(), events.end(), [&](const auto &e) { return filter.matches(e); });
+			};
+
+			Twitch::LogFilter filter;
+			CHECK(count(filter) == 4);
+
+			filter.Channel = "#a";
+			CHECK(count(filter) == 2);
+
+			filter.Source = "bari";
+			CHECK(count(filter) == 1);
+
+			Twitch::LogFilter command;
+			command.Command = "JOIN";
+			CHECK(count(command) == 1);
+
+			Twitch::LogFilter level;
+			level.MinLevel = LogLevel::Info;
+			CHECK(count(level) == 3);
+
+			Twitch::LogFilter later;
+			later.Since = std::chrono::system_clock::now() + std::chrono::seconds(60);
+			CHECK(count(later) == 0);
+		}
+	}
+
+	GIVEN("A log that rotates every 100 bytes, keeping two segments")
+	{
+		std::string folder = "/tmp/baribot-" + std::to_string(getpid()) + "-rotate";
+		if (Poco::File(folder).exists())
+			Poco::File(folder).remove(true);
+		Poco::File(folder).createDirectories();
+
+		Twitch::LogRotation rotation;
+		rotation.MaxBytes = 100;
+		rotation.Keep = 2;
+		Twitch::Log::setRotation(rotation);
+
+		Twitch::Log log;
+		log.open(folder + "/log.txt");
+		log.setLevel(LogLevel::Info);
+
+		// 60 bytes a line, so every second line starts a new segment
+		for (int i = 0; i < 7; i++)
+		{
+			log << "line " << i << " " << std::string(52, 'x') << endl;
+			Twitch::Log::flush();
+		}
+
+		log.close();
+		Twitch::Log::setRotation(Twitch::defaultLogRotation());
+
+		std::vector<std::string> names;
+		Poco::File(folder).list(names);
+		std::sort(names.begin(), names.end());
+
+		THEN("The live file only has what came after the last rotation")
+		{
+			CHECK(readAll(folder + "/log.txt").rfind("line 6 ", 0) == 0);
+		}
+
+		THEN("Old segments are compressed, and only the newest are kept")
+		{
+			REQUIRE(names.size() == 3);
+			CHECK(names[0] == "log.txt");
+
+			for (std::size_t i = 1; i < names.size(); i++)
+				CHECK(names[i].substr(names[i].size() - 3) == ".gz");
+
+			std::vector<std::string> contents;
+			for (std::size_t i = 1; i < names.size(); i++)
+			{
+				std::ifstream in(folder + "/" + names[i], std::ios::binary);
+				Poco::InflatingInputStream inflate(in, Poco::InflatingStreamBuf::STREAM_GZIP);
+
+				std::stringstream text;
+				text << inflate.rdbuf();
+				contents.push_back(text.str());
+			}
+
+			std::sort(contents.begin(), contents.end());
+
+			CHECK(contents[0].rfind("line 2 ", 0) == 0);
+			CHECK(contents[1].rfind("line 4 ", 0) == 0);
+			CHECK(contents[1].find("line 5 ") != std::string::npos);
+		}
+
+		Poco::File(folder).remove(true);
+	}
+
+	GIVEN("More than ten segments rotated in the same second")
+	{
+		std::string folder = "/tmp/baribot-" + std::to_string(getpid()) + "-prune";
+		if (Poco::File(folder).exists())
+			Poco::File(folder).remove(true);
+		Poco::File(folder).createDirectories();
+
+		// log.txt.20200101-000000, then .1 to .11 (.10 and .11 sort before .2 by name)
+		std::ofstream(folder + "/log.txt.20200101-000000") << "segment 0" << endl;
+		for (int i = 1; i <= 11; i++)
+			std::ofstream(folder + "/log.txt.20200101-000000." + std::to_string(i)) << "segment " << i << endl;
+
+		Twitch::LogRotation rotation;
+		rotation.MaxBytes = 10;
+		rotation.Keep = 3;
+		rotation.Compress = false;
+		Twitch::Log::setRotation(rotation);
+
+		Twitch::Log log;
+		log.open(folder + "/log.txt");
+		log.setLevel(LogLevel::Info);
+
+		log << "enough to rotate once" << endl;
+		Twitch::Log::flush();
+
+		log.close();
+		Twitch::Log::setRotation(Twitch::defaultLogRotation());
+
+		std::vector<std::string> names;
+		Poco::File(folder).list(names);
+		std::sort(names.begin(), names.end());
+
+		THEN("The newest are kept, counting .10 and .11 as newer than .9")
+		{
+			REQUIRE(names.size() == 4);
+			CHECK(names[0] == "log.txt");
+			CHECK(names[1] == "log.txt.20200101-000000.10");
+			CHECK(names[2] == "log.txt.20200101-000000.11");
+			CHECK(names[3].rfind("log.txt.2020", 0) != 0);
+		}
+
+		Poco::File(folder).remove(true);
+	}
+}
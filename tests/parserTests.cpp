@@ -0,0 +1,279 @@
+/* parserTests.cpp - Miles Shamo
+ *
+ * Tests for the hand written IRC parser.
+ *
+ * Every line is checked against the regex that
+ * _onMessage used to use, so that the parser stays
+ * a drop in replacement.  The benchmark at the bottom
+ * compares the two on the same traffic; it is hidden
+ * by default, so run it with
+ *
+ * 		./TEST.out "[benchmark]"
+ *
+ */
+
+// benchmarks have to be enabled in every file that uses them
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include "catch.hpp"
+
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "../source/IRCParser.hpp"
+#include "../source/IRCMessage.hpp"
+
+namespace
+{
+	// the regex from _onMessage before the parser replaced it
+	const std::regex &oldIRCLine()
+	{
+		const static std::regex IRCLine
+		(R"Delim((?:@(\S+) +)?(?::(\S+) +)?(\S+)(?: +([^\n\r]+?)(?!:))?(?: :([^\n\r]+))?\r\n)Delim",
+			 std::regex_constants::ECMAScript | std::regex_constants::optimize);
+
+		return IRCLine;
+	}
+
+	// traffic captured from a few busy channels (names and ids swapped out)
+	const std::vector<std::string> &recordedTraffic()
+	{
+		const static std::vector<std::string> lines =
+		{
+			":tmi.twitch.tv 001 baribot :Welcome, GLHF!\r\n",
+			":tmi.twitch.tv 372 baribot :You are in a maze of twisty passages, all alike.\r\n",
+			":tmi.twitch.tv CAP * ACK :twitch.tv/tags twitch.tv/commands twitch.tv/membership\r\n",
+			":baribot!baribot@baribot.tmi.twitch.tv JOIN #baricus\r\n",
+			":baribot.tmi.twitch.tv 353 baribot = #baricus :baribot\r\n",
+			":baribot.tmi.twitch.tv 366 baribot #baricus :End of /NAMES list\r\n",
+			"@badge-info=;badges=broadcaster/1;color=#0D4200;display-name=Baricus;emote-sets=0,33,50,237;"
+				"mod=0;subscriber=0;user-type= :tmi.twitch.tv USERSTATE #baricus\r\n",
+			"@badge-info=subscriber/8;badges=subscriber/6,premium/1;client-nonce=b1f3a8e2c4;color=#1E90FF;"
+				"display-name=SomeViewer;emotes=25:0-4,12-16;flags=;id=1e7b4f1a-56ad-4a1e-a5b3-3d3c5f61e6d2;"
+				"mod=0;room-id=12345678;subscriber=1;tmi-sent-ts=1593650731471;turbo=0;user-id=87654321;"
+				"user-type= :someviewer!someviewer@someviewer.tmi.twitch.tv PRIVMSG #baricus :Kappa Keepo Kappa\r\n",
+			"@badge-info=;badges=;color=;display-name=lurker_42;emotes=;flags=;id=aa61b1b6-d3c1-4d7f-9a0e-5c9c1b2f0e44;"
+				"mod=0;room-id=12345678;subscriber=0;tmi-sent-ts=1593650731902;turbo=0;user-id=11223344;"
+				"user-type= :lurker_42!lurker_42@lurker_42.tmi.twitch.tv PRIVMSG #baricus :!echo hello there :)\r\n",
+			"@badge-info=;badges=moderator/1;color=#FF4500;display-name=ModPerson;emotes=;flags=;"
+				"id=0c2d8f0e-6d0b-4e7c-8b1a-9f2e3d4c5b6a;mod=1;room-id=12345678;subscriber=0;tmi-sent-ts=1593650732011;"
+				"turbo=0;user-id=99887766;user-type=mod :modperson!modperson@modperson.tmi.twitch.tv PRIVMSG #baricus :!purge\r\n",
+			"@ban-duration=1;room-id=12345678;target-user-id=11223344;tmi-sent-ts=1593650732100 :tmi.twitch.tv CLEARCHAT #baricus :lurker_42\r\n",
+			"@emote-only=0;followers-only=-1;r9k=0;rituals=0;room-id=12345678;slow=0;subs-only=0 :tmi.twitch.tv ROOMSTATE #baricus\r\n",
+			"@msg-id=slow_off :tmi.twitch.tv NOTICE #baricus :This room is no longer in slow mode.\r\n",
+			":tmi.twitch.tv NOTICE * :Login authentication failed\r\n",
+			":someviewer!someviewer@someviewer.tmi.twitch.tv PART #baricus\r\n",
+			":tmi.twitch.tv HOSTTARGET #baricus :otherchannel 12\r\n",
+			"RECONNECT\r\n",
+		};
+
+		return lines;
+	}
+
+	// compares one parsed field to the matching regex group
+	void checkGroup(const std::smatch &sm, int group, std::string_view field, bool matched)
+	{
+		INFO("group [" << group << "]");
+		CHECK(sm[group].matched == matched);
+
+		if (matched)
+			CHECK(sm[group].str() == std::string(field));
+	}
+}
+
+SCENARIO("Parsing IRC lines")
+{
+	GIVEN("Recorded Twitch traffic")
+	{
+		THEN("Every line is split the same way the regex split it")
+		{
+			for (const auto &raw : recordedTraffic())
+			{
+				INFO(raw);
+
+				std::smatch sm;
+				Twitch::IRCLine line;
+
+				REQUIRE(std::regex_match(raw, sm, oldIRCLine()));
+				REQUIRE(Twitch::parseIRCLine(raw, line));
+
+				checkGroup(sm, 1, line.tags, line.hasTags);
+				checkGroup(sm, 2, line.prefix, line.hasPrefix);
+				checkGroup(sm, 3, line.command, true);
+				checkGroup(sm, 4, line.params, line.hasParams);
+				checkGroup(sm, 5, line.trailing, line.hasTrailing);
+			}
+		}
+	}
+
+	GIVEN("A line with only a trailing parameter")
+	{
+		std::string raw = "PING :tmi.twitch.tv\r\n";
+
+		THEN("It is reported as trailing, not as a parameter")
+		{
+			Twitch::IRCLine line;
+
+			REQUIRE(Twitch::parseIRCLine(raw, line));
+			CHECK(line.command == "PING");
+			CHECK_FALSE(line.hasParams);
+			REQUIRE(line.hasTrailing);
+			CHECK(line.trailing == "tmi.twitch.tv");
+		}
+	}
+
+	GIVEN("Lines the regex rejected")
+	{
+		THEN("The parser rejects them too")
+		{
+			for (std::string raw : {"", "\r\n", "PING :tmi.twitch.tv\n", "PING\tfoo\r\n", " PING\r\n", "PRIVMSG #a :b\rc\r\n"})
+			{
+				INFO(raw);
+
+				std::smatch sm;
+				Twitch::IRCLine line;
+
+				CHECK_FALSE(std::regex_match(raw, sm, oldIRCLine()));
+				CHECK_FALSE(Twitch::parseIRCLine(raw, line));
+			}
+		}
+	}
+
+	GIVEN("A parsed line")
+	{
+		std::string raw = recordedTraffic()[7];
+		Twitch::IRCLine line;
+
+		REQUIRE(Twitch::parseIRCLine(raw, line));
+
+		THEN("Every field points into the original buffer")
+		{
+			for (auto field : {line.tags, line.prefix, line.command, line.params, line.trailing})
+			{
+				CHECK(field.data() >= raw.data());
+				CHECK(field.data() + field.size() <= raw.data() + raw.size());
+			}
+		}
+
+		THEN("It can be moved onto a copy of the buffer")
+		{
+			std::string copy = raw;
+			Twitch::IRCLine moved = Twitch::rebaseIRCLine(line, raw, copy);
+
+			raw.assign(raw.size(), 'x');
+
+			CHECK(moved.command == "PRIVMSG");
+			CHECK(moved.params == "#baricus");
+			CHECK(moved.trailing.data() >= copy.data());
+			CHECK(moved.trailing.data() + moved.trailing.size() <= copy.data() + copy.size());
+
+			Twitch::IRCLine reparsed;
+			REQUIRE(Twitch::parseIRCLine(copy, reparsed));
+			CHECK(moved.tags == reparsed.tags);
+			CHECK(moved.prefix == reparsed.prefix);
+			CHECK(moved.trailing == reparsed.trailing);
+		}
+	}
+}
+
+SCENARIO("Building IRCMessages from parsed lines")
+{
+	GIVEN("A PRIVMSG holding a user command")
+	{
+		std::string raw = recordedTraffic()[8];
+		Twitch::IRCLine line;
+
+		REQUIRE(Twitch::parseIRCLine(raw, line));
+		Twitch::IRCMessage msg(line);
+
+		THEN("The command and its arguments are split out")
+		{
+			REQUIRE(msg.isUserCommand());
+			CHECK(msg.userCommand() == "echo");
+			CHECK(msg.userArgs() == "hello there :)");
+			CHECK(msg.channel() == "#baricus");
+			CHECK(msg.nick() == "lurker_42");
+		}
+
+		THEN("Tags are found (and unescaped) on request")
+		{
+			std::string_view rawValue;
+			std::string value;
+
+			REQUIRE(msg.rawTag("display-name", rawValue));
+			CHECK(rawValue == "lurker_42");
+
+			REQUIRE(msg.rawTag("user-type", rawValue));
+			CHECK(rawValue.empty());
+
+			CHECK_FALSE(msg.rawTag("display", rawValue));
+
+			REQUIRE(msg.tag("room-id", value));
+			CHECK(value == "12345678");
+		}
+	}
+
+	GIVEN("A tag with escaped characters")
+	{
+		std::string raw = "@system-msg=5\\sraiders\\:\\shi :tmi.twitch.tv USERNOTICE #baricus\r\n";
+		Twitch::IRCLine line;
+
+		REQUIRE(Twitch::parseIRCLine(raw, line));
+		Twitch::IRCMessage msg(line);
+
+		THEN("tag() undoes the escaping")
+		{
+			std::string value;
+
+			REQUIRE(msg.tag("system-msg", value));
+			CHECK(value == "5 raiders; hi");
+		}
+	}
+
+	GIVEN("A PRIVMSG that is not a command")
+	{
+		std::string raw = recordedTraffic()[7];
+		Twitch::IRCLine line;
+
+		REQUIRE(Twitch::parseIRCLine(raw, line));
+
+		THEN("It is not treated as one")
+		{
+			CHECK_FALSE(Twitch::IRCMessage(line).isUserCommand());
+		}
+	}
+}
+
+TEST_CASE("IRC parser against the old regex", "[.][benchmark]")
+{
+	const auto &lines = recordedTraffic();
+
+	BENCHMARK("std::regex (copy + regex_match)")
+	{
+		std::size_t matched = 0;
+
+		for (const auto &raw : lines)
+		{
+			std::string line = raw;
+			std::smatch sm;
+
+			matched += std::regex_match(line, sm, oldIRCLine());
+		}
+
+		return matched;
+	};
+
+	BENCHMARK("parseIRCLine (in place)")
+	{
+		std::size_t matched = 0;
+
+		for (const auto &raw : lines)
+		{
+			Twitch::IRCLine line;
+
+			matched += Twitch::parseIRCLine(raw, line);
+		}
+
+		return matched;
+	};
+}
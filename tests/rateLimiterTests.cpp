@@ -0,0 +1,173 @@
+/* rateLimiterTests.cpp - Miles Shamo
+ *
+ * Tests for the send windows and the account
+ * wide chat limiter.  Time is passed in by hand
+ * so nothing here actually waits.
+ *
+ */
+
+#include "catch.hpp"
+
+#include <chrono>
+#include <vector>
+
+#include "../source/RateLimiter.hpp"
+
+using namespace std::chrono_literals;
+
+SCENARIO("Send windows")
+{
+	auto start = Twitch::Clock::now();
+
+	GIVEN("A window of 20 sends per 30 seconds")
+	{
+		Twitch::SendWindow window(20, 30s);
+
+		THEN("After a full burst, nothing more goes until 30 seconds after the first send")
+		{
+			REQUIRE(window.tryTake(start));
+			for (int i = 1; i < 20; i++)
+				REQUIRE(window.tryTake(start + 10s));
+
+			CHECK_FALSE(window.tryTake(start + 10s));
+			CHECK_FALSE(window.tryTake(start + 29900ms));
+			CHECK(window.waitTime(start + 29900ms) == 100ms);
+
+			CHECK(window.tryTake(start + 30s));
+			CHECK_FALSE(window.tryTake(start + 30s));
+			CHECK(window.waitTime(start + 30s) == 10s);
+		}
+
+		THEN("No more than 20 go out in any 30 seconds")
+		{
+			int sent = 0;
+			for (auto t = start; t < start + 30s; t += 100ms)
+				sent += window.tryTake(t);
+
+			CHECK(sent == 20);
+		}
+
+		THEN("Waiting for several sends waits for that many to leave")
+		{
+			for (int i = 0; i < 20; i++)
+				REQUIRE(window.tryTake(start + i * 1s));
+
+			CHECK(window.waitTime(start + 20s, 5) == 14s);
+		}
+	}
+}
+
+SCENARIO("Limiting chat for an account")
+{
+	auto now = Twitch::Clock::now();
+
+	Twitch::RateLimits limits;
+	Twitch::ChatLimiter limiter(limits);
+
+	GIVEN("A channel where we aren't a moderator")
+	{
+		THEN("Only one message a second goes to it")
+		{
+			CHECK(limiter.acquire("#a", now).Allowed);
+
+			auto second = limiter.acquire("#a", now);
+			CHECK_FALSE(second.Allowed);
+			CHECK_FALSE(second.AccountLimited);
+			CHECK(second.Wait > 0s);
+
+			CHECK(limiter.acquire("#a", now + 1100ms).Allowed);
+		}
+
+		THEN("Other channels are not held up by it")
+		{
+			CHECK(limiter.acquire("#a", now).Allowed);
+			CHECK(limiter.acquire("#b", now).Allowed);
+		}
+
+		THEN("The whole account stops at 20 messages")
+		{
+			for (int i = 0; i < 20; i++)
+				REQUIRE(limiter.acquire("#" + std::to_string(i), now).Allowed);
+
+			auto decision = limiter.acquire("#another", now);
+			CHECK_FALSE(decision.Allowed);
+			CHECK(decision.AccountLimited);
+
+			CHECK_FALSE(limiter.acquire("#another", now + 29900ms).Allowed);
+			CHECK(limiter.acquire("#another", now + 30s).Allowed);
+		}
+	}
+
+	GIVEN("A channel where we are a moderator")
+	{
+		limiter.setModerator("#mine", true);
+
+		THEN("It can go up to 100 messages, all at once")
+		{
+			for (int i = 0; i < 100; i++)
+				REQUIRE(limiter.acquire("#mine", now).Allowed);
+
+			CHECK_FALSE(limiter.acquire("#mine", now).Allowed);
+		}
+
+		THEN("Those messages still count against the other channels")
+		{
+			for (int i = 0; i < 100; i++)
+				limiter.acquire("#mine", now);
+
+			CHECK_FALSE(limiter.acquire("#a", now).Allowed);
+		}
+	}
+}
+
+SCENARIO("Limiting JOINs for an account")
+{
+	auto now = Twitch::Clock::now();
+
+	Twitch::RateLimits limits;
+	Twitch::ChatLimiter limiter(limits);
+
+	Twitch::Clock::duration wait;
+
+	THEN("A burst of up to 20 goes out at once")
+	{
+		CHECK(limiter.acquireJoins(100, wait, now) == 20);
+		CHECK(limiter.acquireJoins(100, wait, now) == 0);
+		CHECK(wait == 10s);
+	}
+
+	THEN("After that they go out in batches, not one at a time")
+	{
+		limiter.acquireJoins(5, wait, now);
+		limiter.acquireJoins(15, wait, now + 2s);
+
+		CHECK(limiter.acquireJoins(100, wait, now + 9s) == 0);
+		CHECK(limiter.acquireJoins(100, wait, now + 10s) == 0);
+		CHECK(wait == 2s);
+		CHECK(limiter.acquireJoins(100, wait, now + 12s) == 20);
+	}
+
+	THEN("No more than 20 go out in any 10 seconds")
+	{
+		std::vector<Twitch::Clock::time_point> sent;
+
+		for (auto t = now; t < now + 60s; t += 100ms)
+		{
+			std::size_t allowed = limiter.acquireJoins(100, wait, t);
+			sent.insert(sent.end(), allowed, t);
+		}
+
+		REQUIRE(sent.size() >= 100);
+
+		for (std::size_t i = 20; i < sent.size(); i++)
+			CHECK(sent[i] - sent[i - 20] >= 10s);
+	}
+
+	THEN("A short list doesn't wait for a full batch")
+	{
+		limiter.acquireJoins(15, wait, now);
+
+		CHECK(limiter.acquireJoins(10, wait, now + 1s) == 0);
+		CHECK(limiter.acquireJoins(2, wait, now + 1s) == 2);
+	}
+}
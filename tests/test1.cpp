@@ -1,21 +1,346 @@
+/* test1.cpp - Miles Shamo
+ *
+ * End to end tests of a whole IRCBot, connected
+ * to a FakeTwitch on the loopback interface.  Each
+ * bot gets a throwaway client folder under /tmp.
+ *
+ * Nothing here needs a network, but these do take
+ * real (if short) time, as the bot logs in and
+ * joins just as it would against Twitch.
+ */
 
 #include "catch.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
 #include <asio.hpp>
 #include <asio/io_context.hpp>
+
+#include <Poco/File.h>
+#include <Poco/Path.h>
+
+#include "../source/CommandCorrelator.hpp"
+#include "../source/FakeTwitch.hpp"
 #include "../source/TIRCBot.hpp"
+#include "../source/loginException.hpp"
 
-SCENARIO("Creating individual clients")
+using namespace std::chrono_literals;
+
+namespace
 {
-	asio::io_context io;
+	// a client folder for a bot logging in as nick, joining channels (with
+	// custom as its customCommands.txt)
+	std::string makeClient(const std::string &nick, const std::vector<std::string> &channels, const std::string &custom)
+	{
+		std::string folder = "/tmp/baribot-" + std::to_string(getpid()) + "-" + nick;
+		if (Poco::File(folder).exists())
+			Poco::File(folder).remove(true);
+		Poco::File(folder).createDirectories();
+
+		std::ofstream(folder + "/token.tok") << nick << std::endl << "access" << std::endl << "refresh" << std::endl << "chat:read chat:edit" << std::endl;
+
+		std::ofstream list(folder + "/channels.txt");
+		for (const auto &channel : channels)
+			list << channel << std::endl;
+
+		std::ofstream(folder + "/customCommands.txt") << custom;
+
+		return folder + "/";
+	}
+
+	// a bot and everything the Overseer would give it, run on its own threads
+	struct Client
+	{
+		asio::io_context Context;
+		asio::executor_work_guard<asio::io_context::executor_type> Work;
+
+		Twitch::IRCCorrelator IRC;
+		Twitch::CommandCorrelator BuiltIns;
+		Twitch::CommandRegistry Commands;
+		Twitch::AccountRegistry Accounts;
+		Twitch::Admission Gate;
+		Twitch::FairScheduler Fairness;
+
+		std::string Folder;
+		std::unique_ptr<Twitch::IRCBot> Bot;
 
-	GIVEN("A single IRCBot cleint")
+		std::vector<std::thread> Threads;
+
+		// set if the bot was turned away (the login exception leaves run)
+		std::atomic<bool> LoginFailed{false};
+
+		Client(const Twitch::FakeTwitch &server, const std::string &nick, const std::vector<std::string> &channels,
+				const std::string &custom = std::string())
+			:	Work(asio::make_work_guard(Context)),
+				Commands(BuiltIns),
+				Gate(Context),
+				Folder(makeClient(nick, channels, custom))
+		{
+			Bot = std::make_unique<Twitch::IRCBot>(Context, "127.0.0.1", std::to_string(server.port()),
+					IRC, Commands, Accounts, Gate, Fairness, Poco::Path(Folder));
+
+			for (int i = 0; i < 2; i++)
+				Threads.emplace_back([this]()
+				{
+					try
+					{
+						Context.run();
+					}
+					catch (const Twitch::loginException &)
+					{
+						LoginFailed = true;
+					}
+				});
+		}
+
+		~Client()
+		{
+			Context.stop();
+			for (auto &thread : Threads)
+				thread.join();
+
+			Bot.reset();
+			Poco::File(Folder).remove(true);
+		}
+	};
+}
+
+SCENARIO("A bot against a fake Twitch")
+{
+	GIVEN("A bot with two channels to join")
 	{
-		Twitch::IRCBot client(io, "192.168.1.76", "23");
+		Twitch::FakeTwitch server;
+		Client client(server, "bari", {"#one", "two"});
 
-		WHEN("We start the io service the bot listens for return pings")
+		REQUIRE(server.waitUntil([](const auto &s) { return s.Joins == 2; }, 5s));
+
+		THEN("It logs in and joins them")
 		{
-			io.run();
+			auto stats = server.stats();
+			CHECK(stats.Logins == 1);
+			CHECK(stats.LoggedIn == 1);
+			CHECK(stats.AuthFailures == 0);
+		}
+
+		THEN("It answers PINGs")
+		{
+			server.broadcast("PING :tmi.twitch.tv");
+
+			// the PING handler also says hello in #baricus
+			CHECK(server.waitUntil([](const auto &s) { return s.ChatReceived == 1; }, 5s));
+		}
+
+		THEN("It answers a command in the channel it was used in")
+		{
+			server.say("#two", "viewer", "!echo hi there");
+
+			REQUIRE(server.waitUntil([](const auto &s) { return s.ChatReceived == 1; }, 5s));
+
+			auto chat = server.chatReceived();
+			REQUIRE(chat.size() == 1);
+			CHECK(chat[0] == "bari #two :hi there");
+		}
+
+		THEN("It joins and leaves only what changed in an edited channels.txt, without reconnecting")
+		{
+			std::ofstream(client.Folder + "channels.txt") << "two" << std::endl << "#Three" << std::endl;
+			client.Bot->reloadChannels();
+
+			REQUIRE(server.waitUntil([](const auto &s) { return s.Parts == 1 && s.Joins == 3; }, 5s));
+
+			server.say("#three", "viewer", "!echo in three");
+			REQUIRE(server.waitUntil([](const auto &s) { return s.ChatReceived == 1; }, 5s));
+
+			auto chat = server.chatReceived();
+			REQUIRE(chat.size() == 1);
+			CHECK(chat[0] == "bari #three :in three");
+
+			auto stats = server.stats();
+			CHECK(stats.Accepted == 1);
+			CHECK(stats.Logins == 1);
+		}
+
+		THEN("It picks up new custom commands without reconnecting")
+		{
+			std::ofstream(client.Folder + "customCommands.txt") << "!new a new command for {user}" << std::endl;
+			client.Bot->reloadCommands();
+
+			// the reload is queued on the bot's strand ahead of the line
+			server.say("#one", "viewer", "!new");
+			REQUIRE(server.waitUntil([](const auto &s) { return s.ChatReceived == 1; }, 5s));
+
+			auto chat = server.chatReceived();
+			REQUIRE(chat.size() == 1);
+			CHECK(chat[0] == "bari #one :a new command for viewer");
+
+			CHECK(server.stats().Logins == 1);
+		}
+
+		THEN("It connects again, and rejoins, when asked to reconnect")
+		{
+			server.reconnectAll();
+
+			CHECK(server.waitUntil([](const auto &s) { return s.Logins == 2 && s.Joins == 4 && s.Connections == 1; }, 5s));
+		}
+
+		THEN("It connects again when dropped")
+		{
+			server.dropAll();
+
+			// the first retry waits out a short backoff
+			CHECK(server.waitUntil([](const auto &s) { return s.Logins == 2 && s.LoggedIn == 1; }, 10s));
+		}
+
+		THEN("Nothing meant for the old connection goes out ahead of the next login")
+		{
+			server.broadcast("PING :tmi.twitch.tv");
+			server.dropAll();
+
+			// left while reconnecting, so there's no PART to send
+			std::ofstream(client.Folder + "channels.txt") << "two" << std::endl;
+			client.Bot->reloadChannels();
+
+			REQUIRE(server.waitUntil([](const auto &s) { return s.Logins == 2 && s.Joins == 3; }, 10s));
+
+			std::this_thread::sleep_for(200ms);
+
+			auto stats = server.stats();
+			CHECK(stats.Ignored == 0);
+			CHECK(stats.Parts == 0);
+			CHECK(stats.Joins == 3);
+		}
+
+		THEN("Once stopped, it hangs up and is handed back to be freed, once")
+		{
+			server.say("#two", "viewer", "!echo hi there");
+			REQUIRE(server.waitUntil([](const auto &s) { return s.ChatReceived == 1; }, 5s));
+
+			std::atomic<int> reclaimed{0};
+			std::atomic<Twitch::IRCBot *> handed{nullptr};
+
+			client.Bot->stop([&](Twitch::IRCBot *bot) { handed = bot; reclaimed++; });
+
+			CHECK(server.waitUntil([](const auto &s) { return s.Connections == 0; }, 5s));
+
+			auto until = std::chrono::steady_clock::now() + 5s;
+			while (reclaimed == 0 && std::chrono::steady_clock::now() < until)
+				std::this_thread::sleep_for(10ms);
+
+			std::this_thread::sleep_for(100ms);
+
+			CHECK(reclaimed == 1);
+			CHECK(handed == client.Bot.get());
+		}
+
+		THEN("A channel it just left is still drained before it's handed back")
+		{
+			for (int i = 0; i < 20; i++)
+				server.say("#one", "viewer", "!echo in one");
+
+			std::ofstream(client.Folder + "channels.txt") << "two" << std::endl;
+			client.Bot->reloadChannels();
+
+			std::atomic<int> reclaimed{0};
+			client.Bot->stop([&](Twitch::IRCBot *) { reclaimed++; });
+
+			auto until = std::chrono::steady_clock::now() + 5s;
+			while (reclaimed == 0 && std::chrono::steady_clock::now() < until)
+				std::this_thread::sleep_for(10ms);
+
+			CHECK(reclaimed == 1);
+		}
+	}
+
+	GIVEN("A bot with custom commands")
+	{
+		Twitch::FakeTwitch server;
+		Client client(server, "bari", {"#one"},
+				"# greetings\n"
+				"!hi hello {user}, welcome to {channel} (#{count})\n"
+				"!echo custom {args}\n");
+
+		REQUIRE(server.waitUntil([](const auto &s) { return s.Joins == 1; }, 5s));
+
+		THEN("They are answered from the file, and win over shared commands of the same name")
+		{
+			server.say("#one", "viewer", "!hi");
+			server.say("#one", "other", "!hi");
+			server.say("#one", "viewer", "!echo some words");
+
+			REQUIRE(server.waitUntil([](const auto &s) { return s.ChatReceived == 3; }, 5s));
+
+			auto chat = server.chatReceived();
+			REQUIRE(chat.size() == 3);
+			CHECK(chat[0] == "bari #one :hello viewer, welcome to one (#1)");
+			CHECK(chat[1] == "bari #one :hello other, welcome to one (#2)");
+			CHECK(chat[2] == "bari #one :custom some words");
+		}
+	}
+
+	GIVEN("Chat load on a bot's channels")
+	{
+		Twitch::FakeTwitchOptions options;
+		options.ChatRate = 200;
+		options.PingInterval = 100ms;
+
+		Twitch::FakeTwitch server(options);
+		Client client(server, "busy", {"#a", "#b", "#c"});
+
+		REQUIRE(server.waitUntil([](const auto &s) { return s.Joins == 3; }, 5s));
+
+		THEN("The chat is delivered, and PINGs are still answered promptly")
+		{
+			CHECK(server.waitUntil([](const auto &s) { return s.ChatSent >= 1000 && s.Pongs >= 5; }, 10s));
+
+			auto latencies = server.pingLatencies();
+			REQUIRE_FALSE(latencies.empty());
+
+			for (auto latency : latencies)
+				CHECK(latency < 1s);
+		}
+	}
+
+	GIVEN("A suspended channel")
+	{
+		Twitch::FakeTwitch server;
+		server.suspendChannel("#gone");
+
+		Client client(server, "bari", {"#gone", "#here"});
+
+		THEN("Only the other channel is joined")
+		{
+			REQUIRE(server.waitUntil([](const auto &s) { return s.Joins == 1; }, 5s));
+
+			std::this_thread::sleep_for(200ms);
+			CHECK(server.stats().Joins == 1);
+		}
+	}
+
+	GIVEN("A bot whose login is refused")
+	{
+		Twitch::FakeTwitch server;
+		server.rejectLogins("expired");
+
+		Client client(server, "expired", {"#a"});
+
+		THEN("It gives up with a login exception, for its token to be renewed")
+		{
+			REQUIRE(server.waitUntil([](const auto &s) { return s.AuthFailures == 1; }, 5s));
+
+			auto until = std::chrono::steady_clock::now() + 5s;
+			while (!client.LoginFailed && std::chrono::steady_clock::now() < until)
+				std::this_thread::sleep_for(10ms);
+
+			CHECK(client.LoginFailed);
+			CHECK(server.stats().Joins == 0);
 		}
 	}
 }
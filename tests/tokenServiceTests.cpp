@@ -0,0 +1,87 @@
+/* tokenServiceTests.cpp - Miles Shamo
+ *
+ * Tests for the token renewal service.  The real
+ * renewal (an HTTPS request) is swapped for one
+ * the test controls, and the token file is a
+ * scratch file in the working directory.
+ *
+ */
+
+#include "catch.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <future>
+
+#include "../source/TokenService.hpp"
+
+SCENARIO("Renewing tokens")
+{
+	asio::io_context context;
+
+	const char *fileName = "tokenServiceTest.tok";
+	Poco::Path tokenFile(fileName);
+
+	{
+		Twitch::token original{"baribot", "old", "refresh", "chat:read"};
+		std::ofstream out(fileName);
+		out << original;
+	}
+
+	// the "request" doesn't finish until the test says so
+	std::promise<void> release;
+	std::shared_future<void> released = release.get_future().share();
+	std::atomic<int> requests{0};
+
+	Twitch::TokenService service(context, [&](Twitch::token &tok)
+	{
+		requests++;
+		released.wait();
+
+		tok.accessToken = "new";
+		return true;
+	});
+
+	GIVEN("Several clients on one account failing at once")
+	{
+		int finished = 0, renewed = 0;
+
+		for (int i = 0; i < 3; i++)
+		{
+			service.renew(tokenFile, [&](bool ok)
+			{
+				finished++;
+				renewed += ok;
+			});
+		}
+
+		THEN("Only one renewal runs, and they all wait on it")
+		{
+			CHECK(service.inFlight() == 1);
+
+			release.set_value();
+
+			for (int tries = 0; finished < 3 && tries < 200; tries++)
+			{
+				context.run_for(std::chrono::milliseconds(10));
+				context.restart();
+			}
+
+			CHECK(finished == 3);
+			CHECK(renewed == 3);
+			CHECK(requests == 1);
+			CHECK(service.inFlight() == 0);
+
+			Twitch::token stored;
+			std::ifstream in(fileName);
+			in >> stored;
+
+			CHECK(stored.accessToken == "new");
+			CHECK(stored.refreshToken == "refresh");
+		}
+	}
+
+	std::remove(fileName);
+}
@@ -0,0 +1,108 @@
+/* trafficRecorderTests.cpp - Miles Shamo
+ *
+ * Tests for recording raw traffic and reading
+ * it back.  Time is passed in by hand.
+ *
+ */
+
+#include "catch.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "../source/TrafficRecorder.hpp"
+
+using namespace std::chrono_literals;
+
+namespace
+{
+	std::vector<Twitch::TrafficChunk> readAll(const std::string &path)
+	{
+		std::ifstream in(path, std::ios::binary);
+		Twitch::TrafficReader reader(in);
+
+		std::vector<Twitch::TrafficChunk> chunks;
+		Twitch::TrafficChunk chunk;
+		while (reader.next(chunk))
+			chunks.push_back(chunk);
+
+		return chunks;
+	}
+}
+
+SCENARIO("Recording and reading back traffic")
+{
+	std::string path = "/tmp/baribot-" + std::to_string(getpid()) + "-traffic.rec";
+	std::remove(path.c_str());
+
+	auto start = std::chrono::steady_clock::now();
+
+	GIVEN("A recording of a few reads")
+	{
+		{
+			Twitch::TrafficRecorder recorder;
+			REQUIRE(recorder.open(path));
+
+			recorder.record("PING :tmi.twitch.tv\r\n", start + 1ms);
+			recorder.record("PRIVMSG #a :hi\r\nPRIVMSG #a :th", start + 3ms);
+			recorder.record(std::string(1000, 'x') + "\r\n", start + 2s);
+		}
+
+		auto chunks = readAll(path);
+
+		THEN("Every read comes back as it was, with its time")
+		{
+			REQUIRE(chunks.size() == 3);
+
+			CHECK(chunks[0].Bytes == "PING :tmi.twitch.tv\r\n");
+			CHECK(chunks[1].Bytes == "PRIVMSG #a :hi\r\nPRIVMSG #a :th");
+			CHECK(chunks[2].Bytes.size() == 1002);
+
+			CHECK(chunks[1].At - chunks[0].At == 2ms);
+			CHECK(chunks[2].At - chunks[1].At == 2s - 3ms);
+		}
+
+		THEN("A second session carries on after the first")
+		{
+			{
+				Twitch::TrafficRecorder recorder;
+				REQUIRE(recorder.open(path));
+				recorder.record("PING :again\r\n");
+			}
+
+			auto more = readAll(path);
+
+			REQUIRE(more.size() == 4);
+			CHECK(more[3].Bytes == "PING :again\r\n");
+			CHECK(more[3].At >= more[2].At);
+		}
+
+		THEN("A recording cut short ends at its last whole read")
+		{
+			std::ifstream in(path, std::ios::binary);
+			std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+			in.close();
+
+			std::ofstream(path, std::ios::binary) << bytes.substr(0, bytes.size() - 10);
+
+			CHECK(readAll(path).size() == 2);
+		}
+	}
+
+	GIVEN("A file that isn't a recording")
+	{
+		std::ofstream(path) << "not a recording at all";
+
+		THEN("Reading it throws")
+		{
+			CHECK_THROWS_AS(readAll(path), std::runtime_error);
+		}
+	}
+
+	std::remove(path.c_str());
+}
@@ -0,0 +1,271 @@
+/* loadtest.cpp - Miles Shamo
+ *
+ * baribot-loadtest, which runs the Overseer with
+ * many bots against a FakeTwitch on the loopback
+ * interface, for capacity planning.
+ *
+ * 	baribot-loadtest [options]
+ *
+ * 	--bots N       bots to run, each on its own account (default 100)
+ * 	--channels N   channels each bot joins (default 1)
+ * 	--rate N       chat lines a second in each channel, per bot (default 10)
+ * 	--commands N   every Nth line of chat is a "!echo" (default 0, none)
+ * 	--seconds N    how long to run the chat for (default 30)
+ * 	--ping N       PING every bot every N milliseconds, and time it (default 1000)
+ * 	--threads N    threads for the fake server (default 2)
+ * 	--keep         keep the client folders (and their logs) afterwards
+ *
+ * The bots are made as the Overseer expects, in a
+ * .Clients folder under a fresh folder in /tmp, and
+ * launched the same way BARIBOT_LAUNCH_ALL would.
+ * The Overseer reads the rest of its setup from the
+ * environment as usual (BARIBOT_THREADS and so on),
+ * and its login pacing is opened up to let all of
+ * the bots in within about ten seconds, unless the
+ * environment says otherwise.
+ *
+ * Once every bot has joined its channels, the chat
+ * starts, and every second we report how much was
+ * delivered and how long the bots took to answer
+ * their PINGs.  As PINGs are answered in the order
+ * they're read, their round trip is how far behind
+ * the chat the bots are running.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <Poco/File.h>
+
+#include "../source/FakeTwitch.hpp"
+#include "../source/InstanceOverseer.hpp"
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+using Clock = std::chrono::steady_clock;
+
+namespace
+{
+	struct Options
+	{
+		std::size_t Bots = 100;
+		std::size_t Channels = 1;
+		double Rate = 10;
+		std::size_t Commands = 0;
+		unsigned Seconds = 30;
+		unsigned Ping = 1000;
+		unsigned Threads = 2;
+		bool Keep = false;
+	};
+
+	void usage()
+	{
+		cerr << "usage: baribot-loadtest [--bots N] [--channels N] [--rate N] [--commands N]" << endl
+			 << "                        [--seconds N] [--ping MS] [--threads N] [--keep]" << endl;
+	}
+
+	bool parseOptions(int argc, char **argv, Options &options)
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			std::string option = argv[i];
+			bool hasValue = i + 1 < argc;
+
+			if (option == "--keep")
+				options.Keep = true;
+			else if (option == "--bots" && hasValue)
+				options.Bots = std::strtoul(argv[++i], nullptr, 10);
+			else if (option == "--channels" && hasValue)
+				options.Channels = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+			else if (option == "--rate" && hasValue)
+				options.Rate = std::atof(argv[++i]);
+			else if (option == "--commands" && hasValue)
+				options.Commands = std::strtoul(argv[++i], nullptr, 10);
+			else if (option == "--seconds" && hasValue)
+				options.Seconds = std::strtoul(argv[++i], nullptr, 10);
+			else if (option == "--ping" && hasValue)
+				options.Ping = std::strtoul(argv[++i], nullptr, 10);
+			else if (option == "--threads" && hasValue)
+				options.Threads = std::max(1, std::atoi(argv[++i]));
+			else
+				return false;
+		}
+
+		return options.Bots > 0;
+	}
+
+	std::string percentile(std::vector<Clock::duration> &sorted, double fraction)
+	{
+		if (sorted.empty())
+			return "-";
+
+		auto index = static_cast<std::size_t>(fraction * (sorted.size() - 1));
+		double millis = std::chrono::duration<double, std::milli>(sorted[index]).count();
+
+		char text[32];
+		std::snprintf(text, sizeof(text), "%.2fms", millis);
+		return text;
+	}
+
+	// every bot holds a socket, and each writes a log
+	void raiseFileLimit()
+	{
+		rlimit limit;
+		if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+		{
+			limit.rlim_cur = limit.rlim_max;
+			setrlimit(RLIMIT_NOFILE, &limit);
+		}
+	}
+
+	// the client folders, as Overseer::createClient would make them
+	void makeClients(const Options &options)
+	{
+		for (std::size_t bot = 0; bot < options.Bots; bot++)
+		{
+			std::string name = "loadbot" + std::to_string(bot);
+			std::string folder = ".Clients/" + name;
+			Poco::File(folder).createDirectories();
+
+			std::ofstream(folder + "/token.tok") << name << endl << "access" << endl << "refresh" << endl << "chat:read chat:edit" << endl;
+
+			// bots share channels in groups, as bots in the same community would
+			std::ofstream channels(folder + "/channels.txt");
+			for (std::size_t channel = 0; channel < options.Channels; channel++)
+				channels << "#load" << (bot / 10) << "_" << channel << endl;
+		}
+	}
+}
+
+
+int main(int argc, char **argv)
+{
+	Options options;
+	if (!parseOptions(argc, argv, options))
+	{
+		usage();
+		return 2;
+	}
+
+	raiseFileLimit();
+
+	char folderName[] = "/tmp/baribot-loadtest-XXXXXX";
+	if (!mkdtemp(folderName) || chdir(folderName) != 0)
+	{
+		cerr << "baribot-loadtest: can't make a folder for the clients" << endl;
+		return 1;
+	}
+
+	makeClients(options);
+
+	// the chat only starts once everyone is in
+	Twitch::FakeTwitchOptions serverOptions;
+	serverOptions.Threads = options.Threads;
+	serverOptions.CommandEvery = options.Commands;
+	serverOptions.PingInterval = std::chrono::milliseconds(options.Ping);
+
+	Twitch::FakeTwitch server(serverOptions);
+
+	// the Overseer takes all of this from the environment
+	setenv("BARIBOT_CLIENT_ID", "loadtest", 0);
+	setenv("BARIBOT_CLIENT_SECRET", "loadtest", 0);
+	setenv("BARIBOT_IRC_SERVER", "127.0.0.1", 1);
+	setenv("BARIBOT_IRC_PORT", std::to_string(server.port()).c_str(), 1);
+	setenv("BARIBOT_LOGIN_RATE", std::to_string(std::max<std::size_t>(options.Bots, 20)).c_str(), 0);
+
+	auto overseer = std::make_unique<Twitch::Overseer>();
+	overseer->init();
+
+	auto start = Clock::now();
+	overseer->launchStored();
+
+	// logging in and joining
+	std::size_t wantedJoins = options.Bots * options.Channels;
+	cout << endl << "Waiting for " << options.Bots << " bots to join " << wantedJoins << " channels" << endl;
+
+	bool joined = false;
+	for (int second = 1; !joined && second <= 120; second++)
+	{
+		joined = server.waitUntil([&](const auto &s) { return s.Joins >= wantedJoins; }, std::chrono::seconds(1));
+
+		auto stats = server.stats();
+		cout << "\t" << second << "s: " << stats.Logins << " logged in, " << stats.Joins << " joins" << endl;
+	}
+
+	double rampSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	if (!joined)
+		cerr << "baribot-loadtest: not every bot joined in time; running the chat anyway" << endl;
+
+	// the chat itself
+	cout << endl << "Chat at " << options.Rate << " lines/s per channel per bot ("
+		 << options.Rate * wantedJoins << " lines/s in all) for " << options.Seconds << "s" << endl;
+
+	server.pingLatencies();
+	server.setChatRate(options.Rate);
+
+	auto before = server.stats();
+	auto chatStart = Clock::now();
+
+	std::vector<Clock::duration> all;
+	auto last = before;
+
+	for (unsigned second = 1; second <= options.Seconds; second++)
+	{
+		std::this_thread::sleep_until(chatStart + std::chrono::seconds(second));
+
+		auto stats = server.stats();
+		auto latencies = server.pingLatencies();
+		std::sort(latencies.begin(), latencies.end());
+
+		cout << "\t" << second << "s: " << stats.ChatSent - last.ChatSent << " msgs/s, "
+			 << stats.ChatReceived - last.ChatReceived << " replies, "
+			 << stats.LoggedIn << " connected, PING p50 " << percentile(latencies, 0.5)
+			 << " p99 " << percentile(latencies, 0.99) << endl;
+
+		all.insert(all.end(), latencies.begin(), latencies.end());
+		last = stats;
+	}
+
+	server.setChatRate(0);
+
+	double chatSeconds = std::chrono::duration<double>(Clock::now() - chatStart).count();
+	auto after = server.stats();
+
+	overseer.reset();
+	server.stop();
+
+	std::sort(all.begin(), all.end());
+
+	cout << endl
+		 << "Ran " << options.Bots << " bots in " << wantedJoins << " channels" << endl
+		 << "\tall joined in " << rampSeconds << "s" << (joined ? "" : " (not all of them)") << endl
+		 << "\t" << (after.ChatSent - before.ChatSent) / chatSeconds << " msgs/s delivered" << endl
+		 << "\t" << after.ChatReceived - before.ChatReceived << " messages sent by the bots" << endl
+		 << "\t" << after.Accepted - std::min(after.Accepted, options.Bots) << " reconnects, " << after.AuthFailures << " failed logins" << endl
+		 << "\tPING round trip over " << all.size() << " PINGs:"
+		 << " p50 " << percentile(all, 0.50)
+		 << " p90 " << percentile(all, 0.90)
+		 << " p99 " << percentile(all, 0.99)
+		 << " max " << percentile(all, 1.0) << endl;
+
+	if (options.Keep)
+		cout << "Client folders kept in " << folderName << endl;
+	else
+		Poco::File(folderName).remove(true);
+
+	return joined ? 0 : 1;
+}
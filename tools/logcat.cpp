@@ -0,0 +1,178 @@
+/* logcat.cpp - Miles Shamo
+ *
+ * baribot-logcat, which prints binary bot logs
+ * (BARIBOT_LOG_FORMAT=binary) as text.
+ *
+ * 	baribot-logcat [options] client/log.bin ...
+ *
+ * 	--client NAME     only lines from this bot
+ * 	--channel #NAME   only lines about this channel
+ * 	--command NAME    only lines about this IRC command
+ * 	--level LEVEL     only lines at or above this level
+ * 	--since TIME      only lines at or after this time
+ * 	--until TIME      only lines at or before this time
+ *
+ * Times are local, as "YYYY-MM-DD HH:MM:SS" (or with
+ * a T in the middle), or seconds since the epoch.
+ */
+
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../source/LogDecoder.hpp"
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+namespace
+{
+	using TimePoint = std::chrono::system_clock::time_point;
+
+	bool parseTime(const std::string &text, TimePoint &time)
+	{
+		char *end;
+		long long seconds = std::strtoll(text.c_str(), &end, 10);
+
+		if (*end == '\0' && !text.empty())
+		{
+			time = std::chrono::system_clock::from_time_t(static_cast<std::time_t>(seconds));
+			return true;
+		}
+
+		std::tm parts = {};
+		parts.tm_isdst = -1;
+
+		if (std::sscanf(text.c_str(), "%d-%d-%d%*1[ T]%d:%d:%d",
+					&parts.tm_year, &parts.tm_mon, &parts.tm_mday,
+					&parts.tm_hour, &parts.tm_min, &parts.tm_sec) != 6)
+			return false;
+
+		parts.tm_year -= 1900;
+		parts.tm_mon -= 1;
+
+		time = std::chrono::system_clock::from_time_t(std::mktime(&parts));
+		return true;
+	}
+
+	void printTime(std::ostream &out, TimePoint time)
+	{
+		std::time_t seconds = std::chrono::system_clock::to_time_t(time);
+		auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count() % 1000;
+
+		std::tm parts;
+		localtime_r(&seconds, &parts);
+
+		char text[32];
+		std::strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &parts);
+
+		char fraction[8];
+		std::snprintf(fraction, sizeof(fraction), ".%03lld", static_cast<long long>(millis));
+
+		out << text << fraction;
+	}
+
+	void usage()
+	{
+		cerr << "usage: baribot-logcat [--client NAME] [--channel #NAME] [--command NAME]" << endl
+			 << "                      [--level LEVEL] [--since TIME] [--until TIME] LOG..." << endl;
+	}
+}
+
+
+int main(int argc, char **argv)
+{
+	Twitch::LogFilter filter;
+	std::vector<std::string> files;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string option = argv[i];
+
+		// every option takes a value
+		if (option.rfind("--", 0) == 0)
+		{
+			if (i + 1 >= argc)
+			{
+				usage();
+				return 2;
+			}
+
+			std::string value = argv[++i];
+			TimePoint time;
+			bool good = true;
+
+			if (option == "--client")
+				filter.Source = value;
+			else if (option == "--channel")
+				filter.Channel = value;
+			else if (option == "--command")
+				filter.Command = value;
+			else if (option == "--level")
+				good = Twitch::parseLogLevel(value, filter.MinLevel);
+			else if (option == "--since" && (good = parseTime(value, time)))
+				filter.Since = time;
+			else if (option == "--until" && (good = parseTime(value, time)))
+				filter.Until = time;
+			else
+				good = false;
+
+			if (!good)
+			{
+				cerr << "baribot-logcat: bad option " << option << " " << value << endl;
+				usage();
+				return 2;
+			}
+		}
+		else
+		{
+			files.push_back(option);
+		}
+	}
+
+	if (files.empty())
+	{
+		usage();
+		return 2;
+	}
+
+	int status = 0;
+
+	for (const auto &path : files)
+	{
+		std::ifstream in(path, std::ios::binary);
+		if (!in)
+		{
+			cerr << "baribot-logcat: can't open " << path << endl;
+			status = 1;
+			continue;
+		}
+
+		Twitch::LogDecoder decoder(in);
+		Twitch::LogEvent event;
+
+		try
+		{
+			while (decoder.next(event))
+			{
+				if (!filter.matches(event))
+					continue;
+
+				printTime(cout, event.Time);
+				cout << " " << event.Source << " " << Twitch::logLevelName(event.Level) << ": " << event.Text << "\n";
+			}
+		}
+		catch (const std::runtime_error &e)
+		{
+			cerr << "baribot-logcat: " << path << ": " << e.what() << endl;
+			status = 1;
+		}
+	}
+
+	return status;
+}
@@ -0,0 +1,415 @@
+/* replay.cpp - Miles Shamo
+ *
+ * baribot-replay, which plays recorded traffic
+ * (BARIBOT_RECORD, see TrafficRecorder.hpp) through
+ * a real IRCBot, for benchmarking and for checking
+ * changes against real chat.
+ *
+ * 	baribot-replay [options] client/traffic.rec ...
+ *
+ * 	--realtime    keep the recording's timing (default: as fast as possible)
+ * 	--threads N   threads running the bot (default 2)
+ * 	--probe N     send a PING every N lines to measure latency (default 100, 0 for none)
+ *
+ * The bot connects to a server in this process on
+ * the loopback interface, so its reads, parsing,
+ * dispatch and writes all run exactly as they would
+ * against Twitch, but no network is needed.  Its
+ * token and channel list are dummies in a folder
+ * under /tmp.
+ *
+ * Once the recording has been sent, a final PING
+ * tells us when the bot has caught up, and we report
+ * messages per second, allocations per message (made
+ * by the bot; the server side isn't counted), and
+ * percentiles of the probe PINGs' round trips.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <asio.hpp>
+
+#include <Poco/File.h>
+#include <Poco/Path.h>
+
+#include "../source/CommandCorrelator.hpp"
+#include "../source/TIRCBot.hpp"
+#include "../source/TrafficRecorder.hpp"
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+using Clock = std::chrono::steady_clock;
+
+//--------------------------------------------------------
+// Allocation counting
+//
+// (kept out of line, so gcc doesn't pair the malloc and free
+// up across an inlined new and delete and warn about them)
+
+namespace
+{
+	std::atomic<std::size_t> Allocations{0};
+
+	// the replay server's own threads turn this off
+	thread_local bool Counted = true;
+}
+
+[[gnu::noinline]] void *operator new(std::size_t size)
+{
+	if (Counted)
+		Allocations.fetch_add(1, std::memory_order_relaxed);
+
+	if (void *memory = std::malloc(size ? size : 1))
+		return memory;
+
+	throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void *memory) noexcept
+{
+	std::free(memory);
+}
+
+[[gnu::noinline]] void operator delete(void *memory, std::size_t) noexcept
+{
+	std::free(memory);
+}
+
+
+namespace
+{
+	struct Options
+	{
+		bool Realtime = false;
+		unsigned Threads = 2;
+		std::size_t Probe = 100;
+		std::vector<std::string> Files;
+	};
+
+	void usage()
+	{
+		cerr << "usage: baribot-replay [--realtime] [--threads N] [--probe N] RECORDING..." << endl;
+	}
+
+	bool parseOptions(int argc, char **argv, Options &options)
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			std::string option = argv[i];
+
+			if (option == "--realtime")
+				options.Realtime = true;
+			else if (option == "--threads" && i + 1 < argc)
+				options.Threads = std::max(1, std::atoi(argv[++i]));
+			else if (option == "--probe" && i + 1 < argc)
+				options.Probe = std::strtoul(argv[++i], nullptr, 10);
+			else if (option.rfind("--", 0) == 0)
+				return false;
+			else
+				options.Files.push_back(option);
+		}
+
+		return !options.Files.empty();
+	}
+
+	std::string percentile(std::vector<Clock::duration> &sorted, double fraction)
+	{
+		if (sorted.empty())
+			return "-";
+
+		auto index = static_cast<std::size_t>(fraction * (sorted.size() - 1));
+		double millis = std::chrono::duration<double, std::milli>(sorted[index]).count();
+
+		char text[32];
+		std::snprintf(text, sizeof(text), "%.3fms", millis);
+		return text;
+	}
+
+	// Reads everything the bot writes.  PONGs to our probes are
+	// timed, and the PONG to the last PING says the replay is done
+	class Listener
+	{
+		private:
+			asio::ip::tcp::socket &Peer;
+
+			std::mutex Lock;
+			std::condition_variable Finished;
+			bool Done = false;
+
+			std::vector<Clock::time_point> Sent;
+			std::vector<Clock::duration> Latencies;
+			std::size_t Lines = 0;
+
+			std::thread Thread;
+
+			void _run()
+			{
+				Counted = false;
+
+				std::string pending;
+				char buffer[16384];
+
+				asio::error_code e;
+				while (true)
+				{
+					std::size_t size = Peer.read_some(asio::buffer(buffer), e);
+					if (e)
+						break;
+
+					pending.append(buffer, size);
+
+					std::size_t end;
+					while ((end = pending.find('\n')) != std::string::npos)
+					{
+						_line(std::string_view(pending).substr(0, end));
+						pending.erase(0, end + 1);
+					}
+				}
+
+				std::lock_guard<std::mutex> guard(Lock);
+				Done = true;
+				Finished.notify_all();
+			}
+
+			void _line(std::string_view line)
+			{
+				auto now = Clock::now();
+
+				std::lock_guard<std::mutex> guard(Lock);
+				Lines++;
+
+				constexpr std::string_view probe = "PONG :probe-";
+				constexpr std::string_view done = "PONG :replay-done";
+
+				if (line.rfind(probe, 0) == 0)
+				{
+					std::size_t index = std::strtoul(std::string(line.substr(probe.size())).c_str(), nullptr, 10);
+					if (index < Sent.size())
+						Latencies.push_back(now - Sent[index]);
+				}
+				else if (line.rfind(done, 0) == 0)
+				{
+					Done = true;
+					Finished.notify_all();
+				}
+			}
+
+		public:
+			explicit Listener(asio::ip::tcp::socket &peer) : Peer(peer), Thread(&Listener::_run, this) {}
+
+			~Listener() { Thread.join(); }
+
+			// a probe is about to be sent; returns its number
+			std::size_t probe()
+			{
+				std::lock_guard<std::mutex> guard(Lock);
+				Sent.push_back(Clock::now());
+				return Sent.size() - 1;
+			}
+
+			bool wait(Clock::duration timeout)
+			{
+				std::unique_lock<std::mutex> guard(Lock);
+				return Finished.wait_for(guard, timeout, [this]() { return Done; });
+			}
+
+			std::vector<Clock::duration> latencies()
+			{
+				std::lock_guard<std::mutex> guard(Lock);
+				return Latencies;
+			}
+
+			std::size_t lines()
+			{
+				std::lock_guard<std::mutex> guard(Lock);
+				return Lines;
+			}
+	};
+}
+
+
+int main(int argc, char **argv)
+{
+	Options options;
+	if (!parseOptions(argc, argv, options))
+	{
+		usage();
+		return 2;
+	}
+
+	// loads the whole recording up front, so reading it isn't measured
+	std::vector<Twitch::TrafficChunk> chunks;
+	std::size_t messages = 0, bytes = 0;
+
+	for (const auto &path : options.Files)
+	{
+		std::ifstream in(path, std::ios::binary);
+		if (!in)
+		{
+			cerr << "baribot-replay: can't open " << path << endl;
+			return 1;
+		}
+
+		Twitch::TrafficReader reader(in);
+		Twitch::TrafficChunk chunk;
+
+		// later files carry on from the end of the one before
+		auto offset = chunks.empty() ? std::chrono::nanoseconds(0) : chunks.back().At;
+
+		try
+		{
+			while (reader.next(chunk))
+			{
+				messages += std::count(chunk.Bytes.begin(), chunk.Bytes.end(), '\n');
+				bytes += chunk.Bytes.size();
+
+				chunk.At += offset;
+				chunks.push_back(std::move(chunk));
+			}
+		}
+		catch (const std::runtime_error &e)
+		{
+			cerr << "baribot-replay: " << path << ": " << e.what() << endl;
+			return 1;
+		}
+	}
+
+	if (chunks.empty())
+	{
+		cerr << "baribot-replay: nothing to replay" << endl;
+		return 1;
+	}
+
+	// a throwaway client for the bot
+	char folderName[] = "/tmp/baribot-replay-XXXXXX";
+	if (!mkdtemp(folderName))
+	{
+		cerr << "baribot-replay: can't make a client folder" << endl;
+		return 1;
+	}
+
+	std::string folder = folderName;
+	std::ofstream(folder + "/token.tok") << "replay" << endl << "replay" << endl << "replay" << endl << "chat:read" << endl;
+	std::ofstream(folder + "/channels.txt");
+
+	// the "server", used with blocking calls from this thread and the listener's
+	Counted = false;
+
+	asio::io_context server;
+	asio::ip::tcp::acceptor acceptor(server, asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), 0));
+	std::string port = std::to_string(acceptor.local_endpoint().port());
+
+	// the bot, set up as the Overseer would
+	asio::io_context context;
+	auto work = asio::make_work_guard(context);
+
+	Twitch::IRCCorrelator irc;
+	Twitch::CommandCorrelator builtIns;
+	Twitch::CommandRegistry commands(builtIns);
+	Twitch::AccountRegistry accounts;
+	Twitch::Admission gate(context);
+	Twitch::FairScheduler fairness;
+
+	auto bot = std::make_unique<Twitch::IRCBot>(context, "127.0.0.1", port, irc, commands, accounts, gate, fairness, Poco::Path(folder + "/"));
+
+	std::vector<std::thread> threads;
+	for (unsigned i = 0; i < options.Threads; i++)
+		threads.emplace_back([&context]() { context.run(); });
+
+	asio::ip::tcp::socket peer(server);
+	acceptor.accept(peer);
+
+	// small writes (the probes) shouldn't wait on Nagle's algorithm
+	peer.set_option(asio::ip::tcp::no_delay(true));
+
+	bool finished;
+	Clock::duration elapsed;
+	std::size_t allocations;
+	std::vector<Clock::duration> latencies;
+	std::size_t written;
+
+	{
+		Listener listener(peer);
+
+		std::size_t lines = 0, nextProbe = options.Probe;
+
+		auto start = Clock::now();
+		std::size_t allocationsBefore = Allocations.load();
+
+		for (const auto &chunk : chunks)
+		{
+			if (options.Realtime)
+				std::this_thread::sleep_until(start + (chunk.At - chunks.front().At));
+
+			asio::write(peer, asio::buffer(chunk.Bytes));
+
+			// probes only go between whole lines
+			lines += std::count(chunk.Bytes.begin(), chunk.Bytes.end(), '\n');
+
+			if (options.Probe && lines >= nextProbe && chunk.Bytes.back() == '\n')
+			{
+				std::string probe = "PING :probe-" + std::to_string(listener.probe()) + "\r\n";
+				asio::write(peer, asio::buffer(probe));
+
+				nextProbe = lines + options.Probe;
+			}
+		}
+
+		asio::write(peer, asio::buffer(std::string("PING :replay-done\r\n")));
+
+		finished = listener.wait(std::chrono::minutes(1));
+
+		elapsed = Clock::now() - start;
+		allocations = Allocations.load() - allocationsBefore;
+		latencies = listener.latencies();
+		written = listener.lines();
+
+		asio::error_code ignored;
+		peer.shutdown(asio::ip::tcp::socket::shutdown_both, ignored);
+		peer.close(ignored);
+	}
+
+	context.stop();
+	for (auto &thread : threads)
+		thread.join();
+
+	bot.reset();
+	Poco::File(folder).remove(true);
+
+	if (!finished)
+	{
+		cerr << "baribot-replay: the bot never caught up (no PONG to the last PING)" << endl;
+		return 1;
+	}
+
+	double seconds = std::chrono::duration<double>(elapsed).count();
+	std::sort(latencies.begin(), latencies.end());
+
+	cout << "Replayed " << messages << " messages (" << bytes << " bytes) in " << seconds << "s"
+		 << (options.Realtime ? " in real time" : " as fast as possible") << endl
+		 << "\t" << messages / seconds << " messages/s" << endl
+		 << "\t" << static_cast<double>(allocations) / std::max<std::size_t>(messages, 1) << " allocations per message" << endl
+		 << "\t" << written << " lines written by the bot" << endl
+		 << "\tlatency over " << latencies.size() << " probes:"
+		 << " p50 " << percentile(latencies, 0.50)
+		 << " p90 " << percentile(latencies, 0.90)
+		 << " p99 " << percentile(latencies, 0.99)
+		 << " max " << percentile(latencies, 1.0) << endl;
+
+	return 0;
+}